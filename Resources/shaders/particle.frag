@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec4 tint;
+
+layout(location = 0) out vec4 color;
+
+void main() {
+    float falloff = 1.0 - dot(corner, corner);
+    if (falloff <= 0.0) {
+        discard;
+    }
+    color = vec4(tint.rgb, tint.a * falloff);
+}
@@ -0,0 +1,6 @@
+// Shared by the particle kernels and shaders; matches
+// ParticleSystem::PARTICLE_SIZE.
+struct Particle {
+    vec4 positionLife;      // xyz in clip space, w seconds left
+    vec4 velocityLifetime;  // xyz per second, w seconds it was emitted with
+};
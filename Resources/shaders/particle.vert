@@ -0,0 +1,32 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// One camera-facing quad per instance, in the sorted order. No vertex
+// buffers: the corner comes from the vertex index.
+#include "particle.glsl"
+
+layout(set = 0, binding = 0) readonly buffer Particles {
+    Particle particles[];
+};
+layout(set = 0, binding = 1) readonly buffer DrawOrder {
+    uint drawOrder[];
+};
+
+layout(push_constant) uniform Push {
+    vec2 halfSize;  // in clip space
+} push;
+
+layout(location = 0) out vec2 corner;
+layout(location = 1) out vec4 tint;
+
+const vec2 corners[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main() {
+    Particle particle = particles[drawOrder[gl_InstanceIndex]];
+    float age = 1.0 - particle.positionLife.w / particle.velocityLifetime.w;
+    corner = corners[gl_VertexIndex];
+    tint = vec4(mix(vec3(1.0, 0.9, 0.4), vec3(0.9, 0.2, 0.1), age), 0.6 * (1.0 - age));
+    gl_Position = vec4(particle.positionLife.xyz + vec3(corner * push.halfSize, 0.0), 1.0);
+}
@@ -1,72 +1,905 @@
+#include "core/frame_pacer.hpp"
+#include "core/frame_profiler.hpp"
+#include "core/image_io.hpp"
+#include "core/image_writer.hpp"
+#include "core/capture_encoder.hpp"
+#include "core/host_allocations.hpp"
+#include "core/job_system.hpp"
+#include "core/task_graph.hpp"
+#include "core/triple_buffer.hpp"
 #include "gfx/window.hpp"
 #include "gfx/pipeline.hpp"
 #include "gfx/device.hpp"
 #include "gfx/swap_chain.hpp"
+#include "gfx/asset_streamer.hpp"
+#include "gfx/compute_context.hpp"
+#include "gfx/frame_readback.hpp"
+#include "gfx/geometry_pool.hpp"
+#include "gfx/mesh_cache.hpp"
+#include "gfx/gpu_skinning.hpp"
+#include "gfx/gpu_timer.hpp"
 #include "gfx/model.hpp"
+#include "gfx/particle_system.hpp"
+#include "gfx/pipeline_cache.hpp"
+#include "gfx/pipeline_layout_cache.hpp"
+#include "gfx/prefix_sum.hpp"
+#include "gfx/render_graph.hpp"
+#include "gfx/shader_watcher.hpp"
+#include "scene/animation.hpp"
+#include "scene/bvh.hpp"
+#include "scene/frustum.hpp"
+#include "scene/scene.hpp"
+
+#include <glm/gtc/constants.hpp>
 
 #include <memory>
 #include <vector>
 #include <stdexcept>
 #include <iostream>
 #include <array>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <limits>
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <random>
+#include <string>
 
 class App {
     public:
         static constexpr int WIDTH = 800;
         static constexpr int HEIGHT = 600;
+        static constexpr const char* VERT_SHADER_PATH = "../Resources/compiledShaders/temp.vert.spv";
+        static constexpr const char* FRAG_SHADER_PATH = "../Resources/compiledShaders/temp.frag.spv";
+        static constexpr double DEFAULT_FRAME_TIME_MS = 1000.0 / 60.0;
+        // How often the main thread samples input and steps the simulation
+        static constexpr double SIMULATION_STEP_SECONDS = 1.0 / 240.0;
+        // Largest simplification error allowed on screen
+        static constexpr float LOD_ERROR_PIXELS = 1.0f;
+        static constexpr uint32_t TRIANGLE_MESH = 0;
+        static constexpr uint32_t SPHERE_MESH = 1;
+        static constexpr uint32_t MESH_COUNT = 2;
+        static constexpr uint32_t SPHERE_SEGMENTS = 128;
+        static constexpr uint32_t SPHERE_LOD_COUNT = 8;
+        // Shared by every model: 3 MB of vertices, 4 MB of indices
+        static constexpr uint32_t GEOMETRY_POOL_VERTICES = 1u << 18;
+        static constexpr uint32_t GEOMETRY_POOL_INDICES = 1u << 20;
+        // Most geometry copied to the GPU per frame; larger meshes take several frames
+        static constexpr VkDeviceSize STREAM_BYTES_PER_FRAME = 256 * 1024;
+        // Imported meshes, relative to the working directory like the pipeline cache
+        static constexpr const char* MESH_CACHE_DIR = "mesh_cache";
+        static constexpr uint32_t PARTICLE_CAPACITY = 1u << 20;
+        // Longest frame the particles are stepped by, so a stall doesn't emit a burst
+        static constexpr float MAX_PARTICLE_STEP_SECONDS = 0.1f;
+        // Skinned tentacles, each with its own range of the pool to be skinned into
+        static constexpr uint32_t CHARACTER_COUNT = 128;
+        static constexpr uint32_t CHARACTER_JOINTS = 8;
+        static constexpr uint32_t CHARACTERS_PER_ANIMATION_TASK = 16;
+        // Name of the GPU timer scope around the render graph
+        static constexpr const char* RENDER_GRAPH_SCOPE = "render graph";
+        // Frames copied back at once; collected MAX_FRAMES_IN_FLIGHT frames later
+        static constexpr uint32_t READBACK_SLOTS = SwapChain::MAX_FRAMES_IN_FLIGHT + 2;
+        // Simulation step of golden tests, so their frames don't depend on timing
+        static constexpr double GOLDEN_STEP_SECONDS = 1.0 / 60.0;
 
-        App() {
+        // targetFrameTimeMs: time between rendered frames, 0 renders as fast as possible
+        // samples: MSAA of the main pass, lowered to what the device supports
+        explicit App(
+            double targetFrameTimeMs = DEFAULT_FRAME_TIME_MS,
+            VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT)
+            : pacer{std::chrono::duration_cast<FramePacer::Clock::duration>(
+                  std::chrono::duration<double, std::milli>(targetFrameTimeMs))},
+              sampleCount{device.getUsableSampleCount(samples)} {
             loadModels();
+            createScene();
+            createFrameGraph();
+            createRenderGraph();
             createPipelineLayout();
             createPipeline();
+            createParticles();
+            createCharacters();
             createCommandBuffers();
+#if defined(SHADER_HOT_RELOAD)
+            // Recompile into the directory the shaders are loaded from, which is
+            // the bundle's copy on macOS rather than the build tree
+            shaderWatcher = std::make_unique<ShaderWatcher>(
+                SHADER_SOURCE_DIR,
+                getShaderDirectory(),
+                GLSLC_EXECUTABLE);
+#endif
         };
-        ~App() {
-            vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
-        };
+        ~App() {};
 
         App(const App&) = delete;
         App& operator=(const App&) = delete;
 
         void loadModels() {
-            std::vector<VModel::Vertex> vertices{{{0.0f, -0.5f}}, {{0.5f, 0.5f}}, {{-0.5f, 0.5f}}};
-            model = std::make_unique<VModel>(device, vertices);
+            models.resize(MESH_COUNT);
+            std::vector<VModel::Vertex> vertices{{{0.0f, -0.5f, 0.0f}}, {{0.5f, 0.5f, 0.0f}}, {{-0.5f, 0.5f, 0.0f}}};
+            models[TRIANGLE_MESH] = std::make_unique<VModel>(geometryPool, vertices);
+
+            // Streamed in the background; until it's resident its entities are skipped.
+            // Nothing is visible yet, so it waits at the back until a frame reprioritizes it.
+            // The key holds everything the build below depends on, so editing it rebuilds the cache
+            const uint64_t sphereKey = makeMeshCacheKey({SPHERE_SEGMENTS, SPHERE_LOD_COUNT});
+            streamer.request(SPHERE_MESH, std::string(MESH_CACHE_DIR) + "/sphere.mesh", sphereKey, [] {
+                std::vector<VModel::Vertex> vertices;
+                std::vector<uint32_t> indices;
+                createSphere(SPHERE_SEGMENTS, vertices, indices);
+                return VModel::import(vertices, indices, SPHERE_LOD_COUNT);
+            }, std::numeric_limits<float>::max());
+        };
+        void printStreamedModel(uint32_t mesh, const VModel& model, std::chrono::steady_clock::time_point requestedAt) {
+            auto now = std::chrono::steady_clock::now();
+            std::cout << std::fixed << std::setprecision(1) << "Mesh " << mesh << " streamed: first drawn "
+                      << std::chrono::duration<double, std::milli>(now - requestedAt).count() << " ms after its request, "
+                      << std::chrono::duration<double, std::milli>(now - launchTime).count() << " ms after launch"
+                      << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+            if (mesh == SPHERE_MESH) {
+                std::cout << "Sphere LODs (triangles/error):";
+                for (const auto& lod : model.getLods()) {
+                    std::cout << " " << lod.indexCount / 3 << "/" << lod.error;
+                }
+                const auto& stats = model.getImportStats();
+                std::cout << std::endl << std::setprecision(3) << "Sphere vertex cache: ACMR " << stats.original.acmr
+                          << " -> " << stats.optimized.acmr << ", ATVR " << stats.original.atvr << " -> "
+                          << stats.optimized.atvr << ", " << stats.meshlets << " meshlets" << std::endl;
+            }
+            auto poolStats = geometryPool.getStats();
+            auto streamStats = streamer.getStats();
+            std::cout << "Geometry pool: " << poolStats.meshes << " meshes, " << poolStats.verticesUsed << "/"
+                      << poolStats.vertexCapacity << " vertices, " << poolStats.indicesUsed << "/"
+                      << poolStats.indexCapacity << " indices; mesh cache " << streamStats.cacheHits << " hits, "
+                      << streamStats.cacheMisses << " misses" << std::endl;
+        };
+        // Unit UV sphere
+        static void createSphere(
+            uint32_t segments, std::vector<VModel::Vertex>& vertices, std::vector<uint32_t>& indices) {
+            uint32_t rings = segments / 2;
+            vertices.clear();
+            indices.clear();
+            vertices.push_back({{0.0f, 0.0f, 1.0f}});
+            for (uint32_t ring = 1; ring < rings; ring++) {
+                float theta = glm::pi<float>() * ring / rings;
+                for (uint32_t segment = 0; segment < segments; segment++) {
+                    float phi = glm::two_pi<float>() * segment / segments;
+                    vertices.push_back({{std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)}});
+                }
+            }
+            vertices.push_back({{0.0f, 0.0f, -1.0f}});
+
+            uint32_t south = static_cast<uint32_t>(vertices.size() - 1);
+            auto at = [segments](uint32_t ring, uint32_t segment) { return 1 + (ring - 1) * segments + segment % segments; };
+            for (uint32_t segment = 0; segment < segments; segment++) {
+                indices.insert(indices.end(), {0, at(1, segment), at(1, segment + 1)});
+                indices.insert(indices.end(), {at(rings - 1, segment), south, at(rings - 1, segment + 1)});
+            }
+            for (uint32_t ring = 1; ring + 1 < rings; ring++) {
+                for (uint32_t segment = 0; segment < segments; segment++) {
+                    uint32_t a = at(ring, segment), b = at(ring, segment + 1);
+                    uint32_t c = at(ring + 1, segment), d = at(ring + 1, segment + 1);
+                    indices.insert(indices.end(), {a, c, b, b, c, d});
+                }
+            }
+        };
+        void createScene() {
+            // A ring of small triangles around a root that spins, to exercise the hierarchy
+            constexpr int RING_SIZE = 12;
+            constexpr float RING_RADIUS = 0.6f;
+            const Aabb triangleBounds{{-0.5f, -0.5f, 0.0f}, {0.5f, 0.5f, 0.0f}};
+
+            sceneRoot = scene.createEntity({});
+            for (int i = 0; i < RING_SIZE; i++) {
+                float angle = glm::two_pi<float>() * i / RING_SIZE;
+                Transform local;
+                local.position = {RING_RADIUS * std::cos(angle), RING_RADIUS * std::sin(angle), 0.0f};
+                local.rotation = glm::angleAxis(angle, glm::vec3{0.0f, 0.0f, 1.0f});
+                local.scale = glm::vec3{0.2f};
+                EntityId entity = scene.createEntity(local, sceneRoot);
+                scene.setRenderable(entity, {0, 0, TRIANGLE_MESH}, triangleBounds);
+            }
+
+            // A dense grid of spheres behind the ring, smaller towards the top, so
+            // each row lands on a different level of detail
+            constexpr int GRID_SIZE = 16;
+            const Aabb sphereBounds{glm::vec3{-1.0f}, glm::vec3{1.0f}};
+            for (int row = 0; row < GRID_SIZE; row++) {
+                for (int column = 0; column < GRID_SIZE; column++) {
+                    Transform local;
+                    local.position = {
+                        -0.9f + 1.8f * column / (GRID_SIZE - 1), -0.9f + 1.8f * row / (GRID_SIZE - 1), 0.5f};
+                    local.scale = glm::vec3{0.055f * (row + 1) / GRID_SIZE};
+                    EntityId entity = scene.createEntity(local);
+                    scene.setRenderable(entity, {0, 0, SPHERE_MESH}, sphereBounds);
+                }
+            }
+
+            scene.updateTransforms();
+            bvh.build(scene);
+            std::cout << "Frustum culling kernel: " << frustumKernelName() << std::endl;
+        };
+        void createFrameGraph() {
+            // CPU work of a frame that doesn't need the swapchain image, run on the
+            // workers while the main thread waits for the frame's fence
+            updateTask = frameGraph.add("update", [this] { updateScene(); });
+            animateTask = frameGraph.addParallel(
+                "animate",
+                [] { return (CHARACTER_COUNT + CHARACTERS_PER_ANIMATION_TASK - 1) / CHARACTERS_PER_ANIMATION_TASK; },
+                [this](uint32_t task) { animateCharacters(task); });
+            cullTask = frameGraph.addParallel(
+                "cull",
+                [this] { return bvh.getTaskCount(); },
+                [this](uint32_t task) { bvh.cullTask(task, frustum); },
+                {updateTask});
+            drawListTask = frameGraph.add("draw list", [this] {
+                cullStats = bvh.gather(visibleEntities);
+                scene.buildDrawList(visibleEntities, drawList);
+            }, {cullTask});
+
+            profiler.setReportHook([this](std::ostream& out) {
+                auto pacing = pacer.takeStats();
+                out << std::setprecision(2) << "pacing: target "
+                    << std::chrono::duration<double, std::milli>(pacer.getTargetFrameTime()).count()
+                    << " ms, mean " << pacing.meanMilliseconds << " ms, jitter " << pacing.jitterMilliseconds
+                    << " ms, max " << pacing.maxMilliseconds << " ms, " << pacing.missed << " missed" << std::endl;
+
+                out << "threads";
+                auto stats = jobSystem.takeStats();
+                for (size_t i = 0; i < stats.size(); i++) {
+                    out << " | " << i << ": " << std::setprecision(0) << stats[i].utilization * 100.0 << "% busy, "
+                        << stats[i].jobs << " jobs, " << stats[i].steals << " stolen";
+                }
+                out << std::endl;
+
+                printMemoryReport(out, device.getMemoryTracker().getReport());
+
+                if (captureEncoder) {
+                    auto capture = captureEncoder->getStats();
+                    out << std::setprecision(1) << "capture: " << capture.encoded << " frames encoded, "
+                        << capture.encoded / capture.seconds << " fps, "
+                        << capture.bytesWritten / (1024.0 * 1024.0) / capture.seconds << " MiB/s, "
+                        << readback->getDroppedCount()
+                        << " skipped by readback, " << capture.dropped << " dropped by the encoder" << std::endl;
+                }
+            });
+        };
+        void updateScene() {
+            Transform root = scene.getLocalTransform(sceneRoot);
+            root.rotation = glm::angleAxis(currentPacket.rootAngle, glm::vec3{0.0f, 0.0f, 1.0f});
+            scene.setLocalTransform(sceneRoot, root);
+
+            // Runs as a task, so the level-by-level jobs can be waited on here
+            scene.updateTransforms(&jobSystem);
+            if (bvh.needsRebuild()) {
+                bvh.build(scene);
+            } else {
+                bvh.refit(scene);
+            }
+
+            // No camera yet: world matrices are already in clip space
+            frustum = Frustum::fromViewProjection(glm::mat4{1.0f});
         };
 
         void run() {
-            while (!window.shouldClose()) {
-                glfwPollEvents();
-                drawFrame();
+            // Input and simulation stay on this thread, which GLFW requires on macOS;
+            // a slow present or fence wait on the render thread no longer delays them
+            renderRunning = true;
+            std::thread renderThread([this] { renderLoop(); });
+
+            while (!window.shouldClose() && renderRunning) {
+                glfwWaitEventsTimeout(SIMULATION_STEP_SECONDS);
+                simulate();
+            }
+
+            renderRunning = false;
+            renderThread.join();
+            if (renderError) {
+                std::rethrow_exception(renderError);
+            }
+            if (!dumpDirectory.empty()) {
+                // The render thread waited for the device before it stopped
+                collectReadbacks(std::numeric_limits<uint64_t>::max());
+                imageWriter.flush();
+                auto stats = imageWriter.getStats();
+                std::cout << "Frame dump: " << stats.written << " written to " << dumpDirectory << ", "
+                          << readback->getDroppedCount() << " skipped by readback, " << stats.dropped
+                          << " dropped by the writer, " << stats.failed << " failed" << std::endl;
+            }
+            if (captureEncoder) {
+                collectReadbacks(std::numeric_limits<uint64_t>::max());
+                captureEncoder->finish();
+                reclaimCaptureFrames();
+                auto capture = captureEncoder->getStats();
+                uint64_t rendered = capture.encoded + capture.dropped + readback->getDroppedCount();
+                std::cout << std::fixed << std::setprecision(1) << "Capture: " << capture.encoded << " of "
+                          << rendered << " frames written to " << captureEncoder->getPath() << " in "
+                          << capture.seconds << " s (" << capture.encoded / capture.seconds << " fps, "
+                          << capture.bytesWritten / (1024.0 * 1024.0) / capture.seconds << " MiB/s), "
+                          << readback->getDroppedCount() << " skipped by readback, " << capture.dropped
+                          << " dropped by the encoder" << std::endl;
+                std::cout.unsetf(std::ios::floatfield);
+            }
+            if (!memoryReportPath.empty()) {
+                std::ofstream file{memoryReportPath};
+                writeMemoryReportJson(file, device.getMemoryTracker().getReport());
+                if (!file) {
+                    throw std::runtime_error("failed to write memory report " + memoryReportPath);
+                }
+            }
+        };
+        // Writes live and peak device memory per heap and category, with the
+        // budget where the driver reports one, to path as JSON when run() ends
+        void enableMemoryReport(const std::string& path) {
+            memoryReportPath = path;
+        };
+        // Reads every frame back and encodes it on a background thread: a Y4M
+        // stream for a path ending in .y4m, a PNG sequence in the directory at
+        // path otherwise. buffers frames can be in flight between rendering and
+        // the encoder, which reads them straight from the readback buffers;
+        // frames that find none free are skipped, the render loop never waits.
+        void enableCapture(const std::string& path, uint32_t buffers) {
+            createReadback(std::max(buffers, 1u));
+            VkExtent2D extent = swapChain.getSwapChainExtent();
+            double frameTimeMs = std::chrono::duration<double, std::milli>(pacer.getTargetFrameTime()).count();
+            uint32_t framesPerSecond = frameTimeMs > 0.0 ? static_cast<uint32_t>(std::lround(1000.0 / frameTimeMs)) : 60;
+            captureEncoder = std::make_unique<CaptureEncoder>(
+                path, extent.width, extent.height, framesPerSecond, readback->getSlotCount());
+        };
+        // Copies every interval-th frame back and writes it to directory as PNG
+        // on a background thread. Frames are skipped, never waited for, when
+        // readback or writing can't keep up.
+        void enableFrameDump(const std::string& directory, uint32_t interval) {
+            createReadback();
+            std::filesystem::create_directories(directory);
+            dumpDirectory = directory;
+            dumpInterval = std::max(interval, 1u);
+        };
+        // Lets streaming finish, then renders frame frames with a fixed time step
+        // from a reset simulation and compares the last one with the PNG at
+        // goldenPath; with update the frame becomes the new golden image instead.
+        // Throws if there is no golden image to compare with, or if more than the
+        // allowed share of pixels differ by more than tolerance in any channel;
+        // the frame and a difference image are then written next to the golden one.
+        void runGoldenTest(const std::string& goldenPath, uint32_t frame, bool update, uint32_t tolerance) {
+            constexpr double MAX_DIFFERING_PIXELS = 0.001;
+            constexpr double STREAMING_TIMEOUT_SECONDS = 30.0;
+            // Only an explicit update may write it, or a lost golden image would pass
+            if (!update && !std::filesystem::exists(goldenPath)) {
+                throw std::runtime_error("golden test: no golden image at " + goldenPath + ", run --update-golden first");
+            }
+            createReadback();
+
+            auto start = std::chrono::steady_clock::now();
+            while (!allModelsResident()) {
+                if (std::chrono::steady_clock::now() - start > std::chrono::duration<double>(STREAMING_TIMEOUT_SECONDS)) {
+                    throw std::runtime_error("golden test: meshes still streaming after 30 s");
+                }
+                stepFrame();
             }
 
+            fixedStepSeconds = GOLDEN_STEP_SECONDS;
+            simulationSteps = 0;
+            particles->reset();
+            goldenFrameNumber = frameNumber + frame;
+            while (frameNumber <= goldenFrameNumber) {
+                stepFrame();
+            }
             vkDeviceWaitIdle(device.device());
+            collectReadbacks(std::numeric_limits<uint64_t>::max());
+            if (!goldenImage) {
+                throw std::runtime_error("golden test: the frame couldn't be read back");
+            }
+
+            if (update) {
+                if (!std::filesystem::path(goldenPath).parent_path().empty()) {
+                    std::filesystem::create_directories(std::filesystem::path(goldenPath).parent_path());
+                }
+                writePng(goldenPath, *goldenImage);
+                std::cout << "Golden image written to " << goldenPath << std::endl;
+                return;
+            }
+
+            Image golden = readPng(goldenPath);
+            if (golden.width != goldenImage->width || golden.height != goldenImage->height) {
+                throw std::runtime_error(
+                    "golden test: frame is " + std::to_string(goldenImage->width) + "x" +
+                    std::to_string(goldenImage->height) + ", golden image " + std::to_string(golden.width) + "x" +
+                    std::to_string(golden.height));
+            }
+            ImageDifference difference = compareImages(golden, *goldenImage, tolerance);
+            double share = static_cast<double>(difference.differingPixels) / (golden.width * golden.height);
+            std::cout << "Golden test on " << device.properties.deviceName << ": " << difference.differingPixels
+                      << " pixels differ by more than " << tolerance << ", largest difference "
+                      << difference.maxChannelDifference << std::endl;
+            if (share > MAX_DIFFERING_PIXELS) {
+                std::string base = std::filesystem::path(goldenPath).replace_extension().string();
+                writePng(base + ".actual.png", *goldenImage);
+                writePng(base + ".diff.png", differenceImage(golden, *goldenImage));
+                throw std::runtime_error(
+                    "golden test failed, see " + base + ".actual.png and " + base + ".diff.png");
+            }
+        };
+        // Scans count random values with the GPU prefix sum on the compute queue and
+        // checks them against a CPU scan; throws on a mismatch. Timings are wall
+        // clock from submit to completion, best of BENCHMARK_RUNS.
+        void runComputeBenchmark(uint32_t count) {
+            constexpr int BENCHMARK_RUNS = 10;
+            const VkDeviceSize bytes = sizeof(uint32_t) * static_cast<VkDeviceSize>(count);
+            PrefixSum prefixSum{
+                device,
+                pipelineCache,
+                layoutCache,
+                getShaderDirectory(),
+                count};
+
+            std::vector<uint32_t> values(count);
+            std::mt19937 random{1234};
+            for (auto& value : values) {
+                value = random();
+            }
+
+            VkBuffer staging, input, output;
+            VkDeviceMemory stagingMemory, inputMemory, outputMemory;
+            device.createBuffer(
+                bytes,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                staging,
+                stagingMemory);
+            device.createBuffer(
+                bytes,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                input,
+                inputMemory);
+            device.createBuffer(
+                bytes,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                output,
+                outputMemory);
+            void* mapped;
+            vkMapMemory(device.device(), stagingMemory, 0, bytes, 0, &mapped);
+            std::memcpy(mapped, values.data(), bytes);
+
+            // Everything on the compute queue, so the buffers never change queue family
+            VkBufferCopy region{0, 0, bytes};
+            auto upload = computeContext.begin();
+            vkCmdCopyBuffer(upload.getCommandBuffer(), staging, input, 1, &region);
+            upload.barrier();
+            computeContext.wait(computeContext.submit(upload));
+
+            double gpuMs = std::numeric_limits<double>::max();
+            for (int run = 0; run < BENCHMARK_RUNS; run++) {
+                auto job = computeContext.begin();
+                prefixSum.record(job, input, output, count);
+                auto start = std::chrono::steady_clock::now();
+                computeContext.wait(computeContext.submit(job));
+                gpuMs = std::min(gpuMs, std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count());
+            }
+
+            auto download = computeContext.begin();
+            download.barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+            vkCmdCopyBuffer(download.getCommandBuffer(), output, staging, 1, &region);
+            download.barrier(VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+            computeContext.wait(computeContext.submit(download));
+            std::vector<uint32_t> sums(count);
+            std::memcpy(sums.data(), mapped, bytes);
+            vkUnmapMemory(device.device(), stagingMemory);
+            for (auto buffer : {staging, input, output}) {
+                vkDestroyBuffer(device.device(), buffer, nullptr);
+            }
+            for (auto memory : {stagingMemory, inputMemory, outputMemory}) {
+                device.freeMemory(memory);
+            }
+
+            double cpuMs = std::numeric_limits<double>::max();
+            std::vector<uint32_t> expected(count);
+            for (int run = 0; run < BENCHMARK_RUNS; run++) {
+                auto start = std::chrono::steady_clock::now();
+                std::exclusive_scan(values.begin(), values.end(), expected.begin(), uint32_t{0});
+                cpuMs = std::min(cpuMs, std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count());
+            }
+
+            auto mismatch = std::mismatch(sums.begin(), sums.end(), expected.begin());
+            std::cout << std::fixed << std::setprecision(3) << "Prefix sum of " << count << " values on "
+                      << device.properties.deviceName << ": GPU " << gpuMs << " ms, CPU " << cpuMs << " ms"
+                      << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+            if (mismatch.first != sums.end()) {
+                size_t index = static_cast<size_t>(mismatch.first - sums.begin());
+                throw std::runtime_error(
+                    "prefix sum mismatch at " + std::to_string(index) + ": GPU " + std::to_string(*mismatch.first) +
+                    ", CPU " + std::to_string(*mismatch.second));
+            }
+            std::cout << "Prefix sum matches the CPU reference" << std::endl;
+        };
+        // Renders the scene for frames frames at each MSAA sample count the device
+        // supports and reports the render graph's mean GPU time and attachment memory
+        static void runMsaaBenchmark(uint32_t frames) {
+            constexpr double MiB = 1024.0 * 1024.0;
+            double baselineMs = 0.0;
+            for (VkSampleCountFlagBits samples :
+                 {VK_SAMPLE_COUNT_1_BIT, VK_SAMPLE_COUNT_2_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_8_BIT}) {
+                App app{0.0, samples};
+                if (app.sampleCount != samples) {
+                    std::cout << "MSAA " << samples << "x: not supported" << std::endl;
+                    continue;
+                }
+                if (!app.gpuTimer.isSupported()) {
+                    throw std::runtime_error("the MSAA benchmark needs timestamp queries");
+                }
+                double ms = app.measureRenderGraph(frames);
+                if (samples == VK_SAMPLE_COUNT_1_BIT) {
+                    baselineMs = ms;
+                }
+
+                VkExtent2D extent = app.swapChain.getSwapChainExtent();
+                VkDeviceSize bytes = app.renderGraph.getImageSize(app.depth, extent);
+                bool lazy = app.renderGraph.isLazilyAllocated(app.depth);
+                if (samples != VK_SAMPLE_COUNT_1_BIT) {
+                    bytes += app.renderGraph.getImageSize(app.colorSamples, extent);
+                    lazy = lazy && app.renderGraph.isLazilyAllocated(app.colorSamples);
+                }
+                std::cout << std::fixed << std::setprecision(3) << "MSAA " << samples << "x: render graph " << ms
+                          << " ms on the GPU (" << std::setprecision(2) << ms / baselineMs << "x of 1x), "
+                          << std::setprecision(1) << bytes / MiB << " MiB of attachments per frame"
+                          << (lazy ? ", lazily allocated" : "") << std::endl;
+                std::cout.unsetf(std::ios::floatfield);
+            }
         };
     private:
-        void createPipelineLayout() {
-            VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-            pipelineLayoutInfo.setLayoutCount = 0;
-            pipelineLayoutInfo.pSetLayouts = nullptr;
-            pipelineLayoutInfo.pushConstantRangeCount = 0;
-            pipelineLayoutInfo.pPushConstantRanges = nullptr;
+        // Everything the render thread needs from the simulation for one frame
+        struct FramePacket {
+            uint64_t sequence = 0;
+            std::chrono::steady_clock::time_point sampledAt;
+            float rootAngle = 0.0f;
+            float animationSeconds = 0.0f;
+        };
+
+        // Where the compiled shaders are loaded from
+        static std::string getShaderDirectory() {
+            return std::filesystem::path(VERT_SHADER_PATH).parent_path().string();
+        };
+        void simulate() {
+            auto now = std::chrono::steady_clock::now();
+            float seconds = fixedStepSeconds > 0.0
+                ? static_cast<float>(simulationSteps * fixedStepSeconds)
+                : std::chrono::duration<float>(now - startTime).count();
+
+            FramePacket& packet = framePackets.writeSlot();
+            packet.sequence = ++simulationSteps;
+            packet.sampledAt = now;
+            packet.rootAngle = 0.5f * seconds;
+            packet.animationSeconds = seconds;
+            framePackets.publish();
+        };
+        // Renders frames frames as fast as possible on this thread and returns the
+        // mean GPU time of the render graph, once streaming and pipelines have
+        // settled
+        double measureRenderGraph(uint32_t frames) {
+            constexpr uint32_t WARMUP_FRAMES = 60;
+            double totalMs = 0.0;
+            uint32_t measured = 0;
+            for (uint32_t frame = 0; frame < WARMUP_FRAMES + frames && !window.shouldClose(); frame++) {
+                stepFrame();
+                if (frame >= WARMUP_FRAMES && renderGraphMs > 0.0) {
+                    totalMs += renderGraphMs;
+                    measured++;
+                }
+            }
+            vkDeviceWaitIdle(device.device());
+            return measured > 0 ? totalMs / measured : 0.0;
+        };
+        // One frame of what run() splits over two threads, all on this one
+        void stepFrame() {
+            glfwPollEvents();
+            simulate();
+            framePackets.update();
+            currentPacket = framePackets.read();
+            drawFrame();
+        };
+        void renderLoop() {
+            try {
+                while (renderRunning) {
+                    pacer.waitForNextFrame();
+                    // Always the newest packet; steps the render thread was too slow for are skipped
+                    framePackets.update();
+                    currentPacket = framePackets.read();
+                    drawFrame();
+                }
+            } catch (...) {
+                renderError = std::current_exception();
+                renderRunning = false;
+                glfwPostEmptyEvent();
+            }
+            vkDeviceWaitIdle(device.device());
+        };
+        void createRenderGraph() {
+            RGImageDesc colorDesc{swapChain.getSwapChainImageFormat(), swapChain.getSwapChainExtent()};
+            RGImageDesc depthDesc{swapChain.findDepthFormat(), swapChain.getSwapChainExtent(), sampleCount};
+
+            backbuffer = renderGraph.importImage(
+                "backbuffer", colorDesc, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+            depth = renderGraph.createImage("depth", depthDesc);
+            if (sampleCount != VK_SAMPLE_COUNT_1_BIT) {
+                // Resolved into the backbuffer as the pass ends and never stored
+                colorDesc.samples = sampleCount;
+                colorSamples = renderGraph.createImage("color samples", colorDesc);
+            }
 
-            if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-                throw std::runtime_error("Failed to create pipeline layout.");
+            mainPass = renderGraph.addRasterPass("main", [this](VkCommandBuffer commandBuffer) {
+                pipeline->bind(commandBuffer);
+                // Every model lives in the pool, so geometry is bound once per pass
+                geometryPool.bind(commandBuffer);
+                for (const DrawItem& item : drawList) {
+                    uint32_t mesh = scene.decodeDrawKey(item.key).mesh;
+                    if (!models[mesh]) {
+                        continue;  // still streaming
+                    }
+                    const glm::mat4& world = scene.getWorldMatrix(item.entity);
+                    vkCmdPushConstants(
+                        commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &world);
+
+                    // World space is clip space for now, so one unit spans half the
+                    // viewport and there's no perspective to account for
+                    float scale = 0.0f;
+                    for (int axis = 0; axis < 3; axis++) {
+                        scale = std::max(scale, std::sqrt(
+                            world[axis][0] * world[axis][0] + world[axis][1] * world[axis][1] +
+                            world[axis][2] * world[axis][2]));
+                    }
+                    float pixelsPerUnit = scale * 0.5f * std::max(swapChain.width(), swapChain.height());
+                    uint32_t lod = models[mesh]->selectLod(pixelsPerUnit, LOD_ERROR_PIXELS);
+
+                    // The camera looks down +z; taking it to model space with the
+                    // transpose is exact for the rotations and uniform scales used here
+                    glm::vec3 viewDirection{world[0][2], world[1][2], world[2][2]};
+                    viewDirection /= scale;
+                    trianglesSubmitted += models[mesh]->drawCulled(commandBuffer, lod, viewDirection);
+                    trianglesFullDetail += models[mesh]->getTriangleCount();
+                }
+                // Blended over the opaque geometry, so last
+                particles->draw(commandBuffer);
+            });
+            if (sampleCount != VK_SAMPLE_COUNT_1_BIT) {
+                renderGraph.colorAttachment(mainPass, colorSamples, VkClearColorValue{{0.1f, 0.1f, 0.1f, 1.0f}});
+                renderGraph.resolveAttachment(mainPass, colorSamples, backbuffer);
+            } else {
+                renderGraph.colorAttachment(mainPass, backbuffer, VkClearColorValue{{0.1f, 0.1f, 0.1f, 1.0f}});
             }
+            renderGraph.depthAttachment(mainPass, depth, VkClearDepthStencilValue{1.0f, 0});
+
+            renderGraph.compile();
+            renderGraph.printReport(std::cout);
+            printDepthMemoryReport();
+        };
+        void printDepthMemoryReport() {
+            // What depth costs at 4K with one copy per swapchain image (the old layout)
+            // versus one per frame in flight
+            constexpr VkExtent2D extent4K{3840, 2160};
+            constexpr double MiB = 1024.0 * 1024.0;
+            VkDeviceSize depthSize = renderGraph.getImageSize(depth, extent4K);
+            VkDeviceSize perImage = depthSize * swapChain.imageCount();
+            VkDeviceSize perFrame = depthSize * SwapChain::MAX_FRAMES_IN_FLIGHT;
+            VkDeviceSize resident = renderGraph.isLazilyAllocated(depth) ? 0 : perFrame;
+
+            std::cout << std::fixed << std::setprecision(1)
+                      << "Depth at 3840x2160: " << depthSize / MiB << " MiB per copy, "
+                      << swapChain.imageCount() << " swapchain images: " << perImage / MiB << " MiB, "
+                      << SwapChain::MAX_FRAMES_IN_FLIGHT << " frames in flight: " << perFrame / MiB << " MiB ("
+                      << resident / MiB << " MiB resident"
+                      << (renderGraph.isLazilyAllocated(depth) ? ", lazily allocated" : "")
+                      << "), saved " << (perImage - resident) / MiB << " MiB" << std::endl;
+        };
+        void createPipelineLayout() {
+            // The layout follows whatever the shaders declare; identical interfaces share one layout
+            pipelineLayout = layoutCache.getPipelineLayout({
+                &pipelineCache.getReflection(VERT_SHADER_PATH),
+                &pipelineCache.getReflection(FRAG_SHADER_PATH)});
+        };
+        void setMainPassTarget(PipelineConfigInfo& pipelineConfig) {
+            pipelineConfig.renderPass = renderGraph.getRenderPass(mainPass);
+            RGAttachmentFormats formats = renderGraph.getAttachmentFormats(mainPass);
+            pipelineConfig.colorAttachmentFormats = formats.color;
+            pipelineConfig.depthAttachmentFormat = formats.depth;
+            pipelineConfig.stencilAttachmentFormat = formats.stencil;
+            pipelineConfig.multisampling.rasterizationSamples = formats.samples;
         };
         void createPipeline() {
             auto pipelineConfig = Pipeline::defaultPipelineConfigInfo(swapChain.width(), swapChain.height());
-            pipelineConfig.renderPass = swapChain.getRenderPass();
+            setMainPassTarget(pipelineConfig);
             
             pipelineConfig.pipelineLayout = pipelineLayout;
             pipeline = std::make_unique<Pipeline>(
                 device,
-                "../Resources/compiledShaders/temp.vert.spv",
-                "../Resources/compiledShaders/temp.frag.spv",
+                pipelineCache,
+                VERT_SHADER_PATH,
+                FRAG_SHADER_PATH,
                 pipelineConfig
             );
         };
-        
+        void createParticles() {
+            particles = std::make_unique<ParticleSystem>(
+                device, pipelineCache, layoutCache, computeContext, getShaderDirectory(), PARTICLE_CAPACITY);
+            auto pipelineConfig = Pipeline::defaultPipelineConfigInfo(swapChain.width(), swapChain.height());
+            setMainPassTarget(pipelineConfig);
+            particles->createPipeline(pipelineConfig);
+            std::cout << "GPU particles: " << particles->getCapacity() << " slots, "
+                      << (gpuTimer.isSupported() ? "timed with timestamp queries" : "no timestamp support")
+                      << std::endl;
+        };
+        // A tapering tube along +y on a chain of joints, bending with a blend of a
+        // sway and a curl clip that differs per character
+        void createCharacters() {
+            constexpr uint32_t RINGS = 48;
+            constexpr uint32_t SEGMENTS = 16;
+            constexpr float SEGMENT_LENGTH = 1.0f / CHARACTER_JOINTS;
+            constexpr int GRID_COLUMNS = 16;
+
+            skeleton.parents.resize(CHARACTER_JOINTS);
+            skeleton.inverseBindMatrices.resize(CHARACTER_JOINTS);
+            for (uint32_t joint = 0; joint < CHARACTER_JOINTS; joint++) {
+                skeleton.parents[joint] = static_cast<int32_t>(joint) - 1;
+                glm::mat4 inverseBind{1.0f};
+                inverseBind[3][1] = -SEGMENT_LENGTH * joint;
+                skeleton.inverseBindMatrices[joint] = inverseBind;
+            }
+
+            // Each ring follows the two joints nearest to it
+            std::vector<GpuSkinning::Vertex> bindPose;
+            std::vector<VModel::Vertex> vertices;
+            for (uint32_t ring = 0; ring < RINGS; ring++) {
+                float y = static_cast<float>(ring) / (RINGS - 1);
+                float radius = 0.1f - 0.08f * y;
+                float along = std::min(y / SEGMENT_LENGTH, CHARACTER_JOINTS - 1.0f);
+                uint32_t joint = std::min(static_cast<uint32_t>(along), CHARACTER_JOINTS - 2);
+                float weight = along - joint;
+                for (uint32_t segment = 0; segment < SEGMENTS; segment++) {
+                    float phi = glm::two_pi<float>() * segment / SEGMENTS;
+                    glm::vec3 position{radius * std::cos(phi), y, radius * std::sin(phi)};
+                    bindPose.push_back({position, joint | ((joint + 1) << 8), {1.0f - weight, weight, 0.0f, 0.0f}});
+                    vertices.push_back({position});
+                }
+            }
+            std::vector<uint32_t> indices;
+            for (uint32_t ring = 0; ring + 1 < RINGS; ring++) {
+                for (uint32_t segment = 0; segment < SEGMENTS; segment++) {
+                    uint32_t a = ring * SEGMENTS + segment, b = ring * SEGMENTS + (segment + 1) % SEGMENTS;
+                    uint32_t c = a + SEGMENTS, d = b + SEGMENTS;
+                    indices.insert(indices.end(), {a, c, b, b, c, d});
+                }
+            }
+
+            // Two seconds each, looping
+            constexpr uint32_t CLIP_FRAMES = 60;
+            swayClip.frames.assign(CLIP_FRAMES, Pose{CHARACTER_JOINTS});
+            curlClip.frames.assign(CLIP_FRAMES, Pose{CHARACTER_JOINTS});
+            for (uint32_t frame = 0; frame < CLIP_FRAMES; frame++) {
+                float phase = glm::two_pi<float>() * frame / CLIP_FRAMES;
+                for (uint32_t joint = 1; joint < CHARACTER_JOINTS; joint++) {
+                    glm::vec3 offset{0.0f, SEGMENT_LENGTH, 0.0f};
+                    float sway = 0.2f * std::sin(phase - 0.4f * joint);
+                    float curl = 0.3f * (0.5f - 0.5f * std::cos(phase));
+                    swayClip.frames[frame].setJoint(joint, glm::angleAxis(sway, glm::vec3{0.0f, 0.0f, 1.0f}), offset);
+                    curlClip.frames[frame].setJoint(joint, glm::angleAxis(curl, glm::vec3{1.0f, 0.0f, 0.0f}), offset);
+                }
+            }
+
+            skinning = std::make_unique<GpuSkinning>(
+                device,
+                pipelineCache,
+                layoutCache,
+                computeContext,
+                geometryPool,
+                getShaderDirectory(),
+                SwapChain::MAX_FRAMES_IN_FLIGHT);
+            uint32_t mesh = skinning->addMesh(bindPose, CHARACTER_JOINTS);
+
+            // Upside down, since clip space y points down the screen
+            const Aabb characterBounds{{-1.0f, -0.2f, -1.0f}, {1.0f, 1.1f, 1.0f}};
+            models.resize(MESH_COUNT + CHARACTER_COUNT);
+            for (uint32_t i = 0; i < CHARACTER_COUNT; i++) {
+                VModel::MeshData meshData;
+                meshData.vertices = vertices;
+                meshData.indices = indices;
+                meshData.lods = {{0, static_cast<uint32_t>(indices.size()), 0.0f}};
+                uint32_t model = MESH_COUNT + i;
+                models[model] = std::make_unique<VModel>(geometryPool, std::move(meshData));
+                skinning->addInstance(mesh, models[model]->getGeometry());
+
+                int row = static_cast<int>(i) / GRID_COLUMNS, column = static_cast<int>(i) % GRID_COLUMNS;
+                Transform local;
+                local.position = {-0.9f + 1.8f * column / (GRID_COLUMNS - 1), 0.9f - 0.2f * row, 0.25f};
+                local.rotation = glm::angleAxis(glm::pi<float>(), glm::vec3{0.0f, 0.0f, 1.0f});
+                local.scale = glm::vec3{0.12f};
+                EntityId entity = scene.createEntity(local);
+                scene.setRenderable(entity, {0, 0, model}, characterBounds);
+            }
+            scene.updateTransforms();
+            bvh.build(scene);
+
+            characterPalette.resize(skinning->getPaletteSize());
+            animationScratch.resize((CHARACTER_COUNT + CHARACTERS_PER_ANIMATION_TASK - 1) / CHARACTERS_PER_ANIMATION_TASK);
+            for (auto& scratch : animationScratch) {
+                for (Pose* pose : {&scratch.sway, &scratch.curl, &scratch.blended}) {
+                    pose->resize(CHARACTER_JOINTS);
+                }
+            }
+            std::cout << "GPU skinning: " << CHARACTER_COUNT << " characters, " << CHARACTER_JOINTS << " joints, "
+                      << skinning->getSkinnedVertexCount() << " vertices per frame" << std::endl;
+        };
+        void animateCharacters(uint32_t task) {
+            AnimationScratch& scratch = animationScratch[task];
+            uint32_t end = std::min(CHARACTER_COUNT, (task + 1) * CHARACTERS_PER_ANIMATION_TASK);
+            for (uint32_t i = task * CHARACTERS_PER_ANIMATION_TASK; i < end; i++) {
+                float seconds = currentPacket.animationSeconds + 0.37f * i;
+                sampleClip(swayClip, seconds, scratch.sway);
+                sampleClip(curlClip, 1.3f * seconds, scratch.curl);
+                blendPoses(scratch.sway, scratch.curl, 0.5f + 0.5f * std::sin(0.5f * seconds), scratch.blended);
+                computeSkinningPalette(skeleton, scratch.blended, &characterPalette[skinning->getFirstJoint(i)]);
+            }
+        };
+
+        void createReadback(uint32_t slots = READBACK_SLOTS) {
+            if (readback) {
+                return;
+            }
+            if (!swapChain.supportsReadback() || !FrameReadback::isFormatSupported(swapChain.getSwapChainImageFormat())) {
+                throw std::runtime_error("the swapchain images can't be read back on this surface");
+            }
+            readback = std::make_unique<FrameReadback>(
+                device, swapChain.getSwapChainImageFormat(), swapChain.getSwapChainExtent(), slots);
+        };
+        bool isReadbackFrame(uint64_t frame) const {
+            return captureEncoder || frame == goldenFrameNumber ||
+                   (!dumpDirectory.empty() && frame % dumpInterval == 0);
+        };
+        void collectReadbacks(uint64_t completedFrame) {
+            if (!readback) {
+                return;
+            }
+            reclaimCaptureFrames();
+            for (const auto& frame : readback->acquire(completedFrame)) {
+                if (!dumpDirectory.empty() && frame.frameNumber % dumpInterval == 0) {
+                    std::ostringstream name;
+                    name << "frame_" << std::setw(6) << std::setfill('0') << frame.frameNumber << ".png";
+                    imageWriter.write(
+                        (std::filesystem::path(dumpDirectory) / name.str()).string(), readback->copyImage(frame));
+                }
+                if (frame.frameNumber == goldenFrameNumber) {
+                    goldenImage = readback->copyImage(frame);
+                }
+                // The encoder copies the buffer on its own thread and gives it back
+                // through reclaimCaptureFrames(); a full queue drops the frame
+                if (!captureEncoder || !captureEncoder->submit({frame.pixels, readback->isBgra(), frame.slot})) {
+                    readback->release(frame.slot);
+                }
+            }
+        };
+        // Readback buffers the encoder is done with; until then they take no new frames
+        void reclaimCaptureFrames() {
+            uint32_t slot;
+            while (captureEncoder && captureEncoder->reclaim(slot)) {
+                readback->release(slot);
+            }
+        };
+        bool allModelsResident() const {
+            return std::all_of(models.begin(), models.end(), [](const auto& model) { return model != nullptr; });
+        };
+
         void createCommandBuffers() {
             commandBuffers.resize(swapChain.imageCount());
 
@@ -80,62 +913,276 @@ class App {
                 VK_SUCCESS) {
                 throw std::runtime_error("failed to allocate command buffers!");
             }
+        };
+        void recordCommandBuffer(uint32_t imageIndex) {
+            // Recorded every frame so a pipeline swapped in by hot-reload is picked up
+            // without touching command buffers that may still be executing
+            VkCommandBuffer commandBuffer = commandBuffers[imageIndex];
 
-            for (int i = 0; i < commandBuffers.size(); i++) {
-                VkCommandBufferBeginInfo beginInfo{};
-                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-                if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
                 throw std::runtime_error("failed to begin recording command buffer!");
-                }
+            }
 
-                VkRenderPassBeginInfo renderPassInfo{};
-                renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-                renderPassInfo.renderPass = swapChain.getRenderPass();
-                renderPassInfo.framebuffer = swapChain.getFrameBuffer(i);
+            // Meshes whose last bytes are copied here are already drawn by the main pass below
+            for (auto& ready : streamer.recordUploads(commandBuffer, swapChain.getCurrentFrame())) {
+                printStreamedModel(ready.id, *ready.model, ready.requestedAt);
+                models[ready.id] = std::move(ready.model);
+            }
 
-                renderPassInfo.renderArea.offset = {0, 0};
-                renderPassInfo.renderArea.extent = swapChain.getSwapChainExtent();
+            gpuTimer.beginFrame(commandBuffer, swapChain.getCurrentFrame());
+            particles->recordUpdate(commandBuffer, gpuTimer, frameNumber, particleStepSeconds);
+            // Into the pool's vertex buffer, where every pass this frame draws the characters from
+            skinning->record(commandBuffer, gpuTimer, swapChain.getCurrentFrame(), frameNumber, characterPalette);
 
-                std::array<VkClearValue, 2> clearValues{};
-                clearValues[0].color = {0.1f, 0.1f, 0.1f, 1.0f};
-                clearValues[1].depthStencil = {1.0f, 0};
-                renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-                renderPassInfo.pClearValues = clearValues.data();
+            renderGraph.setImportedImage(backbuffer, swapChain.getImage(imageIndex), swapChain.getImageView(imageIndex));
+            uint32_t renderGraphScope = gpuTimer.begin(commandBuffer, RENDER_GRAPH_SCOPE);
+            renderGraph.execute(commandBuffer, swapChain.getCurrentFrame());
+            gpuTimer.end(commandBuffer, renderGraphScope);
+            if (readback && isReadbackFrame(frameNumber)) {
+                readback->record(commandBuffer, swapChain.getImage(imageIndex), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, frameNumber);
+            }
 
-                vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record command buffer!");
+            }
+        };
+        void reloadShaders() {
+            if (!shaderWatcher) {
+                return;
+            }
 
-                pipeline->bind(commandBuffers[i]);
-                model->bind(commandBuffers[i]);
-                model->draw(commandBuffers[i]);
+            bool affected = false;
+            for (const auto& fileName : shaderWatcher->takeRecompiledShaders()) {
+                for (const char* path : {VERT_SHADER_PATH, FRAG_SHADER_PATH}) {
+                    if (std::filesystem::path(path).filename() == fileName) {
+                        pipelineCache.invalidate(path);
+                        affected = true;
+                    }
+                }
+            }
+            if (!affected) {
+                return;
+            }
 
-                // vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
+            auto previousPipeline = std::move(pipeline);
+            auto previousLayout = pipelineLayout;
+            try {
+                createPipelineLayout();
+                createPipeline();
+            } catch (const std::exception& e) {
+                std::cerr << "Shader hot-reload: " << e.what() << ", keeping the previous pipeline" << std::endl;
+                pipeline = std::move(previousPipeline);
+                pipelineLayout = previousLayout;
+                return;
+            }
 
-                vkCmdEndRenderPass(commandBuffers[i]);
-                if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to record command buffer!");
+            // Frames already submitted still reference the old pipeline
+            retiredPipelines.push_back({std::move(previousPipeline), frameNumber});
+        };
+        void destroyRetiredPipelines() {
+            // Called once this frame's fence has been waited on; by then every frame
+            // that could have used a pipeline retired MAX_FRAMES_IN_FLIGHT frames ago is done
+            while (!retiredPipelines.empty() &&
+                   frameNumber - retiredPipelines.front().retiredAt >= SwapChain::MAX_FRAMES_IN_FLIGHT) {
+                retiredPipelines.erase(retiredPipelines.begin());
+            }
+        };
+        void updateStreamingPriorities() {
+            // Visible meshes that aren't resident go nearest first. There's no camera
+            // yet, so depth in clip space stands in for the distance from the eye.
+            streamingDepths.assign(models.size(), std::numeric_limits<float>::max());
+            for (const DrawItem& item : drawList) {
+                uint32_t mesh = scene.decodeDrawKey(item.key).mesh;
+                if (!models[mesh]) {
+                    streamingDepths[mesh] = std::min(streamingDepths[mesh], scene.getWorldMatrix(item.entity)[3][2]);
+                }
+            }
+            for (uint32_t mesh = 0; mesh < models.size(); mesh++) {
+                if (streamingDepths[mesh] != std::numeric_limits<float>::max()) {
+                    streamer.setPriority(mesh, streamingDepths[mesh]);
                 }
             }
         };
         void drawFrame() {
+            reloadShaders();
+
+            JobSystem::Counter frameWork;
+            frameGraph.run(jobSystem, frameWork);
+
             uint32_t imageIndex;
             auto result = swapChain.acquireNextImage(&imageIndex);
+            jobSystem.wait(frameWork);
             if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
                 throw std::runtime_error("failed to acquire swap chain image!");
             }
+            destroyRetiredPipelines();
+            // Same reasoning for the descriptor pools of the particles' and skinning's inline compute
+            if (frameNumber >= SwapChain::MAX_FRAMES_IN_FLIGHT) {
+                computeContext.retireInline(frameNumber - SwapChain::MAX_FRAMES_IN_FLIGHT);
+                collectReadbacks(frameNumber - SwapChain::MAX_FRAMES_IN_FLIGHT);
+            }
+            updateStreamingPriorities();
+
+            auto now = std::chrono::steady_clock::now();
+            if (fixedStepSeconds > 0.0) {
+                particleStepSeconds = static_cast<float>(fixedStepSeconds);
+            } else {
+                particleStepSeconds = frameNumber == 0 ? 0.0f : std::min(
+                    std::chrono::duration<float>(now - lastFrameTime).count(), MAX_PARTICLE_STEP_SECONDS);
+            }
+            lastFrameTime = now;
+
+            profiler.addTime("update", frameGraph.getMilliseconds(updateTask));
+            profiler.addTime("animate", frameGraph.getMilliseconds(animateTask));
+            profiler.addTime("cull", frameGraph.getMilliseconds(cullTask));
+            profiler.addTime("draw list", frameGraph.getMilliseconds(drawListTask));
+            profiler.addCount("visible", cullStats.visible);
+            profiler.addCount("culled", cullStats.culled);
+            if (currentPacket.sequence != 0) {
+                profiler.addTime("input age", std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - currentPacket.sampledAt).count());
+            }
+
+            // Allocations in the hot path: the frame graph's tasks on the workers, and
+            // recording and submission here. Waiting above may have run tasks on this
+            // thread, so its own count starts only now.
+            HostAllocations taskAllocations;
+            for (TaskGraph::Task task : {updateTask, animateTask, cullTask, drawListTask}) {
+                HostAllocations made = frameGraph.getHostAllocations(task);
+                taskAllocations.count += made.count;
+                taskAllocations.bytes += made.bytes;
+            }
+            const HostAllocations recordStart = getThreadHostAllocations();
+
+            trianglesSubmitted = 0;
+            trianglesFullDetail = 0;
+            recordCommandBuffer(imageIndex);
+            // From the last time this frame's slot was recorded
+            renderGraphMs = 0.0;
+            for (const auto& timing : gpuTimer.getTimings()) {
+                profiler.addTime(timing.name, timing.milliseconds);
+                if (timing.name == RENDER_GRAPH_SCOPE) {
+                    renderGraphMs = timing.milliseconds;
+                }
+                if (timing.name == GpuSkinning::TIMER_SCOPE && timing.milliseconds > 0.0) {
+                    profiler.addCount(
+                        "skinned verts/ms",
+                        static_cast<uint64_t>(skinning->getSkinnedVertexCount() / timing.milliseconds));
+                }
+            }
+            profiler.addCount("triangles", trianglesSubmitted);
+            profiler.addCount("without LOD", trianglesFullDetail);
+            auto streamStats = streamer.getStats();
+            profiler.addCount("stream queue", streamStats.queueDepth());
+            profiler.addCount("streamed KB", streamStats.bytesLastFrame / 1024);
 
             result = swapChain.submitCommandBuffers(&commandBuffers[imageIndex], &imageIndex);
             if (result != VK_SUCCESS) {
                 throw std::runtime_error("failed to present swap chain image!");
             }
-            
+            const HostAllocations recordAllocations = getThreadHostAllocations() - recordStart;
+            profiler.addCount("task allocs", taskAllocations.count);
+            profiler.addCount("record allocs", recordAllocations.count);
+            profiler.addCount("alloc KB", (taskAllocations.bytes + recordAllocations.bytes) / 1024);
+            if (frameNumber == 0) {
+                std::cout << std::fixed << std::setprecision(1) << "First frame submitted "
+                          << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launchTime).count()
+                          << " ms after launch" << std::endl;
+                std::cout.unsetf(std::ios::floatfield);
+            }
+            frameNumber++;
+            profiler.endFrame();
         };
 
+        // First member, so it's taken before the window and device are created
+        std::chrono::steady_clock::time_point launchTime = std::chrono::steady_clock::now();
         VWindow window{WIDTH, HEIGHT, "Hello Vulkan!"};
         Device device{window};
         SwapChain swapChain{device, window.getExtent()};
+        RenderGraph renderGraph{device, SwapChain::MAX_FRAMES_IN_FLIGHT};
+        RGResource backbuffer;
+        RGResource depth;
+        // Only with MSAA
+        RGResource colorSamples;
+        RGPass mainPass;
+        PipelineCache pipelineCache{device, "pipeline_cache.bin"};
+        PipelineLayoutCache layoutCache{device};
+        ComputeContext computeContext{device};
+        GpuTimer gpuTimer{device, SwapChain::MAX_FRAMES_IN_FLIGHT};
+        double renderGraphMs = 0.0;
+        std::unique_ptr<ParticleSystem> particles;
+        std::chrono::steady_clock::time_point lastFrameTime;
+        float particleStepSeconds = 0.0f;
+        std::unique_ptr<GpuSkinning> skinning;
+        std::unique_ptr<FrameReadback> readback;
+        std::unique_ptr<CaptureEncoder> captureEncoder;
+        // Empty unless a memory report is written at exit
+        std::string memoryReportPath;
+        // Empty unless frames are dumped
+        std::string dumpDirectory;
+        uint32_t dumpInterval = 1;
+        uint64_t goldenFrameNumber = std::numeric_limits<uint64_t>::max();
+        std::optional<Image> goldenImage;
+        // Simulation time per step instead of the wall clock, when positive
+        double fixedStepSeconds = 0.0;
         std::unique_ptr<Pipeline> pipeline;
         VkPipelineLayout pipelineLayout;
         std::vector<VkCommandBuffer> commandBuffers;
-        std::unique_ptr<VModel> model;
+        // Declared before the models, which give their ranges back on destruction
+        GeometryPool geometryPool{device, sizeof(VModel::Vertex), GEOMETRY_POOL_VERTICES, GEOMETRY_POOL_INDICES};
+        AssetStreamer streamer{device, geometryPool, SwapChain::MAX_FRAMES_IN_FLIGHT, STREAM_BYTES_PER_FRAME};
+        // indexed by the mesh id in the scene's renderables; null until streamed in
+        std::vector<std::unique_ptr<VModel>> models;
+        std::vector<float> streamingDepths;
+        Scene scene;
+        EntityId sceneRoot;
+        Bvh bvh;
+        Frustum frustum;
+        Bvh::CullStats cullStats;
+        std::vector<EntityId> visibleEntities;
+        std::vector<DrawItem> drawList;
+
+        struct AnimationScratch {
+            Pose sway;
+            Pose curl;
+            Pose blended;
+        };
+        Skeleton skeleton;
+        AnimationClip swayClip;
+        AnimationClip curlClip;
+        // One per animate job, so jobs don't share poses
+        std::vector<AnimationScratch> animationScratch;
+        // Every character's joints, at GpuSkinning::getFirstJoint()
+        std::vector<glm::mat4> characterPalette;
+        uint64_t trianglesSubmitted = 0;
+        uint64_t trianglesFullDetail = 0;
+        std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+        struct RetiredPipeline {
+            std::unique_ptr<Pipeline> pipeline;
+            uint64_t retiredAt;
+        };
+        std::unique_ptr<ShaderWatcher> shaderWatcher;
+        std::vector<RetiredPipeline> retiredPipelines;
+        uint64_t frameNumber = 0;
+        FrameProfiler profiler{std::cout};
+        ImageWriter imageWriter;
+
+        FramePacer pacer;
+        VkSampleCountFlagBits sampleCount;
+        TripleBuffer<FramePacket> framePackets;
+        FramePacket currentPacket;
+        uint64_t simulationSteps = 0;
+        std::atomic<bool> renderRunning{false};
+        std::exception_ptr renderError;
+
+        JobSystem jobSystem;
+        TaskGraph frameGraph;
+        TaskGraph::Task updateTask;
+        TaskGraph::Task animateTask;
+        TaskGraph::Task cullTask;
+        TaskGraph::Task drawListTask;
 };
\ No newline at end of file
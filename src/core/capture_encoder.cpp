@@ -0,0 +1,177 @@
+#include "capture_encoder.hpp"
+
+// std
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// How long the encoder sleeps when there's nothing to encode
+constexpr std::chrono::milliseconds IDLE_WAIT{1};
+
+bool endsWith(const std::string &text, const std::string &suffix) {
+  return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// BT.601 in video range, from 8-bit sRGB-encoded values as they are
+uint8_t lumaOf(int r, int g, int b) { return static_cast<uint8_t>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8)); }
+uint8_t blueDifferenceOf(int r, int g, int b) {
+  return static_cast<uint8_t>(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+}
+uint8_t redDifferenceOf(int r, int g, int b) {
+  return static_cast<uint8_t>(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+}
+
+}  // namespace
+
+CaptureEncoder::CaptureEncoder(
+    const std::string &path, uint32_t width, uint32_t height, uint32_t framesPerSecond, size_t queueCapacity)
+    : path{path},
+      width{width},
+      height{height},
+      y4m{endsWith(path, ".y4m")},
+      queue{queueCapacity},
+      returned{queueCapacity},
+      startTime{std::chrono::steady_clock::now()} {
+  if (y4m) {
+    stream.open(path, std::ios::binary);
+    if (!stream) {
+      throw std::runtime_error("failed to open " + path + " for capture");
+    }
+    // Chroma sited at the centre of each 2x2 block, as JPEG and most encoders expect
+    // Video range, which is what the coefficients below produce
+    stream << "YUV4MPEG2 W" << width << " H" << height << " F" << framesPerSecond
+           << ":1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n";
+    const size_t chromaSize = size_t{(width + 1) / 2} * ((height + 1) / 2);
+    planes.resize(size_t{width} * height + 2 * chromaSize);
+  } else {
+    std::filesystem::create_directories(path);
+  }
+  thread = std::thread{[this] { encoderMain(); }};
+}
+
+CaptureEncoder::~CaptureEncoder() { finish(); }
+
+void CaptureEncoder::finish() {
+  if (!thread.joinable()) {
+    return;
+  }
+  stopping.store(true, std::memory_order_release);
+  thread.join();
+  finishTime = std::chrono::steady_clock::now();
+}
+
+bool CaptureEncoder::submit(const Frame &frame) {
+  Frame queued = frame;
+  if (!thread.joinable() || !queue.tryPush(std::move(queued))) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+CaptureEncoder::Stats CaptureEncoder::getStats() const {
+  Stats stats;
+  stats.encoded = encoded.load(std::memory_order_relaxed);
+  stats.dropped = dropped.load(std::memory_order_relaxed);
+  stats.bytesWritten = bytesWritten.load(std::memory_order_relaxed);
+  const auto end = thread.joinable() ? std::chrono::steady_clock::now() : finishTime;
+  stats.seconds = std::chrono::duration<double>(end - startTime).count();
+  return stats;
+}
+
+void CaptureEncoder::encoderMain() {
+  Image image{width, height, {}};
+  Frame frame;
+  while (true) {
+    // Checked before popping, so frames pushed before the stop are still encoded
+    bool stop = stopping.load(std::memory_order_acquire);
+    if (!queue.tryPop(frame)) {
+      if (stop) {
+        break;
+      }
+      std::this_thread::sleep_for(IDLE_WAIT);
+      continue;
+    }
+    takeFrame(frame, image);
+    try {
+      if (y4m) {
+        writeY4mFrame(image);
+      } else {
+        writePngFrame(image);
+      }
+      encoded.fetch_add(1, std::memory_order_relaxed);
+    } catch (const std::exception &e) {
+      std::cerr << "Capture: " << e.what() << std::endl;
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if (y4m) {
+    stream.flush();
+  }
+}
+
+void CaptureEncoder::takeFrame(const Frame &frame, Image &image) {
+  // One sequential pass over the borrowed pixels, which may be uncached; the
+  // conversion then reads the cached copy
+  image.rgba.assign(frame.pixels, frame.pixels + size_t{4} * width * height);
+  uint32_t token = frame.token;
+  // Never full while the producer keeps to queueCapacity frames out
+  while (!returned.tryPush(std::move(token))) {
+    std::this_thread::sleep_for(IDLE_WAIT);
+  }
+  if (frame.bgra) {
+    for (size_t i = 0; i < image.rgba.size(); i += 4) {
+      std::swap(image.rgba[i], image.rgba[i + 2]);
+    }
+  }
+}
+
+void CaptureEncoder::writeY4mFrame(const Image &image) {
+  const uint32_t chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+  uint8_t *luma = planes.data();
+  uint8_t *blue = luma + size_t{width} * height;
+  uint8_t *red = blue + size_t{chromaWidth} * chromaHeight;
+  const uint8_t *rgba = image.rgba.data();
+
+  for (size_t i = 0; i < size_t{width} * height; i++) {
+    luma[i] = lumaOf(rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2]);
+  }
+  // Chroma of the average of each 2x2 block; odd edges repeat their last pixel
+  for (uint32_t cy = 0; cy < chromaHeight; cy++) {
+    for (uint32_t cx = 0; cx < chromaWidth; cx++) {
+      int r = 0, g = 0, b = 0;
+      for (uint32_t dy = 0; dy < 2; dy++) {
+        for (uint32_t dx = 0; dx < 2; dx++) {
+          const uint32_t x = std::min(2 * cx + dx, width - 1), y = std::min(2 * cy + dy, height - 1);
+          const uint8_t *pixel = rgba + 4 * (size_t{y} * width + x);
+          r += pixel[0];
+          g += pixel[1];
+          b += pixel[2];
+        }
+      }
+      const size_t index = size_t{cy} * chromaWidth + cx;
+      blue[index] = blueDifferenceOf(r / 4, g / 4, b / 4);
+      red[index] = redDifferenceOf(r / 4, g / 4, b / 4);
+    }
+  }
+
+  stream << "FRAME\n";
+  stream.write(reinterpret_cast<const char *>(planes.data()), static_cast<std::streamsize>(planes.size()));
+  if (!stream) {
+    throw std::runtime_error("failed to write to " + path);
+  }
+  bytesWritten.fetch_add(6 + planes.size(), std::memory_order_relaxed);
+}
+
+void CaptureEncoder::writePngFrame(const Image &image) {
+  std::ostringstream name;
+  name << "frame_" << std::setw(6) << std::setfill('0') << encoded.load(std::memory_order_relaxed) << ".png";
+  const std::filesystem::path file = std::filesystem::path(path) / name.str();
+  writePng(file.string(), image);
+  bytesWritten.fetch_add(std::filesystem::file_size(file), std::memory_order_relaxed);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "image_io.hpp"
+#include "spsc_queue.hpp"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+
+// Encodes a sequence of frames on a thread of its own, for capturing long
+// runs without external codecs. Frames arrive through a lock-free queue, so
+// submitting never waits; when the encoder falls behind and the queue is
+// full, the frame is dropped and counted.
+//
+// Frames are borrowed, not copied: the encoder reads the producer's pixels in
+// place, on its own thread, and hands each frame's token back through a
+// second lock-free queue once it's done with them. The producer thread does
+// no per-pixel work at all.
+//
+// A path ending in .y4m becomes a YUV4MPEG2 stream (4:2:0, BT.601 video
+// range) that ffmpeg and most players read directly; any other path is a
+// directory for a numbered PNG sequence.
+class CaptureEncoder {
+ public:
+  // width x height pixels, 8-bit RGBA or BGRA, which must stay valid and
+  // unchanged until token comes back from reclaim()
+  struct Frame {
+    const uint8_t *pixels = nullptr;
+    bool bgra = false;
+    uint32_t token = 0;
+  };
+
+  struct Stats {
+    uint64_t encoded = 0;
+    uint64_t dropped = 0;
+    uint64_t bytesWritten = 0;
+    // Since the encoder was created, until finish()
+    double seconds = 0.0;
+  };
+
+  // Every frame must be width x height; framesPerSecond goes into the Y4M
+  // header. At most queueCapacity frames may be out at once, submitted and
+  // not yet reclaimed.
+  CaptureEncoder(const std::string &path, uint32_t width, uint32_t height, uint32_t framesPerSecond, size_t queueCapacity);
+  // Encodes what's still queued, then stops
+  ~CaptureEncoder();
+
+  CaptureEncoder(const CaptureEncoder &) = delete;
+  CaptureEncoder &operator=(const CaptureEncoder &) = delete;
+
+  // Producer thread only. false if the frame was dropped, in which case it
+  // stays with the caller and isn't reclaimed.
+  bool submit(const Frame &frame);
+  // Producer thread only. The token of a frame the encoder no longer reads,
+  // encoded or not; false when there's none.
+  bool reclaim(uint32_t &token) { return returned.tryPop(token); }
+  // Encodes what's still queued and stops; later frames are dropped. Every
+  // submitted frame can be reclaimed afterwards.
+  void finish();
+  Stats getStats() const;
+  const std::string &getPath() const { return path; }
+
+ private:
+  void encoderMain();
+  // Copies the borrowed pixels to image as RGBA and gives the frame back
+  void takeFrame(const Frame &frame, Image &image);
+  void writeY4mFrame(const Image &image);
+  void writePngFrame(const Image &image);
+
+  std::string path;
+  uint32_t width;
+  uint32_t height;
+  bool y4m;
+  std::ofstream stream;
+  // Y, Cb and Cr planes of a Y4M frame, reused
+  std::vector<uint8_t> planes;
+  SpscQueue<Frame> queue;
+  // Tokens on their way back to the producer
+  SpscQueue<uint32_t> returned;
+  std::chrono::steady_clock::time_point startTime;
+  // Set by finish(), once the thread has stopped
+  std::chrono::steady_clock::time_point finishTime;
+  std::atomic<uint64_t> encoded{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> bytesWritten{0};
+  std::atomic<bool> stopping{false};
+  std::thread thread;
+};
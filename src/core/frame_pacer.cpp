@@ -0,0 +1,57 @@
+#include "frame_pacer.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+FramePacer::FramePacer(Clock::duration targetFrameTime) : targetFrameTime{targetFrameTime} {}
+
+void FramePacer::waitForNextFrame() {
+  Clock::time_point now = Clock::now();
+  if (targetFrameTime > Clock::duration::zero()) {
+    if (deadline == Clock::time_point{}) {
+      deadline = now;
+    } else if (now > deadline + targetFrameTime) {
+      // overran by more than a whole frame: start now and schedule from here
+      missed++;
+      deadline = now;
+    }
+
+    if (deadline - now > SPIN_MARGIN) {
+      std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+    }
+    while ((now = Clock::now()) < deadline) {
+      std::this_thread::yield();
+    }
+    deadline += targetFrameTime;
+  }
+
+  if (lastStart != Clock::time_point{}) {
+    double interval = std::chrono::duration<double, std::milli>(now - lastStart).count();
+    frames++;
+    sum += interval;
+    sumOfSquares += interval * interval;
+    max = std::max(max, interval);
+  }
+  lastStart = now;
+}
+
+FramePacer::Stats FramePacer::takeStats() {
+  Stats stats;
+  stats.frames = frames;
+  stats.missed = missed;
+  if (frames > 0) {
+    stats.meanMilliseconds = sum / frames;
+    double variance = sumOfSquares / frames - stats.meanMilliseconds * stats.meanMilliseconds;
+    stats.jitterMilliseconds = std::sqrt(std::max(0.0, variance));
+    stats.maxMilliseconds = max;
+  }
+
+  frames = 0;
+  missed = 0;
+  sum = 0.0;
+  sumOfSquares = 0.0;
+  max = 0.0;
+  return stats;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// std
+#include <chrono>
+#include <cstdint>
+
+// Starts frames on a fixed schedule. Deadlines advance by the target frame
+// time from the previous one rather than from when the wait returned, so
+// sleep overshoot doesn't accumulate; a frame that overruns resets the
+// schedule instead of firing a burst of frames to catch up.
+class FramePacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Stats {
+    uint32_t frames = 0;
+    double meanMilliseconds = 0.0;
+    // standard deviation of the time between frame starts
+    double jitterMilliseconds = 0.0;
+    double maxMilliseconds = 0.0;
+    // frames that started late because the previous one overran
+    uint32_t missed = 0;
+  };
+
+  // A target of zero doesn't wait and only measures.
+  explicit FramePacer(Clock::duration targetFrameTime);
+
+  void setTargetFrameTime(Clock::duration target) { targetFrameTime = target; }
+  Clock::duration getTargetFrameTime() const { return targetFrameTime; }
+
+  // Blocks until the next frame is due: sleeps for most of the wait and spins
+  // through the last SPIN_MARGIN, since sleeps can overshoot by a scheduler
+  // tick.
+  void waitForNextFrame();
+  // Over the frames since the previous call.
+  Stats takeStats();
+
+ private:
+  static constexpr auto SPIN_MARGIN = std::chrono::microseconds(1000);
+
+  Clock::duration targetFrameTime;
+  Clock::time_point deadline{};
+  Clock::time_point lastStart{};
+
+  uint32_t frames = 0;
+  uint32_t missed = 0;
+  double sum = 0.0;
+  double sumOfSquares = 0.0;
+  double max = 0.0;
+};
@@ -0,0 +1,65 @@
+#include "frame_profiler.hpp"
+
+// std
+#include <cstring>
+#include <iomanip>
+
+FrameProfiler::FrameProfiler(std::ostream &out, double reportIntervalSeconds)
+    : out{out},
+      reportInterval{std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(reportIntervalSeconds))},
+      intervalStart{Clock::now()},
+      frameStart{intervalStart} {}
+
+void FrameProfiler::endFrame() {
+  Clock::time_point now = Clock::now();
+  frameTimeTotal += std::chrono::duration<double, std::milli>(now - frameStart).count();
+  frameStart = now;
+  frames++;
+
+  if (now - intervalStart >= reportInterval) {
+    report();
+    intervalStart = now;
+    frameTimeTotal = 0.0;
+    frames = 0;
+    for (auto &e : entries) {
+      e.total = 0.0;
+    }
+  }
+}
+
+void FrameProfiler::addTime(const char *name, double milliseconds) { entry(name, true).total += milliseconds; }
+
+void FrameProfiler::addCount(const char *name, uint64_t count) {
+  entry(name, false).total += static_cast<double>(count);
+}
+
+FrameProfiler::Entry &FrameProfiler::entry(const char *name, bool isTime) {
+  for (auto &e : entries) {
+    if (std::strcmp(e.name.c_str(), name) == 0) {
+      return e;
+    }
+  }
+  entries.push_back({name, isTime});
+  return entries.back();
+}
+
+void FrameProfiler::report() {
+  if (frames == 0) {
+    return;
+  }
+  out << std::fixed << std::setprecision(2) << "frame " << frameTimeTotal / frames << " ms";
+  for (const auto &e : entries) {
+    out << " | " << e.name << " ";
+    if (e.isTime) {
+      out << std::setprecision(3) << e.total / frames << " ms";
+    } else {
+      out << std::setprecision(0) << e.total / frames;
+    }
+  }
+  out << std::endl;
+
+  if (reportHook) {
+    reportHook(out);
+  }
+}
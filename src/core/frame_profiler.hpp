@@ -0,0 +1,67 @@
+#pragma once
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Per-frame timings and counters, averaged over an interval and printed as a
+// single line, e.g.
+//   frame 16.67 ms | cull 0.25 ms | visible 12 | culled 0
+// Entries keep the order they were first recorded in.
+class FrameProfiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Times the enclosing scope.
+  class Scope {
+   public:
+    Scope(FrameProfiler &profiler, const char *name)
+        : profiler{profiler}, name{name}, start{Clock::now()} {}
+    ~Scope() {
+      profiler.addTime(name, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    FrameProfiler &profiler;
+    const char *name;
+    Clock::time_point start;
+  };
+
+  explicit FrameProfiler(std::ostream &out, double reportIntervalSeconds = 1.0);
+
+  // Closes the current frame; prints and resets once the interval has passed.
+  void endFrame();
+
+  void addTime(const char *name, double milliseconds);
+  void addCount(const char *name, uint64_t count);
+  Scope scope(const char *name) { return Scope{*this, name}; }
+
+  // Called after each report line, for statistics that aren't per frame.
+  void setReportHook(std::function<void(std::ostream &)> hook) { reportHook = std::move(hook); }
+
+ private:
+  struct Entry {
+    std::string name;
+    bool isTime;
+    double total = 0.0;
+  };
+
+  Entry &entry(const char *name, bool isTime);
+  void report();
+
+  std::ostream &out;
+  Clock::duration reportInterval;
+  Clock::time_point intervalStart;
+  Clock::time_point frameStart;
+  double frameTimeTotal = 0.0;
+  uint32_t frames = 0;
+  std::vector<Entry> entries;
+  std::function<void(std::ostream &)> reportHook;
+};
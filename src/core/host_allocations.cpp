@@ -0,0 +1,78 @@
+#include "host_allocations.hpp"
+
+// std
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Constant-initialized, so it's safe to touch from operator new on any thread
+thread_local HostAllocations threadAllocations;
+
+void *allocate(std::size_t size) noexcept {
+  threadAllocations.count++;
+  threadAllocations.bytes += size;
+  // malloc(0) may return null, which would read as failure
+  return std::malloc(std::max<std::size_t>(size, 1));
+}
+
+void *allocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+  threadAllocations.count++;
+  threadAllocations.bytes += size;
+  void *pointer = nullptr;
+  // posix_memalign wants at least pointer alignment
+  std::size_t bytes = std::max<std::size_t>(static_cast<std::size_t>(alignment), sizeof(void *));
+  if (posix_memalign(&pointer, bytes, std::max<std::size_t>(size, 1)) != 0) {
+    return nullptr;
+  }
+  return pointer;
+}
+
+template <typename Allocate, typename... Args>
+void *allocateOrThrow(Allocate allocateFunction, Args... args) {
+  while (true) {
+    if (void *pointer = allocateFunction(args...)) {
+      return pointer;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+}  // namespace
+
+HostAllocations getThreadHostAllocations() { return threadAllocations; }
+
+void *operator new(std::size_t size) { return allocateOrThrow(allocate, size); }
+void *operator new[](std::size_t size) { return allocateOrThrow(allocate, size); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(allocateAligned, size, alignment);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(allocateAligned, size, alignment);
+}
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return allocateAligned(size, alignment);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return allocateAligned(size, alignment);
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { std::free(pointer); }
@@ -0,0 +1,19 @@
+#pragma once
+
+// std
+#include <cstdint>
+
+// Heap allocations through operator new, counted per thread by the replacement
+// operators in host_allocations.cpp: a thread-local increment each, cheap
+// enough to leave on. Direct malloc() calls, e.g. from drivers, aren't seen.
+struct HostAllocations {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+
+  HostAllocations operator-(const HostAllocations &earlier) const {
+    return {count - earlier.count, bytes - earlier.bytes};
+  }
+};
+
+// Made on the calling thread since it started
+HostAllocations getThreadHostAllocations();
@@ -0,0 +1,246 @@
+#include "image_io.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+constexpr std::array<uint8_t, 8> PNG_SIGNATURE{0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+// Largest stored deflate block
+constexpr size_t MAX_STORED_BLOCK = 65535;
+
+uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> entries{};
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      entries[n] = c;
+    }
+    return entries;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint32_t adler32(const uint8_t *data, size_t size) {
+  constexpr uint32_t MOD = 65521;
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < size; i++) {
+    a = (a + data[i]) % MOD;
+    b = (b + a) % MOD;
+  }
+  return (b << 16) | a;
+}
+
+void putBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+uint32_t getBigEndian(const uint8_t *data) {
+  return (uint32_t{data[0]} << 24) | (uint32_t{data[1]} << 16) | (uint32_t{data[2]} << 8) | data[3];
+}
+
+void putChunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data) {
+  putBigEndian(out, static_cast<uint32_t>(data.size()));
+  size_t typeStart = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  putBigEndian(out, crc32(&out[typeStart], out.size() - typeStart));
+}
+
+void checkSize(const Image &image) {
+  if (image.width == 0 || image.height == 0 || image.rgba.size() != size_t{4} * image.width * image.height) {
+    throw std::invalid_argument("image has no pixels or the wrong number of them");
+  }
+}
+
+void writeFile(const std::string &path, const std::vector<uint8_t> &bytes) {
+  std::ofstream file{path, std::ios::binary};
+  file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  if (!file) {
+    throw std::runtime_error("failed to write " + path);
+  }
+}
+
+uint8_t paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+}  // namespace
+
+void writePng(const std::string &path, const Image &image) {
+  checkSize(image);
+  // Each row behind filter type 0 (none)
+  const size_t rowBytes = size_t{4} * image.width;
+  std::vector<uint8_t> scanlines;
+  scanlines.reserve((rowBytes + 1) * image.height);
+  for (uint32_t y = 0; y < image.height; y++) {
+    scanlines.push_back(0);
+    auto row = image.rgba.begin() + rowBytes * y;
+    scanlines.insert(scanlines.end(), row, row + rowBytes);
+  }
+
+  // zlib stream of stored blocks
+  std::vector<uint8_t> zlib{0x78, 0x01};
+  zlib.reserve(scanlines.size() + scanlines.size() / MAX_STORED_BLOCK * 5 + 16);
+  for (size_t offset = 0; offset < scanlines.size(); offset += MAX_STORED_BLOCK) {
+    const size_t length = std::min(MAX_STORED_BLOCK, scanlines.size() - offset);
+    const bool last = offset + length == scanlines.size();
+    zlib.push_back(last ? 1 : 0);
+    zlib.push_back(static_cast<uint8_t>(length));
+    zlib.push_back(static_cast<uint8_t>(length >> 8));
+    zlib.push_back(static_cast<uint8_t>(~length));
+    zlib.push_back(static_cast<uint8_t>(~length >> 8));
+    zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + length);
+  }
+  putBigEndian(zlib, adler32(scanlines.data(), scanlines.size()));
+
+  std::vector<uint8_t> header;
+  putBigEndian(header, image.width);
+  putBigEndian(header, image.height);
+  // 8 bits per channel, RGBA, deflate, adaptive filtering, not interlaced
+  header.insert(header.end(), {8, 6, 0, 0, 0});
+
+  std::vector<uint8_t> file(PNG_SIGNATURE.begin(), PNG_SIGNATURE.end());
+  putChunk(file, "IHDR", header);
+  putChunk(file, "IDAT", zlib);
+  putChunk(file, "IEND", {});
+  writeFile(path, file);
+}
+
+Image readPng(const std::string &path) {
+  std::ifstream stream{path, std::ios::binary};
+  if (!stream) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  std::vector<uint8_t> file{std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+  if (file.size() < PNG_SIGNATURE.size() || !std::equal(PNG_SIGNATURE.begin(), PNG_SIGNATURE.end(), file.begin())) {
+    throw std::runtime_error(path + " is not a PNG");
+  }
+
+  Image image;
+  std::vector<uint8_t> zlib;
+  for (size_t offset = PNG_SIGNATURE.size(); offset + 12 <= file.size();) {
+    const uint32_t length = getBigEndian(&file[offset]);
+    if (offset + 12 + length > file.size()) {
+      throw std::runtime_error(path + " is truncated");
+    }
+    const std::string type(reinterpret_cast<const char *>(&file[offset + 4]), 4);
+    const uint8_t *data = &file[offset + 8];
+    if (type == "IHDR") {
+      if (length != 13 || data[8] != 8 || data[9] != 6 || data[12] != 0) {
+        throw std::runtime_error(path + " is not an 8-bit RGBA PNG without interlacing");
+      }
+      image.width = getBigEndian(data);
+      image.height = getBigEndian(data + 4);
+    } else if (type == "IDAT") {
+      zlib.insert(zlib.end(), data, data + length);
+    } else if (type == "IEND") {
+      break;
+    }
+    offset += 12 + length;
+  }
+
+  const size_t rowBytes = size_t{4} * image.width;
+  std::vector<uint8_t> scanlines;
+  scanlines.reserve((rowBytes + 1) * image.height);
+  size_t position = 2;
+  bool last = false;
+  while (!last) {
+    if (position + 5 > zlib.size()) {
+      throw std::runtime_error(path + " has a truncated image stream");
+    }
+    last = zlib[position] & 1;
+    if ((zlib[position] >> 1) & 3) {
+      throw std::runtime_error(path + " is compressed; only stored PNGs like writePng()'s can be read");
+    }
+    const size_t length = zlib[position + 1] | size_t{zlib[position + 2]} << 8;
+    position += 5;
+    if (position + length > zlib.size()) {
+      throw std::runtime_error(path + " has a truncated image stream");
+    }
+    scanlines.insert(scanlines.end(), zlib.begin() + position, zlib.begin() + position + length);
+    position += length;
+  }
+  if (image.width == 0 || scanlines.size() != (rowBytes + 1) * image.height) {
+    throw std::runtime_error(path + " has the wrong amount of pixel data");
+  }
+
+  // Undo the per-row filters, against the row above
+  image.rgba.resize(rowBytes * image.height);
+  for (uint32_t y = 0; y < image.height; y++) {
+    const uint8_t filter = scanlines[(rowBytes + 1) * y];
+    const uint8_t *in = &scanlines[(rowBytes + 1) * y + 1];
+    uint8_t *out = &image.rgba[rowBytes * y];
+    const uint8_t *above = y > 0 ? out - rowBytes : nullptr;
+    for (size_t x = 0; x < rowBytes; x++) {
+      const int a = x >= 4 ? out[x - 4] : 0;
+      const int b = above ? above[x] : 0;
+      const int c = above && x >= 4 ? above[x - 4] : 0;
+      switch (filter) {
+        case 0: out[x] = in[x]; break;
+        case 1: out[x] = static_cast<uint8_t>(in[x] + a); break;
+        case 2: out[x] = static_cast<uint8_t>(in[x] + b); break;
+        case 3: out[x] = static_cast<uint8_t>(in[x] + (a + b) / 2); break;
+        case 4: out[x] = static_cast<uint8_t>(in[x] + paeth(a, b, c)); break;
+        default: throw std::runtime_error(path + " uses an unknown row filter");
+      }
+    }
+  }
+  return image;
+}
+
+void writePpm(const std::string &path, const Image &image) {
+  checkSize(image);
+  const std::string header = "P6\n" + std::to_string(image.width) + " " + std::to_string(image.height) + "\n255\n";
+  std::vector<uint8_t> file(header.begin(), header.end());
+  file.reserve(header.size() + size_t{3} * image.width * image.height);
+  for (size_t i = 0; i < image.rgba.size(); i += 4) {
+    file.insert(file.end(), &image.rgba[i], &image.rgba[i] + 3);
+  }
+  writeFile(path, file);
+}
+
+ImageDifference compareImages(const Image &a, const Image &b, uint32_t tolerance) {
+  if (a.width != b.width || a.height != b.height) {
+    throw std::invalid_argument("compared images differ in size");
+  }
+  ImageDifference difference;
+  for (size_t i = 0; i < a.rgba.size(); i += 4) {
+    uint32_t pixelDifference = 0;
+    for (size_t channel = i; channel < i + 4; channel++) {
+      pixelDifference = std::max<uint32_t>(pixelDifference, std::abs(a.rgba[channel] - b.rgba[channel]));
+    }
+    difference.maxChannelDifference = std::max(difference.maxChannelDifference, pixelDifference);
+    difference.differingPixels += pixelDifference > tolerance;
+  }
+  return difference;
+}
+
+Image differenceImage(const Image &a, const Image &b) {
+  if (a.width != b.width || a.height != b.height) {
+    throw std::invalid_argument("compared images differ in size");
+  }
+  Image difference{a.width, a.height, std::vector<uint8_t>(a.rgba.size())};
+  for (size_t i = 0; i < a.rgba.size(); i++) {
+    // Opaque, so the result is visible in any viewer
+    difference.rgba[i] = i % 4 == 3 ? 255 : static_cast<uint8_t>(std::min(255, 8 * std::abs(a.rgba[i] - b.rgba[i])));
+  }
+  return difference;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 8-bit RGBA pixels, rows top to bottom without padding.
+struct Image {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<uint8_t> rgba;
+};
+
+// Writes a PNG without compression: the pixels go into stored deflate blocks,
+// so no zlib is needed and writing costs little more than the copy. Throws on
+// I/O errors.
+void writePng(const std::string &path, const Image &image);
+// Reads 8-bit RGBA PNGs whose deflate blocks are stored, i.e. those written
+// by writePng(). Throws on anything else.
+Image readPng(const std::string &path);
+// Binary PPM (P6): the raw RGB bytes behind a short header; alpha is dropped.
+void writePpm(const std::string &path, const Image &image);
+
+struct ImageDifference {
+  // Largest difference of any channel, 0-255
+  uint32_t maxChannelDifference = 0;
+  // Pixels with a channel more than tolerance apart
+  uint64_t differingPixels = 0;
+};
+
+// Both images must have the same size.
+ImageDifference compareImages(const Image &a, const Image &b, uint32_t tolerance);
+// Per pixel, the channel differences scaled by 8 so small ones show up.
+Image differenceImage(const Image &a, const Image &b);
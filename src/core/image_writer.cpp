@@ -0,0 +1,73 @@
+#include "image_writer.hpp"
+
+// std
+#include <exception>
+#include <iostream>
+
+ImageWriter::ImageWriter(size_t maxQueued) : maxQueued{maxQueued}, thread{[this] { writerMain(); }} {}
+
+ImageWriter::~ImageWriter() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  queued.notify_one();
+  thread.join();
+}
+
+bool ImageWriter::write(std::string path, Image image) {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (requests.size() >= maxQueued) {
+      stats.dropped++;
+      return false;
+    }
+    requests.push_back({std::move(path), std::move(image)});
+  }
+  queued.notify_one();
+  return true;
+}
+
+void ImageWriter::flush() {
+  std::unique_lock<std::mutex> lock{mutex};
+  drained.wait(lock, [this] { return requests.empty() && !busy; });
+}
+
+ImageWriter::Stats ImageWriter::getStats() {
+  std::lock_guard<std::mutex> lock{mutex};
+  return stats;
+}
+
+void ImageWriter::writerMain() {
+  std::unique_lock<std::mutex> lock{mutex};
+  while (true) {
+    queued.wait(lock, [this] { return stopping || !requests.empty(); });
+    if (requests.empty()) {
+      return;  // stopping, and everything is written
+    }
+    Request request = std::move(requests.front());
+    requests.pop_front();
+    busy = true;
+    lock.unlock();
+
+    bool written = true;
+    try {
+      const std::string &path = request.path;
+      if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".ppm") == 0) {
+        writePpm(path, request.image);
+      } else {
+        writePng(path, request.image);
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "Image writer: " << e.what() << std::endl;
+      written = false;
+    }
+
+    lock.lock();
+    busy = false;
+    (written ? stats.written : stats.failed)++;
+    if (requests.empty()) {
+      drained.notify_all();
+    }
+  }
+}
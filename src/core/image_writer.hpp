@@ -0,0 +1,56 @@
+#pragma once
+
+#include "image_io.hpp"
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Writes images to disk on a thread of its own, so encoding and I/O never
+// hold up the caller. The format follows the extension: .png, or .ppm for
+// raw pixels. When maxQueued images are already waiting, write() drops the
+// image instead of blocking.
+class ImageWriter {
+ public:
+  struct Stats {
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    uint64_t failed = 0;
+  };
+
+  explicit ImageWriter(size_t maxQueued = 8);
+  // Writes whatever is still queued first
+  ~ImageWriter();
+
+  ImageWriter(const ImageWriter &) = delete;
+  ImageWriter &operator=(const ImageWriter &) = delete;
+
+  // false if the image was dropped because the queue is full
+  bool write(std::string path, Image image);
+  // Blocks until everything queued so far is on disk
+  void flush();
+  Stats getStats();
+
+ private:
+  struct Request {
+    std::string path;
+    Image image;
+  };
+
+  void writerMain();
+
+  size_t maxQueued;
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::condition_variable drained;
+  std::deque<Request> requests;
+  // the request being written, not in requests anymore
+  bool busy = false;
+  bool stopping = false;
+  Stats stats;
+  std::thread thread;
+};
@@ -0,0 +1,283 @@
+#include "job_system.hpp"
+
+// std
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+namespace {
+
+// Which pool the current thread belongs to and its index in it
+thread_local const JobSystem *currentPool = nullptr;
+thread_local uint32_t currentIndex = 0;
+// Jobs run from inside a waiting job are already counted in its busy time
+thread_local uint32_t executeDepth = 0;
+
+// One logical CPU per physical core, in ascending order. Empty when the
+// topology isn't available.
+std::vector<int> physicalCoreCpus() {
+  std::vector<int> cpus;
+#if defined(__linux__)
+  std::set<std::string> seenCores;
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return cpus;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) {
+      continue;
+    }
+    // hyperthreads of one core list the same siblings
+    std::ifstream siblings{
+        "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list"};
+    std::string core;
+    if (!std::getline(siblings, core)) {
+      core = std::to_string(cpu);
+    }
+    if (seenCores.insert(core).second) {
+      cpus.push_back(cpu);
+    }
+  }
+#endif
+  return cpus;
+}
+
+uint32_t physicalCoreCount() {
+#if defined(__APPLE__)
+  int count = 0;
+  size_t size = sizeof(count);
+  if (sysctlbyname("hw.physicalcpu", &count, &size, nullptr, 0) == 0 && count > 0) {
+    return static_cast<uint32_t>(count);
+  }
+#else
+  auto cpus = physicalCoreCpus();
+  if (!cpus.empty()) {
+    return static_cast<uint32_t>(cpus.size());
+  }
+#endif
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void pinCurrentThread(int cpu) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  // macOS has no hard affinity; the scheduler keeps busy threads on P-cores
+  (void)cpu;
+#endif
+}
+
+}  // namespace
+
+uint32_t JobSystem::defaultWorkerCount() { return std::max(1u, physicalCoreCount() - 1); }
+
+JobSystem::JobSystem(uint32_t workerCount) : statsStart{std::chrono::steady_clock::now()} {
+  for (uint32_t i = 0; i <= workerCount; i++) {
+    threads.push_back(std::make_unique<ThreadState>());
+  }
+  currentPool = this;
+  currentIndex = 0;
+
+  // The creating thread usually runs on the first core; give each worker one of
+  // the others so they don't fight over a core's execution units
+  std::vector<int> cpus = physicalCoreCpus();
+  for (uint32_t i = 1; i <= workerCount; i++) {
+    int cpu = cpus.size() > 1 ? cpus[1 + (i - 1) % (cpus.size() - 1)] : -1;
+    workers.emplace_back([this, i, cpu] { workerMain(i, cpu); });
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock{sleepMutex};
+    running = false;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (currentPool == this) {
+    currentPool = nullptr;
+  }
+}
+
+uint32_t JobSystem::currentThreadIndex() const { return currentPool == this ? currentIndex : 0; }
+
+void JobSystem::submit(Job job, Counter *counter) {
+  if (counter) {
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+  ThreadState &thread = *threads[currentThreadIndex()];
+  {
+    std::lock_guard<std::mutex> lock{thread.mutex};
+    thread.deque.push_back({std::move(job), counter});
+  }
+
+  // Pairs with the sleeping worker bumping sleepingWorkers before it checks
+  // queuedJobs: at least one of the two sees the other's update
+  queuedJobs.fetch_add(1);
+  if (sleepingWorkers.load() > 0) {
+    std::lock_guard<std::mutex> lock{sleepMutex};
+    wake.notify_one();
+  }
+}
+
+void JobSystem::parallelFor(
+    uint32_t count, uint32_t grain, std::function<void(uint32_t)> body, Counter &counter) {
+  grain = std::max(1u, grain);
+  auto shared = std::make_shared<std::function<void(uint32_t)>>(std::move(body));
+  for (uint32_t begin = 0; begin < count; begin += grain) {
+    uint32_t end = std::min(count, begin + grain);
+    submit(
+        [shared, begin, end] {
+          for (uint32_t i = begin; i < end; i++) {
+            (*shared)(i);
+          }
+        },
+        &counter);
+  }
+}
+
+void JobSystem::wait(Counter &counter) {
+  uint32_t index = currentThreadIndex();
+  while (!counter.done()) {
+    if (!runOne(index)) {
+      // the remaining jobs are running elsewhere
+      std::this_thread::yield();
+    }
+  }
+
+  // Taken out, so the counter can be reused and each error is thrown once
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock{counter.errorMutex};
+    std::swap(error, counter.error);
+  }
+  if (!error) {
+    std::lock_guard<std::mutex> lock{errorMutex};
+    std::swap(error, uncountedError);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+std::vector<JobSystem::ThreadStats> JobSystem::takeStats() {
+  auto now = std::chrono::steady_clock::now();
+  double wallNanoseconds = std::chrono::duration<double, std::nano>(now - statsStart).count();
+  statsStart = now;
+
+  std::vector<ThreadStats> stats;
+  for (auto &thread : threads) {
+    double busy = static_cast<double>(thread->busyNanoseconds.exchange(0));
+    stats.push_back(
+        {wallNanoseconds > 0.0 ? std::min(1.0, busy / wallNanoseconds) : 0.0,
+         thread->jobs.exchange(0),
+         thread->steals.exchange(0)});
+  }
+  return stats;
+}
+
+void JobSystem::workerMain(uint32_t index, int cpu) {
+  currentPool = this;
+  currentIndex = index;
+  if (cpu >= 0) {
+    pinCurrentThread(cpu);
+  }
+
+  while (running) {
+    if (runOne(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock{sleepMutex};
+    sleepingWorkers.fetch_add(1);
+    wake.wait(lock, [this] { return queuedJobs.load() > 0 || !running; });
+    sleepingWorkers.fetch_sub(1);
+  }
+}
+
+bool JobSystem::runOne(uint32_t index) {
+  Task task;
+  if (pop(index, task)) {
+    execute(index, task);
+    return true;
+  }
+  if (steal(index, task)) {
+    threads[index]->steals.fetch_add(1, std::memory_order_relaxed);
+    execute(index, task);
+    return true;
+  }
+  return false;
+}
+
+bool JobSystem::pop(uint32_t index, Task &task) {
+  ThreadState &thread = *threads[index];
+  std::lock_guard<std::mutex> lock{thread.mutex};
+  if (thread.deque.empty()) {
+    return false;
+  }
+  // newest first: its data is most likely still in this core's cache
+  task = std::move(thread.deque.back());
+  thread.deque.pop_back();
+  queuedJobs.fetch_sub(1);
+  return true;
+}
+
+bool JobSystem::steal(uint32_t index, Task &task) {
+  uint32_t count = static_cast<uint32_t>(threads.size());
+  for (uint32_t offset = 1; offset < count; offset++) {
+    ThreadState &victim = *threads[(index + offset) % count];
+    std::unique_lock<std::mutex> lock{victim.mutex, std::try_to_lock};
+    if (!lock.owns_lock() || victim.deque.empty()) {
+      continue;
+    }
+    // oldest first: usually the biggest piece of work left
+    task = std::move(victim.deque.front());
+    victim.deque.pop_front();
+    queuedJobs.fetch_sub(1);
+    return true;
+  }
+  return false;
+}
+
+void JobSystem::execute(uint32_t index, Task &task) {
+  auto start = std::chrono::steady_clock::now();
+  executeDepth++;
+  try {
+    task.job();
+  } catch (...) {
+    // Kept for wait(): escaping here would terminate a worker, or leave the
+    // counter pending forever when run inline by wait()
+    std::mutex &mutex = task.counter ? task.counter->errorMutex : errorMutex;
+    std::exception_ptr &error = task.counter ? task.counter->error : uncountedError;
+    std::lock_guard<std::mutex> lock{mutex};
+    if (!error) {
+      error = std::current_exception();
+    }
+  }
+  executeDepth--;
+
+  ThreadState &thread = *threads[index];
+  if (executeDepth == 0) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    thread.busyNanoseconds.fetch_add(
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+        std::memory_order_relaxed);
+  }
+  thread.jobs.fetch_add(1, std::memory_order_relaxed);
+  if (task.counter) {
+    task.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
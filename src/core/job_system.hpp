@@ -0,0 +1,108 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every thread, including the one that created the
+// pool (thread 0), owns a deque: it pushes and pops its own jobs at the back
+// while idle threads steal the oldest jobs from the front of the others.
+// Workers are pinned to distinct physical cores where the OS allows it.
+//
+// Jobs report completion through a Counter. Waiting on a counter runs other
+// jobs instead of blocking, so jobs may wait on jobs they submitted. A job
+// that throws still counts as finished; the first exception of a counter's
+// jobs is rethrown by wait() once all of them are done.
+class JobSystem {
+ public:
+  using Job = std::function<void()>;
+
+  // Number of jobs submitted against it that haven't finished yet.
+  class Counter {
+   public:
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+   private:
+    friend class JobSystem;
+    std::atomic<uint32_t> pending{0};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+  };
+
+  struct ThreadStats {
+    double utilization;  // share of the wall time spent running jobs
+    uint64_t jobs;
+    uint64_t steals;
+  };
+
+  // workerCount threads besides the calling one; by default one per physical
+  // core the calling thread doesn't use.
+  explicit JobSystem(uint32_t workerCount = defaultWorkerCount());
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // Can be called from any thread, including from inside a job. Threads
+  // outside the pool share thread 0's deque.
+  void submit(Job job, Counter *counter = nullptr);
+  // body(i) for i in [0, count), grouped into jobs of up to grain iterations.
+  void parallelFor(uint32_t count, uint32_t grain, std::function<void(uint32_t)> body, Counter &counter);
+  // Runs jobs on the calling thread until the counter reaches zero, then
+  // rethrows the first exception a job of the counter threw, if any. Errors
+  // of jobs submitted without a counter are rethrown by the next wait().
+  void wait(Counter &counter);
+
+  uint32_t getThreadCount() const { return static_cast<uint32_t>(threads.size()); }
+  // Per thread (0 is the one that created the pool) since the previous call.
+  std::vector<ThreadStats> takeStats();
+
+  static uint32_t defaultWorkerCount();
+
+ private:
+  struct Task {
+    Job job;
+    Counter *counter;
+  };
+
+  // Padded so threads updating their own stats don't share cache lines
+  struct alignas(64) ThreadState {
+    std::mutex mutex;
+    std::deque<Task> deque;
+    std::atomic<uint64_t> busyNanoseconds{0};
+    std::atomic<uint64_t> jobs{0};
+    std::atomic<uint64_t> steals{0};
+  };
+
+  void workerMain(uint32_t index, int cpu);
+  bool runOne(uint32_t index);
+  bool pop(uint32_t index, Task &task);
+  bool steal(uint32_t index, Task &task);
+  void execute(uint32_t index, Task &task);
+  uint32_t currentThreadIndex() const;
+
+  std::vector<std::unique_ptr<ThreadState>> threads;
+  std::vector<std::thread> workers;
+  std::atomic<bool> running{true};
+
+  // idle workers sleep here until jobs are queued
+  std::atomic<uint32_t> queuedJobs{0};
+  std::atomic<uint32_t> sleepingWorkers{0};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+
+  std::chrono::steady_clock::time_point statsStart;
+
+  // first error of a job without a counter, not rethrown yet
+  std::mutex errorMutex;
+  std::exception_ptr uncountedError;
+};
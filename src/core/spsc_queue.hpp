@@ -0,0 +1,51 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded single-producer, single-consumer queue without locks. Neither side
+// ever waits: pushing into a full queue and popping from an empty one fail
+// instead, and the caller decides whether to drop, retry or sleep.
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity) : slots(capacity + 1) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  // Producer thread only. value is left untouched when the queue is full.
+  bool tryPush(T &&value) {
+    const size_t tail = this->tail.load(std::memory_order_relaxed);
+    const size_t next = (tail + 1) % slots.size();
+    if (next == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    slots[tail] = std::move(value);
+    this->tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread only.
+  bool tryPop(T &value) {
+    const size_t head = this->head.load(std::memory_order_relaxed);
+    if (head == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = std::move(slots[head]);
+    this->head.store((head + 1) % slots.size(), std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const { return slots.size() - 1; }
+
+ private:
+  // One slot always stays empty, so full and empty can be told apart
+  std::vector<T> slots;
+  // Each side writes its own cache line
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
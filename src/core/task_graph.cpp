@@ -0,0 +1,104 @@
+#include "task_graph.hpp"
+
+// std
+#include <stdexcept>
+
+TaskGraph::Task TaskGraph::add(
+    const std::string &name, std::function<void()> work, std::initializer_list<Task> dependencies) {
+  auto node = std::make_unique<Node>();
+  node->name = name;
+  node->work = [work = std::move(work)](uint32_t) { work(); };
+  return addNode(std::move(node), dependencies);
+}
+
+TaskGraph::Task TaskGraph::addParallel(
+    const std::string &name,
+    std::function<uint32_t()> count,
+    std::function<void(uint32_t)> work,
+    std::initializer_list<Task> dependencies) {
+  auto node = std::make_unique<Node>();
+  node->name = name;
+  node->count = std::move(count);
+  node->work = std::move(work);
+  return addNode(std::move(node), dependencies);
+}
+
+TaskGraph::Task TaskGraph::addNode(std::unique_ptr<Node> node, std::initializer_list<Task> dependencies) {
+  Task task = static_cast<Task>(nodes.size());
+  for (Task dependency : dependencies) {
+    if (dependency >= task) {
+      throw std::invalid_argument("task graph: dependency '" + node->name + "' isn't added yet");
+    }
+    nodes[dependency]->successors.push_back(task);
+  }
+  node->dependencyCount = static_cast<uint32_t>(dependencies.size());
+  nodes.push_back(std::move(node));
+  return task;
+}
+
+void TaskGraph::run(JobSystem &jobSystem, JobSystem::Counter &counter) {
+  this->jobSystem = &jobSystem;
+  this->counter = &counter;
+  for (auto &node : nodes) {
+    node->waitingOn.store(node->dependencyCount, std::memory_order_relaxed);
+  }
+  for (Task task = 0; task < nodes.size(); task++) {
+    if (nodes[task]->dependencyCount == 0) {
+      start(task);
+    }
+  }
+}
+
+void TaskGraph::start(Task task) {
+  Node &node = *nodes[task];
+  uint32_t jobs = node.count ? node.count() : 1;
+  node.start = std::chrono::steady_clock::now();
+  node.allocationCount.store(0, std::memory_order_relaxed);
+  node.allocationBytes.store(0, std::memory_order_relaxed);
+  if (jobs == 0) {
+    node.end = node.start;
+    node.jobsLeft.store(1, std::memory_order_relaxed);
+    finishJob(task);
+    return;
+  }
+
+  node.jobsLeft.store(jobs, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < jobs; i++) {
+    // Each job counts against the caller's counter until it has also started
+    // whatever it unblocked, so the counter can't hit zero in between
+    jobSystem->submit(
+        [this, task, i] {
+          Node &node = *nodes[task];
+          const HostAllocations before = getThreadHostAllocations();
+          node.work(i);
+          const HostAllocations made = getThreadHostAllocations() - before;
+          node.allocationCount.fetch_add(made.count, std::memory_order_relaxed);
+          node.allocationBytes.fetch_add(made.bytes, std::memory_order_relaxed);
+          finishJob(task);
+        },
+        counter);
+  }
+}
+
+void TaskGraph::finishJob(Task task) {
+  Node &node = *nodes[task];
+  if (node.jobsLeft.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  node.end = std::chrono::steady_clock::now();
+  for (Task successor : node.successors) {
+    if (nodes[successor]->waitingOn.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      start(successor);
+    }
+  }
+}
+
+double TaskGraph::getMilliseconds(Task task) const {
+  const Node &node = *nodes[task];
+  return std::chrono::duration<double, std::milli>(node.end - node.start).count();
+}
+
+HostAllocations TaskGraph::getHostAllocations(Task task) const {
+  const Node &node = *nodes[task];
+  return {node.allocationCount.load(std::memory_order_relaxed), node.allocationBytes.load(std::memory_order_relaxed)};
+}
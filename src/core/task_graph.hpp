@@ -0,0 +1,67 @@
+#pragma once
+
+#include "host_allocations.hpp"
+#include "job_system.hpp"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A fixed set of tasks with dependencies, built once and run every frame.
+// Dependencies are continuations: the job that finishes a task's last
+// predecessor submits the task, so no thread ever blocks waiting for one.
+class TaskGraph {
+ public:
+  using Task = uint32_t;
+
+  Task add(const std::string &name, std::function<void()> work, std::initializer_list<Task> dependencies = {});
+  // work(i) for every i in [0, count()) as separate jobs; count is asked each
+  // time the task starts, so it may change between runs.
+  Task addParallel(
+      const std::string &name,
+      std::function<uint32_t()> count,
+      std::function<void(uint32_t)> work,
+      std::initializer_list<Task> dependencies = {});
+
+  // Starts every task without dependencies; counter reaches zero once all
+  // tasks have finished. The graph must not be changed or run again until then.
+  void run(JobSystem &jobSystem, JobSystem::Counter &counter);
+
+  size_t size() const { return nodes.size(); }
+  const std::string &getName(Task task) const { return nodes[task]->name; }
+  // Wall time from the task's dependencies finishing to its last job
+  // finishing, in the last run.
+  double getMilliseconds(Task task) const;
+  // Made by the task's jobs in the last run, on whichever threads they ran
+  HostAllocations getHostAllocations(Task task) const;
+
+ private:
+  struct Node {
+    std::string name;
+    std::function<uint32_t()> count;  // empty for single-job tasks
+    std::function<void(uint32_t)> work;
+    std::vector<Task> successors;
+    uint32_t dependencyCount = 0;
+
+    std::atomic<uint32_t> waitingOn{0};
+    std::atomic<uint32_t> jobsLeft{0};
+    std::atomic<uint64_t> allocationCount{0};
+    std::atomic<uint64_t> allocationBytes{0};
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+  };
+
+  Task addNode(std::unique_ptr<Node> node, std::initializer_list<Task> dependencies);
+  void start(Task task);
+  void finishJob(Task task);
+
+  std::vector<std::unique_ptr<Node>> nodes;
+  JobSystem *jobSystem = nullptr;
+  JobSystem::Counter *counter = nullptr;
+};
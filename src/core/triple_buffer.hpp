@@ -0,0 +1,45 @@
+#pragma once
+
+// std
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Single-producer, single-consumer hand-off of the latest value without locks.
+// The writer fills its own slot and publishes it; the reader picks up the
+// newest published slot whenever it's ready. Neither side ever waits, and a
+// reader that falls behind simply skips values.
+template <typename T>
+class TripleBuffer {
+ public:
+  // Writer thread only.
+  T &writeSlot() { return slots[back].value; }
+  void publish() { back = state.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+  // Reader thread only. Switches to the newest published value, if there is
+  // one since the last call, and returns whether it did.
+  bool update() {
+    if ((state.load(std::memory_order_relaxed) & FRESH) == 0) {
+      return false;
+    }
+    front = state.exchange(front, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+  const T &read() const { return slots[front].value; }
+
+ private:
+  static constexpr uint8_t INDEX = 3;
+  static constexpr uint8_t FRESH = 4;
+
+  // Each side works on its own cache line
+  struct alignas(64) Slot {
+    T value{};
+  };
+
+  std::array<Slot, 3> slots;
+  // index of the slot between the two sides, plus FRESH if the writer has
+  // published into it since the reader last took it
+  std::atomic<uint8_t> state{1};
+  alignas(64) uint8_t back = 0;
+  alignas(64) uint8_t front = 2;
+};
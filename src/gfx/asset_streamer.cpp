@@ -0,0 +1,321 @@
+#include "asset_streamer.hpp"
+
+#include "mesh_cache.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Whole file with positioned reads, which don't share a file offset and so
+// never need a lock between threads.
+bool readFile(const std::string &path, std::vector<char> &bytes) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return false;
+  }
+#if defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  bytes.resize(static_cast<size_t>(info.st_size));
+  size_t done = 0;
+  while (done < bytes.size()) {
+    ssize_t count = pread(fd, bytes.data() + done, bytes.size() - done, static_cast<off_t>(done));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      break;
+    }
+    done += static_cast<size_t>(count);
+  }
+  close(fd);
+  return done == bytes.size();
+}
+
+}  // namespace
+
+AssetStreamer::AssetStreamer(
+    Device &_device,
+    GeometryPool &_pool,
+    uint32_t _frameCount,
+    VkDeviceSize _bytesPerFrame,
+    uint32_t ioThreadCount)
+    : device{_device}, pool{_pool}, frameCount{_frameCount}, bytesPerFrame{_bytesPerFrame} {
+  device.createBuffer(
+      bytesPerFrame * frameCount,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      stagingBuffer,
+      stagingBufferMemory);
+  void *mapped;
+  vkMapMemory(device.device(), stagingBufferMemory, 0, bytesPerFrame * frameCount, 0, &mapped);
+  staging = static_cast<char *>(mapped);
+
+  for (uint32_t i = 0; i < ioThreadCount; i++) {
+    threads.emplace_back([this] { ioThread(); });
+  }
+}
+
+AssetStreamer::~AssetStreamer() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Partly copied meshes; the caller has waited for the device by now
+  for (const Upload &upload : uploads) {
+    if (upload.allocated) {
+      pool.free(upload.range);
+    }
+  }
+  vkUnmapMemory(device.device(), stagingBufferMemory);
+  vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
+  device.freeMemory(stagingBufferMemory);
+}
+
+void AssetStreamer::request(
+    uint32_t id, const std::string &cachePath, uint64_t buildKey, BuildFunction build, float priority) {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    requests.push_back({id, cachePath, buildKey, std::move(build), priority, Clock::now()});
+  }
+  wake.notify_one();
+}
+
+void AssetStreamer::setPriority(uint32_t id, float priority) {
+  std::lock_guard<std::mutex> lock{mutex};
+  for (Request &request : requests) {
+    if (request.id == id) {
+      request.priority = priority;
+    }
+  }
+  for (auto *list : {&decoded, &uploads}) {
+    for (Upload &upload : *list) {
+      if (upload.id == id) {
+        upload.priority = priority;
+      }
+    }
+  }
+}
+
+void AssetStreamer::ioThread() {
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      wake.wait(lock, [this] { return stopping || !requests.empty(); });
+      if (stopping) {
+        return;
+      }
+      // Only a handful of requests are ever queued, a scan beats a heap that
+      // would have to be rebuilt on every priority change
+      auto next = std::min_element(requests.begin(), requests.end(), [](const Request &a, const Request &b) {
+        return a.priority < b.priority;
+      });
+      request = std::move(*next);
+      requests.erase(next);
+      loading++;
+    }
+
+    try {
+      Upload upload = load(request);
+      std::lock_guard<std::mutex> lock{mutex};
+      decoded.push_back(std::move(upload));
+      loading--;
+    } catch (...) {
+      std::lock_guard<std::mutex> lock{mutex};
+      loading--;
+      if (!ioError) {
+        ioError = std::current_exception();
+      }
+    }
+  }
+}
+
+AssetStreamer::Upload AssetStreamer::load(Request &request) {
+  Upload upload;
+  upload.id = request.id;
+  upload.priority = request.priority;
+  upload.requestedAt = request.requestedAt;
+
+  std::vector<char> bytes;
+  if (readFile(request.cachePath, bytes) && decodeMeshCache(bytes, request.buildKey, upload.mesh)) {
+    std::lock_guard<std::mutex> lock{mutex};
+    cacheHits++;
+    return upload;
+  }
+
+  upload.mesh = request.build();
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    cacheMisses++;
+  }
+  try {
+    writeMeshCache(request.cachePath, request.buildKey, upload.mesh);
+  } catch (const std::exception &e) {
+    // Not fatal, the mesh is simply built again next run
+    std::cerr << "Mesh cache: " << e.what() << std::endl;
+  }
+  return upload;
+}
+
+std::vector<AssetStreamer::ReadyModel> AssetStreamer::recordUploads(
+    VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+  assert(frameIndex < frameCount && "no staging slice for this frame");
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    if (ioError) {
+      std::rethrow_exception(ioError);
+    }
+    for (Upload &upload : decoded) {
+      uploads.push_back(std::move(upload));
+    }
+    decoded.clear();
+  }
+  std::stable_sort(uploads.begin(), uploads.end(), [](const Upload &a, const Upload &b) {
+    return a.priority < b.priority;
+  });
+
+  const VkDeviceSize sliceOffset = bytesPerFrame * frameIndex;
+  VkDeviceSize used = 0;
+  std::vector<VkBufferCopy> vertexCopies;
+  std::vector<VkBufferCopy> indexCopies;
+  // Copies the next chunk of one array into the slice; false once the budget is spent
+  auto copyChunk = [&](const void *source, VkDeviceSize size, VkDeviceSize destination, VkDeviceSize &copied,
+                       std::vector<VkBufferCopy> &copies) {
+    VkDeviceSize chunk = std::min(size - copied, bytesPerFrame - used);
+    if (chunk > 0) {
+      std::memcpy(staging + sliceOffset + used, static_cast<const char *>(source) + copied, chunk);
+      copies.push_back({sliceOffset + used, destination + copied, chunk});
+      used += chunk;
+      copied += chunk;
+    }
+    return copied == size;
+  };
+
+  std::vector<ReadyModel> ready;
+  size_t finished = 0;
+  for (Upload &upload : uploads) {
+    if (used == bytesPerFrame) {
+      break;
+    }
+    if (!upload.allocated) {
+      upload.range = pool.allocate(
+          static_cast<uint32_t>(upload.mesh.vertices.size()), static_cast<uint32_t>(upload.mesh.indices.size()));
+      upload.allocated = true;
+    }
+
+    const VkDeviceSize stride = pool.getVertexStride();
+    bool done = copyChunk(
+        upload.mesh.vertices.data(),
+        stride * upload.mesh.vertices.size(),
+        stride * upload.range.firstVertex,
+        upload.vertexBytesCopied,
+        vertexCopies);
+    done = copyChunk(
+               upload.mesh.indices.data(),
+               sizeof(uint32_t) * upload.mesh.indices.size(),
+               sizeof(uint32_t) * static_cast<VkDeviceSize>(upload.range.firstIndex),
+               upload.indexBytesCopied,
+               indexCopies) &&
+           done;
+    if (!done) {
+      break;
+    }
+    ready.push_back(
+        {upload.id, std::make_unique<VModel>(pool, std::move(upload.mesh), upload.range), upload.requestedAt});
+    finished++;
+  }
+  // Completed uploads are always at the front, in the order they were copied
+  uploads.erase(uploads.begin(), uploads.begin() + finished);
+  resident += static_cast<uint32_t>(ready.size());
+  bytesLastFrame = used;
+  bytesTotal += used;
+
+  if (used == 0) {
+    return ready;
+  }
+
+  // Ranges can be reused from freed meshes that earlier draws still read
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+  if (!vertexCopies.empty()) {
+    vkCmdCopyBuffer(
+        commandBuffer,
+        stagingBuffer,
+        pool.getVertexBuffer(),
+        static_cast<uint32_t>(vertexCopies.size()),
+        vertexCopies.data());
+  }
+  if (!indexCopies.empty()) {
+    vkCmdCopyBuffer(
+        commandBuffer,
+        stagingBuffer,
+        pool.getIndexBuffer(),
+        static_cast<uint32_t>(indexCopies.size()),
+        indexCopies.data());
+  }
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+  return ready;
+}
+
+AssetStreamer::Stats AssetStreamer::getStats() {
+  Stats stats;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stats.queued = static_cast<uint32_t>(requests.size());
+    stats.loading = loading;
+    stats.uploading = static_cast<uint32_t>(decoded.size());
+    stats.cacheHits = cacheHits;
+    stats.cacheMisses = cacheMisses;
+  }
+  stats.uploading += static_cast<uint32_t>(uploads.size());
+  stats.resident = resident;
+  stats.bytesLastFrame = bytesLastFrame;
+  stats.bytesTotal = bytesTotal;
+  return stats;
+}
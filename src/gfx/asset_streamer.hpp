@@ -0,0 +1,135 @@
+#pragma once
+
+#include "device.hpp"
+#include "geometry_pool.hpp"
+#include "model.hpp"
+
+// std
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads meshes in the background and uploads them a little every frame.
+//
+// I/O threads take requests most urgent first (lowest priority value, e.g.
+// distance to the camera), read the mesh's cache file with pread and decode
+// it; when there's no usable cache they build the mesh from source and write
+// the cache for next time. They block on the disk, so they're separate from
+// the job system's workers.
+//
+// The render thread copies decoded meshes into the geometry pool through a
+// staging ring with one slice per frame in flight, at most bytesPerFrame per
+// frame, so a large mesh is spread over several frames instead of stalling
+// one. A slice is reused only once its frame's fence has been waited on.
+class AssetStreamer {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // Makes the mesh from source when its cache file is missing or unusable.
+  using BuildFunction = std::function<VModel::MeshData()>;
+
+  struct Stats {
+    uint32_t queued = 0;     // waiting for an I/O thread
+    uint32_t loading = 0;    // being read, decoded or built
+    uint32_t uploading = 0;  // decoded, not fully copied yet
+    uint32_t resident = 0;
+    uint32_t cacheHits = 0;
+    uint32_t cacheMisses = 0;
+    VkDeviceSize bytesLastFrame = 0;
+    VkDeviceSize bytesTotal = 0;
+
+    uint32_t queueDepth() const { return queued + loading + uploading; }
+  };
+
+  // A mesh whose last bytes were copied in this frame's command buffer; it
+  // can be drawn by anything recorded after recordUploads().
+  struct ReadyModel {
+    uint32_t id;
+    std::unique_ptr<VModel> model;
+    Clock::time_point requestedAt;
+  };
+
+  AssetStreamer(
+      Device &device,
+      GeometryPool &pool,
+      uint32_t frameCount,
+      VkDeviceSize bytesPerFrame,
+      uint32_t ioThreadCount = 2);
+  ~AssetStreamer();
+
+  AssetStreamer(const AssetStreamer &) = delete;
+  AssetStreamer &operator=(const AssetStreamer &) = delete;
+
+  // Any thread. id is the caller's, returned with the model once it's resident.
+  // buildKey stands for everything build depends on (see makeMeshCacheKey);
+  // a cache file written with a different key is rebuilt.
+  void request(uint32_t id, const std::string &cachePath, uint64_t buildKey, BuildFunction build, float priority);
+  // Render thread. Reorders a request that isn't resident yet; unknown ids
+  // are ignored.
+  void setPriority(uint32_t id, float priority);
+
+  // Render thread, outside a render pass. frameIndex selects the staging
+  // slice and must be a frame whose previous submission has completed.
+  // Rethrows errors from the I/O threads.
+  std::vector<ReadyModel> recordUploads(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+  // Render thread.
+  Stats getStats();
+
+ private:
+  struct Request {
+    uint32_t id;
+    std::string cachePath;
+    uint64_t buildKey;
+    BuildFunction build;
+    float priority;
+    Clock::time_point requestedAt;
+  };
+
+  struct Upload {
+    uint32_t id;
+    float priority;
+    Clock::time_point requestedAt;
+    VModel::MeshData mesh;
+    GeometryRange range;
+    bool allocated = false;
+    VkDeviceSize vertexBytesCopied = 0;
+    VkDeviceSize indexBytesCopied = 0;
+  };
+
+  void ioThread();
+  Upload load(Request &request);
+
+  Device &device;
+  GeometryPool &pool;
+  uint32_t frameCount;
+  VkDeviceSize bytesPerFrame;
+  VkBuffer stagingBuffer;
+  VkDeviceMemory stagingBufferMemory;
+  char *staging;
+
+  // guarded by mutex
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::vector<Request> requests;
+  std::vector<Upload> decoded;
+  uint32_t loading = 0;
+  uint32_t cacheHits = 0;
+  uint32_t cacheMisses = 0;
+  std::exception_ptr ioError;
+
+  // render thread only
+  std::vector<Upload> uploads;
+  uint32_t resident = 0;
+  VkDeviceSize bytesLastFrame = 0;
+  VkDeviceSize bytesTotal = 0;
+
+  std::vector<std::thread> threads;
+};
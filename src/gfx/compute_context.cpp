@@ -0,0 +1,390 @@
+#include "compute_context.hpp"
+
+// std
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Per pool; a job that needs more takes another
+constexpr uint32_t SETS_PER_POOL = 64;
+constexpr uint32_t STORAGE_BUFFERS_PER_POOL = 4 * SETS_PER_POOL;
+constexpr uint32_t UNIFORM_BUFFERS_PER_POOL = SETS_PER_POOL;
+
+}  // namespace
+
+ComputeContext::Job::Job(ComputeContext &context, VkCommandBuffer commandBuffer, bool external)
+    : context{&context}, commandBuffer{commandBuffer}, external{external} {}
+
+ComputeContext::Job::Job(Job &&other) noexcept
+    : context{other.context},
+      commandBuffer{other.commandBuffer},
+      external{other.external},
+      descriptorPools{std::move(other.descriptorPools)} {
+  other.commandBuffer = VK_NULL_HANDLE;
+  other.descriptorPools.clear();
+}
+
+ComputeContext::Job::~Job() {
+  if (commandBuffer == VK_NULL_HANDLE) {
+    return;
+  }
+  if (external) {
+    // The caller may still submit what was recorded
+    context->abandonedDescriptorPools.insert(
+        context->abandonedDescriptorPools.end(), descriptorPools.begin(), descriptorPools.end());
+  } else {
+    // Never submitted: nothing of it reached the GPU. It may still be recording
+    // (or executable, if submit() threw after ending it), so it's reset back to
+    // the initial state before anyone can take it from the free list.
+    if (vkResetCommandBuffer(commandBuffer, 0) == VK_SUCCESS) {
+      context->freeCommandBuffers.push_back(commandBuffer);
+    } else {
+      vkFreeCommandBuffers(context->device.device(), context->commandPool, 1, &commandBuffer);
+    }
+    context->releaseDescriptorPools(descriptorPools);
+  }
+}
+
+VkDescriptorSet ComputeContext::Job::allocateSet(VkDescriptorSetLayout layout) {
+  if (descriptorPools.empty()) {
+    descriptorPools.push_back(context->acquireDescriptorPool());
+  }
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPools.back();
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  VkDescriptorSet set;
+  VkResult result = vkAllocateDescriptorSets(context->device.device(), &allocInfo, &set);
+  if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+    descriptorPools.push_back(context->acquireDescriptorPool());
+    allocInfo.descriptorPool = descriptorPools.back();
+    result = vkAllocateDescriptorSets(context->device.device(), &allocInfo, &set);
+  }
+  if (result != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate compute descriptor set!");
+  }
+  return set;
+}
+
+void ComputeContext::Job::dispatch(
+    ComputePipeline &pipeline,
+    const std::vector<ComputeBinding> &bindings,
+    uint32_t groupCountX,
+    uint32_t groupCountY,
+    uint32_t groupCountZ,
+    const void *pushConstants,
+    uint32_t pushConstantSize) {
+  const ShaderReflection &reflection = pipeline.getReflection();
+  std::vector<VkDescriptorBufferInfo> bufferInfos;
+  std::vector<VkWriteDescriptorSet> writes;
+  bufferInfos.reserve(bindings.size());
+  for (const ComputeBinding &binding : bindings) {
+    auto declared = std::find_if(
+        reflection.descriptorBindings.begin(),
+        reflection.descriptorBindings.end(),
+        [&](const ShaderDescriptorBinding &candidate) {
+          return candidate.set == 0 && candidate.binding == binding.binding;
+        });
+    if (declared == reflection.descriptorBindings.end() ||
+        (declared->type != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER && declared->type != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)) {
+      throw std::invalid_argument(
+          "compute kernel has no buffer at set 0, binding " + std::to_string(binding.binding));
+    }
+    bufferInfos.push_back({binding.buffer, binding.offset, binding.range});
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstBinding = binding.binding;
+    write.descriptorCount = 1;
+    write.descriptorType = declared->type;
+    write.pBufferInfo = &bufferInfos.back();
+    writes.push_back(write);
+  }
+  for (const auto &declared : reflection.descriptorBindings) {
+    bool given = std::any_of(bindings.begin(), bindings.end(), [&](const ComputeBinding &binding) {
+      return declared.set == 0 && binding.binding == declared.binding;
+    });
+    if (!given) {
+      throw std::invalid_argument(
+          "compute kernel binding " + declared.name + " (set " + std::to_string(declared.set) + ", binding " +
+          std::to_string(declared.binding) + ") is not bound");
+    }
+  }
+
+  pipeline.bind(commandBuffer);
+  if (!writes.empty()) {
+    VkDescriptorSet set = allocateSet(pipeline.getSetLayouts().at(0));
+    for (auto &write : writes) {
+      write.dstSet = set;
+    }
+    vkUpdateDescriptorSets(
+        context->device.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    vkCmdBindDescriptorSets(
+        commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.getLayout(), 0, 1, &set, 0, nullptr);
+  }
+  if (pushConstantSize > 0) {
+    vkCmdPushConstants(
+        commandBuffer, pipeline.getLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize, pushConstants);
+  }
+  vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
+
+void ComputeContext::Job::barrier(VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+  VkMemoryBarrier memoryBarrier{};
+  memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  memoryBarrier.dstAccessMask = dstAccess;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      dstStages,
+      0,
+      1,
+      &memoryBarrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+}
+
+ComputeContext::ComputeContext(Device &device) : device{device} {
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.queueFamilyIndex = device.findPhysicalQueueFamilies().computeFamily;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  if (vkCreateCommandPool(device.device(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute command pool!");
+  }
+
+  if (device.getCapabilities().timelineSemaphore) {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create compute timeline semaphore!");
+    }
+  }
+}
+
+ComputeContext::~ComputeContext() {
+  if (lastTicket > 0) {
+    wait(lastTicket);
+  }
+  retire();
+  for (auto &retirement : inlineRetirements) {
+    freeDescriptorPools.insert(
+        freeDescriptorPools.end(), retirement.descriptorPools.begin(), retirement.descriptorPools.end());
+  }
+  freeDescriptorPools.insert(
+      freeDescriptorPools.end(), abandonedDescriptorPools.begin(), abandonedDescriptorPools.end());
+  for (VkDescriptorPool pool : freeDescriptorPools) {
+    vkDestroyDescriptorPool(device.device(), pool, nullptr);
+  }
+  for (VkFence fence : freeFences) {
+    vkDestroyFence(device.device(), fence, nullptr);
+  }
+  if (timeline != VK_NULL_HANDLE) {
+    vkDestroySemaphore(device.device(), timeline, nullptr);
+  }
+  // Frees the command buffers with it
+  vkDestroyCommandPool(device.device(), commandPool, nullptr);
+}
+
+ComputeContext::Job ComputeContext::begin() {
+  retire();
+  VkCommandBuffer commandBuffer;
+  if (!freeCommandBuffers.empty()) {
+    commandBuffer = freeCommandBuffers.back();
+    freeCommandBuffers.pop_back();
+  } else {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate compute command buffer!");
+    }
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    freeCommandBuffers.push_back(commandBuffer);
+    throw std::runtime_error("failed to begin recording compute command buffer!");
+  }
+  return Job{*this, commandBuffer, false};
+}
+
+ComputeContext::Job ComputeContext::beginInline(VkCommandBuffer commandBuffer) {
+  return Job{*this, commandBuffer, true};
+}
+
+void ComputeContext::endInline(Job &job, uint64_t completionValue) {
+  if (!job.external || job.commandBuffer == VK_NULL_HANDLE) {
+    throw std::logic_error("not an inline compute job, or already ended");
+  }
+  inlineRetirements.push_back({completionValue, std::move(job.descriptorPools)});
+  job.descriptorPools.clear();
+  job.commandBuffer = VK_NULL_HANDLE;
+}
+
+void ComputeContext::retireInline(uint64_t completedValue) {
+  while (!inlineRetirements.empty() && inlineRetirements.front().completionValue <= completedValue) {
+    releaseDescriptorPools(inlineRetirements.front().descriptorPools);
+    inlineRetirements.pop_front();
+  }
+}
+
+uint64_t ComputeContext::submit(Job &job) {
+  if (job.commandBuffer == VK_NULL_HANDLE) {
+    throw std::logic_error("compute job was already submitted");
+  }
+  if (job.external) {
+    throw std::logic_error("inline compute jobs are submitted by the caller");
+  }
+  if (vkEndCommandBuffer(job.commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record compute command buffer!");
+  }
+
+  Submission submission;
+  submission.ticket = lastTicket + 1;
+  submission.commandBuffer = job.commandBuffer;
+  submission.descriptorPools = std::move(job.descriptorPools);
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &submission.commandBuffer;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  if (timeline != VK_NULL_HANDLE) {
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &submission.ticket;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timeline;
+  } else if (!freeFences.empty()) {
+    submission.fence = freeFences.back();
+    freeFences.pop_back();
+    vkResetFences(device.device(), 1, &submission.fence);
+  } else {
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device.device(), &fenceInfo, nullptr, &submission.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create compute fence!");
+    }
+  }
+
+  VkResult result = vkQueueSubmit(device.computeQueue(), 1, &submitInfo, submission.fence);
+  job.commandBuffer = VK_NULL_HANDLE;
+  if (result != VK_SUCCESS) {
+    // Nothing was queued, the job's resources can be reused right away
+    freeCommandBuffers.push_back(submission.commandBuffer);
+    releaseDescriptorPools(submission.descriptorPools);
+    if (submission.fence != VK_NULL_HANDLE) {
+      freeFences.push_back(submission.fence);
+    }
+    throw std::runtime_error("failed to submit compute command buffer!");
+  }
+  lastTicket = submission.ticket;
+  submissions.push_back(std::move(submission));
+  return lastTicket;
+}
+
+bool ComputeContext::isComplete(uint64_t ticket) {
+  if (timeline != VK_NULL_HANDLE) {
+    uint64_t value = 0;
+    device.getSemaphoreCounterValue(timeline, value);
+    return value >= ticket;
+  }
+  retire();
+  // Submissions retire in ticket order
+  return submissions.empty() || submissions.front().ticket > ticket;
+}
+
+void ComputeContext::wait(uint64_t ticket) {
+  if (ticket > lastTicket) {
+    throw std::invalid_argument("compute ticket was never submitted");
+  }
+  if (timeline != VK_NULL_HANDLE) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline;
+    waitInfo.pValues = &ticket;
+    if (device.waitSemaphores(waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to wait for compute work!");
+    }
+  } else {
+    for (const Submission &submission : submissions) {
+      if (submission.ticket == ticket) {
+        vkWaitForFences(device.device(), 1, &submission.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        break;
+      }
+    }
+  }
+  retire();
+}
+
+bool ComputeContext::isSubmissionComplete(const Submission &submission) {
+  if (timeline != VK_NULL_HANDLE) {
+    uint64_t value = 0;
+    device.getSemaphoreCounterValue(timeline, value);
+    return value >= submission.ticket;
+  }
+  return vkGetFenceStatus(device.device(), submission.fence) == VK_SUCCESS;
+}
+
+void ComputeContext::retire() {
+  while (!submissions.empty() && isSubmissionComplete(submissions.front())) {
+    Submission &submission = submissions.front();
+    freeCommandBuffers.push_back(submission.commandBuffer);
+    releaseDescriptorPools(submission.descriptorPools);
+    if (submission.fence != VK_NULL_HANDLE) {
+      freeFences.push_back(submission.fence);
+    }
+    submissions.pop_front();
+  }
+}
+
+VkDescriptorPool ComputeContext::acquireDescriptorPool() {
+  if (!freeDescriptorPools.empty()) {
+    VkDescriptorPool pool = freeDescriptorPools.back();
+    freeDescriptorPools.pop_back();
+    return pool;
+  }
+  VkDescriptorPoolSize poolSizes[] = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, STORAGE_BUFFERS_PER_POOL},
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, UNIFORM_BUFFERS_PER_POOL}};
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = SETS_PER_POOL;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = poolSizes;
+
+  VkDescriptorPool pool;
+  if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute descriptor pool!");
+  }
+  return pool;
+}
+
+void ComputeContext::releaseDescriptorPools(std::vector<VkDescriptorPool> &pools) {
+  for (VkDescriptorPool pool : pools) {
+    vkResetDescriptorPool(device.device(), pool, 0);
+    freeDescriptorPools.push_back(pool);
+  }
+  pools.clear();
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "compute_pipeline.hpp"
+#include "device.hpp"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// A buffer for one of a kernel's storage or uniform buffer bindings in set 0.
+struct ComputeBinding {
+  uint32_t binding;
+  VkBuffer buffer;
+  VkDeviceSize offset = 0;
+  VkDeviceSize range = VK_WHOLE_SIZE;
+};
+
+// Records compute jobs and submits them to the device's compute queue, which
+// runs alongside graphics on devices with a separate compute family.
+//
+// Each submission returns a ticket: the value a timeline semaphore reaches
+// once the job is done. The CPU can poll or wait for it, and other queues can
+// wait on getTimelineSemaphore() at that value. Without timeline semaphores a
+// fence per submission stands in, and only the CPU can wait.
+//
+// Jobs can also be recorded inline into a command buffer the caller submits,
+// e.g. a frame's graphics command buffer, for compute that has to happen in
+// step with rendering. Only their descriptor pools come from the context.
+//
+// Command buffers and descriptor pools are recycled once their submission has
+// completed. Not thread-safe. Without async compute the compute queue is the
+// graphics queue, so submit from the thread that submits graphics work.
+// Buffers written here and read on the graphics queue need
+// VK_SHARING_MODE_CONCURRENT or a queue family ownership transfer when the
+// device hasAsyncCompute().
+class ComputeContext {
+ public:
+  class Job {
+   public:
+    Job(Job &&other) noexcept;
+    Job &operator=(Job &&) = delete;
+    Job(const Job &) = delete;
+    Job &operator=(const Job &) = delete;
+    ~Job();
+
+    // Binds the pipeline and a descriptor set 0 made of the bindings, pushes
+    // the constants and dispatches. Every binding the kernel declares in set 0
+    // must be given.
+    void dispatch(
+        ComputePipeline &pipeline,
+        const std::vector<ComputeBinding> &bindings,
+        uint32_t groupCountX,
+        uint32_t groupCountY = 1,
+        uint32_t groupCountZ = 1,
+        const void *pushConstants = nullptr,
+        uint32_t pushConstantSize = 0);
+    // Makes shader writes of the dispatches so far available to dstStages,
+    // by default to later dispatches
+    void barrier(
+        VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VkAccessFlags dstAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // For anything else the compute queue can record, e.g. copies
+    VkCommandBuffer getCommandBuffer() const { return commandBuffer; }
+
+   private:
+    friend class ComputeContext;
+    Job(ComputeContext &context, VkCommandBuffer commandBuffer, bool external);
+
+    VkDescriptorSet allocateSet(VkDescriptorSetLayout layout);
+
+    ComputeContext *context;
+    VkCommandBuffer commandBuffer;
+    // Recorded inline; the command buffer belongs to the caller
+    bool external;
+    std::vector<VkDescriptorPool> descriptorPools;
+  };
+
+  explicit ComputeContext(Device &device);
+  // Waits for everything submitted; inline jobs have to be done already
+  ~ComputeContext();
+
+  ComputeContext(const ComputeContext &) = delete;
+  ComputeContext &operator=(const ComputeContext &) = delete;
+
+  Job begin();
+  // Ends and submits the job, which can't be used afterwards
+  uint64_t submit(Job &job);
+  bool isComplete(uint64_t ticket);
+  void wait(uint64_t ticket);
+
+  // Records into commandBuffer, which must be recording and is submitted by
+  // the caller. End the job with endInline(), tagged with a value of the
+  // caller's own increasing counter (e.g. the frame number); its descriptor
+  // pools are recycled by retireInline() once that value has completed. A job
+  // dropped without endInline() keeps its pools until the context is destroyed.
+  Job beginInline(VkCommandBuffer commandBuffer);
+  void endInline(Job &job, uint64_t completionValue);
+  void retireInline(uint64_t completedValue);
+
+  // Signalled with each ticket; null without timeline semaphores
+  VkSemaphore getTimelineSemaphore() const { return timeline; }
+
+ private:
+  struct Submission {
+    uint64_t ticket;
+    VkCommandBuffer commandBuffer;
+    std::vector<VkDescriptorPool> descriptorPools;
+    VkFence fence = VK_NULL_HANDLE;
+  };
+
+  struct InlineRetirement {
+    uint64_t completionValue;
+    std::vector<VkDescriptorPool> descriptorPools;
+  };
+
+  // Recycles the resources of completed submissions, oldest first
+  void retire();
+  bool isSubmissionComplete(const Submission &submission);
+  VkDescriptorPool acquireDescriptorPool();
+  void releaseDescriptorPools(std::vector<VkDescriptorPool> &pools);
+
+  Device &device;
+  VkCommandPool commandPool;
+  VkSemaphore timeline = VK_NULL_HANDLE;
+  uint64_t lastTicket = 0;
+  std::deque<Submission> submissions;
+  std::deque<InlineRetirement> inlineRetirements;
+  // Of inline jobs that were never ended
+  std::vector<VkDescriptorPool> abandonedDescriptorPools;
+  std::vector<VkCommandBuffer> freeCommandBuffers;
+  std::vector<VkDescriptorPool> freeDescriptorPools;
+  std::vector<VkFence> freeFences;
+};
@@ -0,0 +1,55 @@
+#include "compute_pipeline.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+ComputePipeline::ComputePipeline(
+    Device &device,
+    PipelineCache &pipelineCache,
+    PipelineLayoutCache &layoutCache,
+    const std::string &compFilePath,
+    const SpecializationConstants &specialization)
+    : device{device}, reflection{pipelineCache.getReflection(compFilePath)} {
+  if (reflection.stage != VK_SHADER_STAGE_COMPUTE_BIT) {
+    throw std::runtime_error("Not a compute shader: " + compFilePath);
+  }
+  for (const auto &entry : specialization.getEntries()) {
+    if (std::find(
+            reflection.specializationConstantIds.begin(),
+            reflection.specializationConstantIds.end(),
+            entry.constantID) == reflection.specializationConstantIds.end()) {
+      throw std::runtime_error(
+          "Specialization constant " + std::to_string(entry.constantID) + " is not declared by " +
+          compFilePath);
+    }
+  }
+
+  pipelineLayout = layoutCache.getPipelineLayout({&reflection});
+  setLayouts = layoutCache.getSetLayouts(pipelineLayout);
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = pipelineCache.getShaderModule(compFilePath);
+  pipelineInfo.stage.pName = reflection.entryPoint.c_str();
+  pipelineInfo.stage.pSpecializationInfo = specialization.info();
+  pipelineInfo.layout = pipelineLayout;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+  pipelineInfo.basePipelineIndex = -1;
+
+  if (vkCreateComputePipelines(
+          device.device(), pipelineCache.handle(), 1, &pipelineInfo, nullptr, &computePipeline) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create compute pipeline: " + compFilePath);
+  }
+}
+
+ComputePipeline::~ComputePipeline() {
+  vkDestroyPipeline(device.device(), computePipeline, nullptr);
+}
+
+void ComputePipeline::bind(VkCommandBuffer commandBuffer) {
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+}
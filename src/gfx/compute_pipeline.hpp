@@ -0,0 +1,41 @@
+#pragma once
+
+#include "device.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_layout_cache.hpp"
+#include "shader_reflection.hpp"
+#include "specialization_constants.hpp"
+
+// std
+#include <string>
+
+// The compute counterpart of Pipeline. The shader module and reflection come
+// from the shared PipelineCache, and the layout from the PipelineLayoutCache,
+// so a kernel's descriptor interface is whatever the shader declares.
+class ComputePipeline {
+ public:
+  ComputePipeline(
+      Device &device,
+      PipelineCache &pipelineCache,
+      PipelineLayoutCache &layoutCache,
+      const std::string &compFilePath,
+      const SpecializationConstants &specialization = {});
+  ~ComputePipeline();
+
+  ComputePipeline(const ComputePipeline &) = delete;
+  ComputePipeline &operator=(const ComputePipeline &) = delete;
+
+  void bind(VkCommandBuffer commandBuffer);
+
+  VkPipelineLayout getLayout() const { return pipelineLayout; }
+  const ShaderReflection &getReflection() const { return reflection; }
+  // Set layouts of getLayout(), indexed by set
+  const std::vector<VkDescriptorSetLayout> &getSetLayouts() const { return setLayouts; }
+
+ private:
+  Device &device;
+  ShaderReflection reflection;
+  VkPipelineLayout pipelineLayout;
+  std::vector<VkDescriptorSetLayout> setLayouts;
+  VkPipeline computePipeline;
+};
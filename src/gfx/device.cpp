@@ -1,6 +1,8 @@
 #include "device.hpp"
 
 // std headers
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <set>
@@ -52,6 +54,7 @@ Device::Device(VWindow &window) : window{window} {
   pickPhysicalDevice();
   createLogicalDevice();
   createCommandPool();
+  memoryTracker = std::make_unique<MemoryTracker>(physicalDevice, capabilities.memoryBudget.enabled);
 }
 
 Device::~Device() {
@@ -77,7 +80,19 @@ void Device::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_2;
+  // The highest version both we and the loader know, 1.0 loaders don't have
+  // vkEnumerateInstanceVersion
+  uint32_t loaderVersion = VK_API_VERSION_1_0;
+  auto enumerateInstanceVersion =
+      (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+  if (enumerateInstanceVersion != nullptr) {
+    enumerateInstanceVersion(&loaderVersion);
+  }
+  if (loaderVersion < VK_API_VERSION_1_1) {
+    throw std::runtime_error("Vulkan 1.1 or later is required!");
+  }
+  instanceVersion = std::min(loaderVersion, VK_API_VERSION_1_3);
+  appInfo.apiVersion = instanceVersion;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -114,30 +129,87 @@ void Device::pickPhysicalDevice() {
   if (deviceCount == 0) {
     throw std::runtime_error("failed to find GPUs with Vulkan support!");
   }
-  std::cout << "Device count: " << deviceCount << std::endl;
   std::vector<VkPhysicalDevice> devices(deviceCount);
   vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
+  uint32_t groupCount = 0;
+  vkEnumeratePhysicalDeviceGroups(instance, &groupCount, nullptr);
+  std::vector<VkPhysicalDeviceGroupProperties> groups(groupCount);
+  for (auto &group : groups) {
+    group.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES;
+  }
+  vkEnumeratePhysicalDeviceGroups(instance, &groupCount, groups.data());
+  auto findGroup = [&groups](VkPhysicalDevice device) -> const VkPhysicalDeviceGroupProperties * {
+    for (const auto &group : groups) {
+      if (std::find(group.physicalDevices, group.physicalDevices + group.physicalDeviceCount, device) !=
+          group.physicalDevices + group.physicalDeviceCount) {
+        return &group;
+      }
+    }
+    return nullptr;
+  };
+
+  std::vector<PhysicalDeviceInfo> infos;
   for (const auto &device : devices) {
-    if (isDeviceSuitable(device)) {
-      physicalDevice = device;
-      break;
+    infos.push_back(describePhysicalDevice(device));
+    if (const auto *group = findGroup(device)) {
+      infos.back().groupSize = group->physicalDeviceCount;
     }
   }
 
-  if (physicalDevice == VK_NULL_HANDLE) {
-    throw std::runtime_error("failed to find a suitable GPU!");
+  const char *override = std::getenv(DEVICE_OVERRIDE_ENV);
+  size_t selected;
+  try {
+    selected = selectPhysicalDevice(infos, override ? override : "");
+  } catch (const std::exception &) {
+    printPhysicalDevices(std::cout, infos, infos.size());
+    throw;
+  }
+  printPhysicalDevices(std::cout, infos, selected);
+  physicalDevice = devices[selected];
+
+  const char *useGroup = std::getenv(DEVICE_GROUP_ENV);
+  const auto *group = findGroup(physicalDevice);
+  if (useGroup && std::strcmp(useGroup, "1") == 0 && group && group->physicalDeviceCount > 1) {
+    groupDevices.assign(group->physicalDevices, group->physicalDevices + group->physicalDeviceCount);
+    std::cout << "Logical device spans a group of " << groupDevices.size() << " physical devices" << std::endl;
   }
 
   vkGetPhysicalDeviceProperties(physicalDevice, &properties);
   std::cout << "physical device: " << properties.deviceName << std::endl;
 }
 
+PhysicalDeviceInfo Device::describePhysicalDevice(VkPhysicalDevice device) {
+  VkPhysicalDeviceIDProperties idProperties{};
+  idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+  VkPhysicalDeviceProperties2 deviceProperties{};
+  deviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  deviceProperties.pNext = &idProperties;
+  vkGetPhysicalDeviceProperties2(device, &deviceProperties);
+
+  PhysicalDeviceInfo info;
+  info.name = deviceProperties.properties.deviceName;
+  info.type = deviceProperties.properties.deviceType;
+  info.apiVersion = deviceProperties.properties.apiVersion;
+  std::copy(std::begin(idProperties.deviceUUID), std::end(idProperties.deviceUUID), info.uuid.begin());
+
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+  for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+    if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      info.deviceLocalBytes += memoryProperties.memoryHeaps[i].size;
+    }
+  }
+
+  info.unsuitableReason = findUnsuitableReason(device);
+  return info;
+}
+
 void Device::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily, indices.computeFamily};
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -151,16 +223,28 @@ void Device::createLogicalDevice() {
 
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
+  DeviceFeatureChain featureChain{physicalDevice, instanceVersion, deviceFeatures};
+  capabilities = featureChain.getCapabilities();
+  std::vector<const char *> extensions = deviceExtensions;
+  extensions.insert(extensions.end(), featureChain.getExtensions().begin(), featureChain.getExtensions().end());
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
+  VkDeviceGroupDeviceCreateInfo groupCreateInfo = {};
+  if (groupDevices.size() > 1) {
+    groupCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO;
+    groupCreateInfo.physicalDeviceCount = static_cast<uint32_t>(groupDevices.size());
+    groupCreateInfo.pPhysicalDevices = groupDevices.data();
+    createInfo.pNext = &groupCreateInfo;
+  }
+
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-  createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  featureChain.apply(createInfo);
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -177,6 +261,31 @@ void Device::createLogicalDevice() {
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  vkGetDeviceQueue(device_, indices.computeFamily, 0, &computeQueue_);
+
+  // Extension entry points have their own names, and the loader's export of
+  // the core one can't be called on a device that only has the extension
+  auto load = [this](const DeviceFeature &feature, const std::string &name) {
+    return vkGetDeviceProcAddr(device_, (feature.extension ? name + "KHR" : name).c_str());
+  };
+  if (capabilities.synchronization2) {
+    cmdPipelineBarrier2_ = (PFN_vkCmdPipelineBarrier2)load(capabilities.synchronization2, "vkCmdPipelineBarrier2");
+    capabilities.synchronization2.enabled = cmdPipelineBarrier2_ != nullptr;
+  }
+  if (capabilities.dynamicRendering) {
+    cmdBeginRendering_ = (PFN_vkCmdBeginRendering)load(capabilities.dynamicRendering, "vkCmdBeginRendering");
+    cmdEndRendering_ = (PFN_vkCmdEndRendering)load(capabilities.dynamicRendering, "vkCmdEndRendering");
+    capabilities.dynamicRendering.enabled = cmdBeginRendering_ != nullptr && cmdEndRendering_ != nullptr;
+  }
+  if (capabilities.timelineSemaphore) {
+    getSemaphoreCounterValue_ =
+        (PFN_vkGetSemaphoreCounterValue)load(capabilities.timelineSemaphore, "vkGetSemaphoreCounterValue");
+    waitSemaphores_ = (PFN_vkWaitSemaphores)load(capabilities.timelineSemaphore, "vkWaitSemaphores");
+    capabilities.timelineSemaphore.enabled = getSemaphoreCounterValue_ != nullptr && waitSemaphores_ != nullptr;
+  }
+  printDeviceCapabilities(std::cout, capabilities);
+  std::cout << "compute queue: family " << indices.computeFamily
+            << (hasAsyncCompute() ? " (async, separate from graphics)" : " (shared with graphics)") << std::endl;
 }
 
 void Device::createCommandPool() {
@@ -195,22 +304,30 @@ void Device::createCommandPool() {
 
 void Device::createSurface() { window.createWindowSurface(instance, &surface_); }
 
-bool Device::isDeviceSuitable(VkPhysicalDevice device) {
+std::string Device::findUnsuitableReason(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
+  if (!indices.graphicsFamilyHasValue) {
+    return "no graphics queue";
+  }
+  if (!indices.presentFamilyHasValue) {
+    return "can't present to the window surface";
+  }
 
-  bool extensionsSupported = checkDeviceExtensionSupport(device);
+  if (!checkDeviceExtensionSupport(device)) {
+    return "missing required device extensions";
+  }
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
-    SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-    swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+  SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
+  if (swapChainSupport.formats.empty() || swapChainSupport.presentModes.empty()) {
+    return "no surface formats or present modes";
   }
 
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
-
-  return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy;
+  if (!supportedFeatures.samplerAnisotropy) {
+    return "no samplerAnisotropy";
+  }
+  return {};
 }
 
 void Device::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
@@ -331,6 +448,29 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+uint32_t Device::getTimestampValidBits(uint32_t queueFamily) {
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+  return queueFamily < queueFamilyCount ? queueFamilies[queueFamily].timestampValidBits : 0;
+}
+
+VkSampleCountFlagBits Device::getUsableSampleCount(VkSampleCountFlagBits requested) const {
+  VkSampleCountFlags supported =
+      properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+  // Counts are single bits; start at the highest one in requested. Single
+  // sampling is always supported, so this ends at 1 at the latest.
+  uint32_t count = VK_SAMPLE_COUNT_1_BIT;
+  while (count < VK_SAMPLE_COUNT_64_BIT && count * 2 <= static_cast<uint32_t>(requested)) {
+    count *= 2;
+  }
+  while (count > VK_SAMPLE_COUNT_1_BIT && !(supported & count)) {
+    count /= 2;
+  }
+  return static_cast<VkSampleCountFlagBits>(count);
+}
+
 QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -359,6 +499,20 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
     i++;
   }
 
+  if (indices.graphicsFamilyHasValue) {
+    indices.computeFamily = indices.graphicsFamily;
+    indices.computeFamilyHasValue = true;
+  }
+  for (uint32_t family = 0; family < queueFamilyCount; family++) {
+    const auto &queueFamily = queueFamilies[family];
+    if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+        !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+      indices.computeFamily = family;
+      indices.computeFamilyHasValue = true;
+      break;
+    }
+  }
+
   return indices;
 }
 
@@ -417,6 +571,41 @@ uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags prope
   throw std::runtime_error("failed to find suitable memory type!");
 }
 
+bool Device::hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) &&
+        (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return true;
+    }
+  }
+  return false;
+}
+
+VkDeviceMemory Device::allocateMemory(
+    const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, MemoryCategory category) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = requirements.size;
+  allocInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(device_, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+    throw std::runtime_error(std::string("failed to allocate ") + getMemoryCategoryName(category) + " memory!");
+  }
+  memoryTracker->recordAllocation(memory, allocInfo.allocationSize, allocInfo.memoryTypeIndex, category);
+  return memory;
+}
+
+void Device::freeMemory(VkDeviceMemory memory) {
+  if (memory == VK_NULL_HANDLE) {
+    return;
+  }
+  memoryTracker->recordFree(memory);
+  vkFreeMemory(device_, memory, nullptr);
+}
+
 void Device::createBuffer(
     VkDeviceSize size,
     VkBufferUsageFlags usage,
@@ -435,15 +624,7 @@ void Device::createBuffer(
 
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate vertex buffer memory!");
-  }
+  bufferMemory = allocateMemory(memRequirements, properties, categorizeBuffer(usage, properties));
 
   vkBindBufferMemory(device_, buffer, bufferMemory, 0);
 }
@@ -530,15 +711,7 @@ void Device::createImageWithInfo(
 
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device_, image, &memRequirements);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
-  }
+  imageMemory = allocateMemory(memRequirements, properties, categorizeImage(imageInfo.usage));
 
   if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
     throw std::runtime_error("failed to bind image memory!");
@@ -1,8 +1,13 @@
 #pragma once
 
+#include "device_capabilities.hpp"
+#include "device_selection.hpp"
+#include "memory_tracker.hpp"
 #include "window.hpp"
 
 // std lib headers
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -15,8 +20,12 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  // A compute-only family when there is one, so compute can overlap graphics;
+  // otherwise the graphics family
+  uint32_t computeFamily;
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
+  bool computeFamilyHasValue = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
@@ -28,6 +37,13 @@ class Device {
   const bool enableValidationLayers = true;
 #endif
 
+  // The physical device is scored and picked among all suitable ones; set
+  // DEVICE_OVERRIDE_ENV to a name substring or UUID to choose one instead.
+  // With DEVICE_GROUP_ENV=1 and a device that is part of a multi-GPU group,
+  // the logical device spans the whole group.
+  static constexpr const char *DEVICE_OVERRIDE_ENV = "VKTEST_DEVICE";
+  static constexpr const char *DEVICE_GROUP_ENV = "VKTEST_DEVICE_GROUP";
+
   Device(VWindow &window);
   ~Device();
 
@@ -42,14 +58,56 @@ class Device {
   VkSurfaceKHR surface() { return surface_; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
   VkQueue presentQueue() { return presentQueue_; }
+  // The same queue as graphicsQueue() unless hasAsyncCompute()
+  VkQueue computeQueue() { return computeQueue_; }
+  bool hasAsyncCompute() const { return computeQueue_ != graphicsQueue_; }
 
   SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+  bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
   QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
+  // 0 if the family's queues can't write timestamps
+  uint32_t getTimestampValidBits(uint32_t queueFamily);
+  // The largest sample count up to requested that color and depth
+  // framebuffer attachments both support
+  VkSampleCountFlagBits getUsableSampleCount(VkSampleCountFlagBits requested) const;
+  // Physical devices the logical device spans. Without device masks every
+  // command runs, and every allocation is replicated, on all of them.
+  uint32_t getDeviceGroupSize() const { return static_cast<uint32_t>(std::max<size_t>(groupDevices.size(), 1)); }
+  // Optional features that were enabled, for picking between code paths
+  const DeviceCapabilities &getCapabilities() const { return capabilities; }
+  // vkCmdPipelineBarrier2 from core or VK_KHR_synchronization2; only when
+  // getCapabilities().synchronization2 is set
+  void cmdPipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfo &dependencyInfo) {
+    cmdPipelineBarrier2_(commandBuffer, &dependencyInfo);
+  }
+  // vkCmdBeginRendering/vkCmdEndRendering from core or VK_KHR_dynamic_rendering;
+  // only when getCapabilities().dynamicRendering is set
+  void cmdBeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfo &renderingInfo) {
+    cmdBeginRendering_(commandBuffer, &renderingInfo);
+  }
+  void cmdEndRendering(VkCommandBuffer commandBuffer) { cmdEndRendering_(commandBuffer); }
+  // vkGetSemaphoreCounterValue/vkWaitSemaphores from core or
+  // VK_KHR_timeline_semaphore; only when getCapabilities().timelineSemaphore is set
+  VkResult getSemaphoreCounterValue(VkSemaphore semaphore, uint64_t &value) {
+    return getSemaphoreCounterValue_(device_, semaphore, &value);
+  }
+  VkResult waitSemaphores(const VkSemaphoreWaitInfo &waitInfo, uint64_t timeout) {
+    return waitSemaphores_(device_, &waitInfo, timeout);
+  }
   VkFormat findSupportedFormat(
       const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
+  // Every allocation goes through here so the tracker sees it. Throws when
+  // the device is out of memory; free with freeMemory().
+  VkDeviceMemory allocateMemory(
+      const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, MemoryCategory category);
+  // Accepts VK_NULL_HANDLE
+  void freeMemory(VkDeviceMemory memory);
+  MemoryTracker &getMemoryTracker() { return *memoryTracker; }
+
   // Buffer Helper Functions
+  // The memory's category is taken from usage and properties
   void createBuffer(
       VkDeviceSize size,
       VkBufferUsageFlags usage,
@@ -62,6 +120,7 @@ class Device {
   void copyBufferToImage(
       VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
+  // The memory's category is taken from imageInfo.usage
   void createImageWithInfo(
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
@@ -79,7 +138,9 @@ class Device {
   void createCommandPool();
 
   // helper functions
-  bool isDeviceSuitable(VkPhysicalDevice device);
+  // Empty if the device can run us, otherwise what it's missing
+  std::string findUnsuitableReason(VkPhysicalDevice device);
+  PhysicalDeviceInfo describePhysicalDevice(VkPhysicalDevice device);
   std::vector<const char *> getRequiredExtensions();
   bool checkValidationLayerSupport();
   QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
@@ -89,8 +150,11 @@ class Device {
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
   VkInstance instance;
+  uint32_t instanceVersion = VK_API_VERSION_1_0;
   VkDebugUtilsMessengerEXT debugMessenger;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  // More than one only when the logical device spans a device group
+  std::vector<VkPhysicalDevice> groupDevices;
   VWindow &window;
   VkCommandPool commandPool;
 
@@ -98,6 +162,14 @@ class Device {
   VkSurfaceKHR surface_;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
+  VkQueue computeQueue_;
+  DeviceCapabilities capabilities;
+  std::unique_ptr<MemoryTracker> memoryTracker;
+  PFN_vkCmdPipelineBarrier2 cmdPipelineBarrier2_ = nullptr;
+  PFN_vkCmdBeginRendering cmdBeginRendering_ = nullptr;
+  PFN_vkCmdEndRendering cmdEndRendering_ = nullptr;
+  PFN_vkGetSemaphoreCounterValue getSemaphoreCounterValue_ = nullptr;
+  PFN_vkWaitSemaphores waitSemaphores_ = nullptr;
 
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
 
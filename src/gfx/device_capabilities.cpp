@@ -0,0 +1,237 @@
+#include "device_capabilities.hpp"
+
+// std
+#include <algorithm>
+#include <set>
+#include <string>
+
+namespace {
+
+constexpr uint32_t MINOR_VERSION = VK_MAKE_API_VERSION(0, 0, 1, 0);
+
+// The same members exist in the core 1.2 struct and the extension's
+template <typename T>
+bool hasDescriptorIndexing(const T &features) {
+  return features.shaderSampledImageArrayNonUniformIndexing && features.descriptorBindingPartiallyBound &&
+         features.descriptorBindingVariableDescriptorCount && features.runtimeDescriptorArray;
+}
+
+template <typename T>
+void enableDescriptorIndexing(T &features) {
+  features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  features.descriptorBindingPartiallyBound = VK_TRUE;
+  features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+  features.runtimeDescriptorArray = VK_TRUE;
+}
+
+void printFeature(std::ostream &out, const char *name, const DeviceFeature &feature) {
+  out << "  " << name << ": "
+      << (!feature.enabled ? "unavailable" : feature.extension ? feature.extension : "core") << std::endl;
+}
+
+}  // namespace
+
+DeviceFeatureChain::DeviceFeatureChain(
+    VkPhysicalDevice physicalDevice, uint32_t instanceVersion, const VkPhysicalDeviceFeatures &requiredFeatures) {
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.features = requiredFeatures;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  // Patch levels don't change which features exist
+  uint32_t deviceVersion = VK_MAKE_API_VERSION(
+      0, VK_API_VERSION_MAJOR(properties.apiVersion), VK_API_VERSION_MINOR(properties.apiVersion), 0);
+  capabilities.apiVersion = std::min({instanceVersion, deviceVersion, VK_API_VERSION_1_3});
+  // Feature chains need VkPhysicalDeviceFeatures2, so a 1.0 device gets
+  // just the required features
+  if (capabilities.apiVersion < VK_API_VERSION_1_1) {
+    return;
+  }
+  hasFeatures2 = true;
+
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+  std::set<std::string> available;
+  for (const auto &extension : availableExtensions) {
+    available.insert(extension.extensionName);
+  }
+
+  const uint32_t version = capabilities.apiVersion;
+  const bool core12 = version >= VK_API_VERSION_1_2;
+  const bool core13 = version >= VK_API_VERSION_1_3;
+  // Older versions would need the extension's own dependencies as well
+  auto viaExtension = [&](uint32_t coreVersion, const char *extension) {
+    return version < coreVersion && version + MINOR_VERSION >= coreVersion && available.count(extension) > 0;
+  };
+  const bool dynamicRenderingExtension = viaExtension(VK_API_VERSION_1_3, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+  const bool synchronization2Extension = viaExtension(VK_API_VERSION_1_3, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+  // Core in 1.3 without a feature bit, so only the extension is queried
+  const bool extendedDynamicStateExtension =
+      !core13 && viaExtension(VK_API_VERSION_1_3, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+  const bool timelineSemaphoreExtension = viaExtension(VK_API_VERSION_1_2, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+  const bool bufferDeviceAddressExtension =
+      viaExtension(VK_API_VERSION_1_2, VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+  const bool descriptorIndexingExtension = viaExtension(VK_API_VERSION_1_2, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+  // What the device supports, queried with its own chain so that the
+  // members of the enable chain start out all off
+  VkPhysicalDeviceVulkan12Features supported12{};
+  VkPhysicalDeviceVulkan13Features supported13{};
+  VkPhysicalDeviceDynamicRenderingFeatures supportedDynamicRendering{};
+  VkPhysicalDeviceSynchronization2Features supportedSynchronization2{};
+  VkPhysicalDeviceTimelineSemaphoreFeatures supportedTimelineSemaphore{};
+  VkPhysicalDeviceBufferDeviceAddressFeatures supportedBufferDeviceAddress{};
+  VkPhysicalDeviceDescriptorIndexingFeatures supportedDescriptorIndexing{};
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT supportedExtendedDynamicState{};
+  VkPhysicalDeviceFeatures2 query{};
+  query.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  void **queryTail = &query.pNext;
+  auto queryLink = [&queryTail](auto &feature, VkStructureType type) {
+    feature.sType = type;
+    *queryTail = &feature;
+    queryTail = &feature.pNext;
+  };
+  if (core12) {
+    queryLink(supported12, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES);
+  }
+  if (core13) {
+    queryLink(supported13, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_13_FEATURES);
+  }
+  if (dynamicRenderingExtension) {
+    queryLink(supportedDynamicRendering, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES);
+  }
+  if (synchronization2Extension) {
+    queryLink(supportedSynchronization2, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES);
+  }
+  if (extendedDynamicStateExtension) {
+    queryLink(supportedExtendedDynamicState, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT);
+  }
+  if (timelineSemaphoreExtension) {
+    queryLink(supportedTimelineSemaphore, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES);
+  }
+  if (bufferDeviceAddressExtension) {
+    queryLink(supportedBufferDeviceAddress, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES);
+  }
+  if (descriptorIndexingExtension) {
+    queryLink(supportedDescriptorIndexing, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES);
+  }
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &query);
+
+  // A feature turns on through the extension only when its struct was queried
+  auto enable = [this](DeviceFeature &feature, bool supported, bool extension, const char *name) {
+    feature.enabled = supported;
+    if (supported && extension) {
+      feature.extension = name;
+      extensions.push_back(name);
+    }
+  };
+
+  if (core12) {
+    enable(capabilities.timelineSemaphore, supported12.timelineSemaphore, false, nullptr);
+    enable(capabilities.bufferDeviceAddress, supported12.bufferDeviceAddress, false, nullptr);
+    enable(capabilities.descriptorIndexing, hasDescriptorIndexing(supported12), false, nullptr);
+    vulkan12.timelineSemaphore = supported12.timelineSemaphore;
+    vulkan12.bufferDeviceAddress = supported12.bufferDeviceAddress;
+    if (capabilities.descriptorIndexing) {
+      enableDescriptorIndexing(vulkan12);
+    }
+    link(vulkan12, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES);
+  } else {
+    enable(
+        capabilities.timelineSemaphore,
+        supportedTimelineSemaphore.timelineSemaphore,
+        true,
+        VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    enable(
+        capabilities.bufferDeviceAddress,
+        supportedBufferDeviceAddress.bufferDeviceAddress,
+        true,
+        VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+    enable(
+        capabilities.descriptorIndexing,
+        hasDescriptorIndexing(supportedDescriptorIndexing),
+        true,
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    if (capabilities.timelineSemaphore) {
+      timelineSemaphore.timelineSemaphore = VK_TRUE;
+      link(timelineSemaphore, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES);
+    }
+    if (capabilities.bufferDeviceAddress) {
+      bufferDeviceAddress.bufferDeviceAddress = VK_TRUE;
+      link(bufferDeviceAddress, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES);
+    }
+    if (capabilities.descriptorIndexing) {
+      enableDescriptorIndexing(descriptorIndexing);
+      link(descriptorIndexing, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES);
+    }
+  }
+
+  // No feature struct, so nothing to link
+  enable(
+      capabilities.memoryBudget,
+      available.count(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) > 0,
+      true,
+      VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+  if (core13) {
+    enable(capabilities.dynamicRendering, supported13.dynamicRendering, false, nullptr);
+    enable(capabilities.synchronization2, supported13.synchronization2, false, nullptr);
+    capabilities.extendedDynamicState.enabled = true;
+    vulkan13.dynamicRendering = supported13.dynamicRendering;
+    vulkan13.synchronization2 = supported13.synchronization2;
+    link(vulkan13, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_13_FEATURES);
+  } else {
+    enable(
+        capabilities.dynamicRendering,
+        supportedDynamicRendering.dynamicRendering,
+        true,
+        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    enable(
+        capabilities.synchronization2,
+        supportedSynchronization2.synchronization2,
+        true,
+        VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    enable(
+        capabilities.extendedDynamicState,
+        supportedExtendedDynamicState.extendedDynamicState,
+        true,
+        VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+    if (capabilities.dynamicRendering) {
+      dynamicRendering.dynamicRendering = VK_TRUE;
+      link(dynamicRendering, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES);
+    }
+    if (capabilities.synchronization2) {
+      synchronization2.synchronization2 = VK_TRUE;
+      link(synchronization2, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES);
+    }
+    if (capabilities.extendedDynamicState) {
+      extendedDynamicState.extendedDynamicState = VK_TRUE;
+      link(extendedDynamicState, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT);
+    }
+  }
+}
+
+void DeviceFeatureChain::apply(VkDeviceCreateInfo &createInfo) {
+  if (!hasFeatures2) {
+    createInfo.pEnabledFeatures = &features2.features;
+    return;
+  }
+  // Features come from the chain; pEnabledFeatures must be null with it
+  *tail = const_cast<void *>(createInfo.pNext);
+  createInfo.pNext = &features2;
+  createInfo.pEnabledFeatures = nullptr;
+}
+
+void printDeviceCapabilities(std::ostream &out, const DeviceCapabilities &capabilities) {
+  out << "Vulkan " << VK_API_VERSION_MAJOR(capabilities.apiVersion) << "."
+      << VK_API_VERSION_MINOR(capabilities.apiVersion) << " device features:" << std::endl;
+  printFeature(out, "dynamic rendering", capabilities.dynamicRendering);
+  printFeature(out, "synchronization2", capabilities.synchronization2);
+  printFeature(out, "timeline semaphores", capabilities.timelineSemaphore);
+  printFeature(out, "buffer device address", capabilities.bufferDeviceAddress);
+  printFeature(out, "descriptor indexing", capabilities.descriptorIndexing);
+  printFeature(out, "extended dynamic state", capabilities.extendedDynamicState);
+  printFeature(out, "memory budget", capabilities.memoryBudget);
+}
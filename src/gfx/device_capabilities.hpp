@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <ostream>
+#include <vector>
+
+struct DeviceFeature {
+  bool enabled = false;
+  // Extension it was enabled through; null when it's core or off
+  const char *extension = nullptr;
+
+  explicit operator bool() const { return enabled; }
+};
+
+// Optional features the renderer has faster paths for. Each is enabled
+// through core Vulkan when the API version in use includes it, through its
+// extension on the version just before that, and otherwise left off for the
+// renderer to take its fallback.
+struct DeviceCapabilities {
+  // Lower of what the instance and the device support, at most 1.3
+  uint32_t apiVersion = VK_API_VERSION_1_0;
+  DeviceFeature dynamicRendering;
+  DeviceFeature synchronization2;
+  DeviceFeature timelineSemaphore;
+  DeviceFeature bufferDeviceAddress;
+  // Non-uniform indexing into partially bound, variable sized arrays of
+  // sampled images, i.e. bindless textures
+  DeviceFeature descriptorIndexing;
+  DeviceFeature extendedDynamicState;
+  // Per-heap budget and usage queries; extension only
+  DeviceFeature memoryBudget;
+};
+
+// Queries which capabilities a physical device has and holds the feature
+// structs enabling them. Not copyable or movable: the chain points into
+// itself.
+class DeviceFeatureChain {
+ public:
+  // requiredFeatures have already been checked for by device selection.
+  DeviceFeatureChain(
+      VkPhysicalDevice physicalDevice, uint32_t instanceVersion, const VkPhysicalDeviceFeatures &requiredFeatures);
+
+  DeviceFeatureChain(const DeviceFeatureChain &) = delete;
+  DeviceFeatureChain &operator=(const DeviceFeatureChain &) = delete;
+
+  const DeviceCapabilities &getCapabilities() const { return capabilities; }
+  // Needed on top of the ones we always enable
+  const std::vector<const char *> &getExtensions() const { return extensions; }
+
+  // Puts the features into createInfo, in front of whatever its pNext
+  // already points to. The chain has to outlive the vkCreateDevice call.
+  void apply(VkDeviceCreateInfo &createInfo);
+
+ private:
+  // Appends a feature struct to the enable chain
+  template <typename T>
+  void link(T &feature, VkStructureType type) {
+    feature.sType = type;
+    *tail = &feature;
+    tail = &feature.pNext;
+  }
+
+  DeviceCapabilities capabilities;
+  std::vector<const char *> extensions;
+  bool hasFeatures2 = false;
+  void **tail = &features2.pNext;
+
+  VkPhysicalDeviceFeatures2 features2{};
+  VkPhysicalDeviceVulkan12Features vulkan12{};
+  VkPhysicalDeviceVulkan13Features vulkan13{};
+  VkPhysicalDeviceDynamicRenderingFeatures dynamicRendering{};
+  VkPhysicalDeviceSynchronization2Features synchronization2{};
+  VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphore{};
+  VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddress{};
+  VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexing{};
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicState{};
+};
+
+// The API version and one line per capability saying how it was enabled.
+void printDeviceCapabilities(std::ostream &out, const DeviceCapabilities &capabilities);
@@ -0,0 +1,140 @@
+#include "device_selection.hpp"
+
+// std
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint64_t MiB = 1024 * 1024;
+// Memory in MiB fills the low bits, the type ranks above any amount of it
+constexpr uint64_t TYPE_WEIGHT = uint64_t{1} << 32;
+
+uint64_t typeRank(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return 4;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return 3;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return 2;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+std::string lowercase(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+// The override with dashes removed if it's a UUID, empty otherwise
+std::string asUuid(const std::string &text) {
+  std::string digits;
+  for (char c : text) {
+    if (c == '-') {
+      continue;
+    }
+    if (!std::isxdigit(static_cast<unsigned char>(c))) {
+      return {};
+    }
+    digits += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return digits.size() == 2 * VK_UUID_SIZE ? digits : std::string{};
+}
+
+}  // namespace
+
+uint64_t scorePhysicalDevice(const PhysicalDeviceInfo &device) {
+  if (!device.suitable()) {
+    return 0;
+  }
+  uint64_t memoryMiB = std::min<uint64_t>(device.deviceLocalBytes / MiB, TYPE_WEIGHT - 1);
+  return typeRank(device.type) * TYPE_WEIGHT + memoryMiB;
+}
+
+size_t selectPhysicalDevice(const std::vector<PhysicalDeviceInfo> &devices, const std::string &override) {
+  if (!override.empty()) {
+    std::string uuid = asUuid(override);
+    std::string name = lowercase(override);
+    std::string rejected;
+    for (size_t i = 0; i < devices.size(); i++) {
+      bool matches = uuid.empty() ? lowercase(devices[i].name).find(name) != std::string::npos
+                                  : asUuid(formatUuid(devices[i].uuid)) == uuid;
+      if (!matches) {
+        continue;
+      }
+      if (devices[i].suitable()) {
+        return i;
+      }
+      rejected += "\n\t" + devices[i].name + ": " + devices[i].unsuitableReason;
+    }
+    throw std::runtime_error(
+        "no suitable physical device matches '" + override + "'" +
+        (rejected.empty() ? std::string{} : ", rejected:" + rejected));
+  }
+
+  size_t best = devices.size();
+  uint64_t bestScore = 0;
+  for (size_t i = 0; i < devices.size(); i++) {
+    uint64_t score = scorePhysicalDevice(devices[i]);
+    if (devices[i].suitable() && (best == devices.size() || score > bestScore)) {
+      best = i;
+      bestScore = score;
+    }
+  }
+  if (best == devices.size()) {
+    throw std::runtime_error("failed to find a suitable GPU!");
+  }
+  return best;
+}
+
+std::string formatUuid(const std::array<uint8_t, VK_UUID_SIZE> &uuid) {
+  std::string text;
+  for (size_t i = 0; i < uuid.size(); i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      text += '-';
+    }
+    char digits[3];
+    std::snprintf(digits, sizeof(digits), "%02x", uuid[i]);
+    text += digits;
+  }
+  return text;
+}
+
+const char *physicalDeviceTypeName(VkPhysicalDeviceType type) {
+  switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return "discrete";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return "integrated";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return "virtual";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return "cpu";
+    default:
+      return "other";
+  }
+}
+
+void printPhysicalDevices(std::ostream &out, const std::vector<PhysicalDeviceInfo> &devices, size_t selected) {
+  out << "Physical devices:" << std::endl;
+  for (size_t i = 0; i < devices.size(); i++) {
+    const PhysicalDeviceInfo &device = devices[i];
+    out << (i == selected ? " * " : "   ") << "[" << i << "] " << device.name << " ("
+        << physicalDeviceTypeName(device.type) << ", " << device.deviceLocalBytes / MiB << " MiB device-local, Vulkan "
+        << VK_API_VERSION_MAJOR(device.apiVersion) << "." << VK_API_VERSION_MINOR(device.apiVersion) << "."
+        << VK_API_VERSION_PATCH(device.apiVersion) << ", group of " << device.groupSize << ") uuid "
+        << formatUuid(device.uuid);
+    if (device.suitable()) {
+      out << " score " << scorePhysicalDevice(device);
+    } else {
+      out << " unsuitable: " << device.unsuitableReason;
+    }
+    out << std::endl;
+  }
+}
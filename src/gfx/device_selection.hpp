@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// What physical device selection looks at, gathered from the driver by
+// Device. Kept apart from the Vulkan calls so the choice can be checked
+// against any set of devices, real or made up.
+struct PhysicalDeviceInfo {
+  std::string name;
+  VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+  std::array<uint8_t, VK_UUID_SIZE> uuid{};
+  VkDeviceSize deviceLocalBytes = 0;
+  uint32_t apiVersion = 0;
+  // Devices in the same group as this one, itself included
+  uint32_t groupSize = 1;
+  // Empty if the device has every queue, extension and feature we require
+  std::string unsuitableReason;
+
+  bool suitable() const { return unsuitableReason.empty(); }
+};
+
+// Discrete beats integrated beats virtual beats CPU; within a type, more
+// device-local memory wins. 0 for unsuitable devices.
+uint64_t scorePhysicalDevice(const PhysicalDeviceInfo &device);
+
+// Index of the device to use. A non-empty override selects by UUID (32 hex
+// digits, dashes optional) or else by a case-insensitive substring of the
+// name, and throws if it matches no suitable device. Otherwise the highest
+// score wins, ties going to the first enumerated. Throws if nothing is
+// suitable.
+size_t selectPhysicalDevice(const std::vector<PhysicalDeviceInfo> &devices, const std::string &override);
+
+std::string formatUuid(const std::array<uint8_t, VK_UUID_SIZE> &uuid);
+const char *physicalDeviceTypeName(VkPhysicalDeviceType type);
+// One line per device with its score, marking the selected one.
+void printPhysicalDevices(std::ostream &out, const std::vector<PhysicalDeviceInfo> &devices, size_t selected);
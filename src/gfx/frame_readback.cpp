@@ -0,0 +1,157 @@
+#include "frame_readback.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+bool isBgraFormat(VkFormat format) {
+  return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+void transition(
+    VkCommandBuffer commandBuffer,
+    VkImage image,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout,
+    VkPipelineStageFlags srcStages,
+    VkAccessFlags srcAccess,
+    VkPipelineStageFlags dstStages,
+    VkAccessFlags dstAccess) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = srcAccess;
+  barrier.dstAccessMask = dstAccess;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+}  // namespace
+
+bool FrameReadback::isFormatSupported(VkFormat format) {
+  return isBgraFormat(format) || format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+FrameReadback::FrameReadback(Device &device, VkFormat format, VkExtent2D extent, uint32_t slotCount)
+    : device{device}, extent{extent}, swizzle{isBgraFormat(format)}, slots(slotCount) {
+  if (!isFormatSupported(format)) {
+    throw std::invalid_argument("frame readback only handles 8-bit RGBA and BGRA images");
+  }
+  const VkDeviceSize bytes = VkDeviceSize{4} * extent.width * extent.height;
+  for (Slot &slot : slots) {
+    device.createBuffer(
+        bytes,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        slot.buffer,
+        slot.memory);
+    void *mapped;
+    vkMapMemory(device.device(), slot.memory, 0, bytes, 0, &mapped);
+    slot.mapped = static_cast<const uint8_t *>(mapped);
+  }
+}
+
+FrameReadback::~FrameReadback() {
+  for (Slot &slot : slots) {
+    vkUnmapMemory(device.device(), slot.memory);
+    vkDestroyBuffer(device.device(), slot.buffer, nullptr);
+    device.freeMemory(slot.memory);
+  }
+}
+
+bool FrameReadback::record(
+    VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, uint64_t frameNumber) {
+  Slot &slot = slots[nextSlot];
+  if (slot.state != SlotState::Free) {
+    dropped++;
+    return false;
+  }
+  slot.state = SlotState::Pending;
+  slot.frameNumber = frameNumber;
+  nextSlot = (nextSlot + 1) % slots.size();
+
+  // Whatever wrote the image last, e.g. a render graph's final transition
+  transition(
+      commandBuffer,
+      image,
+      layout,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      VK_ACCESS_MEMORY_WRITE_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_ACCESS_TRANSFER_READ_BIT);
+
+  VkBufferImageCopy region{};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {extent.width, extent.height, 1};
+  vkCmdCopyImageToBuffer(
+      commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+  // Back for whoever uses the image next, e.g. presentation, which waits on a semaphore
+  transition(
+      commandBuffer,
+      image,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      layout,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      0);
+  VkMemoryBarrier hostBarrier{};
+  hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_HOST_BIT,
+      0,
+      1,
+      &hostBarrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+  return true;
+}
+
+std::vector<FrameReadback::MappedFrame> FrameReadback::acquire(uint64_t completedFrame) {
+  std::vector<MappedFrame> frames;
+  for (uint32_t i = 0; i < slots.size(); i++) {
+    Slot &slot = slots[i];
+    if (slot.state != SlotState::Pending || slot.frameNumber > completedFrame) {
+      continue;
+    }
+    slot.state = SlotState::Lent;
+    frames.push_back({slot.frameNumber, i, slot.mapped});
+  }
+  std::sort(frames.begin(), frames.end(), [](const MappedFrame &a, const MappedFrame &b) {
+    return a.frameNumber < b.frameNumber;
+  });
+  return frames;
+}
+
+void FrameReadback::release(uint32_t slot) {
+  if (slots.at(slot).state != SlotState::Lent) {
+    throw std::logic_error("releasing a readback slot that wasn't lent out");
+  }
+  slots[slot].state = SlotState::Free;
+}
+
+Image FrameReadback::copyImage(const MappedFrame &frame) const {
+  Image image{extent.width, extent.height, {}};
+  image.rgba.assign(frame.pixels, frame.pixels + size_t{4} * extent.width * extent.height);
+  if (swizzle) {
+    for (size_t i = 0; i < image.rgba.size(); i += 4) {
+      std::swap(image.rgba[i], image.rgba[i + 2]);
+    }
+  }
+  return image;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "device.hpp"
+#include "../core/image_io.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+// Copies rendered frames into a ring of host-visible buffers and lends them
+// out in place once the GPU is done with them, a few frames later, so reading
+// pixels never stalls the frame loop. A frame recorded while every buffer is
+// still in flight or lent out is skipped rather than waited for.
+class FrameReadback {
+ public:
+  // A completed copy, lent to the caller where it lies: pixels, width x height
+  // in the image's channel order, stay valid and unchanged until the slot is
+  // released. They may be uncached memory, so read them once, in order.
+  struct MappedFrame {
+    uint64_t frameNumber;
+    uint32_t slot;
+    const uint8_t *pixels;
+  };
+
+  // 8-bit RGBA or BGRA formats, UNORM or SRGB
+  static bool isFormatSupported(VkFormat format);
+
+  // Images of format and extent; slotCount copies can be in flight at once
+  FrameReadback(Device &device, VkFormat format, VkExtent2D extent, uint32_t slotCount);
+  ~FrameReadback();
+
+  FrameReadback(const FrameReadback &) = delete;
+  FrameReadback &operator=(const FrameReadback &) = delete;
+
+  // Records a copy of image, which must have been created with TRANSFER_SRC
+  // usage. It's expected in layout, after everything that renders it, and
+  // left in it. false if no buffer was free, and nothing was recorded.
+  bool record(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, uint64_t frameNumber);
+  // The copies of frames up to completedFrame, whose submissions the caller
+  // knows have finished, oldest first. Each one's slot takes no further copies
+  // until release(); the pixels may be handed to another thread meanwhile.
+  std::vector<MappedFrame> acquire(uint64_t completedFrame);
+  void release(uint32_t slot);
+  // An RGBA copy of a frame that hasn't been released yet
+  Image copyImage(const MappedFrame &frame) const;
+
+  // Whether the pixels are BGRA rather than RGBA
+  bool isBgra() const { return swizzle; }
+  VkExtent2D getExtent() const { return extent; }
+  uint32_t getSlotCount() const { return static_cast<uint32_t>(slots.size()); }
+  uint64_t getDroppedCount() const { return dropped; }
+
+ private:
+  enum class SlotState { Free, Pending, Lent };
+
+  struct Slot {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    const uint8_t *mapped;
+    SlotState state = SlotState::Free;
+    uint64_t frameNumber = 0;
+  };
+
+  Device &device;
+  VkExtent2D extent;
+  bool swizzle;
+  std::vector<Slot> slots;
+  uint32_t nextSlot = 0;
+  uint64_t dropped = 0;
+};
@@ -0,0 +1,210 @@
+#include "geometry_pool.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+RangeAllocator::RangeAllocator(uint32_t _capacity) : capacity{_capacity}, freeCount{_capacity} {
+  if (capacity > 0) {
+    freeRanges.emplace(0, capacity);
+  }
+}
+
+uint32_t RangeAllocator::allocate(uint32_t count) {
+  if (count == 0) {
+    return 0;
+  }
+  for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+    if (it->second < count) {
+      continue;
+    }
+    uint32_t offset = it->first;
+    uint32_t remaining = it->second - count;
+    freeRanges.erase(it);
+    if (remaining > 0) {
+      freeRanges.emplace(offset + count, remaining);
+    }
+    freeCount -= count;
+    return offset;
+  }
+  return NO_SPACE;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+  assert(offset + count <= capacity && "range is outside the allocator");
+  freeCount += count;
+  auto next = freeRanges.lower_bound(offset);
+  assert((next == freeRanges.end() || offset + count <= next->first) && "range is already free");
+
+  // Merge with the free range right before and the one right after
+  if (next != freeRanges.begin()) {
+    auto previous = std::prev(next);
+    assert(previous->first + previous->second <= offset && "range is already free");
+    if (previous->first + previous->second == offset) {
+      offset = previous->first;
+      count += previous->second;
+      freeRanges.erase(previous);
+    }
+  }
+  if (next != freeRanges.end() && offset + count == next->first) {
+    count += next->second;
+    freeRanges.erase(next);
+  }
+  freeRanges.emplace(offset, count);
+}
+
+uint32_t RangeAllocator::getLargestFree() const {
+  uint32_t largest = 0;
+  for (const auto &range : freeRanges) {
+    largest = std::max(largest, range.second);
+  }
+  return largest;
+}
+
+GeometryPool::GeometryPool(
+    Device &_device, uint32_t _vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity)
+    : device{_device},
+      vertexStride{_vertexStride},
+      vertexAllocator{vertexCapacity},
+      indexAllocator{indexCapacity} {
+  // Storage too, so compute can write vertices in place, e.g. GPU skinning
+  device.createBuffer(
+      static_cast<VkDeviceSize>(vertexStride) * vertexCapacity,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      vertexBuffer,
+      vertexBufferMemory);
+  device.createBuffer(
+      sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCapacity),
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      indexBuffer,
+      indexBufferMemory);
+}
+
+GeometryPool::~GeometryPool() {
+  vkDestroyBuffer(device.device(), vertexBuffer, nullptr);
+  device.freeMemory(vertexBufferMemory);
+  vkDestroyBuffer(device.device(), indexBuffer, nullptr);
+  device.freeMemory(indexBufferMemory);
+}
+
+GeometryRange GeometryPool::allocate(uint32_t vertexCount, uint32_t indexCount) {
+  GeometryRange range;
+  range.firstVertex = vertexAllocator.allocate(vertexCount);
+  if (range.firstVertex == RangeAllocator::NO_SPACE) {
+    throw std::runtime_error("geometry pool is out of vertex space");
+  }
+  range.firstIndex = indexAllocator.allocate(indexCount);
+  if (range.firstIndex == RangeAllocator::NO_SPACE) {
+    vertexAllocator.free(range.firstVertex, vertexCount);
+    throw std::runtime_error("geometry pool is out of index space");
+  }
+  range.vertexCount = vertexCount;
+  range.indexCount = indexCount;
+  meshCount++;
+  return range;
+}
+
+GeometryRange GeometryPool::upload(
+    const void *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount) {
+  GeometryRange range = allocate(vertexCount, indexCount);
+  copyToBuffer(
+      vertexBuffer,
+      static_cast<VkDeviceSize>(vertexStride) * range.firstVertex,
+      vertices,
+      static_cast<VkDeviceSize>(vertexStride) * vertexCount);
+  copyToBuffer(
+      indexBuffer,
+      sizeof(uint32_t) * static_cast<VkDeviceSize>(range.firstIndex),
+      indices,
+      sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCount));
+  return range;
+}
+
+void GeometryPool::free(const GeometryRange &range) {
+  vertexAllocator.free(range.firstVertex, range.vertexCount);
+  indexAllocator.free(range.firstIndex, range.indexCount);
+  meshCount--;
+}
+
+void GeometryPool::copyToBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size) {
+  if (size == 0) {
+    return;
+  }
+  VkBuffer stagingBuffer;
+  VkDeviceMemory stagingBufferMemory;
+  device.createBuffer(
+      size,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      stagingBuffer,
+      stagingBufferMemory);
+
+  void *mapped;
+  vkMapMemory(device.device(), stagingBufferMemory, 0, size, 0, &mapped);
+  memcpy(mapped, data, static_cast<size_t>(size));
+  vkUnmapMemory(device.device(), stagingBufferMemory);
+
+  VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+  // The range may have belonged to a freed mesh that earlier draws still read
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  VkBufferCopy copyRegion{};
+  copyRegion.dstOffset = offset;
+  copyRegion.size = size;
+  vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+  device.endSingleTimeCommands(commandBuffer);
+
+  vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
+  device.freeMemory(stagingBufferMemory);
+}
+
+void GeometryPool::bind(VkCommandBuffer commandBuffer) {
+  VkBuffer buffers[] = {vertexBuffer};
+  VkDeviceSize offsets[] = {0};
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+  vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+GeometryPool::Stats GeometryPool::getStats() const {
+  Stats stats;
+  stats.meshes = meshCount;
+  stats.vertexCapacity = vertexAllocator.getCapacity();
+  stats.verticesUsed = vertexAllocator.getCapacity() - vertexAllocator.getFreeCount();
+  stats.indexCapacity = indexAllocator.getCapacity();
+  stats.indicesUsed = indexAllocator.getCapacity() - indexAllocator.getFreeCount();
+  return stats;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "device.hpp"
+
+// std
+#include <cstdint>
+#include <map>
+
+// First-fit suballocator over [0, capacity) elements. Free ranges are kept by
+// offset and merged with their neighbours on free, so the pool doesn't
+// fragment into slivers as meshes come and go.
+class RangeAllocator {
+ public:
+  static constexpr uint32_t NO_SPACE = UINT32_MAX;
+
+  explicit RangeAllocator(uint32_t capacity);
+
+  // Offset of count free elements, or NO_SPACE if no free range is that large.
+  uint32_t allocate(uint32_t count);
+  void free(uint32_t offset, uint32_t count);
+
+  uint32_t getCapacity() const { return capacity; }
+  uint32_t getFreeCount() const { return freeCount; }
+  uint32_t getLargestFree() const;
+
+ private:
+  uint32_t capacity;
+  uint32_t freeCount;
+  // offset -> count
+  std::map<uint32_t, uint32_t> freeRanges;
+};
+
+// Where a mesh lives in the pool, in vertices and indices. Indices are local
+// to the mesh; draws pass firstVertex as the vertexOffset.
+struct GeometryRange {
+  uint32_t firstVertex = 0;
+  uint32_t vertexCount = 0;
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+};
+
+// One device-local vertex buffer and one 32-bit index buffer shared by every
+// mesh, so a frame binds geometry once and each draw only picks its range.
+// Uploads go through a staging buffer on the graphics queue and wait for it,
+// so they're meant for load time, from the thread that owns the queue.
+class GeometryPool {
+ public:
+  struct Stats {
+    uint32_t meshes = 0;
+    uint32_t vertexCapacity = 0;
+    uint32_t verticesUsed = 0;
+    uint32_t indexCapacity = 0;
+    uint32_t indicesUsed = 0;
+  };
+
+  // vertexStride: size of one vertex in bytes; capacities are in elements
+  GeometryPool(Device &device, uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity);
+  ~GeometryPool();
+
+  GeometryPool(const GeometryPool &) = delete;
+  GeometryPool &operator=(const GeometryPool &) = delete;
+
+  // Reserves space for a mesh without filling it, for callers that record
+  // their own copies. Throws if either buffer has no free range large enough.
+  GeometryRange allocate(uint32_t vertexCount, uint32_t indexCount);
+  // allocate() plus a blocking copy of the mesh into the new range.
+  GeometryRange upload(const void *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount);
+  // The range may be reused by the next upload, so the GPU must be done with it.
+  void free(const GeometryRange &range);
+
+  void bind(VkCommandBuffer commandBuffer);
+  Stats getStats() const;
+
+  VkBuffer getVertexBuffer() const { return vertexBuffer; }
+  VkBuffer getIndexBuffer() const { return indexBuffer; }
+  uint32_t getVertexStride() const { return vertexStride; }
+
+ private:
+  void copyToBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size);
+
+  Device &device;
+  uint32_t vertexStride;
+  uint32_t meshCount = 0;
+  RangeAllocator vertexAllocator;
+  RangeAllocator indexAllocator;
+  VkBuffer vertexBuffer;
+  VkDeviceMemory vertexBufferMemory;
+  VkBuffer indexBuffer;
+  VkDeviceMemory indexBufferMemory;
+};
@@ -0,0 +1,214 @@
+#include "gpu_skinning.hpp"
+
+#include "model.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Matches GROUP_SIZE in skin.comp
+constexpr uint32_t GROUP_SIZE = 64;
+// Joint indices are 8 bits wide
+constexpr uint32_t MAX_JOINTS = 256;
+
+struct SkinPush {
+  uint32_t vertexCount;
+  uint32_t firstInstance;
+};
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+GpuSkinning::GpuSkinning(
+    Device &device,
+    PipelineCache &pipelineCache,
+    PipelineLayoutCache &layoutCache,
+    ComputeContext &computeContext,
+    GeometryPool &geometryPool,
+    const std::string &shaderDirectory,
+    uint32_t frameCount)
+    : device{device}, computeContext{computeContext}, geometryPool{geometryPool}, frameCount{frameCount} {
+  if (geometryPool.getVertexStride() != sizeof(VModel::Vertex)) {
+    throw std::invalid_argument("GPU skinning writes VModel::Vertex, the pool holds another vertex format");
+  }
+  skinPipeline = std::make_unique<ComputePipeline>(
+      device, pipelineCache, layoutCache, shaderDirectory + "/skin.comp.spv");
+}
+
+GpuSkinning::~GpuSkinning() {
+  for (Mesh &mesh : meshes) {
+    vkDestroyBuffer(device.device(), mesh.bindPose, nullptr);
+    device.freeMemory(mesh.bindPoseMemory);
+  }
+  if (finalized) {
+    vkDestroyBuffer(device.device(), instanceTable, nullptr);
+    device.freeMemory(instanceTableMemory);
+    vkUnmapMemory(device.device(), paletteRingMemory);
+    vkDestroyBuffer(device.device(), paletteRing, nullptr);
+    device.freeMemory(paletteRingMemory);
+  }
+}
+
+uint32_t GpuSkinning::addMesh(const std::vector<Vertex> &vertices, uint32_t jointCount) {
+  if (finalized) {
+    throw std::logic_error("skinned meshes have to be added before the first record()");
+  }
+  if (vertices.empty() || jointCount == 0 || jointCount > MAX_JOINTS) {
+    throw std::invalid_argument("skinned mesh needs vertices and 1 to 256 joints");
+  }
+  Mesh mesh{};
+  mesh.vertexCount = static_cast<uint32_t>(vertices.size());
+  mesh.jointCount = jointCount;
+
+  const VkDeviceSize bytes = sizeof(Vertex) * vertices.size();
+  VkBuffer stagingBuffer;
+  VkDeviceMemory stagingBufferMemory;
+  device.createBuffer(
+      bytes,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      stagingBuffer,
+      stagingBufferMemory);
+  void *data;
+  vkMapMemory(device.device(), stagingBufferMemory, 0, bytes, 0, &data);
+  std::memcpy(data, vertices.data(), bytes);
+  vkUnmapMemory(device.device(), stagingBufferMemory);
+
+  device.createBuffer(
+      bytes,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      mesh.bindPose,
+      mesh.bindPoseMemory);
+  device.copyBuffer(stagingBuffer, mesh.bindPose, bytes);
+  vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
+  device.freeMemory(stagingBufferMemory);
+
+  meshes.push_back(std::move(mesh));
+  return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+uint32_t GpuSkinning::addInstance(uint32_t mesh, const GeometryRange &output) {
+  if (finalized) {
+    throw std::logic_error("skinned instances have to be added before the first record()");
+  }
+  if (output.vertexCount != meshes.at(mesh).vertexCount) {
+    throw std::invalid_argument("skinning output range doesn't match the mesh's vertex count");
+  }
+  uint32_t instance = static_cast<uint32_t>(instances.size());
+  instances.push_back({mesh, output.firstVertex, paletteSize});
+  meshes[mesh].instances.push_back(instance);
+  paletteSize += meshes[mesh].jointCount;
+  return instance;
+}
+
+uint64_t GpuSkinning::getSkinnedVertexCount() const {
+  uint64_t count = 0;
+  for (const Mesh &mesh : meshes) {
+    count += static_cast<uint64_t>(mesh.vertexCount) * mesh.instances.size();
+  }
+  return count;
+}
+
+void GpuSkinning::finalize() {
+  finalized = true;
+  const uint32_t entries = std::max<uint32_t>(getInstanceCount(), 1);
+  std::vector<uint32_t> table;
+  table.reserve(2 * entries);
+  for (const Mesh &mesh : meshes) {
+    firstTableEntry.push_back(static_cast<uint32_t>(table.size() / 2));
+    for (uint32_t instance : mesh.instances) {
+      table.push_back(instances[instance].firstVertex);
+      table.push_back(instances[instance].firstJoint);
+    }
+  }
+  table.resize(2 * entries);
+
+  // Written once and read by every frame, so host-visible is fine
+  const VkDeviceSize tableBytes = sizeof(uint32_t) * table.size();
+  device.createBuffer(
+      tableBytes,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      instanceTable,
+      instanceTableMemory);
+  void *data;
+  vkMapMemory(device.device(), instanceTableMemory, 0, tableBytes, 0, &data);
+  std::memcpy(data, table.data(), tableBytes);
+  vkUnmapMemory(device.device(), instanceTableMemory);
+
+  paletteSliceSize = alignUp(
+      sizeof(glm::mat4) * std::max<uint32_t>(paletteSize, 1),
+      device.properties.limits.minStorageBufferOffsetAlignment);
+  device.createBuffer(
+      paletteSliceSize * frameCount,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      paletteRing,
+      paletteRingMemory);
+  vkMapMemory(device.device(), paletteRingMemory, 0, VK_WHOLE_SIZE, 0, &data);
+  paletteRingMapped = static_cast<char *>(data);
+}
+
+void GpuSkinning::record(
+    VkCommandBuffer commandBuffer,
+    GpuTimer &timer,
+    uint32_t frameIndex,
+    uint64_t frameNumber,
+    const std::vector<glm::mat4> &palette) {
+  if (!finalized) {
+    finalize();
+  }
+  if (instances.empty()) {
+    return;
+  }
+  if (palette.size() != paletteSize) {
+    throw std::invalid_argument("skinning palette has the wrong number of joints");
+  }
+  // The frame that used this slice last has finished, its fence was waited on
+  const VkDeviceSize sliceOffset = paletteSliceSize * frameIndex;
+  std::memcpy(paletteRingMapped + sliceOffset, palette.data(), sizeof(glm::mat4) * palette.size());
+
+  // Last frame's draws read the vertices this overwrites
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      0,
+      nullptr,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  auto job = computeContext.beginInline(commandBuffer);
+  uint32_t scope = timer.begin(commandBuffer, TIMER_SCOPE);
+  for (uint32_t mesh = 0; mesh < meshes.size(); mesh++) {
+    if (meshes[mesh].instances.empty()) {
+      continue;
+    }
+    const SkinPush push{meshes[mesh].vertexCount, firstTableEntry[mesh]};
+    job.dispatch(
+        *skinPipeline,
+        {{0, meshes[mesh].bindPose},
+         {1, instanceTable},
+         {2, paletteRing, sliceOffset, paletteSliceSize},
+         {3, geometryPool.getVertexBuffer()}},
+        (push.vertexCount + GROUP_SIZE - 1) / GROUP_SIZE,
+        static_cast<uint32_t>(meshes[mesh].instances.size()),
+        1,
+        &push,
+        sizeof(push));
+  }
+  timer.end(commandBuffer, scope);
+  job.barrier(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+  computeContext.endInline(job, frameNumber);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "compute_context.hpp"
+#include "compute_pipeline.hpp"
+#include "device.hpp"
+#include "geometry_pool.hpp"
+#include "gpu_timer.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_layout_cache.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <memory>
+#include <string>
+#include <vector>
+
+// Skins instances of meshes on the GPU. Each frame the joint palettes of all
+// instances are copied into that frame's slice of a host-visible ring, and
+// one dispatch per mesh writes the skinned positions of all its instances
+// into their ranges of the GeometryPool's vertex buffer. Models over those
+// ranges then draw like any other, and every pass that draws them in the
+// frame reuses the same skinned vertices.
+//
+// Meshes and instances are added at load time, before the first record().
+class GpuSkinning {
+ public:
+  // std430 layout of SkinnedVertex in skin.comp
+  struct Vertex {
+    glm::vec3 position;
+    // four 8-bit joint indices, lowest first
+    uint32_t joints;
+    glm::vec4 weights;
+  };
+
+  // Name of the GpuTimer scope record() is timed with
+  static constexpr const char *TIMER_SCOPE = "skinning";
+
+  GpuSkinning(
+      Device &device,
+      PipelineCache &pipelineCache,
+      PipelineLayoutCache &layoutCache,
+      ComputeContext &computeContext,
+      GeometryPool &geometryPool,
+      const std::string &shaderDirectory,
+      uint32_t frameCount);
+  ~GpuSkinning();
+
+  GpuSkinning(const GpuSkinning &) = delete;
+  GpuSkinning &operator=(const GpuSkinning &) = delete;
+
+  // Uploads the bind pose; joints index a palette of jointCount matrices
+  uint32_t addMesh(const std::vector<Vertex> &vertices, uint32_t jointCount);
+  // output: a range of the pool with the mesh's vertex count, whose vertices
+  // are overwritten every frame
+  uint32_t addInstance(uint32_t mesh, const GeometryRange &output);
+
+  // Where an instance's joints start in the palette given to record()
+  uint32_t getFirstJoint(uint32_t instance) const { return instances[instance].firstJoint; }
+  // Joints of all instances
+  uint32_t getPaletteSize() const { return paletteSize; }
+  uint32_t getInstanceCount() const { return static_cast<uint32_t>(instances.size()); }
+  // Per frame, over all instances
+  uint64_t getSkinnedVertexCount() const;
+
+  // Copies palette into frameIndex's slice of the ring and records the
+  // skinning, outside any render pass, ahead of the draws. The inline compute
+  // job is ended with frameNumber.
+  void record(
+      VkCommandBuffer commandBuffer,
+      GpuTimer &timer,
+      uint32_t frameIndex,
+      uint64_t frameNumber,
+      const std::vector<glm::mat4> &palette);
+
+ private:
+  struct Mesh {
+    VkBuffer bindPose;
+    VkDeviceMemory bindPoseMemory;
+    uint32_t vertexCount;
+    uint32_t jointCount;
+    std::vector<uint32_t> instances;
+  };
+
+  struct Instance {
+    uint32_t mesh;
+    uint32_t firstVertex;
+    uint32_t firstJoint;
+  };
+
+  // Lays out the instance table grouped by mesh and creates the ring
+  void finalize();
+
+  Device &device;
+  ComputeContext &computeContext;
+  GeometryPool &geometryPool;
+  uint32_t frameCount;
+  std::unique_ptr<ComputePipeline> skinPipeline;
+
+  std::vector<Mesh> meshes;
+  std::vector<Instance> instances;
+  uint32_t paletteSize = 0;
+  bool finalized = false;
+
+  // {firstVertex, firstJoint} per instance, grouped by mesh
+  VkBuffer instanceTable = VK_NULL_HANDLE;
+  VkDeviceMemory instanceTableMemory = VK_NULL_HANDLE;
+  // Per mesh, where its instances start in the table
+  std::vector<uint32_t> firstTableEntry;
+  // frameCount slices of paletteSliceSize bytes, persistently mapped
+  VkBuffer paletteRing = VK_NULL_HANDLE;
+  VkDeviceMemory paletteRingMemory = VK_NULL_HANDLE;
+  VkDeviceSize paletteSliceSize = 0;
+  char *paletteRingMapped = nullptr;
+};
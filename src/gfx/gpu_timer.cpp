@@ -0,0 +1,83 @@
+#include "gpu_timer.hpp"
+
+// std
+#include <stdexcept>
+
+GpuTimer::GpuTimer(Device &device, uint32_t frameCount, uint32_t maxScopes)
+    : device{device}, maxScopes{maxScopes}, frames(frameCount) {
+  uint32_t validBits = device.getTimestampValidBits(device.findPhysicalQueueFamilies().graphicsFamily);
+  if (validBits == 0 || device.properties.limits.timestampPeriod <= 0.0f) {
+    return;
+  }
+  timestampMask = validBits >= 64 ? ~uint64_t{0} : (uint64_t{1} << validBits) - 1;
+  nanosecondsPerTick = device.properties.limits.timestampPeriod;
+
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = frameCount * maxScopes * 2;
+  if (vkCreateQueryPool(device.device(), &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create timestamp query pool!");
+  }
+}
+
+GpuTimer::~GpuTimer() {
+  if (queryPool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(device.device(), queryPool, nullptr);
+  }
+}
+
+void GpuTimer::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+  currentFrame = frameIndex;
+  if (!isSupported()) {
+    return;
+  }
+  collect(frameIndex);
+  frames[frameIndex].names.clear();
+  vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery(frameIndex), maxScopes * 2);
+}
+
+uint32_t GpuTimer::begin(VkCommandBuffer commandBuffer, const char *name) {
+  auto &names = frames[currentFrame].names;
+  if (!isSupported() || names.size() == maxScopes) {
+    return maxScopes;
+  }
+  uint32_t scope = static_cast<uint32_t>(names.size());
+  names.push_back(name);
+  vkCmdWriteTimestamp(
+      commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery(currentFrame) + 2 * scope);
+  return scope;
+}
+
+void GpuTimer::end(VkCommandBuffer commandBuffer, uint32_t scope) {
+  if (scope >= frames[currentFrame].names.size()) {
+    return;  // over maxScopes, or not supported
+  }
+  vkCmdWriteTimestamp(
+      commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, firstQuery(currentFrame) + 2 * scope + 1);
+}
+
+void GpuTimer::collect(uint32_t frameIndex) {
+  timings.clear();
+  const auto &names = frames[frameIndex].names;
+  if (names.empty()) {
+    return;
+  }
+  // Every scope of the frame has to have been ended, or this is VK_NOT_READY
+  std::vector<uint64_t> ticks(names.size() * 2);
+  if (vkGetQueryPoolResults(
+          device.device(),
+          queryPool,
+          firstQuery(frameIndex),
+          static_cast<uint32_t>(ticks.size()),
+          ticks.size() * sizeof(uint64_t),
+          ticks.data(),
+          sizeof(uint64_t),
+          VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+    return;
+  }
+  for (size_t scope = 0; scope < names.size(); scope++) {
+    uint64_t elapsed = (ticks[2 * scope + 1] - ticks[2 * scope]) & timestampMask;
+    timings.push_back({names[scope], elapsed * nanosecondsPerTick / 1e6});
+  }
+}
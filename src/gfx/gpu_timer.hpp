@@ -0,0 +1,57 @@
+#pragma once
+
+#include "device.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+// Times stretches of a frame's graphics command buffer with timestamp
+// queries. Each frame in flight has its own queries, read back when the same
+// frame index is recorded again (after its fence has been waited on), so the
+// timings are frameCount frames old. A timestamp is taken once every earlier
+// command has finished, so a scope covers the work recorded inside it plus
+// whatever was still running when it began. Where the graphics queue can't
+// write timestamps nothing is recorded and there are no timings.
+class GpuTimer {
+ public:
+  struct Timing {
+    const char *name;
+    double milliseconds;
+  };
+
+  GpuTimer(Device &device, uint32_t frameCount, uint32_t maxScopes = 16);
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+
+  bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+
+  // Reads back what was recorded the last time with frameIndex and resets its
+  // queries. Call outside a render pass, before any begin() of the frame.
+  void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+  // Returns the scope to end; name must outlive the timer
+  uint32_t begin(VkCommandBuffer commandBuffer, const char *name);
+  void end(VkCommandBuffer commandBuffer, uint32_t scope);
+
+  // Read back by the last beginFrame(), in begin() order
+  const std::vector<Timing> &getTimings() const { return timings; }
+
+ private:
+  struct Frame {
+    std::vector<const char *> names;
+  };
+
+  void collect(uint32_t frameIndex);
+  uint32_t firstQuery(uint32_t frameIndex) const { return frameIndex * maxScopes * 2; }
+
+  Device &device;
+  uint32_t maxScopes;
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+  uint64_t timestampMask = 0;
+  double nanosecondsPerTick = 0.0;
+  std::vector<Frame> frames;
+  uint32_t currentFrame = 0;
+  std::vector<Timing> timings;
+};
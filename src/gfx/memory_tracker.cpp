@@ -0,0 +1,215 @@
+#include "memory_tracker.hpp"
+
+// std
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+constexpr double MEBIBYTE = 1024.0 * 1024.0;
+
+void addUsage(MemoryTracker::Usage &usage, VkDeviceSize size) {
+  usage.liveBytes += size;
+  usage.peakBytes = std::max(usage.peakBytes, usage.liveBytes);
+  usage.allocations++;
+}
+
+void removeUsage(MemoryTracker::Usage &usage, VkDeviceSize size) {
+  usage.liveBytes -= size;
+  usage.allocations--;
+}
+
+void writeUsageJson(std::ostream &out, const MemoryTracker::Usage &usage) {
+  out << "\"liveBytes\": " << usage.liveBytes << ", \"peakBytes\": " << usage.peakBytes
+      << ", \"allocations\": " << usage.allocations;
+}
+
+}  // namespace
+
+const char *getMemoryCategoryName(MemoryCategory category) {
+  switch (category) {
+    case MemoryCategory::Vertex:
+      return "vertex";
+    case MemoryCategory::Index:
+      return "index";
+    case MemoryCategory::Uniform:
+      return "uniform";
+    case MemoryCategory::Storage:
+      return "storage";
+    case MemoryCategory::Staging:
+      return "staging";
+    case MemoryCategory::Readback:
+      return "readback";
+    case MemoryCategory::Texture:
+      return "texture";
+    case MemoryCategory::Attachment:
+      return "attachment";
+    case MemoryCategory::Count:
+      break;
+  }
+  return "unknown";
+}
+
+MemoryCategory categorizeBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+  const bool hostVisible = (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+  if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) {
+    return MemoryCategory::Vertex;
+  }
+  if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) {
+    return MemoryCategory::Index;
+  }
+  if (hostVisible && (usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT)) {
+    return MemoryCategory::Staging;
+  }
+  if (hostVisible && (usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT)) {
+    return MemoryCategory::Readback;
+  }
+  if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) {
+    return MemoryCategory::Uniform;
+  }
+  return MemoryCategory::Storage;
+}
+
+MemoryCategory categorizeImage(VkImageUsageFlags usage) {
+  constexpr VkImageUsageFlags ATTACHMENT_USAGE =
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+      VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  return (usage & ATTACHMENT_USAGE) ? MemoryCategory::Attachment : MemoryCategory::Texture;
+}
+
+MemoryTracker::MemoryTracker(VkPhysicalDevice physicalDevice, bool memoryBudget)
+    : physicalDevice{physicalDevice}, memoryBudget{memoryBudget} {
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+  heapUsage.resize(memoryProperties.memoryHeapCount);
+  queriedBudget.resize(memoryProperties.memoryHeapCount, 0);
+  queriedProcessUsage.resize(memoryProperties.memoryHeapCount, 0);
+  liveBytesAtQuery.resize(memoryProperties.memoryHeapCount, 0);
+  heapWarned.resize(memoryProperties.memoryHeapCount, false);
+  // So allocations made before the first report are judged by the real budget
+  getReport();
+}
+
+void MemoryTracker::recordAllocation(
+    VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex, MemoryCategory category) {
+  const uint32_t heap = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+  std::lock_guard<std::mutex> lock{mutex};
+  allocations[memory] = {size, heap, category};
+  addUsage(heapUsage[heap], size);
+  addUsage(categoryUsage[static_cast<size_t>(category)], size);
+  checkBudget(heap);
+}
+
+void MemoryTracker::recordFree(VkDeviceMemory memory) {
+  std::lock_guard<std::mutex> lock{mutex};
+  auto it = allocations.find(memory);
+  if (it == allocations.end()) {
+    return;
+  }
+  const Allocation allocation = it->second;
+  allocations.erase(it);
+  removeUsage(heapUsage[allocation.heap], allocation.size);
+  removeUsage(categoryUsage[static_cast<size_t>(allocation.category)], allocation.size);
+  checkBudget(allocation.heap);
+}
+
+MemoryTracker::Report MemoryTracker::getReport() {
+  // Outside the lock, so allocations on other threads don't wait for the driver
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+  budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  if (memoryBudget) {
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+  }
+
+  std::lock_guard<std::mutex> lock{mutex};
+  Report report{memoryBudget, {}, categoryUsage};
+  for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+    if (memoryBudget) {
+      queriedBudget[i] = budget.heapBudget[i];
+      queriedProcessUsage[i] = budget.heapUsage[i];
+      liveBytesAtQuery[i] = heapUsage[i].liveBytes;
+    }
+    checkBudget(i);
+    report.heaps.push_back(getHeap(i));
+  }
+  return report;
+}
+
+MemoryTracker::Heap MemoryTracker::getHeap(uint32_t heap) const {
+  Heap state;
+  state.size = memoryProperties.memoryHeaps[heap].size;
+  state.flags = memoryProperties.memoryHeaps[heap].flags;
+  state.usage = heapUsage[heap];
+  if (memoryBudget) {
+    state.budget = queriedBudget[heap];
+    // The driver's figure, moved by what we allocated or freed since it was taken
+    const VkDeviceSize estimate = queriedProcessUsage[heap] + heapUsage[heap].liveBytes;
+    state.processUsage = estimate >= liveBytesAtQuery[heap] ? estimate - liveBytesAtQuery[heap] : 0;
+  }
+  return state;
+}
+
+void MemoryTracker::checkBudget(uint32_t heap) {
+  const Heap state = getHeap(heap);
+  const bool nearBudget = state.isNearBudget();
+  if (nearBudget && !heapWarned[heap]) {
+    std::cerr << std::fixed << std::setprecision(1) << "Memory: heap " << heap << " is at "
+              << state.getUsed() / MEBIBYTE << " of " << state.getLimit() / MEBIBYTE << " MiB"
+              << (memoryBudget ? " budget" : "") << std::endl;
+    std::cerr.unsetf(std::ios::floatfield);
+  }
+  heapWarned[heap] = nearBudget;
+}
+
+void printMemoryReport(std::ostream &out, const MemoryTracker::Report &report) {
+  out << std::fixed << std::setprecision(1) << "memory";
+  for (size_t i = 0; i < report.heaps.size(); i++) {
+    const auto &heap = report.heaps[i];
+    out << " | heap " << i << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device)" : "") << ": "
+        << heap.usage.liveBytes / MEBIBYTE << " MiB, peak " << heap.usage.peakBytes / MEBIBYTE << " MiB";
+    if (report.hasBudget) {
+      out << ", process " << heap.processUsage / MEBIBYTE << " of " << heap.budget / MEBIBYTE << " MiB budget";
+    } else {
+      out << " of " << heap.size / MEBIBYTE << " MiB";
+    }
+    if (heap.isNearBudget()) {
+      out << " NEAR BUDGET";
+    }
+  }
+  out << std::endl;
+
+  out << "by use";
+  for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+    const auto &usage = report.categories[i];
+    if (usage.peakBytes > 0) {
+      out << " | " << getMemoryCategoryName(static_cast<MemoryCategory>(i)) << " " << usage.liveBytes / MEBIBYTE
+          << " MiB (peak " << usage.peakBytes / MEBIBYTE << ")";
+    }
+  }
+  out << std::endl;
+  out.unsetf(std::ios::floatfield);
+}
+
+void writeMemoryReportJson(std::ostream &out, const MemoryTracker::Report &report) {
+  out << "{\n  \"memoryBudget\": " << (report.hasBudget ? "true" : "false") << ",\n  \"heaps\": [";
+  for (size_t i = 0; i < report.heaps.size(); i++) {
+    const auto &heap = report.heaps[i];
+    out << (i > 0 ? "," : "") << "\n    {\"index\": " << i << ", \"size\": " << heap.size << ", \"deviceLocal\": "
+        << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "true" : "false") << ", ";
+    writeUsageJson(out, heap.usage);
+    if (report.hasBudget) {
+      out << ", \"budget\": " << heap.budget << ", \"processUsage\": " << heap.processUsage;
+    }
+    out << ", \"nearBudget\": " << (heap.isNearBudget() ? "true" : "false") << "}";
+  }
+  out << "\n  ],\n  \"categories\": {";
+  for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+    out << (i > 0 ? "," : "") << "\n    \"" << getMemoryCategoryName(static_cast<MemoryCategory>(i)) << "\": {";
+    writeUsageJson(out, report.categories[i]);
+    out << "}";
+  }
+  out << "\n  }\n}" << std::endl;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+enum class MemoryCategory : uint32_t {
+  Vertex,
+  Index,
+  Uniform,
+  Storage,
+  // Host-visible memory the CPU fills for copies to the device
+  Staging,
+  // Host-visible memory the device copies results into
+  Readback,
+  Texture,
+  Attachment,
+  Count
+};
+
+constexpr size_t MEMORY_CATEGORY_COUNT = static_cast<size_t>(MemoryCategory::Count);
+
+const char *getMemoryCategoryName(MemoryCategory category);
+// What a buffer is most likely for, going by the first of vertex, index,
+// staging, readback, uniform and storage that its usage fits
+MemoryCategory categorizeBuffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+// Attachment when it can be rendered to, texture otherwise
+MemoryCategory categorizeImage(VkImageUsageFlags usage);
+
+// Live and peak bytes of every device memory allocation, by heap and by
+// category, along with what VK_EXT_memory_budget says the process may use.
+// Without the extension a heap's size stands in for its budget and only our
+// own allocations count towards it.
+//
+// Warns on stderr when a heap goes past BUDGET_WARNING_FRACTION of its
+// budget, and again only after it has dropped back below. The driver is only
+// asked for the budget by getReport(); in between, allocations are judged
+// against that answer plus what changed since, so recording one is just a
+// few additions under the mutex. Thread-safe.
+class MemoryTracker {
+ public:
+  static constexpr double BUDGET_WARNING_FRACTION = 0.9;
+
+  struct Usage {
+    VkDeviceSize liveBytes = 0;
+    VkDeviceSize peakBytes = 0;
+    uint32_t allocations = 0;
+  };
+
+  struct Heap {
+    VkDeviceSize size;
+    VkMemoryHeapFlags flags;
+    // Of the allocations made through the tracker
+    Usage usage;
+    // From VK_EXT_memory_budget, 0 without it. processUsage also counts what
+    // the driver allocated for us, e.g. swapchain images and pipelines.
+    VkDeviceSize budget = 0;
+    VkDeviceSize processUsage = 0;
+
+    // What nearing the budget is judged by
+    VkDeviceSize getLimit() const { return budget > 0 ? budget : size; }
+    VkDeviceSize getUsed() const { return budget > 0 ? processUsage : usage.liveBytes; }
+    bool isNearBudget() const { return getUsed() > getLimit() * BUDGET_WARNING_FRACTION; }
+  };
+
+  struct Report {
+    bool hasBudget;
+    std::vector<Heap> heaps;
+    std::array<Usage, MEMORY_CATEGORY_COUNT> categories;
+  };
+
+  // memoryBudget when VK_EXT_memory_budget is enabled on the device
+  MemoryTracker(VkPhysicalDevice physicalDevice, bool memoryBudget);
+
+  MemoryTracker(const MemoryTracker &) = delete;
+  MemoryTracker &operator=(const MemoryTracker &) = delete;
+
+  void recordAllocation(VkDeviceMemory memory, VkDeviceSize size, uint32_t memoryTypeIndex, MemoryCategory category);
+  // Ignores memory it never saw allocated
+  void recordFree(VkDeviceMemory memory);
+
+  // Queries the budget afresh, and warns about heaps that have come near it;
+  // call it at most once a frame
+  Report getReport();
+
+ private:
+  struct Allocation {
+    VkDeviceSize size;
+    uint32_t heap;
+    MemoryCategory category;
+  };
+
+  // From the last budget query and our allocations since; mutex held
+  Heap getHeap(uint32_t heap) const;
+  void checkBudget(uint32_t heap);
+
+  VkPhysicalDevice physicalDevice;
+  bool memoryBudget;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+
+  std::mutex mutex;
+  std::unordered_map<VkDeviceMemory, Allocation> allocations;
+  std::vector<Usage> heapUsage;
+  // Per heap, as of the last budget query
+  std::vector<VkDeviceSize> queriedBudget;
+  std::vector<VkDeviceSize> queriedProcessUsage;
+  std::vector<VkDeviceSize> liveBytesAtQuery;
+  std::array<Usage, MEMORY_CATEGORY_COUNT> categoryUsage;
+  // Heaps that were warned about and haven't dropped below the threshold since
+  std::vector<bool> heapWarned;
+};
+
+// Two lines: each heap, then each category that was ever used, in MiB.
+void printMemoryReport(std::ostream &out, const MemoryTracker::Report &report);
+// The whole report as a JSON object, sizes in bytes.
+void writeMemoryReportJson(std::ostream &out, const MemoryTracker::Report &report);
@@ -0,0 +1,163 @@
+#include "mesh_cache.hpp"
+
+// std
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+// POSIX
+#include <unistd.h>
+
+namespace {
+
+constexpr char MAGIC[4] = {'M', 'V', 'K', 'M'};
+// Bump whenever VModel::import() or the src/mesh code it runs would produce a
+// different mesh from the same input, e.g. a changed default cache size,
+// meshlet limit or simplifier weight. Build keys only cover what callers pass
+// in, so without a bump old caches would keep being loaded as they are.
+constexpr uint32_t VERSION = 2;
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t buildKey;
+  // catch caches written with different struct layouts
+  uint32_t vertexSize;
+  uint32_t meshletSize;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t lodCount;
+  uint32_t meshletCount;
+  VModel::ImportStats importStats;
+};
+
+static_assert(std::is_trivially_copyable<VModel::Vertex>::value, "vertices are stored as raw bytes");
+static_assert(std::is_trivially_copyable<Meshlet>::value, "meshlets are stored as raw bytes");
+static_assert(std::is_trivially_copyable<Header>::value, "the header is stored as raw bytes");
+
+template <typename T>
+bool readArray(const std::vector<char> &bytes, size_t &offset, size_t count, std::vector<T> &out) {
+  if ((bytes.size() - offset) / sizeof(T) < count) {
+    return false;
+  }
+  out.resize(count);
+  std::memcpy(out.data(), bytes.data() + offset, sizeof(T) * count);
+  offset += sizeof(T) * count;
+  return true;
+}
+
+template <typename T>
+void writeArray(std::ofstream &file, const std::vector<T> &values) {
+  file.write(reinterpret_cast<const char *>(values.data()), sizeof(T) * values.size());
+}
+
+}  // namespace
+
+uint64_t makeMeshCacheKey(const std::vector<uint32_t> &parameters) {
+  uint64_t hash = 14695981039346656037ull;
+  for (uint32_t parameter : parameters) {
+    for (int byte = 0; byte < 4; byte++) {
+      hash ^= (parameter >> (8 * byte)) & 0xff;
+      hash *= 1099511628211ull;
+    }
+  }
+  return hash;
+}
+
+bool decodeMeshCache(const std::vector<char> &bytes, uint64_t buildKey, VModel::MeshData &mesh) {
+  Header header;
+  if (bytes.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+      header.buildKey != buildKey ||
+      header.vertexSize != sizeof(VModel::Vertex) || header.meshletSize != sizeof(Meshlet)) {
+    return false;
+  }
+
+  size_t offset = sizeof(header);
+  std::vector<uint32_t> lodMeshlets;
+  mesh.importStats = header.importStats;
+  if (!readArray(bytes, offset, header.vertexCount, mesh.vertices) ||
+      !readArray(bytes, offset, header.indexCount, mesh.indices) ||
+      !readArray(bytes, offset, header.lodCount, mesh.lods) ||
+      !readArray(bytes, offset, header.meshletCount, mesh.meshlets) ||
+      !readArray(bytes, offset, size_t{header.lodCount} * 2, lodMeshlets)) {
+    return false;
+  }
+  mesh.lodMeshlets.clear();
+  for (uint32_t lod = 0; lod < header.lodCount; lod++) {
+    mesh.lodMeshlets.push_back({lodMeshlets[2 * lod], lodMeshlets[2 * lod + 1]});
+  }
+
+  // Ranges have to stay inside the arrays they index, whatever is on disk
+  for (const MeshLod &lod : mesh.lods) {
+    if (lod.firstIndex > mesh.indices.size() || lod.indexCount > mesh.indices.size() - lod.firstIndex) {
+      return false;
+    }
+  }
+  for (const auto &range : mesh.lodMeshlets) {
+    if (range.first > range.second || range.second > mesh.meshlets.size()) {
+      return false;
+    }
+  }
+  for (const Meshlet &meshlet : mesh.meshlets) {
+    if (meshlet.firstIndex > mesh.indices.size() || meshlet.indexCount > mesh.indices.size() - meshlet.firstIndex) {
+      return false;
+    }
+  }
+  for (uint32_t index : mesh.indices) {
+    if (index >= mesh.vertices.size()) {
+      return false;
+    }
+  }
+  return offset == bytes.size() && !mesh.lods.empty();
+}
+
+void writeMeshCache(const std::string &path, uint64_t buildKey, const VModel::MeshData &mesh) {
+  Header header{};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.buildKey = buildKey;
+  header.vertexSize = sizeof(VModel::Vertex);
+  header.meshletSize = sizeof(Meshlet);
+  header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+  header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+  header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+  header.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+  header.importStats = mesh.importStats;
+
+  std::filesystem::path target{path};
+  if (target.has_parent_path()) {
+    std::filesystem::create_directories(target.parent_path());
+  }
+  // Unique per process and thread, so writers of the same entry don't share it
+  std::string temporaryPath = path + "." + std::to_string(getpid()) + "." +
+                              std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+  {
+    std::ofstream file{temporaryPath, std::ios::binary | std::ios::trunc};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeArray(file, mesh.vertices);
+    writeArray(file, mesh.indices);
+    writeArray(file, mesh.lods);
+    writeArray(file, mesh.meshlets);
+    std::vector<uint32_t> lodMeshlets;
+    for (const auto &range : mesh.lodMeshlets) {
+      lodMeshlets.insert(lodMeshlets.end(), {range.first, range.second});
+    }
+    writeArray(file, lodMeshlets);
+    // Closed here so a failed final flush is seen before the file is renamed
+    file.close();
+    if (!file) {
+      std::error_code ignored;
+      std::filesystem::remove(temporaryPath, ignored);
+      throw std::runtime_error("failed to write mesh cache: " + temporaryPath);
+    }
+  }
+  std::filesystem::rename(temporaryPath, target);
+}
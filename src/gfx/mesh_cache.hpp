@@ -0,0 +1,28 @@
+#pragma once
+
+#include "model.hpp"
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Imported meshes on disk, exactly as VModel::import() leaves them, so
+// loading one skips simplification and optimization. The layout is the
+// in-memory one of this build; a file written by another version or with
+// different structs is rejected rather than converted.
+//
+// A file also records the build key it was written with: whatever the mesh
+// was made from and imported with (source, level count, ...). A file with
+// another key is a cache of something else and is rejected, so changing a
+// parameter rebuilds the mesh instead of loading the stale one.
+
+// FNV-1a of the parameters a mesh is built with, in order.
+uint64_t makeMeshCacheKey(const std::vector<uint32_t> &parameters);
+// Parses a whole cache file. Returns false if it isn't a cache of this
+// version and buildKey, or is truncated.
+bool decodeMeshCache(const std::vector<char> &bytes, uint64_t buildKey, VModel::MeshData &mesh);
+// Writes through a temporary file of its own and a rename, so a concurrent
+// reader sees either the old file or a complete new one, and concurrent
+// writers don't interleave. Throws on I/O errors.
+void writeMeshCache(const std::string &path, uint64_t buildKey, const VModel::MeshData &mesh);
@@ -1,58 +1,132 @@
 #include "model.hpp"
 
 // std
+#include <algorithm>
 #include <cassert>
-#include <cstring>
+#include <numeric>
 
-VModel::VModel(Device &_device, const std::vector<Vertex> &vertices) : device{_device} {
-  createVertexBuffers(vertices);
+VModel::VModel(GeometryPool &_pool, const std::vector<Vertex> &vertices) : pool{_pool} {
+  assert(vertices.size() >= 3 && "Vertex count must be at least 3");
+  std::vector<uint32_t> indices(vertices.size());
+  std::iota(indices.begin(), indices.end(), 0u);
+  lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f});
+  geometry = pool.upload(
+      vertices.data(),
+      static_cast<uint32_t>(vertices.size()),
+      indices.data(),
+      static_cast<uint32_t>(indices.size()));
 }
 
-VModel::~VModel() {
-  vkDestroyBuffer(device.device(), vertexBuffer, nullptr);
-  vkFreeMemory(device.device(), vertexBufferMemory, nullptr);
-}
+VModel::MeshData VModel::import(
+    const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, uint32_t lodCount) {
+  assert(vertices.size() >= 3 && "Vertex count must be at least 3");
+  assert(indices.size() % 3 == 0 && "Index count must be a multiple of 3");
+  MeshData mesh;
+  mesh.vertices = vertices;
+  std::vector<glm::vec3> positions;
+  positions.reserve(vertices.size());
+  for (const auto &vertex : vertices) {
+    positions.push_back(vertex.position);
+  }
+  mesh.importStats.original = analyzeVertexCache(indices, vertices.size());
+
+  std::vector<uint32_t> &lodIndices = mesh.indices;
+  mesh.lods = generateLods(positions, indices, lodCount, lodIndices);
+  for (const MeshLod &lod : mesh.lods) {
+    auto begin = lodIndices.begin() + lod.firstIndex;
+    std::vector<uint32_t> levelIndices(begin, begin + lod.indexCount);
+    optimizeVertexCache(levelIndices, vertices.size());
+    optimizeOverdraw(levelIndices, positions);
+    std::copy(levelIndices.begin(), levelIndices.end(), begin);
+  }
+
+  // Fetch order follows the full-detail level; coarser levels reuse a subset
+  auto remap = optimizeVertexFetchRemap(lodIndices, vertices.size());
+  remapVertices(mesh.vertices, remap);
+  remapVertices(positions, remap);
+
+  for (const MeshLod &lod : mesh.lods) {
+    auto levelMeshlets = buildMeshlets(lodIndices, lod.firstIndex, lod.indexCount, positions);
+    uint32_t first = static_cast<uint32_t>(mesh.meshlets.size());
+    mesh.meshlets.insert(mesh.meshlets.end(), levelMeshlets.begin(), levelMeshlets.end());
+    mesh.lodMeshlets.push_back({first, static_cast<uint32_t>(mesh.meshlets.size())});
+  }
 
-void VModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
-  vertexCount = static_cast<uint32_t>(vertices.size());
-  assert(vertexCount >= 3 && "Vertex count must be at least 3");
-  VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-  device.createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      vertexBuffer,
-      vertexBufferMemory);
-
-  void *data;
-  vkMapMemory(device.device(), vertexBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
-  vkUnmapMemory(device.device(), vertexBufferMemory);
+  mesh.importStats.optimized = analyzeVertexCache(
+      std::vector<uint32_t>(lodIndices.begin(), lodIndices.begin() + mesh.lods[0].indexCount), vertices.size());
+  mesh.importStats.meshlets = mesh.lodMeshlets[0].second - mesh.lodMeshlets[0].first;
+  return mesh;
 }
 
-void VModel::draw(VkCommandBuffer commandBuffer) {
-  vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+VModel::VModel(
+    GeometryPool &_pool, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, uint32_t lodCount)
+    : VModel(_pool, import(vertices, indices, lodCount)) {}
+
+VModel::VModel(GeometryPool &_pool, MeshData &&mesh)
+    : VModel(
+          _pool,
+          std::move(mesh),
+          _pool.upload(
+              mesh.vertices.data(),
+              static_cast<uint32_t>(mesh.vertices.size()),
+              mesh.indices.data(),
+              static_cast<uint32_t>(mesh.indices.size()))) {}
+
+VModel::VModel(GeometryPool &_pool, MeshData &&mesh, const GeometryRange &range)
+    : pool{_pool},
+      geometry{range},
+      lods{std::move(mesh.lods)},
+      meshlets{std::move(mesh.meshlets)},
+      lodMeshlets{std::move(mesh.lodMeshlets)},
+      importStats{mesh.importStats} {
+  assert(range.vertexCount == mesh.vertices.size() && range.indexCount == mesh.indices.size());
 }
 
-void VModel::bind(VkCommandBuffer commandBuffer) {
-  VkBuffer buffers[] = {vertexBuffer};
-  VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+VModel::~VModel() { pool.free(geometry); }
+
+uint32_t VModel::selectLod(float pixelsPerUnit, float maxErrorPixels) const {
+  // errors only grow with the level, so the last one that fits is the coarsest
+  uint32_t selected = 0;
+  for (uint32_t lod = 1; lod < lods.size(); lod++) {
+    if (lods[lod].error * pixelsPerUnit > maxErrorPixels) {
+      break;
+    }
+    selected = lod;
+  }
+  return selected;
 }
 
-std::vector<VkVertexInputBindingDescription> VModel::Vertex::getBindingDescriptions() {
-  std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
-  bindingDescriptions[0].binding = 0;
-  bindingDescriptions[0].stride = sizeof(Vertex);
-  bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-  return bindingDescriptions;
+void VModel::draw(VkCommandBuffer commandBuffer, uint32_t lod) {
+  drawRange(commandBuffer, lods[lod].firstIndex, lods[lod].indexCount);
 }
 
-std::vector<VkVertexInputAttributeDescription> VModel::Vertex::getAttributeDescriptions() {
-  std::vector<VkVertexInputAttributeDescription> attributeDescriptions(1);
-  attributeDescriptions[0].binding = 0;
-  attributeDescriptions[0].location = 0;
-  attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-  attributeDescriptions[0].offset = 0;
-  return attributeDescriptions;
+uint32_t VModel::drawCulled(VkCommandBuffer commandBuffer, uint32_t lod, const glm::vec3 &viewDirection) {
+  if (lod >= lodMeshlets.size()) {
+    draw(commandBuffer, lod);
+    return getTriangleCount(lod);
+  }
+
+  // Meshlets are consecutive ranges of the level, so neighbouring visible ones
+  // go out as a single draw
+  uint32_t drawn = 0;
+  uint32_t runStart = 0, runCount = 0;
+  for (uint32_t m = lodMeshlets[lod].first; m < lodMeshlets[lod].second; m++) {
+    const Meshlet &meshlet = meshlets[m];
+    if (isMeshletBackfacingOrthographic(meshlet, viewDirection)) {
+      continue;
+    }
+    if (runCount > 0 && runStart + runCount != meshlet.firstIndex) {
+      drawRange(commandBuffer, runStart, runCount);
+      runCount = 0;
+    }
+    if (runCount == 0) {
+      runStart = meshlet.firstIndex;
+    }
+    runCount += meshlet.indexCount;
+    drawn += meshlet.indexCount / 3;
+  }
+  if (runCount > 0) {
+    drawRange(commandBuffer, runStart, runCount);
+  }
+  return drawn;
 }
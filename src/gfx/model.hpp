@@ -1,6 +1,9 @@
 #pragma once
 
-#include "device.hpp"
+#include "geometry_pool.hpp"
+#include "vertex_layout.hpp"
+#include "../mesh/optimizer.hpp"
+#include "../mesh/simplifier.hpp"
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -8,31 +11,84 @@
 #include <glm/glm.hpp>
 
 // std
+#include <utility>
 #include <vector>
 
+// A mesh stored in a GeometryPool. Bind the pool once, then draw any number
+// of models from it.
 class VModel {
  public:
   struct Vertex {
-    glm::vec2 position;
+    glm::vec3 position;
+  };
+
+  // Vertex cache behaviour of the full-detail level as given and as stored
+  struct ImportStats {
+    VertexCacheStats original{};
+    VertexCacheStats optimized{};
+    uint32_t meshlets = 0;
+  };
 
-    static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
-    static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+  // Every attribute of Vertex is declared here once; the binding and attribute
+  // descriptions are generated from it at compile time.
+  using Layout = VertexLayout<Vertex, VERTEX_FIELD(Vertex, position)>;
+
+  // Everything a model is made from, prepared on the CPU. Building one touches
+  // no GPU state, so it can happen on any thread.
+  struct MeshData {
+    std::vector<Vertex> vertices;
+    // all levels, each a range given by lods
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    // per level: first meshlet, one past the last
+    std::vector<std::pair<uint32_t, uint32_t>> lodMeshlets;
+    ImportStats importStats;
   };
 
-  VModel(Device &device, const std::vector<Vertex> &vertices);
+  // Simplifies the mesh into up to lodCount levels of detail. All levels share
+  // the vertices and live in one index range. Each level is reordered for the
+  // vertex cache and overdraw and cut into meshlets, and the vertices are
+  // stored in the order they're fetched.
+  static MeshData import(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, uint32_t lodCount);
+
+  // Draws the vertices in order, at a single level of detail.
+  VModel(GeometryPool &pool, const std::vector<Vertex> &vertices);
+  // Imports the mesh and uploads it.
+  VModel(GeometryPool &pool, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, uint32_t lodCount = 1);
+  // Uploads an imported mesh.
+  VModel(GeometryPool &pool, MeshData &&mesh);
+  // Takes over a range of the pool the caller already filled with the mesh's
+  // vertices and indices, e.g. through streaming; it's freed with the model.
+  VModel(GeometryPool &pool, MeshData &&mesh, const GeometryRange &range);
   ~VModel();
 
   VModel(const VModel &) = delete;
   VModel &operator=(const VModel &) = delete;
 
-  void bind(VkCommandBuffer commandBuffer);
-  void draw(VkCommandBuffer commandBuffer);
+  void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0);
+  // Draws only the meshlets of the level that can face the camera, looking
+  // along viewDirection in model space (orthographic). Returns the triangles drawn.
+  uint32_t drawCulled(VkCommandBuffer commandBuffer, uint32_t lod, const glm::vec3 &viewDirection);
+
+  const std::vector<MeshLod> &getLods() const { return lods; }
+  uint32_t getTriangleCount(uint32_t lod = 0) const { return lods[lod].indexCount / 3; }
+  // The coarsest level whose error stays within maxErrorPixels on screen.
+  // pixelsPerUnit: how many pixels one model unit covers where it's drawn.
+  uint32_t selectLod(float pixelsPerUnit, float maxErrorPixels) const;
+  const ImportStats &getImportStats() const { return importStats; }
+  const GeometryRange &getGeometry() const { return geometry; }
 
  private:
-  void createVertexBuffers(const std::vector<Vertex> &vertices);
+  void drawRange(VkCommandBuffer commandBuffer, uint32_t firstIndex, uint32_t indexCount) {
+    vkCmdDrawIndexed(
+        commandBuffer, indexCount, 1, geometry.firstIndex + firstIndex, static_cast<int32_t>(geometry.firstVertex), 0);
+  }
 
-  Device &device;
-  VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  uint32_t vertexCount;
+  GeometryPool &pool;
+  GeometryRange geometry;
+  std::vector<MeshLod> lods;
+  std::vector<Meshlet> meshlets;
+  std::vector<std::pair<uint32_t, uint32_t>> lodMeshlets;
+  ImportStats importStats;
 };
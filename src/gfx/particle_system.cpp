@@ -0,0 +1,246 @@
+#include "particle_system.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Matches GROUP_SIZE in particle_simulate.comp and particle_compact.comp
+constexpr uint32_t GROUP_SIZE = 256;
+
+struct SimulatePush {
+  float deltaSeconds;
+  uint32_t emitCount;
+  uint32_t capacity;
+  uint32_t seed;
+};
+
+// Index of instanceCount in VkDrawIndirectCommand, as a uint
+constexpr uint32_t INSTANCE_COUNT_INDEX = 1;
+
+}  // namespace
+
+ParticleSystem::ParticleSystem(
+    Device &device,
+    PipelineCache &pipelineCache,
+    PipelineLayoutCache &layoutCache,
+    ComputeContext &computeContext,
+    const std::string &shaderDirectory,
+    uint32_t capacity)
+    : device{device},
+      pipelineCache{pipelineCache},
+      layoutCache{layoutCache},
+      computeContext{computeContext},
+      shaderDirectory{shaderDirectory},
+      capacity{capacity},
+      prefixSum{device, pipelineCache, layoutCache, shaderDirectory, capacity},
+      radixSort{device, pipelineCache, layoutCache, shaderDirectory, capacity} {
+  if ((capacity + GROUP_SIZE - 1) / GROUP_SIZE > device.properties.limits.maxComputeWorkGroupCount[0]) {
+    throw std::invalid_argument("too many particles for one dispatch: " + std::to_string(capacity));
+  }
+  simulatePipeline = std::make_unique<ComputePipeline>(
+      device, pipelineCache, layoutCache, shaderDirectory + "/particle_simulate.comp.spv");
+  compactPipeline = std::make_unique<ComputePipeline>(
+      device, pipelineCache, layoutCache, shaderDirectory + "/particle_compact.comp.spv");
+  drawPipelineLayout = layoutCache.getPipelineLayout({
+      &pipelineCache.getReflection(shaderDirectory + "/particle.vert.spv"),
+      &pipelineCache.getReflection(shaderDirectory + "/particle.frag.spv")});
+
+  createBuffers();
+  createDrawDescriptorSet();
+}
+
+ParticleSystem::~ParticleSystem() {
+  vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+  for (auto buffer : {particles, aliveFlags, aliveOffsets, sortKeys, sortValues, drawArgs}) {
+    vkDestroyBuffer(device.device(), buffer, nullptr);
+  }
+  for (auto memory :
+       {particlesMemory, aliveFlagsMemory, aliveOffsetsMemory, sortKeysMemory, sortValuesMemory, drawArgsMemory}) {
+    device.freeMemory(memory);
+  }
+}
+
+void ParticleSystem::createBuffers() {
+  const VkDeviceSize count = capacity;
+  device.createBuffer(
+      PARTICLE_SIZE * count,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      particles,
+      particlesMemory);
+  device.createBuffer(
+      sizeof(uint32_t) * count,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      aliveFlags,
+      aliveFlagsMemory);
+  device.createBuffer(
+      sizeof(uint32_t) * count,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      aliveOffsets,
+      aliveOffsetsMemory);
+  device.createBuffer(
+      sizeof(uint32_t) * count,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      sortKeys,
+      sortKeysMemory);
+  device.createBuffer(
+      sizeof(uint32_t) * count,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      sortValues,
+      sortValuesMemory);
+  device.createBuffer(
+      sizeof(VkDrawIndirectCommand),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      drawArgs,
+      drawArgsMemory);
+}
+
+void ParticleSystem::createDrawDescriptorSet() {
+  // The buffers never change, so one set written once is enough
+  VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2};
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create particle descriptor pool!");
+  }
+
+  VkDescriptorSetLayout setLayout = layoutCache.getSetLayouts(drawPipelineLayout).at(0);
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &setLayout;
+  if (vkAllocateDescriptorSets(device.device(), &allocInfo, &drawDescriptorSet) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate particle descriptor set!");
+  }
+
+  VkDescriptorBufferInfo bufferInfos[] = {{particles, 0, VK_WHOLE_SIZE}, {sortValues, 0, VK_WHOLE_SIZE}};
+  VkWriteDescriptorSet writes[2]{};
+  for (uint32_t binding = 0; binding < 2; binding++) {
+    writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[binding].dstSet = drawDescriptorSet;
+    writes[binding].dstBinding = binding;
+    writes[binding].descriptorCount = 1;
+    writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[binding].pBufferInfo = &bufferInfos[binding];
+  }
+  vkUpdateDescriptorSets(device.device(), 2, writes, 0, nullptr);
+}
+
+void ParticleSystem::createPipeline(PipelineConfigInfo configInfo) {
+  // Quads come from the vertex index, there are no vertex buffers
+  configInfo.vertexInputInfo.vertexBindingDescriptionCount = 0;
+  configInfo.vertexInputInfo.vertexAttributeDescriptionCount = 0;
+  // Sorted back to front: blend over what's behind, and test against the
+  // opaque depth without hiding other particles
+  configInfo.depthStencil.depthWriteEnable = VK_FALSE;
+  configInfo.colorBlendAttachment.blendEnable = VK_TRUE;
+  configInfo.colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  configInfo.colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  configInfo.colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  configInfo.colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  // The copy points at the caller's attachment state
+  configInfo.colorBlending.pAttachments = &configInfo.colorBlendAttachment;
+  configInfo.pipelineLayout = drawPipelineLayout;
+
+  // One pixel is 2 / extent in clip space
+  halfSize[0] = PARTICLE_SIZE_PIXELS / configInfo.viewport.width;
+  halfSize[1] = PARTICLE_SIZE_PIXELS / configInfo.viewport.height;
+
+  drawPipeline = std::make_unique<Pipeline>(
+      device,
+      pipelineCache,
+      shaderDirectory + "/particle.vert.spv",
+      shaderDirectory + "/particle.frag.spv",
+      configInfo);
+}
+
+void ParticleSystem::recordUpdate(
+    VkCommandBuffer commandBuffer, GpuTimer &timer, uint64_t frameNumber, float deltaSeconds) {
+  // Last frame's draw reads what the simulation is about to overwrite
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      0,
+      nullptr,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  auto job = computeContext.beginInline(commandBuffer);
+  uint32_t simulateScope = timer.begin(commandBuffer, "particle sim");
+  if (!cleared) {
+    // Every slot starts dead, numbered by its index
+    for (VkBuffer buffer : {particles, aliveFlags, aliveOffsets}) {
+      vkCmdFillBuffer(commandBuffer, buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+    job.barrier();
+    cleared = true;
+  }
+
+  float emit = deltaSeconds * capacity / MAX_LIFETIME_SECONDS + emitRemainder;
+  float emitCount = std::floor(emit);
+  emitRemainder = emit - emitCount;
+  const SimulatePush simulatePush{
+      deltaSeconds, static_cast<uint32_t>(std::min<float>(emitCount, capacity)), capacity, emitSeed++};
+  const uint32_t groups = (capacity + GROUP_SIZE - 1) / GROUP_SIZE;
+  job.dispatch(
+      *simulatePipeline,
+      {{0, particles}, {1, aliveFlags}, {2, aliveOffsets}},
+      groups,
+      1,
+      1,
+      &simulatePush,
+      sizeof(simulatePush));
+  job.barrier();
+
+  prefixSum.record(job, aliveFlags, aliveOffsets, capacity);
+  job.dispatch(
+      *compactPipeline,
+      {{0, particles}, {1, aliveFlags}, {2, aliveOffsets}, {3, sortKeys}, {4, sortValues}, {5, drawArgs}},
+      groups,
+      1,
+      1,
+      &capacity,
+      sizeof(capacity));
+  job.barrier();
+  timer.end(commandBuffer, simulateScope);
+
+  uint32_t sortScope = timer.begin(commandBuffer, "particle sort");
+  radixSort.record(job, sortKeys, sortValues, DEPTH_KEY_BITS, drawArgs, INSTANCE_COUNT_INDEX);
+  timer.end(commandBuffer, sortScope);
+
+  job.barrier(
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+  computeContext.endInline(job, frameNumber);
+}
+
+void ParticleSystem::reset() {
+  cleared = false;
+  emitRemainder = 0.0f;
+  emitSeed = 0;
+}
+
+void ParticleSystem::draw(VkCommandBuffer commandBuffer) {
+  drawPipeline->bind(commandBuffer);
+  vkCmdBindDescriptorSets(
+      commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipelineLayout, 0, 1, &drawDescriptorSet, 0, nullptr);
+  vkCmdPushConstants(commandBuffer, drawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(halfSize), halfSize);
+  vkCmdDrawIndirect(commandBuffer, drawArgs, 0, 1, sizeof(VkDrawIndirectCommand));
+}
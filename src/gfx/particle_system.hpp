@@ -0,0 +1,109 @@
+#pragma once
+
+#include "compute_context.hpp"
+#include "compute_pipeline.hpp"
+#include "device.hpp"
+#include "gpu_timer.hpp"
+#include "pipeline.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_layout_cache.hpp"
+#include "prefix_sum.hpp"
+#include "radix_sort.hpp"
+
+// std
+#include <memory>
+#include <string>
+
+// A particle fountain that lives entirely on the GPU. Every frame, recorded
+// into the frame's command buffer ahead of the pass that draws it:
+//  - particle_simulate.comp emits into dead slots and integrates the rest,
+//  - a PrefixSum over the alive flags gives each live particle its place,
+//  - particle_compact.comp packs the live particles into depth keys and
+//    indices and writes the instance count of the indirect draw,
+//  - RadixSort orders them back to front for alpha blending.
+// The draw is one instanced quad per live particle, with the count read
+// from the indirect arguments, so the CPU never learns how many there are.
+// Slots freed in a frame are reused from the next one on.
+class ParticleSystem {
+ public:
+  // Bytes per particle; matches Resources/shaders/particle.glsl
+  static constexpr uint32_t PARTICLE_SIZE = 32;
+  // Matches MAX_LIFETIME in particle_simulate.comp
+  static constexpr float MAX_LIFETIME_SECONDS = 3.0f;
+  static constexpr uint32_t DEPTH_KEY_BITS = 16;
+
+  // On screen, in pixels
+  static constexpr float PARTICLE_SIZE_PIXELS = 6.0f;
+
+  // shaderDirectory holds the compiled particle, prefix sum and radix sort
+  // shaders. Emits capacity / MAX_LIFETIME_SECONDS particles per second, which
+  // keeps about five sixths of the slots alive.
+  ParticleSystem(
+      Device &device,
+      PipelineCache &pipelineCache,
+      PipelineLayoutCache &layoutCache,
+      ComputeContext &computeContext,
+      const std::string &shaderDirectory,
+      uint32_t capacity);
+  ~ParticleSystem();
+
+  ParticleSystem(const ParticleSystem &) = delete;
+  ParticleSystem &operator=(const ParticleSystem &) = delete;
+
+  // Builds the draw pipeline from a raster pass's config, with blending on and
+  // depth writes off. Call again to replace it; the previous one must be idle.
+  void createPipeline(PipelineConfigInfo configInfo);
+
+  // Records the frame's simulation, outside any render pass. The inline
+  // compute job is ended with frameNumber, so retire the context's inline jobs
+  // with the frame numbers known to be complete. Timed as "particle sim"
+  // and "particle sort".
+  void recordUpdate(VkCommandBuffer commandBuffer, GpuTimer &timer, uint64_t frameNumber, float deltaSeconds);
+  // Inside the pass recordUpdate() came before
+  void draw(VkCommandBuffer commandBuffer);
+  // Kills every particle and restarts emission as on the first update, e.g.
+  // for reproducible frames. Takes effect with the next recordUpdate().
+  void reset();
+
+  uint32_t getCapacity() const { return capacity; }
+
+ private:
+  void createBuffers();
+  void createDrawDescriptorSet();
+
+  Device &device;
+  PipelineCache &pipelineCache;
+  PipelineLayoutCache &layoutCache;
+  ComputeContext &computeContext;
+  std::string shaderDirectory;
+  uint32_t capacity;
+
+  std::unique_ptr<ComputePipeline> simulatePipeline;
+  std::unique_ptr<ComputePipeline> compactPipeline;
+  PrefixSum prefixSum;
+  RadixSort radixSort;
+
+  std::unique_ptr<Pipeline> drawPipeline;
+  VkPipelineLayout drawPipelineLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  VkDescriptorSet drawDescriptorSet = VK_NULL_HANDLE;
+  float halfSize[2] = {0.0f, 0.0f};
+
+  VkBuffer particles;
+  VkDeviceMemory particlesMemory;
+  VkBuffer aliveFlags;
+  VkDeviceMemory aliveFlagsMemory;
+  VkBuffer aliveOffsets;
+  VkDeviceMemory aliveOffsetsMemory;
+  // Depth keys and particle indices of the live particles, sorted in place
+  VkBuffer sortKeys;
+  VkDeviceMemory sortKeysMemory;
+  VkBuffer sortValues;
+  VkDeviceMemory sortValuesMemory;
+  VkBuffer drawArgs;
+  VkDeviceMemory drawArgsMemory;
+
+  bool cleared = false;
+  float emitRemainder = 0.0f;
+  uint32_t emitSeed = 0;
+};
@@ -1,18 +1,18 @@
 #include "pipeline.hpp"
 
+#include <algorithm>
 #include <cassert>
 
 Pipeline::Pipeline(Device &device,
+            PipelineCache &pipelineCache,
             const std::string& vertFilePath,
             const std::string& fragFilePath,
             const PipelineConfigInfo& configInfo
-            ) : device(device) {
+            ) : device(device), pipelineCache(pipelineCache) {
     createGraphicsPipeline(vertFilePath, fragFilePath, configInfo);
 }
 
 Pipeline::~Pipeline() {
-    vkDestroyShaderModule(device.device(), fragShaderModule, nullptr);
-    vkDestroyShaderModule(device.device(), vertShaderModule, nullptr);
     vkDestroyPipeline(device.device(), graphicsPipeline, nullptr);
 }
 
@@ -45,29 +45,44 @@ void Pipeline::createGraphicsPipeline(
         "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
 
     assert(
-        configInfo.renderPass != VK_NULL_HANDLE &&
+        (configInfo.renderPass != VK_NULL_HANDLE || device.getCapabilities().dynamicRendering) &&
         "Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-    auto vertCode = readFile(vertFilePath);
-    auto fragCode = readFile(fragFilePath);
-    
-    createShaderModule(vertCode, &vertShaderModule);
-    createShaderModule(fragCode, &fragShaderModule);
+    // Modules and their reflection are shared by every variant built from the same files
+    const ShaderReflection& vertReflection = pipelineCache.getReflection(vertFilePath);
+    const ShaderReflection& fragReflection = pipelineCache.getReflection(fragFilePath);
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = {
-        {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_VERTEX_BIT, vertShaderModule, "main", nullptr},
-        {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule, "main", nullptr}
-    };
+    // Reject a vertex layout that does not match the shader before the driver sees it
+    if (vertReflection.stage != VK_SHADER_STAGE_VERTEX_BIT) {
+        throw std::runtime_error("Not a vertex shader: " + vertFilePath);
+    }
+    try {
+        validateVertexInput(vertReflection, configInfo.vertexInputInfo);
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(std::string(e.what()) + " [" + vertFilePath + "]");
+    }
 
-    auto bindingDescriptions = VModel::Vertex::getBindingDescriptions();
-    auto attributeDescriptions = VModel::Vertex::getAttributeDescriptions();
+    for (const auto& entry : configInfo.specialization.getEntries()) {
+        auto declares = [&](const ShaderReflection& reflection) {
+            return std::find(
+                reflection.specializationConstantIds.begin(),
+                reflection.specializationConstantIds.end(),
+                entry.constantID) != reflection.specializationConstantIds.end();
+        };
+        if (!declares(vertReflection) && !declares(fragReflection)) {
+            throw std::runtime_error(
+                "Specialization constant " + std::to_string(entry.constantID) +
+                " is not declared by " + vertFilePath + " or " + fragFilePath);
+        }
+    }
 
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();;
-    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());;
-    vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();;
+    const VkSpecializationInfo* specializationInfo = configInfo.specialization.info();
+    VkPipelineShaderStageCreateInfo shaderStages[] = {
+        {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_VERTEX_BIT,
+            pipelineCache.getShaderModule(vertFilePath), vertReflection.entryPoint.c_str(), specializationInfo},
+        {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0, VK_SHADER_STAGE_FRAGMENT_BIT,
+            pipelineCache.getShaderModule(fragFilePath), fragReflection.entryPoint.c_str(), specializationInfo}
+    };
 
     // Combine the viewport and scissor into a viewport state
     VkPipelineViewportStateCreateInfo viewportState = {};
@@ -81,7 +96,7 @@ void Pipeline::createGraphicsPipeline(
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineInfo.stageCount = 2;
     pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pVertexInputState = &configInfo.vertexInputInfo;
     pipelineInfo.pInputAssemblyState = &configInfo.inputAssembly;
     pipelineInfo.pViewportState = &viewportState;
     pipelineInfo.pRasterizationState = &configInfo.rasterizer;
@@ -94,28 +109,30 @@ void Pipeline::createGraphicsPipeline(
     pipelineInfo.renderPass = configInfo.renderPass;
     pipelineInfo.subpass = configInfo.subpass;
 
+    // Ignored by the driver when there is a render pass
+    VkPipelineRenderingCreateInfo renderingInfo = {};
+    if (configInfo.renderPass == VK_NULL_HANDLE) {
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = static_cast<uint32_t>(configInfo.colorAttachmentFormats.size());
+        renderingInfo.pColorAttachmentFormats = configInfo.colorAttachmentFormats.data();
+        renderingInfo.depthAttachmentFormat = configInfo.depthAttachmentFormat;
+        renderingInfo.stencilAttachmentFormat = configInfo.stencilAttachmentFormat;
+        pipelineInfo.pNext = &renderingInfo;
+    }
+
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
 
-    if (vkCreateGraphicsPipelines(device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(device.device(), pipelineCache.handle(), 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create graphics pipeline.");
     }
 }
 
-void Pipeline::createShaderModule(const std::vector<char>& code,VkShaderModule* shaderModule) {
-    VkShaderModuleCreateInfo createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-    if (vkCreateShaderModule(device.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create shader module.");
-    }    
-}
-
 PipelineConfigInfo Pipeline::defaultPipelineConfigInfo(uint32_t width, uint32_t height) {
     PipelineConfigInfo configInfo = {};
 
+    setVertexLayout<VModel::Layout>(configInfo);
+
     configInfo.inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     configInfo.inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     configInfo.inputAssembly.primitiveRestartEnable = VK_FALSE;
@@ -4,8 +4,12 @@
 #include <fstream>
 #include "device.hpp"
 #include "model.hpp"
+#include "pipeline_cache.hpp"
+#include "shader_reflection.hpp"
+#include "specialization_constants.hpp"
 
 struct PipelineConfigInfo {
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo;
     VkViewport viewport;
     VkRect2D scissor;
     VkPipelineInputAssemblyStateCreateInfo inputAssembly;
@@ -17,12 +21,20 @@ struct PipelineConfigInfo {
     VkPipelineLayout pipelineLayout = nullptr;
     VkRenderPass renderPass = nullptr;
     uint32_t subpass = 0;
+    // Without a render pass the pipeline is for dynamic rendering into
+    // attachments of these formats.
+    std::vector<VkFormat> colorAttachmentFormats;
+    VkFormat depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+    VkFormat stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+    // Applied to every stage; a constant id only needs to exist in one of them.
+    SpecializationConstants specialization;
 };
 
 class Pipeline {
     public:
         Pipeline(
             Device &device,
+            PipelineCache &pipelineCache,
             const std::string& vertFilePath,
             const std::string& fragFilePath,
             const PipelineConfigInfo& configInfo
@@ -34,21 +46,29 @@ class Pipeline {
 
         void bind(VkCommandBuffer commandBuffer);
 
+        static std::vector<char> readFile(const std::string& filePath);
+
         static PipelineConfigInfo defaultPipelineConfigInfo(uint32_t width, uint32_t height);
 
-    private:
-        std::vector<char> readFile(const std::string& filePath);
+        // Points the config at the compile-time descriptions of a VertexLayout.
+        // The arrays are static, so nothing is allocated and the config can be copied freely.
+        template <typename Layout>
+        static void setVertexLayout(PipelineConfigInfo& configInfo) {
+            configInfo.vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+            configInfo.vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(Layout::bindings.size());
+            configInfo.vertexInputInfo.pVertexBindingDescriptions = Layout::bindings.data();
+            configInfo.vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(Layout::attributes.size());
+            configInfo.vertexInputInfo.pVertexAttributeDescriptions = Layout::attributes.data();
+        }
 
+    private:
         void createGraphicsPipeline(
             const std::string& vertFilePath,
             const std::string& fragFilePath,
             const PipelineConfigInfo& configInfo
             );
 
-        void createShaderModule(const std::vector<char>& code,VkShaderModule* shaderModule);
-        
         Device& device;
+        PipelineCache& pipelineCache;
         VkPipeline graphicsPipeline;
-        VkShaderModule vertShaderModule;
-        VkShaderModule fragShaderModule;
 };
\ No newline at end of file
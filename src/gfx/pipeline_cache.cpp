@@ -0,0 +1,137 @@
+#include "pipeline_cache.hpp"
+
+#include "pipeline.hpp"
+
+// std
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// VkPipelineCacheHeaderVersionOne
+struct PipelineCacheHeader {
+  uint32_t headerSize;
+  uint32_t headerVersion;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+}  // namespace
+
+PipelineCache::PipelineCache(Device &device, const std::string &cacheFilePath)
+    : device{device}, cacheFilePath{cacheFilePath} {
+  std::vector<char> initialData = loadCacheData();
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = initialData.size();
+  cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+  if (vkCreatePipelineCache(device.device(), &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+}
+
+PipelineCache::~PipelineCache() {
+  try {
+    save();
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+  }
+
+  for (auto &entry : shaders) {
+    vkDestroyShaderModule(device.device(), entry.second.module, nullptr);
+  }
+  vkDestroyPipelineCache(device.device(), pipelineCache, nullptr);
+}
+
+std::vector<char> PipelineCache::loadCacheData() {
+  std::ifstream file(cacheFilePath, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    return {};
+  }
+
+  size_t fileSize = static_cast<size_t>(file.tellg());
+  std::vector<char> data(fileSize);
+  file.seekg(0);
+  file.read(data.data(), fileSize);
+
+  // A blob from another driver or GPU is ignored by the implementation anyway,
+  // but checking here keeps a stale file from being handed over at all.
+  PipelineCacheHeader header;
+  if (data.size() < sizeof(header)) {
+    return {};
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.vendorID != device.properties.vendorID ||
+      header.deviceID != device.properties.deviceID ||
+      memcmp(header.pipelineCacheUUID, device.properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    std::cout << "Pipeline cache " << cacheFilePath << " is from another device, ignoring"
+              << std::endl;
+    return {};
+  }
+  return data;
+}
+
+void PipelineCache::save() {
+  size_t dataSize = 0;
+  if (vkGetPipelineCacheData(device.device(), pipelineCache, &dataSize, nullptr) != VK_SUCCESS ||
+      dataSize == 0) {
+    return;
+  }
+  std::vector<char> data(dataSize);
+  if (vkGetPipelineCacheData(device.device(), pipelineCache, &dataSize, data.data()) !=
+      VK_SUCCESS) {
+    return;
+  }
+
+  std::ofstream file(cacheFilePath, std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to write pipeline cache: " + cacheFilePath);
+  }
+  file.write(data.data(), static_cast<std::streamsize>(dataSize));
+}
+
+PipelineCache::ShaderEntry &PipelineCache::loadShader(const std::string &filePath) {
+  auto found = shaders.find(filePath);
+  if (found != shaders.end()) {
+    return found->second;
+  }
+
+  auto code = Pipeline::readFile(filePath);
+
+  ShaderEntry entry;
+  entry.reflection = ShaderReflection::reflect(code);
+
+  VkShaderModuleCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = code.size();
+  createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+  if (vkCreateShaderModule(device.device(), &createInfo, nullptr, &entry.module) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shader module.");
+  }
+
+  return shaders.emplace(filePath, std::move(entry)).first->second;
+}
+
+VkShaderModule PipelineCache::getShaderModule(const std::string &filePath) {
+  return loadShader(filePath).module;
+}
+
+const ShaderReflection &PipelineCache::getReflection(const std::string &filePath) {
+  return loadShader(filePath).reflection;
+}
+
+void PipelineCache::invalidate(const std::string &filePath) {
+  auto found = shaders.find(filePath);
+  if (found == shaders.end()) {
+    return;
+  }
+  // A module is only read while creating pipelines, so it can go right away
+  vkDestroyShaderModule(device.device(), found->second.module, nullptr);
+  shaders.erase(found);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "device.hpp"
+#include "shader_reflection.hpp"
+
+// std
+#include <string>
+#include <unordered_map>
+
+// Shared state for building pipelines: one VkShaderModule and one reflection
+// per SPIR-V file no matter how many variants use it, and a driver
+// VkPipelineCache that is persisted between runs. Specialization constants are
+// part of the driver's cache key, so each variant is compiled at most once.
+class PipelineCache {
+ public:
+  PipelineCache(Device &device, const std::string &cacheFilePath);
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache &) = delete;
+  PipelineCache &operator=(const PipelineCache &) = delete;
+
+  VkPipelineCache handle() { return pipelineCache; }
+
+  VkShaderModule getShaderModule(const std::string &filePath);
+  const ShaderReflection &getReflection(const std::string &filePath);
+
+  // Forgets a SPIR-V file so the next request reads it from disk again.
+  // Pipelines already built from it are unaffected.
+  void invalidate(const std::string &filePath);
+
+  // Writes the driver cache to disk; also done on destruction.
+  void save();
+
+ private:
+  struct ShaderEntry {
+    VkShaderModule module = VK_NULL_HANDLE;
+    ShaderReflection reflection;
+  };
+
+  ShaderEntry &loadShader(const std::string &filePath);
+  std::vector<char> loadCacheData();
+
+  Device &device;
+  std::string cacheFilePath;
+  VkPipelineCache pipelineCache;
+  std::unordered_map<std::string, ShaderEntry> shaders;
+};
@@ -0,0 +1,158 @@
+#include "pipeline_layout_cache.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+PipelineLayoutCache::PipelineLayoutCache(Device &device) : device{device} {}
+
+PipelineLayoutCache::~PipelineLayoutCache() {
+  for (auto &entry : pipelineLayouts) {
+    vkDestroyPipelineLayout(device.device(), entry.second, nullptr);
+  }
+  for (auto &entry : setLayouts) {
+    vkDestroyDescriptorSetLayout(device.device(), entry.second, nullptr);
+  }
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getDescriptorSetLayout(
+    const std::vector<VkDescriptorSetLayoutBinding> &bindings) {
+  std::vector<VkDescriptorSetLayoutBinding> sorted = bindings;
+  std::sort(
+      sorted.begin(),
+      sorted.end(),
+      [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+        return a.binding < b.binding;
+      });
+
+  std::vector<uint32_t> key;
+  key.reserve(sorted.size() * 4);
+  for (const auto &binding : sorted) {
+    key.push_back(binding.binding);
+    key.push_back(static_cast<uint32_t>(binding.descriptorType));
+    key.push_back(binding.descriptorCount);
+    key.push_back(binding.stageFlags);
+  }
+
+  auto found = setLayouts.find(key);
+  if (found != setLayouts.end()) {
+    return found->second;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(sorted.size());
+  layoutInfo.pBindings = sorted.data();
+
+  VkDescriptorSetLayout setLayout;
+  if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo, nullptr, &setLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create descriptor set layout!");
+  }
+  setLayouts.emplace(std::move(key), setLayout);
+  return setLayout;
+}
+
+VkPipelineLayout PipelineLayoutCache::getPipelineLayout(
+    const std::vector<const ShaderReflection *> &stages) {
+  // set -> bindings of that set, merged across stages
+  std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;
+  VkPushConstantRange pushConstants{};
+  uint32_t pushConstantEnd = 0;
+  pushConstants.offset = ~0u;
+
+  for (const ShaderReflection *stage : stages) {
+    for (const auto &reflected : stage->descriptorBindings) {
+      if (reflected.count == 0) {
+        throw std::runtime_error(
+            "Pipeline layout: runtime-sized descriptor array '" + reflected.name +
+            "' needs an explicit layout");
+      }
+      if (sets.size() <= reflected.set) {
+        sets.resize(reflected.set + 1);
+      }
+      auto &bindings = sets[reflected.set];
+      auto existing = std::find_if(
+          bindings.begin(),
+          bindings.end(),
+          [&](const VkDescriptorSetLayoutBinding &b) { return b.binding == reflected.binding; });
+      if (existing == bindings.end()) {
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = reflected.binding;
+        binding.descriptorType = reflected.type;
+        binding.descriptorCount = reflected.count;
+        binding.stageFlags = stage->stage;
+        bindings.push_back(binding);
+      } else if (
+          existing->descriptorType != reflected.type ||
+          existing->descriptorCount != reflected.count) {
+        throw std::runtime_error(
+            "Pipeline layout: stages disagree on set " + std::to_string(reflected.set) +
+            " binding " + std::to_string(reflected.binding));
+      } else {
+        existing->stageFlags |= stage->stage;
+      }
+    }
+
+    if (stage->pushConstantSize > 0) {
+      pushConstants.stageFlags |= stage->stage;
+      pushConstants.offset = std::min(pushConstants.offset, stage->pushConstantOffset);
+      pushConstantEnd =
+          std::max(pushConstantEnd, stage->pushConstantOffset + stage->pushConstantSize);
+    }
+  }
+
+  std::vector<VkDescriptorSetLayout> layouts;
+  layouts.reserve(sets.size());
+  for (const auto &bindings : sets) {
+    layouts.push_back(getDescriptorSetLayout(bindings));
+  }
+
+  bool hasPushConstants = pushConstantEnd > 0;
+  if (hasPushConstants) {
+    pushConstants.size = pushConstantEnd - pushConstants.offset;
+  }
+
+  std::vector<uint64_t> key;
+  for (VkDescriptorSetLayout layout : layouts) {
+    key.push_back(reinterpret_cast<uint64_t>(layout));
+  }
+  // separator so a push range can never alias a set layout handle
+  key.push_back(~0ull);
+  if (hasPushConstants) {
+    key.push_back(pushConstants.stageFlags);
+    key.push_back(pushConstants.offset);
+    key.push_back(pushConstants.size);
+  }
+
+  auto found = pipelineLayouts.find(key);
+  if (found != pipelineLayouts.end()) {
+    return found->second;
+  }
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+  pipelineLayoutInfo.pSetLayouts = layouts.data();
+  pipelineLayoutInfo.pushConstantRangeCount = hasPushConstants ? 1 : 0;
+  pipelineLayoutInfo.pPushConstantRanges = hasPushConstants ? &pushConstants : nullptr;
+
+  VkPipelineLayout pipelineLayout;
+  if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create pipeline layout.");
+  }
+  pipelineLayouts.emplace(std::move(key), pipelineLayout);
+  pipelineSetLayouts.emplace(pipelineLayout, std::move(layouts));
+  return pipelineLayout;
+}
+
+const std::vector<VkDescriptorSetLayout> &PipelineLayoutCache::getSetLayouts(
+    VkPipelineLayout pipelineLayout) const {
+  auto found = pipelineSetLayouts.find(pipelineLayout);
+  if (found == pipelineSetLayouts.end()) {
+    throw std::runtime_error("Pipeline layout was not created by this cache");
+  }
+  return found->second;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "device.hpp"
+#include "shader_reflection.hpp"
+
+// std
+#include <map>
+#include <vector>
+
+// Builds descriptor set layouts and pipeline layouts from shader reflection and
+// hands out the same handle for every request with an identical interface.
+// Owns everything it creates.
+class PipelineLayoutCache {
+ public:
+  explicit PipelineLayoutCache(Device &device);
+  ~PipelineLayoutCache();
+
+  PipelineLayoutCache(const PipelineLayoutCache &) = delete;
+  PipelineLayoutCache &operator=(const PipelineLayoutCache &) = delete;
+
+  // Merges the interfaces of all stages (bindings by set/binding, push constants
+  // into one range) and returns the matching layout.
+  VkPipelineLayout getPipelineLayout(const std::vector<const ShaderReflection *> &stages);
+  VkDescriptorSetLayout getDescriptorSetLayout(
+      const std::vector<VkDescriptorSetLayoutBinding> &bindings);
+
+  // Set layouts a pipeline layout returned by this cache was built from, indexed by set.
+  const std::vector<VkDescriptorSetLayout> &getSetLayouts(VkPipelineLayout pipelineLayout) const;
+
+ private:
+  Device &device;
+
+  std::map<std::vector<uint32_t>, VkDescriptorSetLayout> setLayouts;
+  std::map<std::vector<uint64_t>, VkPipelineLayout> pipelineLayouts;
+  std::map<VkPipelineLayout, std::vector<VkDescriptorSetLayout>> pipelineSetLayouts;
+};
@@ -0,0 +1,118 @@
+#include "prefix_sum.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t blockCount(uint32_t count) {
+  return (count + PrefixSum::BLOCK_SIZE - 1) / PrefixSum::BLOCK_SIZE;
+}
+
+}  // namespace
+
+PrefixSum::PrefixSum(
+    Device &device,
+    PipelineCache &pipelineCache,
+    PipelineLayoutCache &layoutCache,
+    const std::string &shaderDirectory,
+    uint32_t maxCount)
+    : device{device},
+      maxCount{maxCount},
+      alignment{std::max<VkDeviceSize>(device.properties.limits.minStorageBufferOffsetAlignment, sizeof(uint32_t))} {
+  if (maxCount == 0 || blockCount(maxCount) > device.properties.limits.maxComputeWorkGroupCount[0]) {
+    throw std::invalid_argument("prefix sum of " + std::to_string(maxCount) + " values needs too many workgroups");
+  }
+  scanPipeline = std::make_unique<ComputePipeline>(
+      device, pipelineCache, layoutCache, shaderDirectory + "/prefix_sum.comp.spv");
+  addPipeline = std::make_unique<ComputePipeline>(
+      device, pipelineCache, layoutCache, shaderDirectory + "/prefix_sum_add.comp.spv");
+
+  device.createBuffer(
+      getScratchSize(maxCount),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      scratchBuffer,
+      scratchBufferMemory);
+}
+
+PrefixSum::~PrefixSum() {
+  vkDestroyBuffer(device.device(), scratchBuffer, nullptr);
+  device.freeMemory(scratchBufferMemory);
+}
+
+VkDeviceSize PrefixSum::getScratchSize(uint32_t count) const {
+  VkDeviceSize size = 0;
+  do {
+    count = blockCount(count);
+    size += alignUp(sizeof(uint32_t) * count, alignment);
+  } while (count > 1);
+  return size;
+}
+
+void PrefixSum::record(ComputeContext::Job &job, VkBuffer input, VkBuffer output, uint32_t count) {
+  if (count > maxCount) {
+    throw std::invalid_argument("prefix sum of more values than it was created for");
+  }
+  if (count == 0) {
+    return;
+  }
+
+  struct Level {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    uint32_t count;
+  };
+  // Sums of the values, then of each level's block totals
+  std::vector<Level> levels{{output, 0, count}};
+  VkBuffer source = input;
+  VkDeviceSize scratchOffset = 0;
+  while (true) {
+    const Level level = levels.back();
+    const uint32_t blocks = blockCount(level.count);
+    const Level totals{scratchBuffer, scratchOffset, blocks};
+    scratchOffset += alignUp(sizeof(uint32_t) * blocks, alignment);
+
+    const VkDeviceSize bytes = sizeof(uint32_t) * level.count;
+    job.dispatch(
+        *scanPipeline,
+        {{0, source, level.offset, bytes},
+         {1, level.buffer, level.offset, bytes},
+         {2, totals.buffer, totals.offset, sizeof(uint32_t) * blocks}},
+        blocks,
+        1,
+        1,
+        &level.count,
+        sizeof(level.count));
+    job.barrier();
+    if (blocks == 1) {
+      break;
+    }
+    // The next level scans the totals in place
+    levels.push_back(totals);
+    source = totals.buffer;
+  }
+
+  // Level i's scanned totals are the offsets of level i - 1's blocks
+  for (size_t i = levels.size() - 1; i > 0; i--) {
+    const Level &level = levels[i - 1];
+    const Level &offsets = levels[i];
+    job.dispatch(
+        *addPipeline,
+        {{0, level.buffer, level.offset, sizeof(uint32_t) * level.count},
+         {1, offsets.buffer, offsets.offset, sizeof(uint32_t) * offsets.count}},
+        blockCount(level.count),
+        1,
+        1,
+        &level.count,
+        sizeof(level.count));
+    job.barrier();
+  }
+}
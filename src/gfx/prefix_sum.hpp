@@ -0,0 +1,51 @@
+#pragma once
+
+#include "compute_context.hpp"
+#include "compute_pipeline.hpp"
+#include "device.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_layout_cache.hpp"
+
+// std
+#include <memory>
+#include <string>
+
+// Exclusive prefix sum of uint32 values on the GPU, the building block for
+// compacting lists (visible instances, live particles) in compute. Blocks of
+// BLOCK_SIZE values are scanned in shared memory, then the block totals level
+// by level, and finally each level's offsets are added back down. The scratch
+// for the block totals is allocated up front for maxCount values.
+class PrefixSum {
+ public:
+  // Values per workgroup; must match prefix_sum.comp and prefix_sum_add.comp
+  static constexpr uint32_t BLOCK_SIZE = 512;
+
+  // shaderDirectory holds the compiled prefix_sum*.comp.spv
+  PrefixSum(
+      Device &device,
+      PipelineCache &pipelineCache,
+      PipelineLayoutCache &layoutCache,
+      const std::string &shaderDirectory,
+      uint32_t maxCount);
+  ~PrefixSum();
+
+  PrefixSum(const PrefixSum &) = delete;
+  PrefixSum &operator=(const PrefixSum &) = delete;
+
+  // output[i] = input[0] + ... + input[i - 1] for the first count values,
+  // wrapping on overflow. input and output may be the same buffer. Ends with a
+  // barrier, so later dispatches in the job see the sums.
+  void record(ComputeContext::Job &job, VkBuffer input, VkBuffer output, uint32_t count);
+
+ private:
+  // Bytes of block totals for count values, every level aligned for binding
+  VkDeviceSize getScratchSize(uint32_t count) const;
+
+  Device &device;
+  uint32_t maxCount;
+  VkDeviceSize alignment;
+  std::unique_ptr<ComputePipeline> scanPipeline;
+  std::unique_ptr<ComputePipeline> addPipeline;
+  VkBuffer scratchBuffer;
+  VkDeviceMemory scratchBufferMemory;
+};
@@ -0,0 +1,102 @@
+#include "radix_sort.hpp"
+
+// std
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t RADIX = 1u << RadixSort::BITS_PER_PASS;
+
+uint32_t tilesFor(uint32_t count) {
+  return (count + RadixSort::TILE_SIZE - 1) / RadixSort::TILE_SIZE;
+}
+
+}  // namespace
+
+RadixSort::RadixSort(
+    Device &device,
+    PipelineCache &pipelineCache,
+    PipelineLayoutCache &layoutCache,
+    const std::string &shaderDirectory,
+    uint32_t maxCount)
+    : device{device},
+      tileCount{tilesFor(maxCount)},
+      prefixSum{device, pipelineCache, layoutCache, shaderDirectory, RADIX * tilesFor(maxCount)} {
+  if (maxCount == 0 || tileCount > device.properties.limits.maxComputeWorkGroupCount[0]) {
+    throw std::invalid_argument("radix sort of " + std::to_string(maxCount) + " keys needs too many workgroups");
+  }
+  histogramPipeline = std::make_unique<ComputePipeline>(
+      device, pipelineCache, layoutCache, shaderDirectory + "/radix_histogram.comp.spv");
+  scatterPipeline = std::make_unique<ComputePipeline>(
+      device, pipelineCache, layoutCache, shaderDirectory + "/radix_scatter.comp.spv");
+
+  const VkDeviceSize bytes = sizeof(uint32_t) * static_cast<VkDeviceSize>(maxCount);
+  device.createBuffer(
+      bytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scratchKeys, scratchKeysMemory);
+  device.createBuffer(
+      bytes,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      scratchValues,
+      scratchValuesMemory);
+  device.createBuffer(
+      sizeof(uint32_t) * RADIX * tileCount,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      histograms,
+      histogramsMemory);
+}
+
+RadixSort::~RadixSort() {
+  vkDestroyBuffer(device.device(), scratchKeys, nullptr);
+  device.freeMemory(scratchKeysMemory);
+  vkDestroyBuffer(device.device(), scratchValues, nullptr);
+  device.freeMemory(scratchValuesMemory);
+  vkDestroyBuffer(device.device(), histograms, nullptr);
+  device.freeMemory(histogramsMemory);
+}
+
+void RadixSort::record(
+    ComputeContext::Job &job,
+    VkBuffer keys,
+    VkBuffer values,
+    uint32_t keyBits,
+    VkBuffer countBuffer,
+    uint32_t countIndex) {
+  if (keyBits == 0 || keyBits > 32 || keyBits % (2 * BITS_PER_PASS) != 0) {
+    throw std::invalid_argument("radix sort key bits must be a multiple of " + std::to_string(2 * BITS_PER_PASS));
+  }
+
+  struct Push {
+    uint32_t shift;
+    uint32_t countIndex;
+  };
+  VkBuffer keysIn = keys, valuesIn = values;
+  VkBuffer keysOut = scratchKeys, valuesOut = scratchValues;
+  for (uint32_t shift = 0; shift < keyBits; shift += BITS_PER_PASS) {
+    const Push push{shift, countIndex};
+    job.dispatch(
+        *histogramPipeline,
+        {{0, keysIn}, {1, countBuffer}, {2, histograms}},
+        tileCount,
+        1,
+        1,
+        &push,
+        sizeof(push));
+    job.barrier();
+    prefixSum.record(job, histograms, histograms, RADIX * tileCount);
+    job.dispatch(
+        *scatterPipeline,
+        {{0, keysIn}, {1, valuesIn}, {2, keysOut}, {3, valuesOut}, {4, histograms}, {5, countBuffer}},
+        tileCount,
+        1,
+        1,
+        &push,
+        sizeof(push));
+    job.barrier();
+    std::swap(keysIn, keysOut);
+    std::swap(valuesIn, valuesOut);
+  }
+}
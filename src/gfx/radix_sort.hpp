@@ -0,0 +1,68 @@
+#pragma once
+
+#include "compute_context.hpp"
+#include "compute_pipeline.hpp"
+#include "device.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_layout_cache.hpp"
+#include "prefix_sum.hpp"
+
+// std
+#include <memory>
+#include <string>
+
+// Stable least-significant-digit radix sort of uint32 keys with a uint32
+// value each, on the GPU. Every pass over BITS_PER_PASS bits counts the
+// digits per tile, scans the counts with PrefixSum and scatters the keys to
+// the scanned offsets, ping-ponging with scratch buffers allocated up front
+// for maxCount keys.
+//
+// The number of keys is read on the GPU, so it can come from an earlier
+// dispatch of the same job (e.g. a compaction) without a round trip to the
+// CPU. Every pass is dispatched for maxCount keys; tiles past the count do
+// no work.
+class RadixSort {
+ public:
+  // Keys per workgroup; must match radix_histogram.comp and radix_scatter.comp
+  static constexpr uint32_t TILE_SIZE = 256;
+  static constexpr uint32_t BITS_PER_PASS = 4;
+
+  // shaderDirectory holds the compiled radix_*.comp.spv and prefix_sum*.comp.spv
+  RadixSort(
+      Device &device,
+      PipelineCache &pipelineCache,
+      PipelineLayoutCache &layoutCache,
+      const std::string &shaderDirectory,
+      uint32_t maxCount);
+  ~RadixSort();
+
+  RadixSort(const RadixSort &) = delete;
+  RadixSort &operator=(const RadixSort &) = delete;
+
+  // Sorts the first count keys ascending by their low keyBits bits, in place,
+  // moving the values with them. count is countBuffer's uint at countIndex and
+  // at most maxCount. keyBits is a multiple of 2 * BITS_PER_PASS, so the
+  // passes end in keys and values again. Ends with a barrier, so later
+  // dispatches in the job see the sorted keys.
+  void record(
+      ComputeContext::Job &job,
+      VkBuffer keys,
+      VkBuffer values,
+      uint32_t keyBits,
+      VkBuffer countBuffer,
+      uint32_t countIndex);
+
+ private:
+  Device &device;
+  uint32_t tileCount;
+  std::unique_ptr<ComputePipeline> histogramPipeline;
+  std::unique_ptr<ComputePipeline> scatterPipeline;
+  PrefixSum prefixSum;
+  VkBuffer scratchKeys;
+  VkDeviceMemory scratchKeysMemory;
+  VkBuffer scratchValues;
+  VkDeviceMemory scratchValuesMemory;
+  // RADIX counts per tile, then their offsets
+  VkBuffer histograms;
+  VkDeviceMemory histogramsMemory;
+};
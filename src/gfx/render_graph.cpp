@@ -0,0 +1,1027 @@
+#include "render_graph.hpp"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+struct AccessInfo {
+  VkPipelineStageFlags stages;
+  VkAccessFlags access;
+  VkImageLayout layout;
+  VkImageUsageFlags usage;
+};
+
+constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                       VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                       VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+AccessInfo accessInfo(RGAccess access) {
+  constexpr VkPipelineStageFlags fragmentTests =
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  switch (access) {
+    case RGAccess::ColorAttachment:
+      return {
+          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+          VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+    case RGAccess::DepthAttachment:
+      return {
+          fragmentTests,
+          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+    case RGAccess::DepthAttachmentReadOnly:
+      return {
+          fragmentTests,
+          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+          VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+    case RGAccess::SampledFragment:
+      return {
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+          VK_IMAGE_USAGE_SAMPLED_BIT};
+    case RGAccess::SampledCompute:
+      return {
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+          VK_IMAGE_USAGE_SAMPLED_BIT};
+    case RGAccess::StorageRead:
+      return {
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_GENERAL,
+          VK_IMAGE_USAGE_STORAGE_BIT};
+    case RGAccess::StorageWrite:
+      return {
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+          VK_ACCESS_SHADER_WRITE_BIT,
+          VK_IMAGE_LAYOUT_GENERAL,
+          VK_IMAGE_USAGE_STORAGE_BIT};
+    case RGAccess::TransferSrc:
+      return {
+          VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_ACCESS_TRANSFER_READ_BIT,
+          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+    case RGAccess::TransferDst:
+      return {
+          VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_ACCESS_TRANSFER_WRITE_BIT,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+  }
+  throw std::invalid_argument("unknown render graph access");
+}
+
+VkImageAspectFlags aspectFor(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    case VK_FORMAT_S8_UINT:
+      return VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+      return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+RenderGraph::RenderGraph(Device &device, uint32_t frameCount)
+    : device{device}, frameCount{frameCount} {
+  stats.frameCount = frameCount;
+}
+
+RenderGraph::~RenderGraph() {
+  for (auto &entry : framebuffers) {
+    vkDestroyFramebuffer(device.device(), entry.second, nullptr);
+  }
+  for (auto &pass : passes) {
+    if (pass.renderPass != VK_NULL_HANDLE) {
+      vkDestroyRenderPass(device.device(), pass.renderPass, nullptr);
+    }
+  }
+  for (auto &resource : resources) {
+    if (resource.imported) {
+      continue;
+    }
+    for (auto view : resource.views) {
+      vkDestroyImageView(device.device(), view, nullptr);
+    }
+    for (auto image : resource.images) {
+      vkDestroyImage(device.device(), image, nullptr);
+    }
+  }
+  for (auto memory : memoryBlocks) {
+    device.freeMemory(memory);
+  }
+}
+
+RGResource RenderGraph::createImage(const std::string &name, const RGImageDesc &desc) {
+  if (compiled) {
+    throw std::logic_error("render graph is already compiled");
+  }
+  ResourceNode resource;
+  resource.name = name;
+  resource.desc = desc;
+  resources.push_back(std::move(resource));
+  return static_cast<RGResource>(resources.size() - 1);
+}
+
+RGResource RenderGraph::importImage(
+    const std::string &name,
+    const RGImageDesc &desc,
+    VkImageLayout initialLayout,
+    VkImageLayout finalLayout) {
+  RGResource id = createImage(name, desc);
+  resources[id].imported = true;
+  resources[id].images.resize(1, VK_NULL_HANDLE);
+  resources[id].views.resize(1, VK_NULL_HANDLE);
+  resources[id].initialLayout = initialLayout;
+  resources[id].finalLayout = finalLayout;
+  return id;
+}
+
+RGPass RenderGraph::addRasterPass(
+    const std::string &name, std::function<void(VkCommandBuffer)> record) {
+  RGPass id = addPass(name, std::move(record));
+  passes[id].raster = true;
+  return id;
+}
+
+RGPass RenderGraph::addPass(const std::string &name, std::function<void(VkCommandBuffer)> record) {
+  if (compiled) {
+    throw std::logic_error("render graph is already compiled");
+  }
+  PassNode pass;
+  pass.name = name;
+  pass.raster = false;
+  pass.record = std::move(record);
+  passes.push_back(std::move(pass));
+  return static_cast<RGPass>(passes.size() - 1);
+}
+
+void RenderGraph::addUse(RGPass pass, RGResource image, RGAccess access, bool reads, bool writes) {
+  if (compiled) {
+    throw std::logic_error("render graph is already compiled");
+  }
+  auto &uses = passes.at(pass).uses;
+  for (const auto &use : uses) {
+    if (use.resource == image) {
+      throw std::invalid_argument(
+          "pass " + passes[pass].name + " uses image " + resources.at(image).name + " twice");
+    }
+  }
+  resources.at(image).usage |= accessInfo(access).usage;
+  uses.push_back({image, access, reads, writes});
+}
+
+void RenderGraph::colorAttachment(
+    RGPass pass, RGResource image, std::optional<VkClearColorValue> clear) {
+  addUse(pass, image, RGAccess::ColorAttachment, !clear.has_value(), true);
+  Attachment attachment{image, RGAccess::ColorAttachment, std::nullopt};
+  if (clear) {
+    VkClearValue value{};
+    value.color = *clear;
+    attachment.clear = value;
+  }
+  passes[pass].attachments.push_back(attachment);
+}
+
+void RenderGraph::depthAttachment(
+    RGPass pass,
+    RGResource image,
+    std::optional<VkClearDepthStencilValue> clear,
+    bool readOnly) {
+  if (readOnly && clear) {
+    throw std::invalid_argument("a read-only depth attachment can't be cleared");
+  }
+  RGAccess access = readOnly ? RGAccess::DepthAttachmentReadOnly : RGAccess::DepthAttachment;
+  addUse(pass, image, access, !clear.has_value(), !readOnly);
+  Attachment attachment{image, access, std::nullopt};
+  if (clear) {
+    VkClearValue value{};
+    value.depthStencil = *clear;
+    attachment.clear = value;
+  }
+  passes[pass].attachments.push_back(attachment);
+}
+
+void RenderGraph::resolveAttachment(RGPass pass, RGResource source, RGResource target) {
+  auto &attachments = passes.at(pass).attachments;
+  auto found = std::find_if(attachments.begin(), attachments.end(), [&](const Attachment &attachment) {
+    return attachment.resource == source && attachment.access == RGAccess::ColorAttachment &&
+           attachment.resolveOf < 0;
+  });
+  if (found == attachments.end()) {
+    throw std::invalid_argument(
+        resources.at(source).name + " is not a color attachment of pass " + passes[pass].name);
+  }
+  const RGImageDesc &from = resources[source].desc;
+  const RGImageDesc &to = resources.at(target).desc;
+  if (from.samples == VK_SAMPLE_COUNT_1_BIT || to.samples != VK_SAMPLE_COUNT_1_BIT ||
+      from.format != to.format || from.extent.width != to.extent.width ||
+      from.extent.height != to.extent.height) {
+    throw std::invalid_argument(
+        "can't resolve " + resources[source].name + " into " + resources[target].name +
+        ": needs a multisampled source and a single-sampled target of the same format and size");
+  }
+  // The whole target is overwritten, so its previous contents aren't read
+  addUse(pass, target, RGAccess::ColorAttachment, false, true);
+  Attachment attachment{target, RGAccess::ColorAttachment, std::nullopt};
+  attachment.resolveOf = static_cast<int>(found - attachments.begin());
+  attachments.push_back(attachment);
+}
+
+void RenderGraph::read(RGPass pass, RGResource image, RGAccess access) {
+  addUse(pass, image, access, true, false);
+}
+
+void RenderGraph::write(RGPass pass, RGResource image, RGAccess access) {
+  addUse(pass, image, access, false, true);
+}
+
+void RenderGraph::compile() {
+  if (compiled) {
+    throw std::logic_error("render graph is already compiled");
+  }
+  cullPasses();
+  computeLifetimes();
+  allocateTransients();
+  computeBarriers();
+  createRenderPasses();
+  createViews();
+  compiled = true;
+}
+
+void RenderGraph::cullPasses() {
+  // Walk backwards from the imported images: a pass is live if it writes
+  // something a later live pass (or the outside world) still needs.
+  std::vector<bool> needed(resources.size());
+  for (size_t i = 0; i < resources.size(); i++) {
+    needed[i] = resources[i].imported;
+  }
+
+  for (size_t p = passes.size(); p-- > 0;) {
+    auto &pass = passes[p];
+    pass.live = std::any_of(pass.uses.begin(), pass.uses.end(), [&](const Use &use) {
+      return use.writes && needed[use.resource];
+    });
+    if (!pass.live) {
+      continue;
+    }
+    // A full overwrite ends the dependency on earlier writers...
+    for (const auto &use : pass.uses) {
+      if (use.writes && !use.reads && !resources[use.resource].imported) {
+        needed[use.resource] = false;
+      }
+    }
+    // ...unless this pass reads the contents too
+    for (const auto &use : pass.uses) {
+      if (use.reads) {
+        needed[use.resource] = true;
+      }
+    }
+  }
+
+  livePasses.clear();
+  for (RGPass p = 0; p < passes.size(); p++) {
+    if (passes[p].live) {
+      livePasses.push_back(p);
+    }
+  }
+  stats.passes = static_cast<uint32_t>(passes.size());
+  stats.culledPasses = static_cast<uint32_t>(passes.size() - livePasses.size());
+}
+
+void RenderGraph::computeLifetimes() {
+  for (int order = 0; order < static_cast<int>(livePasses.size()); order++) {
+    for (const auto &use : passes[livePasses[order]].uses) {
+      auto &resource = resources[use.resource];
+      if (resource.firstPass < 0) {
+        resource.firstPass = order;
+      }
+      resource.lastPass = order;
+    }
+  }
+}
+
+void RenderGraph::allocateTransients() {
+  std::vector<RGResource> transients;
+  for (RGResource id = 0; id < resources.size(); id++) {
+    auto &resource = resources[id];
+    if (resource.imported || resource.firstPass < 0) {
+      continue;
+    }
+
+    // Contents that are never loaded or stored only ever live in tile memory
+    bool attachmentOnly = true;
+    for (RGPass p : livePasses) {
+      for (const auto &use : passes[p].uses) {
+        if (use.resource == id) {
+          attachmentOnly &= (use.access == RGAccess::ColorAttachment ||
+                             use.access == RGAccess::DepthAttachment) &&
+                            use.writes && !use.reads;
+        }
+      }
+    }
+    if (attachmentOnly) {
+      resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {resource.desc.extent.width, resource.desc.extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = resource.desc.format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = resource.usage;
+    imageInfo.samples = resource.desc.samples;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    resource.images.resize(frameCount);
+    for (auto &image : resource.images) {
+      if (vkCreateImage(device.device(), &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render graph image " + resource.name);
+      }
+    }
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device.device(), resource.images[0], &requirements);
+    resource.alignment = requirements.alignment;
+    resource.size = alignUp(requirements.size, requirements.alignment);
+    resource.memoryTypeBits = requirements.memoryTypeBits;
+    resource.lazy =
+        attachmentOnly &&
+        device.hasMemoryType(
+            requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    stats.transientBytesRequested += resource.size * frameCount;
+    transients.push_back(id);
+  }
+
+  // Largest first, each at the lowest offset that doesn't collide with an
+  // image that is alive at the same time. Images with different memory
+  // requirements go into separate blocks.
+  std::sort(transients.begin(), transients.end(), [&](RGResource a, RGResource b) {
+    return resources[a].size > resources[b].size;
+  });
+
+  std::map<std::pair<uint32_t, bool>, std::vector<RGResource>> blocks;
+  for (RGResource id : transients) {
+    auto &resource = resources[id];
+    auto &placed = blocks[{resource.memoryTypeBits, resource.lazy}];
+
+    auto livesOverlap = [&](const ResourceNode &other) {
+      return resource.firstPass <= other.lastPass && other.firstPass <= resource.lastPass;
+    };
+
+    std::vector<VkDeviceSize> candidates{0};
+    for (RGResource other : placed) {
+      if (livesOverlap(resources[other])) {
+        candidates.push_back(resources[other].offset + resources[other].size);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (VkDeviceSize candidate : candidates) {
+      VkDeviceSize offset = alignUp(candidate, resource.alignment);
+      bool fits = std::none_of(placed.begin(), placed.end(), [&](RGResource other) {
+        const auto &node = resources[other];
+        return livesOverlap(node) && offset < node.offset + node.size &&
+               node.offset < offset + resource.size;
+      });
+      if (fits) {
+        resource.offset = offset;
+        break;
+      }
+    }
+    placed.push_back(id);
+  }
+
+  for (auto &block : blocks) {
+    // The first use of an image has to wait for the earlier images sharing its memory
+    for (RGResource id : block.second) {
+      auto &resource = resources[id];
+      for (RGResource other : block.second) {
+        const auto &node = resources[other];
+        bool memoryOverlaps = resource.offset < node.offset + node.size &&
+                              node.offset < resource.offset + resource.size;
+        if (other != id && memoryOverlaps && node.lastPass < resource.firstPass) {
+          resource.aliasedPredecessors.push_back(other);
+        }
+      }
+    }
+
+    // Every frame copy gets the same layout, one stride apart
+    VkDeviceSize frameStride = 0;
+    VkDeviceSize maxAlignment = 1;
+    for (RGResource id : block.second) {
+      frameStride = std::max(frameStride, resources[id].offset + resources[id].size);
+      maxAlignment = std::max(maxAlignment, resources[id].alignment);
+    }
+    frameStride = alignUp(frameStride, maxAlignment);
+
+    bool lazy = block.first.second;
+    VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (lazy) {
+      properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    }
+
+    VkMemoryRequirements requirements{};
+    requirements.size = frameStride * frameCount;
+    requirements.alignment = maxAlignment;
+    requirements.memoryTypeBits = block.first.first;
+    // Lazily allocated blocks count in full, though the device may never back them
+    VkDeviceMemory memory = device.allocateMemory(requirements, properties, MemoryCategory::Attachment);
+    memoryBlocks.push_back(memory);
+    stats.transientBytesAllocated += requirements.size;
+    if (lazy) {
+      stats.lazilyAllocatedBytes += requirements.size;
+    }
+
+    for (RGResource id : block.second) {
+      auto &resource = resources[id];
+      for (uint32_t frame = 0; frame < frameCount; frame++) {
+        if (vkBindImageMemory(
+                device.device(),
+                resource.images[frame],
+                memory,
+                frame * frameStride + resource.offset) != VK_SUCCESS) {
+          throw std::runtime_error("failed to bind render graph image memory!");
+        }
+      }
+    }
+  }
+}
+
+void RenderGraph::computeBarriers() {
+  // Simulated state of each image while walking the live passes in order
+  struct State {
+    bool touched = false;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags writeStages = 0;
+    VkAccessFlags writeAccess = 0;
+    VkPipelineStageFlags visibleStages = 0;
+    VkPipelineStageFlags readStages = 0;
+  };
+  std::vector<State> states(resources.size());
+
+  auto addBarrier = [](BarrierBatch &batch,
+                       VkPipelineStageFlags srcStages,
+                       VkPipelineStageFlags dstStages,
+                       Barrier barrier,
+                       bool needsImageBarrier) {
+    srcStages = srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    batch.srcStages |= srcStages;
+    batch.dstStages |= dstStages;
+    if (needsImageBarrier) {
+      barrier.srcStages = srcStages;
+      barrier.dstStages = dstStages;
+      batch.barriers.push_back(barrier);
+    } else {
+      batch.executionDependencies.emplace_back(srcStages, dstStages);
+    }
+  };
+
+  for (RGPass p : livePasses) {
+    auto &pass = passes[p];
+    for (const auto &use : pass.uses) {
+      auto &state = states[use.resource];
+      const auto &resource = resources[use.resource];
+      AccessInfo info = accessInfo(use.access);
+      VkAccessFlags dstAccess = use.writes ? info.access : info.access & ~WRITE_ACCESS;
+
+      if (!state.touched) {
+        // An imported image chains with the semaphore wait at the stage of its
+        // first use. A transient's frame copy was last used frameCount frames
+        // ago, which the frame fence already covers, so it only waits for
+        // transients sharing its memory earlier in this frame. Waiting on its
+        // own stage here would serialize consecutive frames on the queue.
+        VkPipelineStageFlags srcStages = 0;
+        VkAccessFlags srcAccess = 0;
+        if (resource.imported) {
+          srcStages = info.stages;
+        }
+        for (RGResource predecessor : resource.aliasedPredecessors) {
+          srcStages |= states[predecessor].writeStages | states[predecessor].readStages;
+          srcAccess |= states[predecessor].writeAccess;
+        }
+        VkImageLayout oldLayout = resource.imported ? resource.initialLayout
+                                                    : VK_IMAGE_LAYOUT_UNDEFINED;
+        addBarrier(
+            pass.barriers,
+            srcStages,
+            info.stages,
+            {use.resource, oldLayout, info.layout, srcAccess, dstAccess},
+            true);
+        state.touched = true;
+        state.visibleStages = info.stages;
+      } else {
+        bool layoutChange = state.layout != info.layout;
+        if (use.writes) {
+          // WAW and layout changes need memory dependencies, WAR only an execution one
+          if (layoutChange || state.writeAccess != 0) {
+            addBarrier(
+                pass.barriers,
+                state.writeStages | state.readStages,
+                info.stages,
+                {use.resource, state.layout, info.layout, state.writeAccess, dstAccess},
+                true);
+          } else if (state.readStages != 0) {
+            addBarrier(pass.barriers, state.readStages, info.stages, {}, false);
+          }
+        } else {
+          bool notVisible =
+              state.writeAccess != 0 && (info.stages & ~state.visibleStages) != 0;
+          if (layoutChange || notVisible) {
+            VkPipelineStageFlags srcStages = state.writeStages;
+            if (layoutChange) {
+              // the transition itself writes, so earlier readers must finish first
+              srcStages |= state.readStages;
+            }
+            addBarrier(
+                pass.barriers,
+                srcStages,
+                info.stages,
+                {use.resource, state.layout, info.layout, state.writeAccess, dstAccess},
+                true);
+            state.visibleStages = layoutChange ? info.stages : state.visibleStages | info.stages;
+          }
+        }
+      }
+
+      state.layout = info.layout;
+      if (use.writes) {
+        state.writeStages = info.stages;
+        state.writeAccess = info.access & WRITE_ACCESS;
+        state.visibleStages = info.stages;
+        state.readStages = 0;
+      } else {
+        state.readStages |= info.stages;
+      }
+    }
+  }
+
+  for (RGResource id = 0; id < resources.size(); id++) {
+    const auto &resource = resources[id];
+    const auto &state = states[id];
+    if (!resource.imported || !state.touched || state.layout == resource.finalLayout) {
+      continue;
+    }
+    addBarrier(
+        finalBarriers,
+        state.writeStages | state.readStages,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        {id, state.layout, resource.finalLayout, state.writeAccess, 0},
+        true);
+  }
+
+  stats.imageBarriers = static_cast<uint32_t>(finalBarriers.barriers.size());
+  stats.barrierBatches = finalBarriers.empty() ? 0 : 1;
+  for (RGPass p : livePasses) {
+    stats.imageBarriers += static_cast<uint32_t>(passes[p].barriers.barriers.size());
+    stats.barrierBatches += passes[p].barriers.empty() ? 0 : 1;
+  }
+}
+
+void RenderGraph::createRenderPasses() {
+  for (size_t order = 0; order < livePasses.size(); order++) {
+    auto &pass = passes[livePasses[order]];
+    if (!pass.raster) {
+      continue;
+    }
+    if (pass.attachments.empty()) {
+      throw std::invalid_argument("raster pass " + pass.name + " has no attachments");
+    }
+
+    std::vector<VkAttachmentDescription> descriptions;
+    std::vector<VkAttachmentReference> colorRefs;
+    // parallel to colorRefs, UNUSED where a color attachment isn't resolved
+    std::vector<VkAttachmentReference> resolveRefs;
+    bool resolves = false;
+    // per attachment, its index in colorRefs
+    std::vector<size_t> colorSlots(pass.attachments.size());
+    std::optional<VkAttachmentReference> depthRef;
+    std::optional<VkSampleCountFlagBits> samples;
+    pass.clearValues.clear();
+    pass.attachmentOps.clear();
+    pass.formats = {};
+    pass.extent = resources[pass.attachments[0].resource].desc.extent;
+
+    for (size_t a = 0; a < pass.attachments.size(); a++) {
+      const auto &attachment = pass.attachments[a];
+      const auto &resource = resources[attachment.resource];
+      AccessInfo info = accessInfo(attachment.access);
+      bool resolveTarget = attachment.resolveOf >= 0;
+      if (!resolveTarget) {
+        if (samples && *samples != resource.desc.samples) {
+          throw std::invalid_argument("attachments of raster pass " + pass.name + " differ in sample count");
+        }
+        samples = resource.desc.samples;
+      }
+
+      // Keep the results only if a later pass reads them or they leave the graph
+      bool contentsNeeded = resource.imported;
+      for (size_t later = order + 1; later < livePasses.size() && !contentsNeeded; later++) {
+        bool found = false;
+        for (const auto &use : passes[livePasses[later]].uses) {
+          if (use.resource == attachment.resource) {
+            contentsNeeded = use.reads;
+            found = true;
+          }
+        }
+        if (found) {
+          break;
+        }
+      }
+      bool hasContents = resource.firstPass < static_cast<int>(order) ||
+                         (resource.imported && resource.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+
+      // A resolve target is overwritten entirely, whatever it held before
+      VkAttachmentLoadOp loadOp = attachment.clear                   ? VK_ATTACHMENT_LOAD_OP_CLEAR
+                                  : hasContents && !resolveTarget ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                                                  : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      VkAttachmentStoreOp storeOp =
+          contentsNeeded ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      bool hasStencil = (aspectFor(resource.desc.format) & VK_IMAGE_ASPECT_STENCIL_BIT) != 0;
+
+      VkAttachmentDescription description{};
+      description.format = resource.desc.format;
+      description.samples = resource.desc.samples;
+      description.loadOp = loadOp;
+      description.storeOp = storeOp;
+      description.stencilLoadOp = hasStencil ? loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      description.stencilStoreOp = hasStencil ? storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      // Transitions happen in the graph's barriers, not in the render pass
+      description.initialLayout = info.layout;
+      description.finalLayout = info.layout;
+
+      VkAttachmentReference reference{static_cast<uint32_t>(descriptions.size()), info.layout};
+      if (resolveTarget) {
+        resolveRefs[colorSlots[attachment.resolveOf]] = reference;
+        resolves = true;
+      } else if (attachment.access == RGAccess::ColorAttachment) {
+        colorSlots[a] = colorRefs.size();
+        colorRefs.push_back(reference);
+        resolveRefs.push_back({VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED});
+        pass.formats.color.push_back(resource.desc.format);
+      } else if (depthRef) {
+        throw std::invalid_argument("raster pass " + pass.name + " has two depth attachments");
+      } else {
+        depthRef = reference;
+        bool hasDepth = (aspectFor(resource.desc.format) & VK_IMAGE_ASPECT_DEPTH_BIT) != 0;
+        pass.formats.depth = hasDepth ? resource.desc.format : VK_FORMAT_UNDEFINED;
+        pass.formats.stencil = hasStencil ? resource.desc.format : VK_FORMAT_UNDEFINED;
+      }
+      descriptions.push_back(description);
+      pass.clearValues.push_back(attachment.clear.value_or(VkClearValue{}));
+      pass.attachmentOps.push_back({info.layout, loadOp, storeOp});
+    }
+    pass.formats.samples = *samples;
+
+    // Dynamic rendering takes the same ops when recording, there's no
+    // render pass or framebuffer object to create
+    if (device.getCapabilities().dynamicRendering) {
+      continue;
+    }
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+    subpass.pColorAttachments = colorRefs.data();
+    subpass.pResolveAttachments = resolves ? resolveRefs.data() : nullptr;
+    subpass.pDepthStencilAttachment = depthRef ? &*depthRef : nullptr;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+    renderPassInfo.pAttachments = descriptions.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &pass.renderPass) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create render pass for " + pass.name);
+    }
+  }
+}
+
+void RenderGraph::createViews() {
+  for (auto &resource : resources) {
+    if (resource.imported) {
+      continue;
+    }
+    resource.views.resize(resource.images.size());
+    for (size_t i = 0; i < resource.images.size(); i++) {
+      VkImageViewCreateInfo viewInfo{};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.image = resource.images[i];
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = resource.desc.format;
+      viewInfo.subresourceRange.aspectMask = aspectFor(resource.desc.format);
+      viewInfo.subresourceRange.baseMipLevel = 0;
+      viewInfo.subresourceRange.levelCount = 1;
+      viewInfo.subresourceRange.baseArrayLayer = 0;
+      viewInfo.subresourceRange.layerCount = 1;
+
+      if (vkCreateImageView(device.device(), &viewInfo, nullptr, &resource.views[i]) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to create render graph image view!");
+      }
+    }
+  }
+}
+
+void RenderGraph::setImportedImage(RGResource image, VkImage handle, VkImageView view) {
+  auto &resource = resources.at(image);
+  if (!resource.imported) {
+    throw std::invalid_argument(resource.name + " is not an imported image");
+  }
+  resource.images[0] = handle;
+  resource.views[0] = view;
+}
+
+VkRenderPass RenderGraph::getRenderPass(RGPass pass) const {
+  if (!compiled) {
+    throw std::logic_error("render graph is not compiled");
+  }
+  return passes.at(pass).renderPass;
+}
+
+RGAttachmentFormats RenderGraph::getAttachmentFormats(RGPass pass) const {
+  if (!compiled) {
+    throw std::logic_error("render graph is not compiled");
+  }
+  return passes.at(pass).formats;
+}
+
+void RenderGraph::recordBarriers(
+    VkCommandBuffer commandBuffer, const BarrierBatch &batch, uint32_t frame) {
+  if (batch.empty()) {
+    return;
+  }
+  if (device.getCapabilities().synchronization2) {
+    recordBarriers2(commandBuffer, batch, frame);
+    return;
+  }
+  std::vector<VkImageMemoryBarrier> imageBarriers;
+  imageBarriers.reserve(batch.barriers.size());
+  for (const auto &barrier : batch.barriers) {
+    const auto &resource = resources[barrier.resource];
+    VkImageMemoryBarrier imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.srcAccessMask = barrier.srcAccess;
+    imageBarrier.dstAccessMask = barrier.dstAccess;
+    imageBarrier.oldLayout = barrier.oldLayout;
+    imageBarrier.newLayout = barrier.newLayout;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = resource.images[copyIndex(resource, frame)];
+    imageBarrier.subresourceRange = {aspectFor(resource.desc.format), 0, 1, 0, 1};
+    imageBarriers.push_back(imageBarrier);
+  }
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      batch.srcStages,
+      batch.dstStages,
+      0,
+      0,
+      nullptr,
+      0,
+      nullptr,
+      static_cast<uint32_t>(imageBarriers.size()),
+      imageBarriers.data());
+}
+
+// Each barrier waits for and blocks only its own stages, so e.g. a shadow
+// map read in the fragment shader doesn't hold up vertex work just because
+// another image in the same batch is sampled there
+void RenderGraph::recordBarriers2(
+    VkCommandBuffer commandBuffer, const BarrierBatch &batch, uint32_t frame) {
+  // The 1.0 stage and access bits keep their values as 64 bit flags
+  std::vector<VkMemoryBarrier2> memoryBarriers;
+  memoryBarriers.reserve(batch.executionDependencies.size());
+  for (const auto &dependency : batch.executionDependencies) {
+    VkMemoryBarrier2 memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    memoryBarrier.srcStageMask = dependency.first;
+    memoryBarrier.dstStageMask = dependency.second;
+    memoryBarriers.push_back(memoryBarrier);
+  }
+  std::vector<VkImageMemoryBarrier2> imageBarriers;
+  imageBarriers.reserve(batch.barriers.size());
+  for (const auto &barrier : batch.barriers) {
+    const auto &resource = resources[barrier.resource];
+    VkImageMemoryBarrier2 imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    imageBarrier.srcStageMask = barrier.srcStages;
+    imageBarrier.srcAccessMask = barrier.srcAccess;
+    imageBarrier.dstStageMask = barrier.dstStages;
+    imageBarrier.dstAccessMask = barrier.dstAccess;
+    imageBarrier.oldLayout = barrier.oldLayout;
+    imageBarrier.newLayout = barrier.newLayout;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = resource.images[copyIndex(resource, frame)];
+    imageBarrier.subresourceRange = {aspectFor(resource.desc.format), 0, 1, 0, 1};
+    imageBarriers.push_back(imageBarrier);
+  }
+
+  VkDependencyInfo dependencyInfo{};
+  dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dependencyInfo.memoryBarrierCount = static_cast<uint32_t>(memoryBarriers.size());
+  dependencyInfo.pMemoryBarriers = memoryBarriers.data();
+  dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+  dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+  device.cmdPipelineBarrier2(commandBuffer, dependencyInfo);
+}
+
+void RenderGraph::beginRendering(VkCommandBuffer commandBuffer, const PassNode &pass, uint32_t frame) {
+  std::vector<VkRenderingAttachmentInfo> colorAttachments;
+  VkRenderingAttachmentInfo depthAttachment{};
+  // per attachment, its index in colorAttachments
+  std::vector<size_t> colorSlots(pass.attachments.size());
+  for (size_t i = 0; i < pass.attachments.size(); i++) {
+    const auto &resource = resources[pass.attachments[i].resource];
+    const AttachmentOps &ops = pass.attachmentOps[i];
+    if (pass.attachments[i].resolveOf >= 0) {
+      // Resolve targets come after their source
+      auto &source = colorAttachments[colorSlots[pass.attachments[i].resolveOf]];
+      source.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+      source.resolveImageView = resource.views[copyIndex(resource, frame)];
+      source.resolveImageLayout = ops.layout;
+      continue;
+    }
+    VkRenderingAttachmentInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    info.imageView = resource.views[copyIndex(resource, frame)];
+    info.imageLayout = ops.layout;
+    info.resolveMode = VK_RESOLVE_MODE_NONE;
+    info.loadOp = ops.loadOp;
+    info.storeOp = ops.storeOp;
+    info.clearValue = pass.clearValues[i];
+    if (pass.attachments[i].access == RGAccess::ColorAttachment) {
+      colorSlots[i] = colorAttachments.size();
+      colorAttachments.push_back(info);
+    } else {
+      depthAttachment = info;
+    }
+  }
+
+  VkRenderingInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+  renderingInfo.renderArea.offset = {0, 0};
+  renderingInfo.renderArea.extent = pass.extent;
+  renderingInfo.layerCount = 1;
+  renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
+  renderingInfo.pColorAttachments = colorAttachments.data();
+  // A combined depth/stencil image is given as both
+  renderingInfo.pDepthAttachment = pass.formats.depth != VK_FORMAT_UNDEFINED ? &depthAttachment : nullptr;
+  renderingInfo.pStencilAttachment = pass.formats.stencil != VK_FORMAT_UNDEFINED ? &depthAttachment : nullptr;
+  device.cmdBeginRendering(commandBuffer, renderingInfo);
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(const PassNode &pass, uint32_t frame) {
+  std::vector<VkImageView> views;
+  for (const auto &attachment : pass.attachments) {
+    const auto &resource = resources[attachment.resource];
+    views.push_back(resource.views[copyIndex(resource, frame)]);
+  }
+  auto key = std::make_pair(pass.renderPass, views);
+  auto found = framebuffers.find(key);
+  if (found != framebuffers.end()) {
+    return found->second;
+  }
+
+  VkFramebufferCreateInfo framebufferInfo{};
+  framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebufferInfo.renderPass = pass.renderPass;
+  framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+  framebufferInfo.pAttachments = views.data();
+  framebufferInfo.width = pass.extent.width;
+  framebufferInfo.height = pass.extent.height;
+  framebufferInfo.layers = 1;
+
+  VkFramebuffer framebuffer;
+  if (vkCreateFramebuffer(device.device(), &framebufferInfo, nullptr, &framebuffer) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create framebuffer!");
+  }
+  framebuffers.emplace(std::move(key), framebuffer);
+  return framebuffer;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+  if (!compiled) {
+    throw std::logic_error("render graph is not compiled");
+  }
+  if (frameIndex >= frameCount) {
+    throw std::out_of_range("render graph frame index out of range");
+  }
+  for (const auto &resource : resources) {
+    if (resource.imported && resource.firstPass >= 0 && resource.images[0] == VK_NULL_HANDLE) {
+      throw std::logic_error("imported image " + resource.name + " is not bound");
+    }
+  }
+
+  for (RGPass p : livePasses) {
+    auto &pass = passes[p];
+    recordBarriers(commandBuffer, pass.barriers, frameIndex);
+
+    if (!pass.raster) {
+      pass.record(commandBuffer);
+      continue;
+    }
+
+    if (pass.renderPass == VK_NULL_HANDLE) {
+      beginRendering(commandBuffer, pass, frameIndex);
+      pass.record(commandBuffer);
+      device.cmdEndRendering(commandBuffer);
+      continue;
+    }
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = pass.renderPass;
+    renderPassInfo.framebuffer = getFramebuffer(pass, frameIndex);
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = pass.extent;
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+    renderPassInfo.pClearValues = pass.clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    pass.record(commandBuffer);
+    vkCmdEndRenderPass(commandBuffer);
+  }
+
+  recordBarriers(commandBuffer, finalBarriers, frameIndex);
+}
+
+void RenderGraph::printReport(std::ostream &out) const {
+  out << "Render graph: " << stats.passes << " passes (" << stats.culledPasses << " culled), "
+      << stats.imageBarriers << " image barriers in " << stats.barrierBatches
+      << " batches per frame, "
+      << (device.getCapabilities().synchronization2 ? "vkCmdPipelineBarrier2 with per-barrier stages"
+                                                      : "vkCmdPipelineBarrier with merged stages")
+      << ", raster passes "
+      << (device.getCapabilities().dynamicRendering ? "via dynamic rendering" : "via render passes")
+      << std::endl;
+  out << "  transient memory for " << stats.frameCount << " frames in flight: "
+      << stats.transientBytesRequested / 1024 << " KiB requested, "
+      << stats.transientBytesAllocated / 1024 << " KiB allocated ("
+      << (stats.transientBytesRequested - stats.transientBytesAllocated) / 1024
+      << " KiB saved by aliasing), " << stats.lazilyAllocatedBytes / 1024
+      << " KiB of it lazily allocated" << std::endl;
+  for (RGPass p = 0; p < passes.size(); p++) {
+    out << "  " << (passes[p].live ? "pass  " : "culled") << " " << passes[p].name;
+    if (passes[p].live && passes[p].raster && passes[p].formats.samples != VK_SAMPLE_COUNT_1_BIT) {
+      out << " (" << passes[p].formats.samples << "x MSAA)";
+    }
+    out << std::endl;
+  }
+}
+
+VkDeviceSize RenderGraph::getImageSize(RGResource image, VkExtent2D extent) const {
+  const auto &resource = resources.at(image);
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent = {extent.width, extent.height, 1};
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = resource.desc.format;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = resource.usage;
+  imageInfo.samples = resource.desc.samples;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  // Never bound to memory, only asked for its requirements
+  VkImage probe;
+  if (vkCreateImage(device.device(), &imageInfo, nullptr, &probe) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create probe image for " + resource.name);
+  }
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(device.device(), probe, &requirements);
+  vkDestroyImage(device.device(), probe, nullptr);
+  return requirements.size;
+}
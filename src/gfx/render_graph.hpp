@@ -0,0 +1,252 @@
+#pragma once
+
+#include "device.hpp"
+
+// std
+#include <functional>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// How a pass uses an image. Decides the layout, stages and access masks the
+// graph synchronizes on, and the usage flags of images the graph creates.
+enum class RGAccess {
+  ColorAttachment,
+  DepthAttachment,
+  DepthAttachmentReadOnly,
+  SampledFragment,
+  SampledCompute,
+  StorageRead,
+  StorageWrite,
+  TransferSrc,
+  TransferDst,
+};
+
+struct RGImageDesc {
+  VkFormat format;
+  VkExtent2D extent;
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+// What a pipeline drawing in a raster pass is created against when the
+// graph renders without render passes; UNDEFINED for a missing attachment.
+struct RGAttachmentFormats {
+  std::vector<VkFormat> color;
+  VkFormat depth = VK_FORMAT_UNDEFINED;
+  VkFormat stencil = VK_FORMAT_UNDEFINED;
+  // Of every attachment drawn to; resolve targets don't count
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+using RGResource = uint32_t;
+using RGPass = uint32_t;
+
+// Frame graph over images. Passes are declared in execution order together
+// with the images they read and write; compile() then
+//  - culls passes whose results never reach an imported image,
+//  - precomputes the pipeline barriers and layout transitions between passes,
+//    batched into one barrier command per pass. With synchronization2 every
+//    barrier in the batch keeps its own stages, otherwise they are merged,
+//  - creates the transient images and places those whose lifetimes don't
+//    overlap at the same memory offset. Nothing transient survives a frame,
+//    so there is one copy per frame in flight rather than per swapchain
+//    image; images that are only ever cleared or discarded attachments are
+//    TRANSIENT_ATTACHMENT in lazily allocated memory where the device has it
+//    (tile memory on Apple/mobile GPUs, i.e. no backing store at all),
+//  - derives each raster pass's load/store ops from whether the contents
+//    are needed before and after it. A multisampled attachment resolved
+//    within its pass and read by nobody afterwards is never stored, so with
+//    the above it can stay in tile memory entirely. With dynamic rendering the pass is
+//    recorded with vkCmdBeginRendering and those ops directly; otherwise a
+//    render pass is built for it and framebuffers are created on demand.
+// Buffers are not tracked; passes synchronize their own buffer accesses.
+class RenderGraph {
+ public:
+  struct Stats {
+    uint32_t passes = 0;
+    uint32_t culledPasses = 0;
+    uint32_t imageBarriers = 0;   // per execute()
+    uint32_t barrierBatches = 0;  // vkCmdPipelineBarrier(2) calls per execute()
+    uint32_t frameCount = 0;
+    // totals over all frame copies
+    VkDeviceSize transientBytesRequested = 0;
+    VkDeviceSize transientBytesAllocated = 0;
+    VkDeviceSize lazilyAllocatedBytes = 0;
+  };
+
+  // frameCount: how many frames can be recorded or executing at once
+  RenderGraph(Device &device, uint32_t frameCount);
+  ~RenderGraph();
+
+  RenderGraph(const RenderGraph &) = delete;
+  RenderGraph &operator=(const RenderGraph &) = delete;
+
+  // An image owned and allocated by the graph, valid only within a frame.
+  RGResource createImage(const std::string &name, const RGImageDesc &desc);
+  // An image owned elsewhere, e.g. a swapchain image; bind it with
+  // setImportedImage before each execute(). It enters the frame in
+  // initialLayout (UNDEFINED discards the contents) and is left in finalLayout.
+  // Passes writing an imported image are never culled.
+  RGResource importImage(
+      const std::string &name,
+      const RGImageDesc &desc,
+      VkImageLayout initialLayout,
+      VkImageLayout finalLayout);
+
+  // A raster pass runs its callback inside a render pass over its attachments;
+  // any other pass just gets the command buffer (compute, transfer).
+  RGPass addRasterPass(const std::string &name, std::function<void(VkCommandBuffer)> record);
+  RGPass addPass(const std::string &name, std::function<void(VkCommandBuffer)> record);
+
+  // Without a clear value the previous contents are loaded, which makes the
+  // attachment a read as well as a write.
+  void colorAttachment(
+      RGPass pass, RGResource image, std::optional<VkClearColorValue> clear = std::nullopt);
+  void depthAttachment(
+      RGPass pass,
+      RGResource image,
+      std::optional<VkClearDepthStencilValue> clear = std::nullopt,
+      bool readOnly = false);
+  // Resolves the multisampled color attachment source of the pass into the
+  // single-sampled target as the pass ends, so the samples never have to be
+  // stored. source must already be attached to the pass.
+  void resolveAttachment(RGPass pass, RGResource source, RGResource target);
+  void read(RGPass pass, RGResource image, RGAccess access);
+  void write(RGPass pass, RGResource image, RGAccess access);
+
+  void compile();
+
+  void setImportedImage(RGResource image, VkImage handle, VkImageView view);
+  // frameIndex selects the copy of the transients, in [0, frameCount)
+  void execute(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+  // For creating pipelines compatible with a raster pass; valid after
+  // compile(). The render pass is VK_NULL_HANDLE with dynamic rendering,
+  // pipelines are then created against the formats.
+  VkRenderPass getRenderPass(RGPass pass) const;
+  RGAttachmentFormats getAttachmentFormats(RGPass pass) const;
+  const Stats &getStats() const { return stats; }
+  void printReport(std::ostream &out) const;
+
+  // Memory one copy of a transient would take at another resolution, queried
+  // from the driver with the same format and usage. Valid after compile().
+  VkDeviceSize getImageSize(RGResource image, VkExtent2D extent) const;
+  bool isLazilyAllocated(RGResource image) const { return resources.at(image).lazy; }
+
+ private:
+  struct Use {
+    RGResource resource;
+    RGAccess access;
+    bool reads;
+    bool writes;
+  };
+
+  struct Attachment {
+    RGResource resource;
+    RGAccess access;
+    std::optional<VkClearValue> clear;
+    // For a resolve target, the index in the pass's attachments of the color
+    // attachment it's resolved from
+    int resolveOf = -1;
+  };
+
+  struct AttachmentOps {
+    VkImageLayout layout;
+    VkAttachmentLoadOp loadOp;
+    VkAttachmentStoreOp storeOp;
+  };
+
+  struct Barrier {
+    RGResource resource;
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+    VkAccessFlags srcAccess;
+    VkAccessFlags dstAccess;
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+  };
+
+  struct BarrierBatch {
+    // union of every barrier's stages, for vkCmdPipelineBarrier
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    std::vector<Barrier> barriers;
+    // execution-only dependencies (write after read), no image barrier
+    std::vector<std::pair<VkPipelineStageFlags, VkPipelineStageFlags>> executionDependencies;
+    bool empty() const { return srcStages == 0; }
+  };
+
+  struct ResourceNode {
+    std::string name;
+    RGImageDesc desc;
+    bool imported = false;
+    VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageUsageFlags usage = 0;
+    bool lazy = false;
+
+    // position in the live pass order, -1 if unused
+    int firstPass = -1;
+    int lastPass = -1;
+
+    // one per frame copy; imported images only use the first
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+    VkDeviceSize size = 0;
+    VkDeviceSize alignment = 1;
+    VkDeviceSize offset = 0;
+    uint32_t memoryTypeBits = 0;
+    // transients placed in the same memory earlier in the frame
+    std::vector<RGResource> aliasedPredecessors;
+  };
+
+  struct PassNode {
+    std::string name;
+    bool raster;
+    std::function<void(VkCommandBuffer)> record;
+    std::vector<Use> uses;
+    std::vector<Attachment> attachments;
+    bool live = false;
+
+    BarrierBatch barriers;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkExtent2D extent{};
+    // per attachment, in declaration order
+    std::vector<VkClearValue> clearValues;
+    std::vector<AttachmentOps> attachmentOps;
+    RGAttachmentFormats formats;
+  };
+
+  void addUse(RGPass pass, RGResource image, RGAccess access, bool reads, bool writes);
+  void cullPasses();
+  void computeLifetimes();
+  void allocateTransients();
+  void computeBarriers();
+  void createRenderPasses();
+  void createViews();
+
+  void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch &batch, uint32_t frame);
+  void recordBarriers2(VkCommandBuffer commandBuffer, const BarrierBatch &batch, uint32_t frame);
+  void beginRendering(VkCommandBuffer commandBuffer, const PassNode &pass, uint32_t frame);
+  VkFramebuffer getFramebuffer(const PassNode &pass, uint32_t frame);
+  uint32_t copyIndex(const ResourceNode &resource, uint32_t frame) const {
+    return resource.imported ? 0 : frame;
+  }
+
+  Device &device;
+  uint32_t frameCount;
+  std::vector<ResourceNode> resources;
+  std::vector<PassNode> passes;
+  std::vector<RGPass> livePasses;
+  BarrierBatch finalBarriers;
+  bool compiled = false;
+
+  std::vector<VkDeviceMemory> memoryBlocks;
+  // Imported views can change every frame, so framebuffers are created on demand
+  std::map<std::pair<VkRenderPass, std::vector<VkImageView>>, VkFramebuffer> framebuffers;
+
+  Stats stats;
+};
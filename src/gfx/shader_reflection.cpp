@@ -0,0 +1,538 @@
+#include "shader_reflection.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Subset of the SPIR-V specification needed for interface reflection.
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+constexpr size_t SPIRV_HEADER_WORDS = 5;
+
+enum Op : uint32_t {
+  OpName = 5,
+  OpEntryPoint = 15,
+  OpTypeBool = 20,
+  OpTypeInt = 21,
+  OpTypeFloat = 22,
+  OpTypeVector = 23,
+  OpTypeMatrix = 24,
+  OpTypeImage = 25,
+  OpTypeSampler = 26,
+  OpTypeSampledImage = 27,
+  OpTypeArray = 28,
+  OpTypeRuntimeArray = 29,
+  OpTypeStruct = 30,
+  OpTypePointer = 32,
+  OpConstant = 43,
+  OpSpecConstant = 50,
+  OpVariable = 59,
+  OpDecorate = 71,
+  OpMemberDecorate = 72,
+};
+
+enum Decoration : uint32_t {
+  DecorationSpecId = 1,
+  DecorationBlock = 2,
+  DecorationBufferBlock = 3,
+  DecorationArrayStride = 6,
+  DecorationMatrixStride = 7,
+  DecorationBuiltIn = 11,
+  DecorationLocation = 30,
+  DecorationBinding = 33,
+  DecorationDescriptorSet = 34,
+  DecorationOffset = 35,
+};
+
+enum StorageClass : uint32_t {
+  StorageClassUniformConstant = 0,
+  StorageClassInput = 1,
+  StorageClassUniform = 2,
+  StorageClassPushConstant = 9,
+  StorageClassStorageBuffer = 12,
+};
+
+enum ExecutionModel : uint32_t {
+  ExecutionModelVertex = 0,
+  ExecutionModelTessellationControl = 1,
+  ExecutionModelTessellationEvaluation = 2,
+  ExecutionModelGeometry = 3,
+  ExecutionModelFragment = 4,
+  ExecutionModelGLCompute = 5,
+};
+
+constexpr uint32_t DimBuffer = 5;
+constexpr uint32_t DimSubpassData = 6;
+constexpr uint32_t NOT_SET = ~0u;
+
+struct TypeInfo {
+  uint32_t op = 0;
+  std::vector<uint32_t> operands;  // everything after the result id
+};
+
+struct Decorations {
+  uint32_t location = NOT_SET;
+  uint32_t binding = NOT_SET;
+  uint32_t set = NOT_SET;
+  uint32_t arrayStride = 0;
+  bool builtIn = false;
+  bool block = false;
+  bool bufferBlock = false;
+};
+
+struct MemberDecorations {
+  uint32_t offset = 0;
+  uint32_t matrixStride = 0;
+};
+
+struct Variable {
+  uint32_t id;
+  uint32_t pointerType;
+  uint32_t storageClass;
+};
+
+struct Module {
+  std::vector<TypeInfo> types;
+  std::vector<Decorations> decorations;
+  std::vector<std::vector<MemberDecorations>> members;
+  std::vector<std::string> names;
+  // NOT_SET unless defined by OpConstant or OpSpecConstant
+  std::vector<uint32_t> constants;
+  std::vector<Variable> variables;
+
+  const TypeInfo &type(uint32_t id) const {
+    if (id >= types.size() || types[id].op == 0) {
+      throw std::runtime_error("SPIR-V reflection: unknown type id " + std::to_string(id));
+    }
+    return types[id];
+  }
+
+  // Length of an OpTypeArray. A specialization constant counts with its
+  // default value; a length computed by OpSpecConstantOp isn't supported.
+  uint32_t arrayLength(const TypeInfo &array) const {
+    uint32_t lengthId = array.operands.size() > 1 ? array.operands[1] : NOT_SET;
+    if (lengthId >= constants.size() || constants[lengthId] == NOT_SET) {
+      throw std::runtime_error(
+          "SPIR-V reflection: array length id " + std::to_string(lengthId) + " isn't an integer constant");
+    }
+    return constants[lengthId];
+  }
+};
+
+std::string readString(const uint32_t *words, size_t wordCount) {
+  const char *chars = reinterpret_cast<const char *>(words);
+  return std::string(chars, strnlen(chars, wordCount * sizeof(uint32_t)));
+}
+
+VkShaderStageFlagBits stageFromExecutionModel(uint32_t model) {
+  switch (model) {
+    case ExecutionModelVertex: return VK_SHADER_STAGE_VERTEX_BIT;
+    case ExecutionModelTessellationControl: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case ExecutionModelTessellationEvaluation: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case ExecutionModelGeometry: return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case ExecutionModelFragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case ExecutionModelGLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+    default: throw std::runtime_error("SPIR-V reflection: unsupported execution model");
+  }
+}
+
+VkFormat formatFromType(const Module &module, uint32_t typeId) {
+  const TypeInfo &type = module.type(typeId);
+  uint32_t components = 1;
+  const TypeInfo *scalar = &type;
+  if (type.op == OpTypeVector) {
+    scalar = &module.type(type.operands[0]);
+    components = type.operands[1];
+  }
+  if (scalar->op != OpTypeFloat && scalar->op != OpTypeInt) {
+    return VK_FORMAT_UNDEFINED;
+  }
+  if (scalar->operands[0] != 32) {
+    return VK_FORMAT_UNDEFINED;
+  }
+
+  static constexpr VkFormat floats[] = {
+      VK_FORMAT_R32_SFLOAT,
+      VK_FORMAT_R32G32_SFLOAT,
+      VK_FORMAT_R32G32B32_SFLOAT,
+      VK_FORMAT_R32G32B32A32_SFLOAT};
+  static constexpr VkFormat sints[] = {
+      VK_FORMAT_R32_SINT,
+      VK_FORMAT_R32G32_SINT,
+      VK_FORMAT_R32G32B32_SINT,
+      VK_FORMAT_R32G32B32A32_SINT};
+  static constexpr VkFormat uints[] = {
+      VK_FORMAT_R32_UINT,
+      VK_FORMAT_R32G32_UINT,
+      VK_FORMAT_R32G32B32_UINT,
+      VK_FORMAT_R32G32B32A32_UINT};
+
+  if (components < 1 || components > 4) {
+    return VK_FORMAT_UNDEFINED;
+  }
+  if (scalar->op == OpTypeFloat) {
+    return floats[components - 1];
+  }
+  return scalar->operands[1] ? sints[components - 1] : uints[components - 1];
+}
+
+uint32_t typeSize(const Module &module, uint32_t typeId, uint32_t matrixStride = 0) {
+  const TypeInfo &type = module.type(typeId);
+  switch (type.op) {
+    case OpTypeBool:
+      return 4;
+    case OpTypeInt:
+    case OpTypeFloat:
+      return type.operands[0] / 8;
+    case OpTypeVector:
+      return type.operands[1] * typeSize(module, type.operands[0]);
+    case OpTypeMatrix: {
+      uint32_t columnSize = typeSize(module, type.operands[0]);
+      return type.operands[1] * std::max(matrixStride, columnSize);
+    }
+    case OpTypeArray: {
+      uint32_t length = module.arrayLength(type);
+      uint32_t stride = module.decorations[typeId].arrayStride;
+      if (stride == 0) {
+        stride = typeSize(module, type.operands[0]);
+      }
+      return length * stride;
+    }
+    case OpTypeRuntimeArray:
+      return 0;
+    case OpTypeStruct: {
+      uint32_t size = 0;
+      const auto &members = module.members[typeId];
+      for (size_t i = 0; i < type.operands.size(); i++) {
+        MemberDecorations decoration = i < members.size() ? members[i] : MemberDecorations{};
+        size = std::max(
+            size,
+            decoration.offset + typeSize(module, type.operands[i], decoration.matrixStride));
+      }
+      return size;
+    }
+    default:
+      throw std::runtime_error("SPIR-V reflection: cannot size type id " + std::to_string(typeId));
+  }
+}
+
+VkDescriptorType descriptorTypeFor(const Module &module, uint32_t typeId, uint32_t storageClass) {
+  const TypeInfo &type = module.type(typeId);
+
+  if (storageClass == StorageClassStorageBuffer) {
+    return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  }
+  if (storageClass == StorageClassUniform) {
+    return module.decorations[typeId].bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                                                  : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  }
+
+  switch (type.op) {
+    case OpTypeSampler:
+      return VK_DESCRIPTOR_TYPE_SAMPLER;
+    case OpTypeSampledImage:
+      return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    case OpTypeImage: {
+      uint32_t dim = type.operands[1];
+      uint32_t sampled = type.operands[5];
+      if (dim == DimBuffer) {
+        return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+                            : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      }
+      if (dim == DimSubpassData) {
+        return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      }
+      return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    }
+    default:
+      throw std::runtime_error("SPIR-V reflection: unsupported descriptor type");
+  }
+}
+
+struct FormatClass {
+  char numeric;  // 'f', 'i' or 'u'
+  uint32_t components;
+};
+
+FormatClass classify(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R32_SFLOAT: return {'f', 1};
+    case VK_FORMAT_R32G32_SFLOAT: return {'f', 2};
+    case VK_FORMAT_R32G32B32_SFLOAT: return {'f', 3};
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return {'f', 4};
+    case VK_FORMAT_R8G8B8A8_UNORM: return {'f', 4};
+    case VK_FORMAT_R32_SINT: return {'i', 1};
+    case VK_FORMAT_R32G32_SINT: return {'i', 2};
+    case VK_FORMAT_R32G32B32_SINT: return {'i', 3};
+    case VK_FORMAT_R32G32B32A32_SINT: return {'i', 4};
+    case VK_FORMAT_R32_UINT: return {'u', 1};
+    case VK_FORMAT_R32G32_UINT: return {'u', 2};
+    case VK_FORMAT_R32G32B32_UINT: return {'u', 3};
+    case VK_FORMAT_R32G32B32A32_UINT: return {'u', 4};
+    default: return {'?', 0};
+  }
+}
+
+}  // namespace
+
+ShaderReflection ShaderReflection::reflect(const std::vector<char> &code) {
+  if (code.size() % sizeof(uint32_t) != 0) {
+    throw std::runtime_error("SPIR-V reflection: module size is not a multiple of 4");
+  }
+  std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+  memcpy(words.data(), code.data(), code.size());
+  return reflect(words.data(), words.size());
+}
+
+ShaderReflection ShaderReflection::reflect(const uint32_t *words, size_t wordCount) {
+  if (wordCount < SPIRV_HEADER_WORDS || words[0] != SPIRV_MAGIC) {
+    throw std::runtime_error("SPIR-V reflection: not a SPIR-V module");
+  }
+
+  uint32_t bound = words[3];
+  Module module;
+  module.types.resize(bound);
+  module.decorations.resize(bound);
+  module.members.resize(bound);
+  module.names.resize(bound);
+  module.constants.resize(bound, NOT_SET);
+
+  ShaderReflection reflection;
+  bool haveEntryPoint = false;
+
+  size_t offset = SPIRV_HEADER_WORDS;
+  while (offset < wordCount) {
+    uint32_t instructionWords = words[offset] >> 16;
+    uint32_t opcode = words[offset] & 0xFFFF;
+    if (instructionWords == 0 || offset + instructionWords > wordCount) {
+      throw std::runtime_error("SPIR-V reflection: malformed instruction stream");
+    }
+    const uint32_t *operands = words + offset + 1;
+    uint32_t operandCount = instructionWords - 1;
+    // Before reading operands[count - 1]
+    auto requireOperands = [&](uint32_t count) {
+      if (operandCount < count) {
+        throw std::runtime_error(
+            "SPIR-V reflection: instruction " + std::to_string(opcode) + " has too few operands");
+      }
+    };
+
+    switch (opcode) {
+      case OpName:
+        requireOperands(1);
+        if (operands[0] < bound) {
+          module.names[operands[0]] = readString(operands + 1, operandCount - 1);
+        }
+        break;
+      case OpEntryPoint:
+        requireOperands(2);
+        if (!haveEntryPoint) {
+          reflection.stage = stageFromExecutionModel(operands[0]);
+          reflection.entryPoint = readString(operands + 2, operandCount - 2);
+          haveEntryPoint = true;
+        }
+        break;
+      case OpTypeBool:
+      case OpTypeInt:
+      case OpTypeFloat:
+      case OpTypeVector:
+      case OpTypeMatrix:
+      case OpTypeImage:
+      case OpTypeSampler:
+      case OpTypeSampledImage:
+      case OpTypeArray:
+      case OpTypeRuntimeArray:
+      case OpTypeStruct:
+      case OpTypePointer: {
+        requireOperands(1);
+        TypeInfo &type = module.types.at(operands[0]);
+        type.op = opcode;
+        type.operands.assign(operands + 1, operands + operandCount);
+        break;
+      }
+      case OpConstant:
+      case OpSpecConstant:
+        // Only the low word matters: array lengths are 32-bit integers.
+        requireOperands(3);
+        module.constants.at(operands[1]) = operands[2];
+        break;
+      case OpVariable:
+        requireOperands(3);
+        module.variables.push_back({operands[1], operands[0], operands[2]});
+        break;
+      case OpDecorate: {
+        requireOperands(2);
+        switch (operands[1]) {
+          case DecorationSpecId:
+          case DecorationArrayStride:
+          case DecorationLocation:
+          case DecorationBinding:
+          case DecorationDescriptorSet: requireOperands(3); break;
+          default: break;
+        }
+        Decorations &decoration = module.decorations.at(operands[0]);
+        switch (operands[1]) {
+          case DecorationSpecId: reflection.specializationConstantIds.push_back(operands[2]); break;
+          case DecorationBlock: decoration.block = true; break;
+          case DecorationBufferBlock: decoration.bufferBlock = true; break;
+          case DecorationArrayStride: decoration.arrayStride = operands[2]; break;
+          case DecorationBuiltIn: decoration.builtIn = true; break;
+          case DecorationLocation: decoration.location = operands[2]; break;
+          case DecorationBinding: decoration.binding = operands[2]; break;
+          case DecorationDescriptorSet: decoration.set = operands[2]; break;
+          default: break;
+        }
+        break;
+      }
+      case OpMemberDecorate: {
+        requireOperands(3);
+        if (operands[2] == DecorationOffset || operands[2] == DecorationMatrixStride) {
+          requireOperands(4);
+        }
+        auto &members = module.members.at(operands[0]);
+        uint32_t member = operands[1];
+        if (members.size() <= member) {
+          members.resize(member + 1);
+        }
+        if (operands[2] == DecorationOffset) {
+          members[member].offset = operands[3];
+        } else if (operands[2] == DecorationMatrixStride) {
+          members[member].matrixStride = operands[3];
+        }
+        break;
+      }
+      default:
+        break;
+    }
+
+    offset += instructionWords;
+  }
+
+  if (!haveEntryPoint) {
+    throw std::runtime_error("SPIR-V reflection: module has no entry point");
+  }
+
+  uint32_t pushConstantEnd = 0;
+  for (const auto &variable : module.variables) {
+    const TypeInfo &pointer = module.type(variable.pointerType);
+    uint32_t pointee = pointer.operands[1];
+    const Decorations &decoration = module.decorations[variable.id];
+    const std::string &name = module.names[variable.id];
+
+    switch (variable.storageClass) {
+      case StorageClassInput: {
+        if (decoration.builtIn || decoration.location == NOT_SET) {
+          break;
+        }
+        const TypeInfo &type = module.type(pointee);
+        if (type.op == OpTypeMatrix) {
+          // a matrix input occupies one location per column
+          for (uint32_t column = 0; column < type.operands[1]; column++) {
+            reflection.inputs.push_back(
+                {decoration.location + column, formatFromType(module, type.operands[0]), name});
+          }
+        } else {
+          reflection.inputs.push_back({decoration.location, formatFromType(module, pointee), name});
+        }
+        break;
+      }
+      case StorageClassUniformConstant:
+      case StorageClassUniform:
+      case StorageClassStorageBuffer: {
+        if (decoration.binding == NOT_SET) {
+          break;
+        }
+        uint32_t count = 1;
+        uint32_t element = pointee;
+        const TypeInfo *type = &module.type(element);
+        if (type->op == OpTypeArray) {
+          count = module.arrayLength(*type);
+          element = type->operands[0];
+        } else if (type->op == OpTypeRuntimeArray) {
+          count = 0;
+          element = type->operands[0];
+        }
+        reflection.descriptorBindings.push_back(
+            {decoration.set == NOT_SET ? 0 : decoration.set,
+             decoration.binding,
+             descriptorTypeFor(module, element, variable.storageClass),
+             count,
+             name});
+        break;
+      }
+      case StorageClassPushConstant: {
+        const TypeInfo &block = module.type(pointee);
+        const auto &members = module.members[pointee];
+        uint32_t begin = ~0u;
+        for (size_t i = 0; i < block.operands.size(); i++) {
+          begin = std::min(begin, i < members.size() ? members[i].offset : 0u);
+        }
+        reflection.pushConstantOffset = block.operands.empty() ? 0 : begin;
+        pushConstantEnd = std::max(pushConstantEnd, typeSize(module, pointee));
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  reflection.pushConstantSize = pushConstantEnd > reflection.pushConstantOffset
+                                    ? pushConstantEnd - reflection.pushConstantOffset
+                                    : 0;
+
+  std::sort(
+      reflection.inputs.begin(),
+      reflection.inputs.end(),
+      [](const ShaderInput &a, const ShaderInput &b) { return a.location < b.location; });
+  std::sort(
+      reflection.descriptorBindings.begin(),
+      reflection.descriptorBindings.end(),
+      [](const ShaderDescriptorBinding &a, const ShaderDescriptorBinding &b) {
+        return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+      });
+
+  return reflection;
+}
+
+void validateVertexInput(
+    const ShaderReflection &vertexShader, const VkPipelineVertexInputStateCreateInfo &vertexInput) {
+  for (const auto &input : vertexShader.inputs) {
+    const VkVertexInputAttributeDescription *attribute = nullptr;
+    for (uint32_t i = 0; i < vertexInput.vertexAttributeDescriptionCount; i++) {
+      if (vertexInput.pVertexAttributeDescriptions[i].location == input.location) {
+        attribute = &vertexInput.pVertexAttributeDescriptions[i];
+        break;
+      }
+    }
+
+    std::string where = "location " + std::to_string(input.location) +
+                        (input.name.empty() ? "" : " (" + input.name + ")");
+    if (attribute == nullptr) {
+      throw std::runtime_error("Vertex input mismatch: shader reads " + where +
+                               " but the vertex layout provides no attribute for it");
+    }
+
+    bool bindingFound = false;
+    for (uint32_t i = 0; i < vertexInput.vertexBindingDescriptionCount; i++) {
+      bindingFound |= vertexInput.pVertexBindingDescriptions[i].binding == attribute->binding;
+    }
+    if (!bindingFound) {
+      throw std::runtime_error("Vertex input mismatch: attribute at " + where +
+                               " references binding " + std::to_string(attribute->binding) +
+                               " which is not described");
+    }
+
+    FormatClass expected = classify(input.format);
+    FormatClass provided = classify(attribute->format);
+    if (expected.components == 0) {
+      throw std::runtime_error("Vertex input mismatch: unsupported shader input type at " + where);
+    }
+    // Missing components are filled in by the vertex fetch (0, 0, 0, 1), but the
+    // numeric type has to agree or the shader reads garbage.
+    if (provided.numeric != expected.numeric) {
+      throw std::runtime_error("Vertex input mismatch: numeric type of the attribute at " + where +
+                               " does not match the shader");
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ShaderInput {
+  uint32_t location;
+  VkFormat format;
+  std::string name;
+};
+
+struct ShaderDescriptorBinding {
+  uint32_t set;
+  uint32_t binding;
+  VkDescriptorType type;
+  uint32_t count;  // 0 for runtime-sized arrays
+  std::string name;
+};
+
+// What a single SPIR-V module exposes to the pipeline: stage inputs, descriptor
+// bindings and the push-constant block. Parsed straight from the module words,
+// so it needs no external SPIR-V tooling at runtime. Arrays sized by a
+// specialization constant are reflected at its default value.
+struct ShaderReflection {
+  VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+  std::string entryPoint = "main";
+  std::vector<ShaderInput> inputs;
+  std::vector<ShaderDescriptorBinding> descriptorBindings;
+  uint32_t pushConstantOffset = 0;
+  uint32_t pushConstantSize = 0;
+  std::vector<uint32_t> specializationConstantIds;
+
+  static ShaderReflection reflect(const std::vector<char> &code);
+  static ShaderReflection reflect(const uint32_t *words, size_t wordCount);
+};
+
+// Throws if the vertex input state does not feed every input the vertex shader
+// declares with a matching location and numeric type.
+void validateVertexInput(
+    const ShaderReflection &vertexShader, const VkPipelineVertexInputStateCreateInfo &vertexInput);
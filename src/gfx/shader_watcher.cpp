@@ -0,0 +1,184 @@
+#include "shader_watcher.hpp"
+
+// std
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <system_error>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+// Editors tend to write a file in several steps; wait for them to settle.
+constexpr auto SETTLE_DELAY = std::chrono::milliseconds(50);
+
+bool isShaderStage(const fs::path &path) {
+  static const std::set<std::string> stages{".vert", ".frag", ".comp", ".geom", ".tesc", ".tese"};
+  return stages.count(path.extension().string()) != 0;
+}
+
+std::string quote(const std::string &arg) { return "\"" + arg + "\""; }
+
+}  // namespace
+
+ShaderWatcher::ShaderWatcher(std::string sourceDir, std::string outputDir, std::string glslcPath)
+    : sourceDir{std::move(sourceDir)},
+      outputDir{std::move(outputDir)},
+      glslcPath{std::move(glslcPath)} {
+  worker = std::thread([this] { watch(); });
+}
+
+ShaderWatcher::~ShaderWatcher() {
+  running = false;
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+std::vector<std::string> ShaderWatcher::takeRecompiledShaders() {
+  std::lock_guard<std::mutex> lock{recompiledMutex};
+  std::vector<std::string> result;
+  result.swap(recompiled);
+  return result;
+}
+
+void ShaderWatcher::watch() {
+  std::error_code error;
+  if (!fs::is_directory(sourceDir, error)) {
+    std::cerr << "Shader hot-reload disabled, no source directory " << sourceDir << std::endl;
+    return;
+  }
+#if defined(__linux__)
+  watchInotify();
+#else
+  watchPolling();
+#endif
+}
+
+void ShaderWatcher::watchInotify() {
+#if defined(__linux__)
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0 || inotify_add_watch(fd, sourceDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    watchPolling();
+    return;
+  }
+
+  alignas(inotify_event) char buffer[4096];
+  std::set<std::string> changed;
+  while (running) {
+    pollfd pfd{fd, POLLIN, 0};
+    // a short timeout so the destructor never waits long for the thread
+    int timeout = changed.empty() ? 100 : static_cast<int>(SETTLE_DELAY.count());
+    int ready = poll(&pfd, 1, timeout);
+
+    if (ready > 0) {
+      ssize_t length;
+      while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + length;) {
+          auto *event = reinterpret_cast<inotify_event *>(ptr);
+          if (event->len > 0) {
+            changed.insert(event->name);
+          }
+          ptr += sizeof(inotify_event) + event->len;
+        }
+      }
+    } else if (ready == 0 && !changed.empty()) {
+      // nothing new for a settle period: compile the batch
+      for (const auto &fileName : changed) {
+        onSourceChanged(fileName);
+      }
+      changed.clear();
+    }
+  }
+  close(fd);
+#endif
+}
+
+void ShaderWatcher::watchPolling() {
+  std::unordered_map<std::string, fs::file_time_type> lastWrite;
+  bool first = true;
+  while (running) {
+    std::error_code error;
+    for (const auto &entry : fs::directory_iterator(sourceDir, error)) {
+      if (!entry.is_regular_file(error)) {
+        continue;
+      }
+      auto fileName = entry.path().filename().string();
+      auto writeTime = entry.last_write_time(error);
+      auto found = lastWrite.find(fileName);
+      if (found == lastWrite.end() || found->second != writeTime) {
+        lastWrite[fileName] = writeTime;
+        if (!first) {
+          std::this_thread::sleep_for(SETTLE_DELAY);
+          onSourceChanged(fileName);
+        }
+      }
+    }
+    first = false;
+    std::this_thread::sleep_for(POLL_INTERVAL);
+  }
+}
+
+void ShaderWatcher::onSourceChanged(const std::string &fileName) {
+  std::vector<std::string> toCompile;
+  if (isShaderStage(fileName)) {
+    toCompile.push_back(fileName);
+  } else {
+    // An include changed. Rebuilding every stage is cheap next to tracking
+    // which ones pull it in, and only the edited shaders actually differ.
+    std::error_code error;
+    for (const auto &entry : fs::directory_iterator(sourceDir, error)) {
+      if (isShaderStage(entry.path())) {
+        toCompile.push_back(entry.path().filename().string());
+      }
+    }
+  }
+
+  for (const auto &source : toCompile) {
+    if (compile(source)) {
+      std::lock_guard<std::mutex> lock{recompiledMutex};
+      recompiled.push_back(source + ".spv");
+    }
+  }
+}
+
+bool ShaderWatcher::compile(const std::string &fileName) {
+  fs::path source = fs::path(sourceDir) / fileName;
+  fs::path output = fs::path(outputDir) / (fileName + ".spv");
+  // Compile next to the target and rename over it, so a half-written file is
+  // never picked up and a failed compile leaves the last good binary in place.
+  fs::path staging = output;
+  staging += ".tmp";
+
+  std::string command = quote(glslcPath) + " -I " + quote(sourceDir) + " -o " +
+                        quote(staging.string()) + " " + quote(source.string());
+  if (std::system(command.c_str()) != 0) {
+    std::cerr << "Shader hot-reload: " << fileName << " failed to compile, keeping the old version"
+              << std::endl;
+    return false;
+  }
+
+  std::error_code error;
+  fs::rename(staging, output, error);
+  if (error) {
+    std::cerr << "Shader hot-reload: could not replace " << output << ": " << error.message()
+              << std::endl;
+    return false;
+  }
+  std::cout << "Shader hot-reload: recompiled " << fileName << std::endl;
+  return true;
+}
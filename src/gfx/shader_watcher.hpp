@@ -0,0 +1,42 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Watches the shader source directory and recompiles changed shaders with
+// glslc on a background thread. The render loop collects the finished SPIR-V
+// files at a frame boundary and rebuilds whatever uses them; nothing here
+// touches Vulkan.
+//
+// Uses inotify on Linux and falls back to polling modification times elsewhere.
+class ShaderWatcher {
+ public:
+  ShaderWatcher(std::string sourceDir, std::string outputDir, std::string glslcPath);
+  ~ShaderWatcher();
+
+  ShaderWatcher(const ShaderWatcher &) = delete;
+  ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+
+  // File names (e.g. "temp.frag.spv") recompiled successfully since the last call.
+  std::vector<std::string> takeRecompiledShaders();
+
+ private:
+  void watch();
+  void watchInotify();
+  void watchPolling();
+  void onSourceChanged(const std::string &fileName);
+  bool compile(const std::string &fileName);
+
+  std::string sourceDir;
+  std::string outputDir;
+  std::string glslcPath;
+
+  std::atomic<bool> running{true};
+  std::mutex recompiledMutex;
+  std::vector<std::string> recompiled;
+  std::thread worker;
+};
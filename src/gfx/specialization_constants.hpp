@@ -0,0 +1,72 @@
+#pragma once
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Values for a shader's `layout(constant_id = N) const ...` declarations.
+// One SPIR-V module compiled once can then be specialized into many pipeline
+// variants, and the driver constant-folds the branches the values disable.
+class SpecializationConstants {
+ public:
+  template <typename T>
+  SpecializationConstants &set(uint32_t constantId, T value) {
+    static_assert(std::is_arithmetic<T>::value, "specialization constants must be scalars");
+    if constexpr (std::is_same<T, bool>::value) {
+      VkBool32 boolValue = value ? VK_TRUE : VK_FALSE;
+      return setBytes(constantId, &boolValue, sizeof(boolValue));
+    } else {
+      static_assert(sizeof(T) == 4 || sizeof(T) == 8, "specialization constants are 32 or 64 bit");
+      return setBytes(constantId, &value, sizeof(value));
+    }
+  }
+
+  bool empty() const { return entries.empty(); }
+  const std::vector<VkSpecializationMapEntry> &getEntries() const { return entries; }
+
+  // Valid until the constants are modified or this object goes away.
+  const VkSpecializationInfo *info() const {
+    if (entries.empty()) {
+      return nullptr;
+    }
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(entries.size());
+    specializationInfo.pMapEntries = entries.data();
+    specializationInfo.dataSize = data.size();
+    specializationInfo.pData = data.data();
+    return &specializationInfo;
+  }
+
+ private:
+  SpecializationConstants &setBytes(uint32_t constantId, const void *value, size_t size) {
+    for (auto &entry : entries) {
+      if (entry.constantID == constantId) {
+        if (entry.size == size) {
+          memcpy(data.data() + entry.offset, value, size);
+          return *this;
+        }
+        // size changed: drop the old slot's entry, the bytes are simply orphaned
+        entry = entries.back();
+        entries.pop_back();
+        break;
+      }
+    }
+    VkSpecializationMapEntry entry{};
+    entry.constantID = constantId;
+    entry.offset = static_cast<uint32_t>(data.size());
+    entry.size = size;
+    entries.push_back(entry);
+    data.resize(data.size() + size);
+    memcpy(data.data() + entry.offset, value, size);
+    return *this;
+  }
+
+  std::vector<VkSpecializationMapEntry> entries;
+  std::vector<uint8_t> data;
+  mutable VkSpecializationInfo specializationInfo{};
+};
@@ -19,10 +19,11 @@ class SwapChain {
   SwapChain(const SwapChain &) = delete;
   void operator=(const SwapChain &) = delete;
 
-  VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
-  VkRenderPass getRenderPass() { return renderPass; }
+  VkImage getImage(int index) { return swapChainImages[index]; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
   size_t imageCount() { return swapChainImages.size(); }
+  // Frame-in-flight slot the next submit belongs to, in [0, MAX_FRAMES_IN_FLIGHT)
+  uint32_t getCurrentFrame() { return static_cast<uint32_t>(currentFrame); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
   uint32_t width() { return swapChainExtent.width; }
@@ -32,6 +33,8 @@ class SwapChain {
     return static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
   }
   VkFormat findDepthFormat();
+  // Whether the images can be copied from
+  bool supportsReadback() { return readbackSupported; }
 
   VkResult acquireNextImage(uint32_t *imageIndex);
   VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
@@ -39,9 +42,6 @@ class SwapChain {
  private:
   void createSwapChain();
   void createImageViews();
-  void createDepthResources();
-  void createRenderPass();
-  void createFramebuffers();
   void createSyncObjects();
 
   // Helper functions
@@ -53,13 +53,8 @@ class SwapChain {
 
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
+  bool readbackSupported = false;
 
-  std::vector<VkFramebuffer> swapChainFramebuffers;
-  VkRenderPass renderPass;
-
-  std::vector<VkImage> depthImages;
-  std::vector<VkDeviceMemory> depthImageMemorys;
-  std::vector<VkImageView> depthImageViews;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
 
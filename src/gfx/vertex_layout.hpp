@@ -0,0 +1,104 @@
+#pragma once
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Maps a C++ attribute type to the VkFormat the vertex input stage reads it as.
+// Types without a specialization resolve to VK_FORMAT_UNDEFINED and are rejected
+// by the static_asserts in VertexLayout.
+template <typename T>
+struct VertexFormat {
+  static constexpr VkFormat value = VK_FORMAT_UNDEFINED;
+};
+
+template <> struct VertexFormat<float> { static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT; };
+template <> struct VertexFormat<glm::vec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+template <> struct VertexFormat<glm::vec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+template <> struct VertexFormat<glm::vec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+template <> struct VertexFormat<int32_t> { static constexpr VkFormat value = VK_FORMAT_R32_SINT; };
+template <> struct VertexFormat<glm::ivec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SINT; };
+template <> struct VertexFormat<glm::ivec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SINT; };
+template <> struct VertexFormat<glm::ivec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SINT; };
+template <> struct VertexFormat<uint32_t> { static constexpr VkFormat value = VK_FORMAT_R32_UINT; };
+template <> struct VertexFormat<glm::uvec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_UINT; };
+template <> struct VertexFormat<glm::uvec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_UINT; };
+template <> struct VertexFormat<glm::uvec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_UINT; };
+template <> struct VertexFormat<glm::u8vec4> { static constexpr VkFormat value = VK_FORMAT_R8G8B8A8_UNORM; };
+
+// One field of a vertex struct. Use the VERTEX_FIELD macro rather than spelling
+// the offset by hand.
+template <typename Member, uint32_t Offset>
+struct VertexField {
+  using type = Member;
+  static constexpr uint32_t offset = Offset;
+  static constexpr uint32_t size = static_cast<uint32_t>(sizeof(Member));
+  static constexpr VkFormat format = VertexFormat<Member>::value;
+};
+
+#define VERTEX_FIELD(VertexType, member) \
+  VertexField<decltype(VertexType::member), static_cast<uint32_t>(offsetof(VertexType, member))>
+
+namespace vertex_layout_detail {
+
+template <typename... Fields, size_t... I>
+constexpr std::array<VkVertexInputAttributeDescription, sizeof...(Fields)> makeAttributes(
+    uint32_t binding, std::index_sequence<I...>) {
+  return {{{static_cast<uint32_t>(I), binding, Fields::format, Fields::offset}...}};
+}
+
+template <typename... Fields>
+constexpr bool fieldsDoNotOverlap() {
+  constexpr std::array<uint32_t, sizeof...(Fields)> offsets{Fields::offset...};
+  constexpr std::array<uint32_t, sizeof...(Fields)> sizes{Fields::size...};
+  for (size_t i = 0; i < offsets.size(); i++) {
+    for (size_t j = i + 1; j < offsets.size(); j++) {
+      if (offsets[i] < offsets[j] + sizes[j] && offsets[j] < offsets[i] + sizes[i]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace vertex_layout_detail
+
+// Compile-time description of a vertex struct bound at a single binding.
+// Attribute locations are assigned in declaration order, so
+//
+//   struct Vertex { glm::vec3 position; glm::vec2 uv; };
+//   using Layout = VertexLayout<Vertex, VERTEX_FIELD(Vertex, position), VERTEX_FIELD(Vertex, uv)>;
+//
+// yields location 0 = position and location 1 = uv. The descriptions live in
+// static constexpr arrays, so pipeline creation only takes their address.
+template <typename V, typename... Fields>
+struct VertexLayout {
+  static_assert(sizeof...(Fields) > 0, "Vertex layout needs at least one field");
+  static_assert(
+      ((Fields::format != VK_FORMAT_UNDEFINED) && ...),
+      "Vertex field type has no VertexFormat specialization");
+  static_assert(((Fields::offset % 4 == 0) && ...), "Vertex field offsets must be 4-byte aligned");
+  static_assert(
+      ((Fields::offset + Fields::size <= sizeof(V)) && ...),
+      "Vertex field extends past the end of the vertex struct");
+  static_assert(vertex_layout_detail::fieldsDoNotOverlap<Fields...>(), "Vertex fields overlap");
+
+  static constexpr uint32_t binding = 0;
+  static constexpr uint32_t stride = static_cast<uint32_t>(sizeof(V));
+  static constexpr uint32_t attributeCount = static_cast<uint32_t>(sizeof...(Fields));
+
+  static constexpr std::array<VkVertexInputBindingDescription, 1> bindings{
+      {{binding, stride, VK_VERTEX_INPUT_RATE_VERTEX}}};
+
+  static constexpr std::array<VkVertexInputAttributeDescription, sizeof...(Fields)> attributes =
+      vertex_layout_detail::makeAttributes<Fields...>(
+          binding, std::make_index_sequence<sizeof...(Fields)>{});
+};
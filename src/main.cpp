@@ -15,10 +15,96 @@
 #include "app.cpp"
 
 int main(int argc, const char* argv[]) {
-    App app{};
+    double frameTimeMs = App::DEFAULT_FRAME_TIME_MS;
+    // Runs the GPU prefix sum against the CPU instead of the renderer
+    unsigned long benchmarkCount = 0;
+    unsigned long samples = 1;
+    // Compares MSAA sample counts over this many frames each instead
+    unsigned long msaaBenchmarkFrames = 0;
+    // Writes every dumpInterval-th frame to dumpDirectory as PNG
+    std::string dumpDirectory;
+    unsigned long dumpInterval = 60;
+    // Compares a reproducible frame with a golden image, or writes a new one
+    std::string goldenPath;
+    bool updateGolden = false;
+    unsigned long goldenFrame = 120;
+    unsigned long goldenTolerance = 2;
+    // Encodes every frame to a .y4m file or a directory of PNGs
+    std::string capturePath;
+    unsigned long captureBuffers = 4;
+    // Device memory usage as JSON, written when the app exits
+    std::string memoryReportPath;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--frame-time-ms") {
+            frameTimeMs = std::atof(argv[i + 1]);
+        }
+        if (std::string(argv[i]) == "--compute-benchmark") {
+            benchmarkCount = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        if (std::string(argv[i]) == "--msaa") {
+            samples = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        if (std::string(argv[i]) == "--msaa-benchmark") {
+            msaaBenchmarkFrames = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        if (std::string(argv[i]) == "--dump-frames") {
+            dumpDirectory = argv[i + 1];
+        }
+        if (std::string(argv[i]) == "--dump-interval") {
+            dumpInterval = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        if (std::string(argv[i]) == "--golden-test" || std::string(argv[i]) == "--update-golden") {
+            goldenPath = argv[i + 1];
+            updateGolden = std::string(argv[i]) == "--update-golden";
+        }
+        if (std::string(argv[i]) == "--golden-frame") {
+            goldenFrame = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        if (std::string(argv[i]) == "--golden-tolerance") {
+            goldenTolerance = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        if (std::string(argv[i]) == "--capture") {
+            capturePath = argv[i + 1];
+        }
+        if (std::string(argv[i]) == "--capture-buffers") {
+            captureBuffers = std::strtoul(argv[i + 1], nullptr, 10);
+        }
+        if (std::string(argv[i]) == "--memory-report") {
+            memoryReportPath = argv[i + 1];
+        }
+    }
+    if (msaaBenchmarkFrames > 0) {
+        try {
+            App::runMsaaBenchmark(static_cast<uint32_t>(msaaBenchmarkFrames));
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    // Rounded down to a count the device supports
+    App app{frameTimeMs, static_cast<VkSampleCountFlagBits>(samples)};
     
     try {
-        app.run();
+        if (benchmarkCount > 0) {
+            app.runComputeBenchmark(static_cast<uint32_t>(benchmarkCount));
+        } else if (!goldenPath.empty()) {
+            app.runGoldenTest(
+                goldenPath, static_cast<uint32_t>(goldenFrame), updateGolden, static_cast<uint32_t>(goldenTolerance));
+        } else {
+            // First, so the readback gets the capture's buffer count
+            if (!capturePath.empty()) {
+                app.enableCapture(capturePath, static_cast<uint32_t>(captureBuffers));
+            }
+            if (!memoryReportPath.empty()) {
+                app.enableMemoryReport(memoryReportPath);
+            }
+            if (!dumpDirectory.empty()) {
+                app.enableFrameDump(dumpDirectory, static_cast<uint32_t>(dumpInterval));
+            }
+            app.run();
+        }
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return -1;
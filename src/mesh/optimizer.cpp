@@ -0,0 +1,333 @@
+#include "optimizer.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// Triangles using each vertex, as offsets into one flat list
+struct Adjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+
+  Adjacency(const std::vector<uint32_t> &indices, size_t vertexCount) : offsets(vertexCount + 1, 0) {
+    for (uint32_t index : indices) {
+      offsets[index + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    triangles.resize(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+      triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+};
+
+// FIFO cache by timestamps: a vertex is cached if it was added within the last
+// cacheSize insertions
+struct CacheSimulator {
+  std::vector<uint32_t> timestamps;
+  uint32_t time;
+  uint32_t cacheSize;
+
+  CacheSimulator(size_t vertexCount, uint32_t cacheSize)
+      : timestamps(vertexCount, 0), time{cacheSize + 1}, cacheSize{cacheSize} {}
+
+  void reset() { time += cacheSize + 1; }
+
+  // returns true on a miss
+  bool access(uint32_t vertex) {
+    if (time - timestamps[vertex] > cacheSize) {
+      timestamps[vertex] = time++;
+      return true;
+    }
+    return false;
+  }
+};
+
+}  // namespace
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize) {
+  CacheSimulator cache{vertexCount, cacheSize};
+  std::vector<uint8_t> used(vertexCount, 0);
+  size_t misses = 0;
+  size_t uniqueVertices = 0;
+  for (uint32_t index : indices) {
+    misses += cache.access(index);
+    uniqueVertices += used[index] == 0;
+    used[index] = 1;
+  }
+  size_t triangles = indices.size() / 3;
+  return {
+      triangles ? static_cast<float>(misses) / triangles : 0.0f,
+      uniqueVertices ? static_cast<float>(misses) / uniqueVertices : 0.0f};
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+  Adjacency adjacency{indices, vertexCount};
+  std::vector<uint32_t> liveTriangles(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  }
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  std::vector<uint8_t> emitted(triangleCount, 0);
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+
+  uint32_t time = cacheSize + 1;
+  uint32_t scan = 0;  // next vertex to try once the dead-end stack runs dry
+  int64_t fan = indices[0];
+
+  while (fan >= 0) {
+    candidates.clear();
+    uint32_t centre = static_cast<uint32_t>(fan);
+    for (uint32_t a = adjacency.offsets[centre]; a < adjacency.offsets[centre + 1]; a++) {
+      uint32_t t = adjacency.triangles[a];
+      if (emitted[t]) {
+        continue;
+      }
+      emitted[t] = 1;
+      for (int k = 0; k < 3; k++) {
+        uint32_t v = indices[3 * t + k];
+        result.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        liveTriangles[v]--;
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    // Prefer the candidate whose fan can be emitted while it's still cached,
+    // and among those the one that entered the cache earliest
+    fan = -1;
+    int64_t bestPriority = -1;
+    for (uint32_t v : candidates) {
+      if (liveTriangles[v] == 0) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+        priority = time - cacheTime[v];
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fan = v;
+      }
+    }
+    if (fan >= 0) {
+      continue;
+    }
+
+    // Dead end: back up to a recently used vertex with work left, else scan
+    while (!deadEnd.empty() && fan < 0) {
+      uint32_t v = deadEnd.back();
+      deadEnd.pop_back();
+      if (liveTriangles[v] > 0) {
+        fan = v;
+      }
+    }
+    while (fan < 0 && scan < vertexCount) {
+      if (liveTriangles[scan] > 0) {
+        fan = scan;
+      }
+      scan++;
+    }
+  }
+  indices.swap(result);
+}
+
+void optimizeOverdraw(
+    std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions, float threshold, uint32_t cacheSize) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+  float targetAcmr = analyzeVertexCache(indices, positions.size(), cacheSize).acmr * threshold;
+
+  // Close a cluster as soon as it's cheap enough on its own
+  std::vector<size_t> clusterStarts;
+  CacheSimulator cache{positions.size(), cacheSize};
+  size_t misses = 0;
+  size_t clusterStart = 0;
+  for (size_t t = 0; t < triangleCount; t++) {
+    if (t == clusterStart) {
+      clusterStarts.push_back(t);
+      cache.reset();
+      misses = 0;
+    }
+    for (int k = 0; k < 3; k++) {
+      misses += cache.access(indices[3 * t + k]);
+    }
+    if (static_cast<float>(misses) <= targetAcmr * (t + 1 - clusterStart)) {
+      clusterStart = t + 1;
+    }
+  }
+  clusterStarts.push_back(triangleCount);
+
+  glm::vec3 meshCentre{0.0f};
+  float meshArea = 0.0f;
+  struct Cluster {
+    size_t begin;
+    size_t end;
+    float sortKey;
+  };
+  std::vector<Cluster> clusters;
+  std::vector<glm::vec3> centroids;
+  std::vector<glm::vec3> normals;
+  for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+    glm::vec3 centroid{0.0f};
+    glm::vec3 normal{0.0f};
+    float area = 0.0f;
+    for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+      const glm::vec3 &a = positions[indices[3 * t]];
+      const glm::vec3 &b = positions[indices[3 * t + 1]];
+      const glm::vec3 &d = positions[indices[3 * t + 2]];
+      glm::vec3 cross = glm::cross(b - a, d - a);
+      float triangleArea = glm::length(cross);
+      centroid += (a + b + d) * (triangleArea / 3.0f);
+      normal += cross;
+      area += triangleArea;
+    }
+    meshCentre += centroid;
+    meshArea += area;
+    centroids.push_back(area > 0.0f ? centroid / area : positions[indices[3 * clusterStarts[c]]]);
+    normals.push_back(normal);
+    clusters.push_back({clusterStarts[c], clusterStarts[c + 1], 0.0f});
+  }
+  if (meshArea > 0.0f) {
+    meshCentre /= meshArea;
+  }
+
+  for (size_t c = 0; c < clusters.size(); c++) {
+    float length = glm::length(normals[c]);
+    clusters[c].sortKey = length > 0.0f ? glm::dot(centroids[c] - meshCentre, normals[c] / length) : 0.0f;
+  }
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+    return a.sortKey > b.sortKey;
+  });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (const Cluster &cluster : clusters) {
+    result.insert(result.end(), indices.begin() + 3 * cluster.begin, indices.begin() + 3 * cluster.end);
+  }
+  indices.swap(result);
+}
+
+std::vector<uint32_t> optimizeVertexFetchRemap(std::vector<uint32_t> &indices, size_t vertexCount) {
+  constexpr uint32_t UNASSIGNED = UINT32_MAX;
+  std::vector<uint32_t> remap(vertexCount, UNASSIGNED);
+  uint32_t next = 0;
+  for (uint32_t &index : indices) {
+    if (remap[index] == UNASSIGNED) {
+      remap[index] = next++;
+    }
+    index = remap[index];
+  }
+  for (uint32_t &position : remap) {
+    if (position == UNASSIGNED) {
+      position = next++;
+    }
+  }
+  return remap;
+}
+
+std::vector<Meshlet> buildMeshlets(
+    const std::vector<uint32_t> &indices,
+    uint32_t firstIndex,
+    uint32_t indexCount,
+    const std::vector<glm::vec3> &positions,
+    uint32_t maxVertices,
+    uint32_t maxTriangles) {
+  std::vector<Meshlet> meshlets;
+  // vertex -> 1 + index of the meshlet it was last added to
+  std::vector<uint32_t> seenIn(positions.size(), 0);
+  std::vector<uint32_t> vertices;
+
+  auto finish = [&](uint32_t begin, uint32_t end) {
+    Meshlet meshlet{};
+    meshlet.firstIndex = begin;
+    meshlet.indexCount = end - begin;
+    meshlet.vertexCount = static_cast<uint32_t>(vertices.size());
+
+    glm::vec3 low = positions[vertices[0]], high = low;
+    for (uint32_t v : vertices) {
+      low = glm::min(low, positions[v]);
+      high = glm::max(high, positions[v]);
+    }
+    meshlet.center = (low + high) * 0.5f;
+    for (uint32_t v : vertices) {
+      meshlet.radius = std::max(meshlet.radius, glm::length(positions[v] - meshlet.center));
+    }
+
+    glm::vec3 axis{0.0f};
+    std::vector<glm::vec3> normals;
+    for (uint32_t i = begin; i < end; i += 3) {
+      glm::vec3 normal = glm::cross(
+          positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+      float length = glm::length(normal);
+      if (length > 0.0f) {
+        normals.push_back(normal / length);
+        axis += normals.back();
+      }
+    }
+    float axisLength = glm::length(axis);
+    meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3{0.0f, 0.0f, 1.0f};
+    float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+    for (const glm::vec3 &normal : normals) {
+      minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+    }
+    // A cone of 90 degrees or more contains normals facing every way
+    meshlet.coneCutoff = minDot > 0.0f ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+    meshlets.push_back(meshlet);
+    vertices.clear();
+  };
+
+  uint32_t begin = firstIndex;
+  uint32_t end = firstIndex + indexCount;
+  for (uint32_t i = firstIndex; i < end; i += 3) {
+    uint32_t id = static_cast<uint32_t>(meshlets.size()) + 1;
+    uint32_t newVertices = 0;
+    for (int k = 0; k < 3; k++) {
+      newVertices += seenIn[indices[i + k]] != id;
+    }
+    if (vertices.size() + newVertices > maxVertices || (i - begin) / 3 + 1 > maxTriangles) {
+      finish(begin, i);
+      begin = i;
+      id++;
+    }
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[i + k];
+      if (seenIn[v] != id) {
+        seenIn[v] = id;
+        vertices.push_back(v);
+      }
+    }
+  }
+  if (begin < end) {
+    finish(begin, end);
+  }
+  return meshlets;
+}
+
+bool isMeshletBackfacing(const Meshlet &meshlet, const glm::vec3 &cameraPosition) {
+  // Widened by the bounding sphere, since the view direction differs across it
+  glm::vec3 toCentre = meshlet.center - cameraPosition;
+  float distance = glm::length(toCentre);
+  return distance > meshlet.radius &&
+         glm::dot(toCentre, meshlet.coneAxis) > meshlet.coneCutoff * distance + meshlet.radius;
+}
+
+bool isMeshletBackfacingOrthographic(const Meshlet &meshlet, const glm::vec3 &viewDirection) {
+  return glm::dot(viewDirection, meshlet.coneAxis) > meshlet.coneCutoff;
+}
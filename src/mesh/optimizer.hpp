@@ -0,0 +1,84 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Import-time reordering of indexed triangle lists. None of these change
+// which triangles are drawn, only the order they are drawn in and the order
+// vertices are stored in.
+
+struct VertexCacheStats {
+  // vertex shader invocations per triangle (0.5 is the ideal on large meshes)
+  float acmr;
+  // vertex shader invocations per vertex (1.0 is ideal)
+  float atvr;
+};
+
+// Simulates a FIFO post-transform cache of cacheSize vertices.
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+// Tipsify (Sander, Nehab & Barczak 2007): fans around recently used vertices
+// and picks the next fan centre by how long its vertices are likely to stay in
+// a cache of cacheSize. Linear time.
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+// Splits the triangles into clusters that each keep their ACMR within
+// threshold of the whole mesh even from a cold cache, then draws clusters
+// facing outwards from the mesh centre first, so that on convex-ish meshes
+// near surfaces tend to be drawn before what they hide. Run it on the output
+// of optimizeVertexCache.
+void optimizeOverdraw(
+    std::vector<uint32_t> &indices,
+    const std::vector<glm::vec3> &positions,
+    float threshold = 1.05f,
+    uint32_t cacheSize = 16);
+
+// New position of every vertex so that vertices are stored in the order they
+// are first used. Indices are rewritten; unused vertices are moved to the end.
+std::vector<uint32_t> optimizeVertexFetchRemap(std::vector<uint32_t> &indices, size_t vertexCount);
+
+template <typename Vertex>
+void remapVertices(std::vector<Vertex> &vertices, const std::vector<uint32_t> &remap) {
+  std::vector<Vertex> reordered(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    reordered[remap[i]] = vertices[i];
+  }
+  vertices.swap(reordered);
+}
+
+// A run of consecutive triangles of an index buffer small enough for one
+// mesh shader workgroup, with what it takes to cull it as a whole.
+struct Meshlet {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t vertexCount;
+  // bounding sphere
+  glm::vec3 center;
+  float radius;
+  // Every triangle normal lies within the cone around coneAxis; coneCutoff is
+  // the sine of its half angle, 1 if the cone is too wide to ever cull
+  glm::vec3 coneAxis;
+  float coneCutoff;
+};
+
+// Cuts indices[firstIndex, firstIndex + indexCount) into meshlets in order,
+// starting a new one whenever maxVertices or maxTriangles would be exceeded.
+// The default limits are the usual mesh shader sizes.
+std::vector<Meshlet> buildMeshlets(
+    const std::vector<uint32_t> &indices,
+    uint32_t firstIndex,
+    uint32_t indexCount,
+    const std::vector<glm::vec3> &positions,
+    uint32_t maxVertices = 64,
+    uint32_t maxTriangles = 124);
+
+// Whether every triangle of the meshlet faces away from a camera at
+// cameraPosition, or looking along viewDirection for orthographic views.
+// Front faces are counter-clockwise.
+bool isMeshletBackfacing(const Meshlet &meshlet, const glm::vec3 &cameraPosition);
+bool isMeshletBackfacingOrthographic(const Meshlet &meshlet, const glm::vec3 &viewDirection);
@@ -0,0 +1,267 @@
+#include "simplifier.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+// Border planes weigh this much more than surface planes, so outlines keep
+// their shape until the interior has been simplified
+constexpr double BORDER_WEIGHT = 10.0;
+
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix
+// of the plane equations
+struct Quadric {
+  double a2 = 0, ab = 0, ac = 0, ad = 0;
+  double b2 = 0, bc = 0, bd = 0;
+  double c2 = 0, cd = 0;
+  double d2 = 0;
+
+  static Quadric fromPlane(double a, double b, double c, double d, double weight) {
+    Quadric q;
+    q.a2 = weight * a * a, q.ab = weight * a * b, q.ac = weight * a * c, q.ad = weight * a * d;
+    q.b2 = weight * b * b, q.bc = weight * b * c, q.bd = weight * b * d;
+    q.c2 = weight * c * c, q.cd = weight * c * d;
+    q.d2 = weight * d * d;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &o) {
+    a2 += o.a2, ab += o.ab, ac += o.ac, ad += o.ad;
+    b2 += o.b2, bc += o.bc, bd += o.bd;
+    c2 += o.c2, cd += o.cd;
+    d2 += o.d2;
+    return *this;
+  }
+
+  double evaluate(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double result = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y +
+                    2 * bc * y * z + 2 * bd * y + c2 * z * z + 2 * cd * z + d2;
+    // rounding can take an exact fit slightly below zero
+    return std::max(0.0, result);
+  }
+};
+
+struct Collapse {
+  double cost;
+  uint32_t from;
+  uint32_t to;
+  uint32_t fromVersion;
+  uint32_t toVersion;
+  bool operator>(const Collapse &o) const { return cost > o.cost; }
+};
+
+uint64_t edgeKey(uint32_t a, uint32_t b) {
+  return a < b ? (static_cast<uint64_t>(a) << 32 | b) : (static_cast<uint64_t>(b) << 32 | a);
+}
+
+glm::vec3 triangleNormal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+  return glm::cross(b - a, c - a);
+}
+
+}  // namespace
+
+std::vector<uint32_t> simplifyMesh(
+    const std::vector<glm::vec3> &positions,
+    const std::vector<uint32_t> &indices,
+    size_t targetIndexCount,
+    float &error) {
+  const size_t vertexCount = positions.size();
+  const size_t triangleCount = indices.size() / 3;
+  std::vector<uint32_t> triangles = indices;
+  std::vector<uint8_t> triangleAlive(triangleCount, 1);
+  std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+  std::vector<Quadric> quadrics(vertexCount);
+
+  std::unordered_map<uint64_t, uint32_t> edgeUses;
+  edgeUses.reserve(indices.size());
+  for (size_t t = 0; t < triangleCount; t++) {
+    const uint32_t *v = &triangles[3 * t];
+    glm::vec3 normal = triangleNormal(positions[v[0]], positions[v[1]], positions[v[2]]);
+    float length = glm::length(normal);
+    if (length > 0.0f) {
+      normal /= length;
+      double d = -glm::dot(normal, positions[v[0]]);
+      Quadric plane = Quadric::fromPlane(normal.x, normal.y, normal.z, d, 1.0);
+      for (int k = 0; k < 3; k++) {
+        quadrics[v[k]] += plane;
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      vertexTriangles[v[k]].push_back(static_cast<uint32_t>(t));
+      edgeUses[edgeKey(v[k], v[(k + 1) % 3])]++;
+    }
+  }
+
+  // A plane through each border edge, perpendicular to its triangle
+  for (size_t t = 0; t < triangleCount; t++) {
+    const uint32_t *v = &triangles[3 * t];
+    glm::vec3 normal = triangleNormal(positions[v[0]], positions[v[1]], positions[v[2]]);
+    for (int k = 0; k < 3; k++) {
+      uint32_t a = v[k], b = v[(k + 1) % 3];
+      if (edgeUses[edgeKey(a, b)] != 1) {
+        continue;
+      }
+      glm::vec3 borderNormal = glm::cross(positions[b] - positions[a], normal);
+      float length = glm::length(borderNormal);
+      if (length == 0.0f) {
+        continue;
+      }
+      borderNormal /= length;
+      double d = -glm::dot(borderNormal, positions[a]);
+      Quadric plane = Quadric::fromPlane(borderNormal.x, borderNormal.y, borderNormal.z, d, BORDER_WEIGHT);
+      quadrics[a] += plane;
+      quadrics[b] += plane;
+    }
+  }
+
+  // Versions change whenever a vertex's quadric or neighbourhood does, which
+  // invalidates queued collapses computed from the old state
+  std::vector<uint32_t> versions(vertexCount, 0);
+  std::vector<uint8_t> removed(vertexCount, 0);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+  auto pushEdge = [&](uint32_t a, uint32_t b) {
+    Quadric combined = quadrics[a];
+    combined += quadrics[b];
+    double aIntoB = combined.evaluate(positions[b]);
+    double bIntoA = combined.evaluate(positions[a]);
+    if (aIntoB <= bIntoA) {
+      queue.push({aIntoB, a, b, versions[a], versions[b]});
+    } else {
+      queue.push({bIntoA, b, a, versions[b], versions[a]});
+    }
+  };
+  for (const auto &edge : edgeUses) {
+    pushEdge(static_cast<uint32_t>(edge.first >> 32), static_cast<uint32_t>(edge.first));
+  }
+
+  // Moving from onto to must not turn any remaining triangle of from over
+  auto flipsTriangle = [&](uint32_t from, uint32_t to) {
+    for (uint32_t t : vertexTriangles[from]) {
+      if (!triangleAlive[t]) {
+        continue;
+      }
+      const uint32_t *v = &triangles[3 * t];
+      if (v[0] == to || v[1] == to || v[2] == to) {
+        continue;  // collapses away
+      }
+      glm::vec3 corners[3] = {positions[v[0]], positions[v[1]], positions[v[2]]};
+      glm::vec3 before = triangleNormal(corners[0], corners[1], corners[2]);
+      for (int k = 0; k < 3; k++) {
+        if (v[k] == from) {
+          corners[k] = positions[to];
+        }
+      }
+      glm::vec3 after = triangleNormal(corners[0], corners[1], corners[2]);
+      if (glm::dot(before, after) <= 0.0f) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  size_t liveIndices = triangleCount * 3;
+  double maxCost = 0.0;
+  std::vector<uint32_t> neighbours;
+  while (liveIndices > targetIndexCount && !queue.empty()) {
+    Collapse collapse = queue.top();
+    queue.pop();
+    uint32_t from = collapse.from, to = collapse.to;
+    if (removed[from] || removed[to] || versions[from] != collapse.fromVersion ||
+        versions[to] != collapse.toVersion) {
+      continue;
+    }
+    if (flipsTriangle(from, to)) {
+      continue;
+    }
+
+    for (uint32_t t : vertexTriangles[from]) {
+      if (!triangleAlive[t]) {
+        continue;
+      }
+      uint32_t *v = &triangles[3 * t];
+      if (v[0] == to || v[1] == to || v[2] == to) {
+        triangleAlive[t] = 0;
+        liveIndices -= 3;
+      } else {
+        for (int k = 0; k < 3; k++) {
+          if (v[k] == from) {
+            v[k] = to;
+          }
+        }
+        vertexTriangles[to].push_back(t);
+      }
+    }
+    vertexTriangles[from].clear();
+    removed[from] = 1;
+    quadrics[to] += quadrics[from];
+    maxCost = std::max(maxCost, collapse.cost);
+
+    // Requeue every edge around the merged vertex with the new quadric
+    auto &adjacent = vertexTriangles[to];
+    adjacent.erase(
+        std::remove_if(adjacent.begin(), adjacent.end(), [&](uint32_t t) { return !triangleAlive[t]; }),
+        adjacent.end());
+    neighbours.clear();
+    for (uint32_t t : adjacent) {
+      for (int k = 0; k < 3; k++) {
+        uint32_t n = triangles[3 * t + k];
+        if (n != to) {
+          neighbours.push_back(n);
+        }
+      }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    versions[to]++;
+    for (uint32_t n : neighbours) {
+      pushEdge(to, n);
+    }
+  }
+
+  std::vector<uint32_t> result;
+  result.reserve(liveIndices);
+  for (size_t t = 0; t < triangleCount; t++) {
+    if (triangleAlive[t]) {
+      result.insert(result.end(), triangles.begin() + 3 * t, triangles.begin() + 3 * t + 3);
+    }
+  }
+  // Quadric costs are squared distances summed over several planes, so their
+  // root bounds the actual distance from above
+  error = static_cast<float>(std::sqrt(maxCost));
+  return result;
+}
+
+std::vector<MeshLod> generateLods(
+    const std::vector<glm::vec3> &positions,
+    const std::vector<uint32_t> &indices,
+    uint32_t maxLods,
+    std::vector<uint32_t> &lodIndices) {
+  // A level that removes less than this share of the previous one isn't worth
+  // its index memory
+  constexpr double MIN_REDUCTION = 0.1;
+
+  std::vector<MeshLod> lods;
+  std::vector<uint32_t> current = indices;
+  float error = 0.0f;
+  while (lods.size() < maxLods) {
+    lods.push_back({static_cast<uint32_t>(lodIndices.size()), static_cast<uint32_t>(current.size()), error});
+    lodIndices.insert(lodIndices.end(), current.begin(), current.end());
+
+    size_t target = current.size() / 6 * 3;
+    float stepError = 0.0f;
+    std::vector<uint32_t> next = simplifyMesh(positions, current, target, stepError);
+    if (next.empty() || next.size() > current.size() * (1.0 - MIN_REDUCTION)) {
+      break;
+    }
+    // each level is simplified from the previous one, so errors add up
+    error += stepError;
+    current.swap(next);
+  }
+  return lods;
+}
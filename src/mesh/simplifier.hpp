@@ -0,0 +1,42 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One level of detail: a range of an index buffer shared by all levels, over
+// the same vertices.
+struct MeshLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  // Upper bound on how far the surface moved from full detail, in model units
+  float error;
+};
+
+// Quadric edge collapse (Garland & Heckbert). Each collapse merges one vertex
+// into a neighbour that already exists, so the result indexes the original
+// vertices and every level can share one vertex buffer. Open borders are held
+// in place by extra planes along them, and collapses that would flip a
+// triangle are rejected.
+//
+// Stops once the index count is at or below targetIndexCount or nothing can
+// be collapsed any more. error receives the largest deviation introduced, in
+// the units of positions.
+std::vector<uint32_t> simplifyMesh(
+    const std::vector<glm::vec3> &positions,
+    const std::vector<uint32_t> &indices,
+    size_t targetIndexCount,
+    float &error);
+
+// Appends up to maxLods levels of indices to lodIndices, the first being
+// indices unchanged, each following one about half the triangles of the
+// previous. Stops early once simplification can't make meaningful progress.
+std::vector<MeshLod> generateLods(
+    const std::vector<glm::vec3> &positions,
+    const std::vector<uint32_t> &indices,
+    uint32_t maxLods,
+    std::vector<uint32_t> &lodIndices);
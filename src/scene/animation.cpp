@@ -0,0 +1,85 @@
+#include "animation.hpp"
+
+#include "simd.hpp"
+
+// std
+#include <cassert>
+#include <cmath>
+
+void Pose::resize(uint32_t count) {
+  jointCount = count;
+  const size_t padded = (count + 3) & ~size_t{3};
+  for (auto *channel : {&rotationX, &rotationY, &rotationZ, &translationX, &translationY, &translationZ}) {
+    channel->assign(padded, 0.0f);
+  }
+  rotationW.assign(padded, 1.0f);
+}
+
+void Pose::setJoint(uint32_t joint, const glm::quat &rotation, const glm::vec3 &translation) {
+  rotationX[joint] = rotation.x;
+  rotationY[joint] = rotation.y;
+  rotationZ[joint] = rotation.z;
+  rotationW[joint] = rotation.w;
+  translationX[joint] = translation.x;
+  translationY[joint] = translation.y;
+  translationZ[joint] = translation.z;
+}
+
+void blendPoses(const Pose &a, const Pose &b, float weight, Pose &out) {
+  assert(a.jointCount == b.jointCount && a.jointCount == out.jointCount);
+  const simd::F4 wb = simd::splat(weight);
+  const simd::F4 wa = simd::splat(1.0f - weight);
+  const simd::F4 one = simd::splat(1.0f);
+  for (size_t j = 0; j < a.rotationW.size(); j += 4) {
+    simd::F4 ax = simd::load(&a.rotationX[j]), ay = simd::load(&a.rotationY[j]);
+    simd::F4 az = simd::load(&a.rotationZ[j]), aw = simd::load(&a.rotationW[j]);
+    simd::F4 bx = simd::load(&b.rotationX[j]), by = simd::load(&b.rotationY[j]);
+    simd::F4 bz = simd::load(&b.rotationZ[j]), bw = simd::load(&b.rotationW[j]);
+
+    // q and -q are the same rotation; flipping b onto a's hemisphere takes the shorter arc
+    simd::F4 dot = ax * bx + ay * by + az * bz + aw * bw;
+    simd::F4 sb = simd::sign(dot) * wb;
+    simd::F4 x = ax * wa + bx * sb, y = ay * wa + by * sb;
+    simd::F4 z = az * wa + bz * sb, w = aw * wa + bw * sb;
+    simd::F4 inverseLength = one / simd::sqrt(x * x + y * y + z * z + w * w);
+    simd::store(&out.rotationX[j], x * inverseLength);
+    simd::store(&out.rotationY[j], y * inverseLength);
+    simd::store(&out.rotationZ[j], z * inverseLength);
+    simd::store(&out.rotationW[j], w * inverseLength);
+
+    simd::store(&out.translationX[j], simd::load(&a.translationX[j]) * wa + simd::load(&b.translationX[j]) * wb);
+    simd::store(&out.translationY[j], simd::load(&a.translationY[j]) * wa + simd::load(&b.translationY[j]) * wb);
+    simd::store(&out.translationZ[j], simd::load(&a.translationZ[j]) * wa + simd::load(&b.translationZ[j]) * wb);
+  }
+}
+
+void sampleClip(const AnimationClip &clip, float seconds, Pose &out) {
+  assert(!clip.frames.empty());
+  const size_t frameCount = clip.frames.size();
+  float position = std::fmod(seconds * clip.framesPerSecond, static_cast<float>(frameCount));
+  if (position < 0.0f) {
+    position += frameCount;
+  }
+  size_t frame = static_cast<size_t>(position) % frameCount;
+  blendPoses(clip.frames[frame], clip.frames[(frame + 1) % frameCount], position - std::floor(position), out);
+}
+
+void computeSkinningPalette(const Skeleton &skeleton, const Pose &pose, glm::mat4 *palette) {
+  assert(pose.jointCount == skeleton.getJointCount());
+  // Model-space transforms first; parents are final before their children need them
+  for (uint32_t joint = 0; joint < skeleton.getJointCount(); joint++) {
+    glm::mat4 local = glm::mat4_cast(pose.getRotation(joint));
+    local[3] = glm::vec4(pose.getTranslation(joint), 1.0f);
+    int32_t parent = skeleton.parents[joint];
+    if (parent < 0) {
+      palette[joint] = local;
+    } else {
+      simd::mat4Mul(&palette[parent][0][0], &local[0][0], &palette[joint][0][0]);
+    }
+  }
+  // Then the inverse bind, in place now that every child has been built from its parent
+  for (uint32_t joint = 0; joint < skeleton.getJointCount(); joint++) {
+    glm::mat4 model = palette[joint];
+    simd::mat4Mul(&model[0][0], &skeleton.inverseBindMatrices[joint][0][0], &palette[joint][0][0]);
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+// Joint hierarchy of a skinned mesh. A parent comes before its children, so
+// model-space transforms are built in one linear pass like Scene's.
+struct Skeleton {
+  // -1 for a root
+  std::vector<int32_t> parents;
+  // Takes a bind-pose vertex into each joint's space
+  std::vector<glm::mat4> inverseBindMatrices;
+
+  uint32_t getJointCount() const { return static_cast<uint32_t>(parents.size()); }
+};
+
+// Joint-local rotations and translations as structure-of-arrays, padded with
+// identity joints to a multiple of four so blends handle four joints per SIMD
+// operation.
+struct Pose {
+  uint32_t jointCount = 0;
+  std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+  std::vector<float> translationX, translationY, translationZ;
+
+  explicit Pose(uint32_t jointCount = 0) { resize(jointCount); }
+  void resize(uint32_t count);
+  void setJoint(uint32_t joint, const glm::quat &rotation, const glm::vec3 &translation);
+  glm::quat getRotation(uint32_t joint) const {
+    return {rotationW[joint], rotationX[joint], rotationY[joint], rotationZ[joint]};
+  }
+  glm::vec3 getTranslation(uint32_t joint) const {
+    return {translationX[joint], translationY[joint], translationZ[joint]};
+  }
+};
+
+// Poses sampled at a fixed rate. Clips loop: the last frame blends back into
+// the first.
+struct AnimationClip {
+  float framesPerSecond = 30.0f;
+  std::vector<Pose> frames;
+
+  float getDuration() const { return frames.size() / framesPerSecond; }
+};
+
+// out = a blended towards b by weight: normalized lerp of the rotations
+// along the shorter arc, lerp of the translations. out may be a or b; all
+// three have the same joint count.
+void blendPoses(const Pose &a, const Pose &b, float weight, Pose &out);
+// The clip at time seconds, wrapped into its duration.
+void sampleClip(const AnimationClip &clip, float seconds, Pose &out);
+// Per joint, its model-space transform times its inverse bind matrix: what
+// moves a bind-pose vertex along with the joint. Writes getJointCount()
+// matrices to palette.
+void computeSkinningPalette(const Skeleton &skeleton, const Pose &pose, glm::mat4 *palette);
@@ -0,0 +1,317 @@
+#include "bvh.hpp"
+
+// std
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+double surfaceAreaOf(const glm::vec3 &min, const glm::vec3 &max) {
+  glm::vec3 size = max - min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+}  // namespace
+
+void Bvh::build(const Scene &scene) {
+  const BoundsSoA &world = scene.getWorldBounds();
+  std::vector<EntityId> entities;
+  for (EntityId entity = 0; entity < scene.size(); entity++) {
+    if (scene.hasRenderable(entity)) {
+      entities.push_back(entity);
+    }
+  }
+  entityCount = static_cast<uint32_t>(entities.size());
+
+  nodes.clear();
+  blockLeaves.clear();
+  slotEntities.clear();
+  entitySlots.assign(scene.size(), NO_SLOT);
+  for (auto *component : {&slotBounds.minX, &slotBounds.minY, &slotBounds.minZ,
+                          &slotBounds.maxX, &slotBounds.maxY, &slotBounds.maxZ}) {
+    component->clear();
+  }
+
+  if (!entities.empty()) {
+    nodes.reserve(2 * (entities.size() / LEAF_SIZE + 1));
+    nodes.emplace_back();
+    buildNode(0, entities, 0, entities.size(), world);
+  }
+
+  parents.assign(nodes.size(), 0);
+  for (uint32_t node = 0; node < nodes.size(); node++) {
+    if (!nodes[node].isLeaf()) {
+      parents[nodes[node].childOrBlock] = node;
+      parents[nodes[node].childOrBlock + 1] = node;
+    }
+  }
+  nodeDirty.assign(nodes.size(), 0);
+
+  surfaceArea = 0.0f;
+  for (const Node &node : nodes) {
+    surfaceArea += surfaceAreaOf(node.min, node.max);
+  }
+  builtSurfaceArea = surfaceArea;
+
+  splitTasks();
+}
+
+// Children are appended after their parent, so walking the nodes backwards
+// always visits children first.
+void Bvh::buildNode(
+    uint32_t node, std::vector<EntityId> &entities, size_t begin, size_t end, const BoundsSoA &world) {
+  auto centroid = [&](EntityId entity, int axis) {
+    switch (axis) {
+      case 0: return world.minX[entity] + world.maxX[entity];
+      case 1: return world.minY[entity] + world.maxY[entity];
+      default: return world.minZ[entity] + world.maxZ[entity];
+    }
+  };
+
+  size_t count = end - begin;
+  if (count <= LEAF_SIZE) {
+    uint32_t block = static_cast<uint32_t>(blockLeaves.size());
+    blockLeaves.push_back(node);
+    nodes[node].childOrBlock = block;
+    nodes[node].count = static_cast<uint32_t>(count);
+
+    // unused slots stay NaN, which the kernel never reports as visible
+    constexpr float NaN = std::numeric_limits<float>::quiet_NaN();
+    for (size_t i = 0; i < LEAF_SIZE; i++) {
+      EntityId entity = begin + i < end ? entities[begin + i] : NO_ENTITY;
+      bool used = entity != NO_ENTITY;
+      if (used) {
+        entitySlots[entity] = static_cast<uint32_t>(slotEntities.size());
+      }
+      slotEntities.push_back(entity);
+      slotBounds.minX.push_back(used ? world.minX[entity] : NaN);
+      slotBounds.minY.push_back(used ? world.minY[entity] : NaN);
+      slotBounds.minZ.push_back(used ? world.minZ[entity] : NaN);
+      slotBounds.maxX.push_back(used ? world.maxX[entity] : NaN);
+      slotBounds.maxY.push_back(used ? world.maxY[entity] : NaN);
+      slotBounds.maxZ.push_back(used ? world.maxZ[entity] : NaN);
+    }
+    updateNodeBounds(node);
+    return;
+  }
+
+  // Median split along the widest axis of the centroids, rounded so the left
+  // half fills whole leaves
+  glm::vec3 low{std::numeric_limits<float>::max()};
+  glm::vec3 high{std::numeric_limits<float>::lowest()};
+  for (size_t i = begin; i < end; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      low[axis] = std::min(low[axis], centroid(entities[i], axis));
+      high[axis] = std::max(high[axis], centroid(entities[i], axis));
+    }
+  }
+  glm::vec3 spread = high - low;
+  int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+
+  size_t half = (count / 2 + LEAF_SIZE - 1) / LEAF_SIZE * LEAF_SIZE;
+  size_t middle = begin + std::min(half, count - 1);
+  std::nth_element(
+      entities.begin() + begin,
+      entities.begin() + middle,
+      entities.begin() + end,
+      [&](EntityId a, EntityId b) { return centroid(a, axis) < centroid(b, axis); });
+
+  uint32_t left = static_cast<uint32_t>(nodes.size());
+  nodes[node].childOrBlock = left;
+  nodes[node].count = 0;
+  nodes.emplace_back();
+  nodes.emplace_back();
+  buildNode(left, entities, begin, middle, world);
+  buildNode(left + 1, entities, middle, end, world);
+  updateNodeBounds(node);
+}
+
+void Bvh::updateNodeBounds(uint32_t index) {
+  Node &node = nodes[index];
+  if (node.isLeaf()) {
+    size_t first = static_cast<size_t>(node.childOrBlock) * LEAF_SIZE;
+    float minX = slotBounds.minX[first], minY = slotBounds.minY[first], minZ = slotBounds.minZ[first];
+    float maxX = slotBounds.maxX[first], maxY = slotBounds.maxY[first], maxZ = slotBounds.maxZ[first];
+    for (size_t slot = first + 1; slot < first + node.count; slot++) {
+      minX = std::min(minX, slotBounds.minX[slot]);
+      minY = std::min(minY, slotBounds.minY[slot]);
+      minZ = std::min(minZ, slotBounds.minZ[slot]);
+      maxX = std::max(maxX, slotBounds.maxX[slot]);
+      maxY = std::max(maxY, slotBounds.maxY[slot]);
+      maxZ = std::max(maxZ, slotBounds.maxZ[slot]);
+    }
+    node.min = {minX, minY, minZ};
+    node.max = {maxX, maxY, maxZ};
+  } else {
+    const Node &left = nodes[node.childOrBlock];
+    const Node &right = nodes[node.childOrBlock + 1];
+    node.min = glm::min(left.min, right.min);
+    node.max = glm::max(left.max, right.max);
+  }
+}
+
+void Bvh::refit(const Scene &scene) {
+  const BoundsSoA &world = scene.getWorldBounds();
+  bool any = false;
+  for (EntityId entity : scene.getMovedEntities()) {
+    uint32_t slot = entity < entitySlots.size() ? entitySlots[entity] : NO_SLOT;
+    if (slot == NO_SLOT) {
+      continue;
+    }
+    slotBounds.minX[slot] = world.minX[entity];
+    slotBounds.minY[slot] = world.minY[entity];
+    slotBounds.minZ[slot] = world.minZ[entity];
+    slotBounds.maxX[slot] = world.maxX[entity];
+    slotBounds.maxY[slot] = world.maxY[entity];
+    slotBounds.maxZ[slot] = world.maxZ[entity];
+
+    // Mark the leaf and its ancestors, stopping at the first one already marked
+    uint32_t node = blockLeaves[slot / LEAF_SIZE];
+    while (!nodeDirty[node]) {
+      nodeDirty[node] = 1;
+      any = true;
+      if (node == 0) {
+        break;
+      }
+      node = parents[node];
+    }
+  }
+  if (!any) {
+    return;
+  }
+
+  for (size_t i = nodes.size(); i-- > 0;) {
+    if (!nodeDirty[i]) {
+      continue;
+    }
+    Node &node = nodes[i];
+    surfaceArea -= surfaceAreaOf(node.min, node.max);
+    updateNodeBounds(static_cast<uint32_t>(i));
+    surfaceArea += surfaceAreaOf(node.min, node.max);
+    nodeDirty[i] = 0;
+  }
+}
+
+bool Bvh::needsRebuild() const { return surfaceArea > REBUILD_GROWTH * builtSurfaceArea; }
+
+void Bvh::splitTasks() {
+  // Breadth-first from the root until there are enough subtrees to keep
+  // every thread busy; leaves can't be split further and stay as they are
+  taskRoots.clear();
+  if (!nodes.empty()) {
+    taskRoots.push_back(0);
+  }
+  bool split = true;
+  while (split && taskRoots.size() < TARGET_TASKS) {
+    split = false;
+    std::vector<uint32_t> next;
+    for (uint32_t root : taskRoots) {
+      if (nodes[root].isLeaf()) {
+        next.push_back(root);
+      } else {
+        next.push_back(nodes[root].childOrBlock);
+        next.push_back(nodes[root].childOrBlock + 1);
+        split = true;
+      }
+    }
+    taskRoots.swap(next);
+  }
+
+  // entities under each task root, for the culled count
+  std::vector<uint32_t> subtreeCounts(nodes.size(), 0);
+  for (size_t i = nodes.size(); i-- > 0;) {
+    const Node &node = nodes[i];
+    subtreeCounts[i] = node.isLeaf() ? node.count
+                                     : subtreeCounts[node.childOrBlock] + subtreeCounts[node.childOrBlock + 1];
+  }
+  taskEntityCounts.clear();
+  for (uint32_t root : taskRoots) {
+    taskEntityCounts.push_back(subtreeCounts[root]);
+  }
+  taskResults.resize(taskRoots.size());
+}
+
+void Bvh::cullTask(uint32_t task, const Frustum &frustum) {
+  CullTaskResult &result = taskResults[task];
+  result.visible.clear();
+  result.blocks.clear();
+  result.stats = {};
+
+  auto acceptLeaf = [&](const Node &leaf) {
+    size_t first = static_cast<size_t>(leaf.childOrBlock) * LEAF_SIZE;
+    result.visible.insert(
+        result.visible.end(), slotEntities.begin() + first, slotEntities.begin() + first + leaf.count);
+  };
+
+  // Nodes fully inside are accepted without testing anything below them;
+  // leaves the frustum cuts through are collected and tested 8 boxes at a time
+  auto &stack = result.stack;
+  stack.assign(1, taskRoots[task]);
+  while (!stack.empty()) {
+    uint32_t index = stack.back();
+    stack.pop_back();
+    const Node &node = nodes[index];
+    result.stats.nodesVisited++;
+
+    Containment containment = frustum.classify({node.min, node.max});
+    if (containment == Containment::Outside) {
+      continue;
+    }
+    if (containment == Containment::Inside) {
+      // descend without further tests
+      size_t base = stack.size();
+      stack.push_back(index);
+      while (stack.size() > base) {
+        const Node &inside = nodes[stack.back()];
+        stack.pop_back();
+        if (inside.isLeaf()) {
+          acceptLeaf(inside);
+        } else {
+          stack.push_back(inside.childOrBlock);
+          stack.push_back(inside.childOrBlock + 1);
+        }
+      }
+    } else if (node.isLeaf()) {
+      result.blocks.push_back(node.childOrBlock);
+    } else {
+      stack.push_back(node.childOrBlock);
+      stack.push_back(node.childOrBlock + 1);
+    }
+  }
+
+  result.masks.resize(result.blocks.size());
+  frustumTestBlocks(frustum, slotBounds, result.blocks.data(), result.blocks.size(), result.masks.data());
+  for (size_t b = 0; b < result.blocks.size(); b++) {
+    size_t first = static_cast<size_t>(result.blocks[b]) * LEAF_SIZE;
+    // padding slots are NaN and never set a bit
+    for (uint32_t slot = 0; slot < LEAF_SIZE; slot++) {
+      if (result.masks[b] & (1u << slot)) {
+        result.visible.push_back(slotEntities[first + slot]);
+      }
+    }
+  }
+
+  result.stats.boxesTested = static_cast<uint32_t>(result.blocks.size() * LEAF_SIZE);
+  result.stats.visible = static_cast<uint32_t>(result.visible.size());
+  result.stats.culled = taskEntityCounts[task] - result.stats.visible;
+}
+
+Bvh::CullStats Bvh::gather(std::vector<EntityId> &visible) const {
+  CullStats stats;
+  visible.clear();
+  for (const CullTaskResult &result : taskResults) {
+    visible.insert(visible.end(), result.visible.begin(), result.visible.end());
+    stats.visible += result.stats.visible;
+    stats.culled += result.stats.culled;
+    stats.nodesVisited += result.stats.nodesVisited;
+    stats.boxesTested += result.stats.boxesTested;
+  }
+  return stats;
+}
+
+Bvh::CullStats Bvh::cull(const Frustum &frustum, std::vector<EntityId> &visible) {
+  for (uint32_t task = 0; task < getTaskCount(); task++) {
+    cullTask(task, frustum);
+  }
+  return gather(visible);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "frustum.hpp"
+#include "scene.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+// Bounding volume hierarchy over the world bounds of a scene's renderables.
+// Leaves hold up to 8 entities whose bounds sit in one 8-wide block of a
+// structure-of-arrays copy, so a leaf the frustum cuts through is finished
+// with a single iteration of the SIMD box kernel. Moving entities refit the
+// tree in place; the topology only changes on build().
+class Bvh {
+ public:
+  static constexpr uint32_t LEAF_SIZE = 8;
+
+  struct CullStats {
+    uint32_t visible = 0;
+    uint32_t culled = 0;
+    uint32_t nodesVisited = 0;
+    uint32_t boxesTested = 0;
+  };
+
+  // Rebuilds from the current world bounds of every renderable. Entities made
+  // renderable after the last build aren't culled until the next one.
+  void build(const Scene &scene);
+  // Takes over the bounds of the scene's moved entities and updates their
+  // ancestors, visiting each affected node once.
+  void refit(const Scene &scene);
+  // Refits only keep the tree valid, not good: once the total surface area of
+  // the nodes has grown past REBUILD_GROWTH times its size at build time,
+  // build() again.
+  bool needsRebuild() const;
+
+  // The tree is cut into independent subtrees so culling can be spread over
+  // threads: cullTask() for every task, in any order and concurrently, then
+  // gather(). Each task only writes its own result.
+  uint32_t getTaskCount() const { return static_cast<uint32_t>(taskRoots.size()); }
+  void cullTask(uint32_t task, const Frustum &frustum);
+  CullStats gather(std::vector<EntityId> &visible) const;
+  // All tasks on the calling thread.
+  CullStats cull(const Frustum &frustum, std::vector<EntityId> &visible);
+
+  uint32_t getEntityCount() const { return entityCount; }
+
+ private:
+  static constexpr double REBUILD_GROWTH = 2.0;
+  static constexpr uint32_t TARGET_TASKS = 64;
+  static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+  // Reused across frames to keep its capacity
+  struct CullTaskResult {
+    std::vector<EntityId> visible;
+    std::vector<uint32_t> blocks;
+    std::vector<uint8_t> masks;
+    std::vector<uint32_t> stack;
+    CullStats stats;
+  };
+
+  struct Node {
+    glm::vec3 min;
+    // interior: index of the left child, the right one follows it
+    // leaf: index of the block of bounds
+    uint32_t childOrBlock;
+    glm::vec3 max;
+    uint32_t count;  // entities in a leaf, 0 for interior nodes
+    bool isLeaf() const { return count != 0; }
+  };
+
+  void buildNode(
+      uint32_t node, std::vector<EntityId> &entities, size_t begin, size_t end, const BoundsSoA &world);
+  void updateNodeBounds(uint32_t node);
+  void splitTasks();
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> parents;
+  std::vector<uint8_t> nodeDirty;
+  // per leaf block: the node, then LEAF_SIZE slots of entity and bounds
+  std::vector<uint32_t> blockLeaves;
+  std::vector<EntityId> slotEntities;
+  BoundsSoA slotBounds;
+  // EntityId -> slot, NO_SLOT if not in the tree
+  std::vector<uint32_t> entitySlots;
+
+  uint32_t entityCount = 0;
+  double surfaceArea = 0.0;
+  double builtSurfaceArea = 0.0;
+
+  std::vector<uint32_t> taskRoots;
+  std::vector<uint32_t> taskEntityCounts;
+  std::vector<CullTaskResult> taskResults;
+};
@@ -0,0 +1,169 @@
+#include "frustum.hpp"
+
+#include "simd.hpp"
+
+namespace {
+
+// Both kernels take, per plane, the distance of the box corner furthest
+// along the plane normal. The max over both extremes picks that corner without
+// a branch on the normal's sign; a box is outside the frustum iff that
+// distance is negative for some plane.
+
+void testBlocksPortable(
+    const Frustum &frustum,
+    const BoundsSoA &bounds,
+    const uint32_t *blocks,
+    size_t blockCount,
+    uint8_t *masks) {
+  using simd::F4;
+  F4 a[6], b[6], c[6], d[6];
+  for (int p = 0; p < 6; p++) {
+    a[p] = simd::splat(frustum.planes[p].x);
+    b[p] = simd::splat(frustum.planes[p].y);
+    c[p] = simd::splat(frustum.planes[p].z);
+    d[p] = simd::splat(frustum.planes[p].w);
+  }
+
+  for (size_t block = 0; block < blockCount; block++) {
+    size_t first = static_cast<size_t>(blocks[block]) * 8;
+    int mask = 0;
+    // two 4-wide halves per block
+    for (size_t half = 0; half < 8; half += 4) {
+      size_t i = first + half;
+      F4 minX = simd::load(&bounds.minX[i]), maxX = simd::load(&bounds.maxX[i]);
+      F4 minY = simd::load(&bounds.minY[i]), maxY = simd::load(&bounds.maxY[i]);
+      F4 minZ = simd::load(&bounds.minZ[i]), maxZ = simd::load(&bounds.maxZ[i]);
+      int inside = 0xF;
+      for (int p = 0; p < 6; p++) {
+        F4 distance = simd::max(a[p] * minX, a[p] * maxX) + simd::max(b[p] * minY, b[p] * maxY) +
+                      simd::max(c[p] * minZ, c[p] * maxZ) + d[p];
+        inside &= simd::nonNegativeMask(distance);
+      }
+      mask |= inside << half;
+    }
+    masks[block] = static_cast<uint8_t>(mask);
+  }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FRUSTUM_AVX2_DISPATCH 1
+
+// Compiled for AVX2 regardless of the target flags and only called when the
+// CPU reports support, so the default build still runs on any x86-64.
+__attribute__((target("avx2"))) void testBlocksAvx2(
+    const Frustum &frustum,
+    const BoundsSoA &bounds,
+    const uint32_t *blocks,
+    size_t blockCount,
+    uint8_t *masks) {
+  __m256 a[6], b[6], c[6], d[6];
+  for (int p = 0; p < 6; p++) {
+    a[p] = _mm256_set1_ps(frustum.planes[p].x);
+    b[p] = _mm256_set1_ps(frustum.planes[p].y);
+    c[p] = _mm256_set1_ps(frustum.planes[p].z);
+    d[p] = _mm256_set1_ps(frustum.planes[p].w);
+  }
+  const __m256 zero = _mm256_setzero_ps();
+
+  for (size_t block = 0; block < blockCount; block++) {
+    size_t i = static_cast<size_t>(blocks[block]) * 8;
+    __m256 minX = _mm256_loadu_ps(&bounds.minX[i]), maxX = _mm256_loadu_ps(&bounds.maxX[i]);
+    __m256 minY = _mm256_loadu_ps(&bounds.minY[i]), maxY = _mm256_loadu_ps(&bounds.maxY[i]);
+    __m256 minZ = _mm256_loadu_ps(&bounds.minZ[i]), maxZ = _mm256_loadu_ps(&bounds.maxZ[i]);
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; p++) {
+      __m256 distance = _mm256_add_ps(
+          _mm256_add_ps(
+              _mm256_max_ps(_mm256_mul_ps(a[p], minX), _mm256_mul_ps(a[p], maxX)),
+              _mm256_max_ps(_mm256_mul_ps(b[p], minY), _mm256_mul_ps(b[p], maxY))),
+          _mm256_add_ps(_mm256_max_ps(_mm256_mul_ps(c[p], minZ), _mm256_mul_ps(c[p], maxZ)), d[p]));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+    }
+    masks[block] = static_cast<uint8_t>(_mm256_movemask_ps(inside));
+  }
+}
+#endif
+
+using TestBlocksFn = void (*)(const Frustum &, const BoundsSoA &, const uint32_t *, size_t, uint8_t *);
+
+bool hasAvx2() {
+#if defined(FRUSTUM_AVX2_DISPATCH)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+TestBlocksFn selectKernel() {
+#if defined(FRUSTUM_AVX2_DISPATCH)
+  if (hasAvx2()) {
+    return testBlocksAvx2;
+  }
+#endif
+  return testBlocksPortable;
+}
+
+const TestBlocksFn testBlocks = selectKernel();
+
+}  // namespace
+
+Frustum Frustum::fromViewProjection(const glm::mat4 &m) {
+  // rows of the (column-major) matrix
+  glm::vec4 row0{m[0][0], m[1][0], m[2][0], m[3][0]};
+  glm::vec4 row1{m[0][1], m[1][1], m[2][1], m[3][1]};
+  glm::vec4 row2{m[0][2], m[1][2], m[2][2], m[3][2]};
+  glm::vec4 row3{m[0][3], m[1][3], m[2][3], m[3][3]};
+
+  Frustum frustum;
+  frustum.planes[0] = row3 + row0;  // left
+  frustum.planes[1] = row3 - row0;  // right
+  frustum.planes[2] = row3 + row1;  // top (Vulkan's y points down)
+  frustum.planes[3] = row3 - row1;  // bottom
+  frustum.planes[4] = row2;         // near
+  frustum.planes[5] = row3 - row2;  // far
+  return frustum;
+}
+
+Containment Frustum::classify(const Aabb &box) const {
+  bool intersecting = false;
+  for (const glm::vec4 &plane : planes) {
+    // corners furthest along and against the normal
+    glm::vec3 positive{
+        plane.x >= 0.0f ? box.max.x : box.min.x,
+        plane.y >= 0.0f ? box.max.y : box.min.y,
+        plane.z >= 0.0f ? box.max.z : box.min.z};
+    glm::vec3 negative{
+        plane.x >= 0.0f ? box.min.x : box.max.x,
+        plane.y >= 0.0f ? box.min.y : box.max.y,
+        plane.z >= 0.0f ? box.min.z : box.max.z};
+    if (plane.x * positive.x + plane.y * positive.y + plane.z * positive.z + plane.w < 0.0f) {
+      return Containment::Outside;
+    }
+    if (plane.x * negative.x + plane.y * negative.y + plane.z * negative.z + plane.w < 0.0f) {
+      intersecting = true;
+    }
+  }
+  return intersecting ? Containment::Intersecting : Containment::Inside;
+}
+
+void frustumTestBlocks(
+    const Frustum &frustum,
+    const BoundsSoA &bounds,
+    const uint32_t *blocks,
+    size_t blockCount,
+    uint8_t *masks) {
+  testBlocks(frustum, bounds, blocks, blockCount, masks);
+}
+
+const char *frustumKernelName() {
+  if (testBlocks != testBlocksPortable) {
+    return "AVX2";
+  }
+#if defined(SCENE_SIMD_SSE)
+  return "SSE";
+#elif defined(SCENE_SIMD_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
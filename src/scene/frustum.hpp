@@ -0,0 +1,34 @@
+#pragma once
+
+#include "scene.hpp"
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum class Containment { Outside, Intersecting, Inside };
+
+// Six planes (a, b, c, d) with ax + by + cz + d >= 0 on the inside. The planes
+// aren't normalized; only the sign of the distance is ever used.
+struct Frustum {
+  std::array<glm::vec4, 6> planes;
+
+  // Gribb/Hartmann extraction for a zero-to-one depth range.
+  static Frustum fromViewProjection(const glm::mat4 &viewProjection);
+
+  Containment classify(const Aabb &box) const;
+};
+
+// Tests blocks of 8 consecutive boxes of bounds; block b covers boxes
+// [8 * blocks[b], 8 * blocks[b] + 8). Writes one mask per block with bit i set
+// when box i is at least partly inside. Boxes with NaN bounds (padding) are
+// never inside. Runs on AVX2 where the CPU has it, otherwise SSE or NEON, with
+// a scalar fallback; the variant in use is named by frustumKernelName().
+void frustumTestBlocks(
+    const Frustum &frustum,
+    const BoundsSoA &bounds,
+    const uint32_t *blocks,
+    size_t blockCount,
+    uint8_t *masks);
+const char *frustumKernelName();
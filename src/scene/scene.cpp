@@ -0,0 +1,312 @@
+#include "scene.hpp"
+
+#include "simd.hpp"
+#include "../core/job_system.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace {
+
+// Column-major TRS matrix written straight into out[16].
+void composeLocal(const glm::vec3 &t, const glm::quat &q, const glm::vec3 &s, float *out) {
+  float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+  float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+  float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+  out[0] = (1.0f - 2.0f * (yy + zz)) * s.x;
+  out[1] = 2.0f * (xy + wz) * s.x;
+  out[2] = 2.0f * (xz - wy) * s.x;
+  out[3] = 0.0f;
+  out[4] = 2.0f * (xy - wz) * s.y;
+  out[5] = (1.0f - 2.0f * (xx + zz)) * s.y;
+  out[6] = 2.0f * (yz + wx) * s.y;
+  out[7] = 0.0f;
+  out[8] = 2.0f * (xz + wy) * s.z;
+  out[9] = 2.0f * (yz - wx) * s.z;
+  out[10] = (1.0f - 2.0f * (xx + yy)) * s.z;
+  out[11] = 0.0f;
+  out[12] = t.x;
+  out[13] = t.y;
+  out[14] = t.z;
+  out[15] = 1.0f;
+}
+
+uint32_t bitsFor(uint32_t value) {
+  uint32_t bits = 0;
+  while (bits < 32 && (value >> bits) != 0) {
+    bits++;
+  }
+  return bits;
+}
+
+}  // namespace
+
+void Scene::reserve(size_t count) {
+  parents.reserve(count);
+  depths.reserve(count);
+  positions.reserve(count);
+  rotations.reserve(count);
+  scales.reserve(count);
+  dirty.reserve(count);
+  worldMatrices.reserve(count);
+  localBounds.reserve(count);
+  pipelineIds.reserve(count);
+  materialIds.reserve(count);
+  meshIds.reserve(count);
+  for (auto *component : {&worldBounds.minX, &worldBounds.minY, &worldBounds.minZ,
+                          &worldBounds.maxX, &worldBounds.maxY, &worldBounds.maxZ}) {
+    component->reserve(count);
+  }
+}
+
+EntityId Scene::createEntity(const Transform &local, EntityId parent) {
+  EntityId entity = static_cast<EntityId>(parents.size());
+  if (parent != NO_ENTITY && parent >= entity) {
+    throw std::invalid_argument("parent entity has to be created before its children");
+  }
+
+  parents.push_back(parent);
+  const uint32_t depth = parent == NO_ENTITY ? 0 : depths[parent] + 1;
+  depths.push_back(depth);
+  if (levels.size() <= depth) {
+    levels.resize(depth + 1);
+  }
+  levels[depth].push_back(entity);
+  positions.push_back(local.position);
+  rotations.push_back(local.rotation);
+  scales.push_back(local.scale);
+  dirty.push_back(1);
+  worldMatrices.emplace_back(1.0f);
+  // inverted box: never visible until the entity gets bounds
+  localBounds.push_back({glm::vec3{1.0f}, glm::vec3{-1.0f}});
+  pipelineIds.push_back(0);
+  materialIds.push_back(0);
+  meshIds.push_back(NO_MESH);
+  for (auto *component : {&worldBounds.minX, &worldBounds.minY, &worldBounds.minZ}) {
+    component->push_back(1.0f);
+  }
+  for (auto *component : {&worldBounds.maxX, &worldBounds.maxY, &worldBounds.maxZ}) {
+    component->push_back(-1.0f);
+  }
+  return entity;
+}
+
+void Scene::setLocalTransform(EntityId entity, const Transform &local) {
+  positions[entity] = local.position;
+  rotations[entity] = local.rotation;
+  scales[entity] = local.scale;
+  dirty[entity] = 1;
+}
+
+Transform Scene::getLocalTransform(EntityId entity) const {
+  return {positions[entity], rotations[entity], scales[entity]};
+}
+
+void Scene::setRenderable(EntityId entity, const Renderable &renderable, const Aabb &bounds) {
+  if (renderable.mesh == NO_MESH) {
+    throw std::invalid_argument("NO_MESH is reserved for entities without a renderable");
+  }
+  uint32_t newPipelineBits = std::max(pipelineBits, bitsFor(renderable.pipeline));
+  uint32_t newMaterialBits = std::max(materialBits, bitsFor(renderable.material));
+  uint32_t newMeshBits = std::max(meshBits, bitsFor(renderable.mesh));
+  if (newPipelineBits + newMaterialBits + newMeshBits > 32) {
+    throw std::out_of_range("pipeline, material and mesh ids don't fit in a 32-bit draw key");
+  }
+  pipelineBits = newPipelineBits;
+  materialBits = newMaterialBits;
+  meshBits = newMeshBits;
+
+  pipelineIds[entity] = renderable.pipeline;
+  materialIds[entity] = renderable.material;
+  meshIds[entity] = renderable.mesh;
+  localBounds[entity] = bounds;
+  dirty[entity] = 1;
+}
+
+void Scene::updateTransforms(JobSystem *jobSystem) {
+  movedEntities.clear();
+
+  // Walking levels scatters the reads and waits once per level, so it only
+  // pays off across threads and when most entities sit in levels wide enough
+  // to be split; a narrow, deep hierarchy is faster in index order
+  size_t splitEntities = 0;
+  for (const auto &level : levels) {
+    splitEntities += level.size() > TRANSFORM_CHUNK_SIZE ? level.size() : 0;
+  }
+  if (!jobSystem || jobSystem->getThreadCount() == 1 || splitEntities * 2 < parents.size()) {
+    alignas(16) float local[16];
+    // Parents come first in index order, so their flag and matrix are final
+    // by the time a child reads them
+    for (EntityId entity = 0; entity < parents.size(); entity++) {
+      if (updateEntity(entity, local)) {
+        movedEntities.push_back(entity);
+      }
+    }
+    std::fill(dirty.begin(), dirty.end(), 0);
+    return;
+  }
+
+  // A level only reads the one before it, which is complete by then. Each
+  // chunk collects its moved entities on its own, so no two jobs share a vector.
+  size_t chunkCount = 0;
+  for (const auto &level : levels) {
+    chunkCount += (level.size() + TRANSFORM_CHUNK_SIZE - 1) / TRANSFORM_CHUNK_SIZE;
+  }
+  chunkMovedEntities.resize(std::max(chunkMovedEntities.size(), chunkCount));
+  size_t firstChunk = 0;
+  for (const auto &level : levels) {
+    const uint32_t chunks = static_cast<uint32_t>((level.size() + TRANSFORM_CHUNK_SIZE - 1) / TRANSFORM_CHUNK_SIZE);
+    auto updateChunk = [this, &level, firstChunk](uint32_t chunk) {
+      alignas(16) float scratch[16];
+      std::vector<EntityId> &moved = chunkMovedEntities[firstChunk + chunk];
+      moved.clear();
+      const size_t end = std::min(level.size(), size_t{chunk + 1} * TRANSFORM_CHUNK_SIZE);
+      for (size_t i = size_t{chunk} * TRANSFORM_CHUNK_SIZE; i < end; i++) {
+        if (updateEntity(level[i], scratch)) {
+          moved.push_back(level[i]);
+        }
+      }
+    };
+    if (chunks == 1) {
+      updateChunk(0);
+    } else {
+      JobSystem::Counter counter;
+      jobSystem->parallelFor(chunks, 1, updateChunk, counter);
+      jobSystem->wait(counter);
+    }
+    firstChunk += chunks;
+  }
+  for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+    movedEntities.insert(
+        movedEntities.end(), chunkMovedEntities[chunk].begin(), chunkMovedEntities[chunk].end());
+  }
+  std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+bool Scene::updateEntity(EntityId entity, float *scratch) {
+  EntityId parent = parents[entity];
+  if (parent != NO_ENTITY) {
+    dirty[entity] |= dirty[parent];
+  }
+  if (!dirty[entity]) {
+    return false;
+  }
+
+  float *world = &worldMatrices[entity][0][0];
+  if (parent == NO_ENTITY) {
+    composeLocal(positions[entity], rotations[entity], scales[entity], world);
+  } else {
+    composeLocal(positions[entity], rotations[entity], scales[entity], scratch);
+    simd::mat4Mul(&worldMatrices[parent][0][0], scratch, world);
+  }
+  const Aabb &bounds = localBounds[entity];
+  if (bounds.min.x > bounds.max.x) {
+    return false;
+  }
+  updateWorldBounds(entity);
+  return meshIds[entity] != NO_MESH;
+}
+
+void Scene::updateWorldBounds(EntityId entity) {
+  const Aabb &bounds = localBounds[entity];
+
+  // Transformed center plus extents projected onto the world axes (Arvo)
+  const float *m = &worldMatrices[entity][0][0];
+  simd::F4 c0 = simd::load(m), c1 = simd::load(m + 4), c2 = simd::load(m + 8);
+  simd::F4 c3 = simd::load(m + 12);
+  glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+  glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+  simd::F4 worldCenter = c0 * simd::splat(center.x) + c1 * simd::splat(center.y) +
+                         c2 * simd::splat(center.z) + c3;
+  simd::F4 worldExtent = simd::abs(c0) * simd::splat(extent.x) +
+                         simd::abs(c1) * simd::splat(extent.y) +
+                         simd::abs(c2) * simd::splat(extent.z);
+
+  alignas(16) float minimum[4], maximum[4];
+  simd::store(minimum, worldCenter - worldExtent);
+  simd::store(maximum, worldCenter + worldExtent);
+  worldBounds.minX[entity] = minimum[0];
+  worldBounds.minY[entity] = minimum[1];
+  worldBounds.minZ[entity] = minimum[2];
+  worldBounds.maxX[entity] = maximum[0];
+  worldBounds.maxY[entity] = maximum[1];
+  worldBounds.maxZ[entity] = maximum[2];
+}
+
+void Scene::buildDrawList(std::vector<DrawItem> &drawList) const {
+  drawList.resize(meshIds.size());
+  size_t count = 0;
+  for (EntityId entity = 0; entity < meshIds.size(); entity++) {
+    drawList[count] = {drawKey(entity), entity};
+    count += meshIds[entity] != NO_MESH;
+  }
+  drawList.resize(count);
+  sortDrawItems(drawList, sortScratch);
+}
+
+void Scene::buildDrawList(
+    const std::vector<EntityId> &entities, std::vector<DrawItem> &drawList) const {
+  drawList.resize(entities.size());
+  for (size_t i = 0; i < entities.size(); i++) {
+    drawList[i] = {drawKey(entities[i]), entities[i]};
+  }
+  sortDrawItems(drawList, sortScratch);
+}
+
+Renderable Scene::decodeDrawKey(uint32_t key) const {
+  // widths can be 0 (all ids are 0), so build masks without shifting by 32
+  auto mask = [](uint32_t bits) { return bits == 0 ? 0u : UINT32_MAX >> (32 - bits); };
+  Renderable renderable;
+  renderable.mesh = key & mask(meshBits);
+  renderable.material = static_cast<uint32_t>(
+      (static_cast<uint64_t>(key) >> meshBits) & mask(materialBits));
+  renderable.pipeline = static_cast<uint32_t>(
+      (static_cast<uint64_t>(key) >> (meshBits + materialBits)) & mask(pipelineBits));
+  return renderable;
+}
+
+void sortDrawItems(std::vector<DrawItem> &items, std::vector<DrawItem> &scratch) {
+  constexpr uint32_t DIGIT_BITS = 11;
+  constexpr uint32_t BUCKETS = 1u << DIGIT_BITS;
+  constexpr int DIGITS = (32 + DIGIT_BITS - 1) / DIGIT_BITS;
+  scratch.resize(items.size());
+
+  // All histograms in one read of the keys
+  std::vector<std::array<uint32_t, BUCKETS>> histograms(DIGITS);
+  for (const auto &item : items) {
+    for (int digit = 0; digit < DIGITS; digit++) {
+      histograms[digit][(item.key >> (DIGIT_BITS * digit)) & (BUCKETS - 1)]++;
+    }
+  }
+
+  DrawItem *source = items.data();
+  DrawItem *destination = scratch.data();
+  for (int digit = 0; digit < DIGITS; digit++) {
+    auto &histogram = histograms[digit];
+    uint32_t shift = DIGIT_BITS * digit;
+    uint32_t firstDigit = items.empty() ? 0 : (items[0].key >> shift) & (BUCKETS - 1);
+    if (histogram[firstDigit] == items.size()) {
+      continue;  // every key has the same digit here, the order is unchanged
+    }
+
+    uint32_t offset = 0;
+    for (auto &bucket : histogram) {
+      uint32_t bucketSize = bucket;
+      bucket = offset;
+      offset += bucketSize;
+    }
+    for (size_t i = 0; i < items.size(); i++) {
+      const DrawItem &item = source[i];
+      destination[histogram[(item.key >> shift) & (BUCKETS - 1)]++] = item;
+    }
+    std::swap(source, destination);
+  }
+
+  if (source != items.data()) {
+    items.swap(scratch);
+  }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+using EntityId = uint32_t;
+constexpr EntityId NO_ENTITY = UINT32_MAX;
+
+struct Transform {
+  glm::vec3 position{0.0f};
+  glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+  glm::vec3 scale{1.0f};
+};
+
+struct Aabb {
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+// What to draw an entity with. Ids index the renderer's own tables.
+struct Renderable {
+  uint32_t pipeline;
+  uint32_t material;
+  uint32_t mesh;
+};
+
+// key packs pipeline, material and mesh ids (most significant first) so that
+// sorting by key groups draws by the most expensive state change first. The
+// field widths depend on the largest ids in the scene; Scene::decodeDrawKey
+// unpacks them.
+struct DrawItem {
+  uint32_t key;
+  EntityId entity;
+};
+
+// World-space bounds, one array per component so culling can test several
+// boxes per instruction.
+struct BoundsSoA {
+  std::vector<float> minX, minY, minZ;
+  std::vector<float> maxX, maxY, maxZ;
+};
+
+// Entities stored as structure-of-arrays. A parent has to exist before its
+// children, so index order is always a topological order of the hierarchy
+// and world matrices are updated in one linear pass with no recursion.
+// Entities are also listed per hierarchy level, so that the update can run a
+// level at a time across threads.
+class Scene {
+ public:
+  static constexpr uint32_t NO_MESH = UINT32_MAX;
+  // Entities per job of a parallel transform update; smaller levels run inline
+  static constexpr uint32_t TRANSFORM_CHUNK_SIZE = 2048;
+
+  void reserve(size_t count);
+  size_t size() const { return parents.size(); }
+
+  EntityId createEntity(const Transform &local, EntityId parent = NO_ENTITY);
+  void setLocalTransform(EntityId entity, const Transform &local);
+  Transform getLocalTransform(EntityId entity) const;
+  EntityId getParent(EntityId entity) const { return parents[entity]; }
+
+  // localBounds are in the entity's own space. Throws if the ids in use would
+  // need more than 32 bits of draw key together.
+  void setRenderable(EntityId entity, const Renderable &renderable, const Aabb &localBounds);
+  bool hasRenderable(EntityId entity) const { return meshIds[entity] != NO_MESH; }
+
+  // Recomputes world matrices and bounds of entities whose transform, or an
+  // ancestor's, changed since the last call. With a job system that has
+  // workers, and when most entities are in levels of the hierarchy wider than
+  // a chunk, each level is split into chunks run as jobs, one level after the
+  // other; the calling thread runs jobs too while it waits, so it may be a job
+  // itself.
+  void updateTransforms(JobSystem *jobSystem = nullptr);
+  // Renderable entities whose world bounds changed in the last updateTransforms()
+  const std::vector<EntityId> &getMovedEntities() const { return movedEntities; }
+
+  const glm::mat4 &getWorldMatrix(EntityId entity) const { return worldMatrices[entity]; }
+  const BoundsSoA &getWorldBounds() const { return worldBounds; }
+
+  // Every renderable entity, sorted by key.
+  void buildDrawList(std::vector<DrawItem> &drawList) const;
+  // Only the given entities (e.g. the visible ones), sorted by key.
+  void buildDrawList(const std::vector<EntityId> &entities, std::vector<DrawItem> &drawList) const;
+  Renderable decodeDrawKey(uint32_t key) const;
+
+ private:
+  // Parents must be up to date. True if it's renderable and its bounds moved.
+  bool updateEntity(EntityId entity, float *scratch);
+  void updateWorldBounds(EntityId entity);
+  uint32_t drawKey(EntityId entity) const {
+    // 64-bit shifts: a field may start at bit 32 when the pipeline id is always 0
+    return static_cast<uint32_t>(
+        static_cast<uint64_t>(pipelineIds[entity]) << (materialBits + meshBits) |
+        static_cast<uint64_t>(materialIds[entity]) << meshBits | meshIds[entity]);
+  }
+
+  std::vector<EntityId> parents;
+  // Entities by depth in the hierarchy, each level in index order
+  std::vector<std::vector<EntityId>> levels;
+  std::vector<uint32_t> depths;
+
+  // local transform
+  std::vector<glm::vec3> positions;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+  std::vector<uint8_t> dirty;
+
+  std::vector<glm::mat4> worldMatrices;
+
+  std::vector<Aabb> localBounds;
+  BoundsSoA worldBounds;
+  std::vector<EntityId> movedEntities;
+  // Per chunk of a parallel update, appended to movedEntities afterwards
+  std::vector<std::vector<EntityId>> chunkMovedEntities;
+
+  // NO_MESH if the entity has nothing to draw
+  std::vector<uint32_t> pipelineIds;
+  std::vector<uint32_t> materialIds;
+  std::vector<uint32_t> meshIds;
+  uint32_t pipelineBits = 0;
+  uint32_t materialBits = 0;
+  uint32_t meshBits = 0;
+
+  mutable std::vector<DrawItem> sortScratch;
+};
+
+// LSD radix sort by key, 11 bits per pass. Passes where every key has the same
+// digit are skipped, so keys up to 22 bits wide take at most two passes.
+void sortDrawItems(std::vector<DrawItem> &items, std::vector<DrawItem> &scratch);
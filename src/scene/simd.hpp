@@ -0,0 +1,143 @@
+#pragma once
+
+// Minimal 4-wide float vector over SSE, NEON or plain scalars, so the scene's
+// hot loops are written once and compile everywhere we build (x86-64 Linux,
+// Apple Silicon, Intel Macs). The NEON path uses AArch64-only intrinsics
+// (vector divide, square root, across-lane add), so 32-bit ARM takes the
+// scalar one.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define SCENE_SIMD_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SCENE_SIMD_NEON 1
+#else
+#include <cmath>
+#endif
+
+namespace simd {
+
+#if defined(SCENE_SIMD_SSE)
+
+struct F4 {
+  __m128 v;
+};
+inline F4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+inline void store(float *p, F4 a) { _mm_storeu_ps(p, a.v); }
+inline F4 splat(float s) { return {_mm_set1_ps(s)}; }
+inline F4 operator+(F4 a, F4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline F4 operator-(F4 a, F4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline F4 operator*(F4 a, F4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline F4 operator/(F4 a, F4 b) { return {_mm_div_ps(a.v, b.v)}; }
+inline F4 sqrt(F4 a) { return {_mm_sqrt_ps(a.v)}; }
+inline F4 abs(F4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+// 1 or -1 with the sign bit of a, so -0 gives -1
+inline F4 sign(F4 a) { return {_mm_or_ps(_mm_and_ps(a.v, _mm_set1_ps(-0.0f)), _mm_set1_ps(1.0f))}; }
+inline F4 max(F4 a, F4 b) { return {_mm_max_ps(a.v, b.v)}; }
+inline F4 min(F4 a, F4 b) { return {_mm_min_ps(a.v, b.v)}; }
+// Bit i set if lane i is >= 0; false for NaN
+inline int nonNegativeMask(F4 a) { return _mm_movemask_ps(_mm_cmpge_ps(a.v, _mm_setzero_ps())); }
+template <int I>
+inline F4 broadcast(F4 a) {
+  return {_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(I, I, I, I))};
+}
+
+#elif defined(SCENE_SIMD_NEON)
+
+struct F4 {
+  float32x4_t v;
+};
+inline F4 load(const float *p) { return {vld1q_f32(p)}; }
+inline void store(float *p, F4 a) { vst1q_f32(p, a.v); }
+inline F4 splat(float s) { return {vdupq_n_f32(s)}; }
+inline F4 operator+(F4 a, F4 b) { return {vaddq_f32(a.v, b.v)}; }
+inline F4 operator-(F4 a, F4 b) { return {vsubq_f32(a.v, b.v)}; }
+inline F4 operator*(F4 a, F4 b) { return {vmulq_f32(a.v, b.v)}; }
+inline F4 operator/(F4 a, F4 b) { return {vdivq_f32(a.v, b.v)}; }
+inline F4 sqrt(F4 a) { return {vsqrtq_f32(a.v)}; }
+inline F4 abs(F4 a) { return {vabsq_f32(a.v)}; }
+inline F4 sign(F4 a) {
+  const uint32x4_t signBit = vdupq_n_u32(0x80000000u);
+  return {vreinterpretq_f32_u32(
+      vorrq_u32(vandq_u32(vreinterpretq_u32_f32(a.v), signBit), vreinterpretq_u32_f32(vdupq_n_f32(1.0f))))};
+}
+inline F4 max(F4 a, F4 b) { return {vmaxq_f32(a.v, b.v)}; }
+inline F4 min(F4 a, F4 b) { return {vminq_f32(a.v, b.v)}; }
+inline int nonNegativeMask(F4 a) {
+  const uint32x4_t bits = {1, 2, 4, 8};
+  return static_cast<int>(vaddvq_u32(vandq_u32(vcgeq_f32(a.v, vdupq_n_f32(0.0f)), bits)));
+}
+template <int I>
+inline F4 broadcast(F4 a) {
+  return {vdupq_laneq_f32(a.v, I)};
+}
+
+#else
+
+struct F4 {
+  float v[4];
+};
+inline F4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void store(float *p, F4 a) {
+  for (int i = 0; i < 4; i++) p[i] = a.v[i];
+}
+inline F4 splat(float s) { return {{s, s, s, s}}; }
+inline F4 operator+(F4 a, F4 b) {
+  return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}};
+}
+inline F4 operator-(F4 a, F4 b) {
+  return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}};
+}
+inline F4 operator*(F4 a, F4 b) {
+  return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}};
+}
+inline F4 operator/(F4 a, F4 b) {
+  return {{a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]}};
+}
+inline F4 sqrt(F4 a) {
+  return {{std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3])}};
+}
+inline F4 sign(F4 a) {
+  return {{std::copysign(1.0f, a.v[0]), std::copysign(1.0f, a.v[1]), std::copysign(1.0f, a.v[2]),
+           std::copysign(1.0f, a.v[3])}};
+}
+inline F4 abs(F4 a) {
+  return {{a.v[0] < 0 ? -a.v[0] : a.v[0], a.v[1] < 0 ? -a.v[1] : a.v[1],
+           a.v[2] < 0 ? -a.v[2] : a.v[2], a.v[3] < 0 ? -a.v[3] : a.v[3]}};
+}
+inline F4 max(F4 a, F4 b) {
+  F4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+  return r;
+}
+inline F4 min(F4 a, F4 b) {
+  F4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+  return r;
+}
+inline int nonNegativeMask(F4 a) {
+  int mask = 0;
+  for (int i = 0; i < 4; i++) mask |= (a.v[i] >= 0.0f) << i;
+  return mask;
+}
+template <int I>
+inline F4 broadcast(F4 a) {
+  return splat(a.v[I]);
+}
+
+#endif
+
+// Column-major 4x4 product, out = a * b; out may alias neither input.
+inline void mat4Mul(const float *a, const float *b, float *out) {
+  F4 a0 = load(a), a1 = load(a + 4), a2 = load(a + 8), a3 = load(a + 12);
+  for (int c = 0; c < 4; c++) {
+    F4 col = load(b + 4 * c);
+    store(
+        out + 4 * c,
+        a0 * broadcast<0>(col) + a1 * broadcast<1>(col) + a2 * broadcast<2>(col) +
+            a3 * broadcast<3>(col));
+  }
+}
+
+}  // namespace simd